@@ -0,0 +1,163 @@
+/**
+ * @file benchmark.hpp
+ *
+ * Minimal harness which measures time of an operation.
+ */
+#ifndef DICE_BENCHMARK_HPP_
+#define DICE_BENCHMARK_HPP_
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstddef>
+#include <ostream>
+#include <algorithm>
+#include <functional>
+
+namespace dice
+{
+    /** @brief Prevent the compiler from removing a computation.
+     *
+     * @param value result of the computation
+     */
+    template<typename T>
+    void do_not_optimize(const T& value)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        asm volatile("" : : "g"(&value) : "memory");
+#else
+        static volatile const void* sink;
+        sink = &value;
+#endif
+    }
+
+    /** @brief Measured time of a benchmark. */
+    struct benchmark_result
+    {
+        std::string name;
+        // number of operations in each sample
+        std::size_t iterations;
+        // time of 1 operation in nanoseconds
+        double min_ns;
+        double median_ns;
+        double mean_ns;
+    };
+
+    /** @brief Run benchmarks and collect their results.
+     *
+     * Each benchmark is a function which runs the measured operation once.
+     * The number of iterations is doubled until a sample takes at least
+     * min_time seconds. Then, the time of samples runs of that many
+     * iterations is measured.
+     */
+    class benchmark_runner
+    {
+    public:
+        /** Minimal time of a sample in seconds. */
+        double min_time = 0.1;
+
+        /** Number of measured samples of each benchmark. */
+        std::size_t samples = 5;
+
+        /** Only benchmarks whose name contains this string are run. */
+        std::string filter;
+
+        /** @brief Measure an operation.
+         *
+         * @param name of the benchmark
+         * @param operation function which runs the operation once
+         */
+        void run(
+            const std::string& name, 
+            const std::function<void()>& operation)
+        {
+            if (name.find(filter) == std::string::npos)
+                return;
+
+            // find the number of iterations (the first call warms up caches)
+            std::size_t iterations = 1;
+            while (measure(operation, iterations) < min_time &&
+                iterations < (std::size_t{ 1 } << 30))
+            {
+                iterations *= 2;
+            }
+
+            std::vector<double> times;
+            for (std::size_t i = 0; i < samples; ++i)
+            {
+                times.push_back(measure(operation, iterations) * 1e9 /
+                    static_cast<double>(iterations));
+            }
+            std::sort(times.begin(), times.end());
+
+            double sum = 0;
+            for (auto&& time : times)
+            {
+                sum += time;
+            }
+            results_.push_back(benchmark_result{
+                name,
+                iterations,
+                times.front(),
+                times[times.size() / 2],
+                sum / static_cast<double>(times.size())
+            });
+        }
+
+        /** @brief Print all results as a JSON object.
+         *
+         * @param output stream
+         */
+        void print_json(std::ostream& output) const
+        {
+            output << "{\n  \"benchmarks\": [";
+            for (std::size_t i = 0; i < results_.size(); ++i)
+            {
+                auto&& result = results_[i];
+                output << (i == 0 ? "\n" : ",\n")
+                    << "    {\"name\": \"" << result.name << "\", "
+                    << "\"iterations\": " << result.iterations << ", "
+                    << "\"min_ns\": " << format(result.min_ns) << ", "
+                    << "\"median_ns\": " << format(result.median_ns) << ", "
+                    << "\"mean_ns\": " << format(result.mean_ns) << "}";
+            }
+            output << "\n  ]\n}\n";
+        }
+
+        /** @brief Get results of all benchmarks which have been run.
+         *
+         * @return list of results in the order in which they were run
+         */
+        const std::vector<benchmark_result>& results() const
+        {
+            return results_;
+        }
+    private:
+        std::vector<benchmark_result> results_;
+
+        // compute time of given number of iterations in seconds
+        static double measure(
+            const std::function<void()>& operation,
+            std::size_t iterations)
+        {
+            auto start = std::chrono::steady_clock::now();
+            for (std::size_t i = 0; i < iterations; ++i)
+            {
+                operation();
+            }
+            std::chrono::duration<double> time =
+                std::chrono::steady_clock::now() - start;
+            return time.count();
+        }
+
+        static std::string format(double value)
+        {
+            char buffer[32];
+            std::snprintf(buffer, sizeof(buffer), "%.1f", value);
+            return buffer;
+        }
+    };
+}
+
+#endif // DICE_BENCHMARK_HPP_
@@ -0,0 +1,230 @@
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include "benchmark.hpp"
+#include "logger.hpp"
+#include "lexer.hpp"
+#include "value.hpp"
+#include "environment.hpp"
+#include "calculator.hpp"
+#include "decomposition.hpp"
+#include "random_variable.hpp"
+
+using var_type = dice::random_variable<int, double>;
+using decomposition_type = dice::decomposition<int, double>;
+
+namespace
+{
+    // scripts which are evaluated end to end
+    const std::pair<const char*, const char*> corpus[] = {
+        { "attack",
+            "var roll = max(1d20, 1d20);"
+            "var isCrit = roll == 20;"
+            "var isHitButNotCrit = roll in [10, 19];"
+            "var value = isCrit * 4d8 + isHitButNotCrit * 2d8;"
+            "value >= 10; value" },
+        { "statistics",
+            "expectation(1d6); variance(1d6); deviation(1d6);"
+            "quantile(1d6, 0.3); max(1d6, 1d6); min(1d6, 1d6)" },
+        { "nested", "(1d4)d6 + (2d4)d8" },
+        { "ability_scores", "keep_highest(4, 6, 3) + keep_lowest(2, 20, 1)" },
+        { "large_sum", "100d100 + 50d20 * 3" },
+    };
+
+    // uniform distribution on 1 to size
+    var_type uniform(int size)
+    {
+        var_type::frequency_list list;
+        for (int i = 1; i <= size; ++i)
+        {
+            list.push_back(std::make_pair(i, 1));
+        }
+        return var_type{ list };
+    }
+
+    void random_variable_benchmarks(dice::benchmark_runner& runner)
+    {
+        for (int size : { 10, 100, 1000 })
+        {
+            auto a = uniform(size);
+            auto b = uniform(size);
+            auto suffix = "/" + std::to_string(size);
+            runner.run("random_variable/add" + suffix, [&]()
+            {
+                dice::do_not_optimize(a + b);
+            });
+            runner.run("random_variable/mult" + suffix, [&]()
+            {
+                dice::do_not_optimize(a * b);
+            });
+            runner.run("random_variable/max" + suffix, [&]()
+            {
+                dice::do_not_optimize(max(a, b));
+            });
+            runner.run("random_variable/less_than" + suffix, [&]()
+            {
+                dice::do_not_optimize(a.less_than(b));
+            });
+        }
+
+        var_type faces{ dice::constant_tag{}, 6 };
+        for (int count : { 1, 10, 100, 1000 })
+        {
+            var_type dice_count{ dice::constant_tag{}, count };
+            runner.run("random_variable/roll/" + std::to_string(count) + "d6",
+                [&]()
+            {
+                dice::do_not_optimize(roll(dice_count, faces));
+            });
+        }
+    }
+
+    void decomposition_benchmarks(dice::benchmark_runner& runner)
+    {
+        for (std::size_t count : { 1, 2, 4, 6 })
+        {
+            // sum of count variables which are used twice
+            std::vector<decomposition_type> inputs;
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                inputs.push_back(
+                    decomposition_type{ uniform(4) }.compute_decomposition());
+            }
+            auto sum = inputs[0];
+            for (std::size_t i = 1; i < count; ++i)
+            {
+                sum = sum + inputs[i];
+            }
+
+            auto suffix = "/" + std::to_string(count);
+            runner.run("decomposition/combine" + suffix, [&]()
+            {
+                dice::do_not_optimize(sum + inputs[0]);
+            });
+            runner.run("decomposition/compute_decomposition" + suffix, [&]()
+            {
+                dice::do_not_optimize(sum.compute_decomposition());
+            });
+            runner.run("decomposition/to_random_variable" + suffix, [&]()
+            {
+                dice::do_not_optimize(sum.to_random_variable());
+            });
+        }
+    }
+
+    void parser_benchmarks(dice::benchmark_runner& runner)
+    {
+        std::string script;
+        for (auto&& item : corpus)
+        {
+            script += item.second;
+            script += ";";
+        }
+
+        std::stringstream errors;
+        dice::logger log{ &errors };
+        runner.run("lexer/corpus", [&]()
+        {
+            dice::buffer_lexer<dice::logger> lexer{ script, &log };
+            while (lexer.read_token().type != dice::symbol_type::end) {}
+        });
+
+        dice::calculator calc{ 1 };
+        calc.log = log;
+        runner.run("parser/corpus", [&]()
+        {
+            dice::do_not_optimize(calc.prepare(script));
+        });
+    }
+
+    void environment_benchmarks(dice::benchmark_runner& runner)
+    {
+        dice::environment env;
+        auto add = env.find_function("+");
+        runner.run("environment/call/name", [&]()
+        {
+            dice::do_not_optimize(env.call("+",
+                dice::make<dice::type_int>(1),
+                dice::make<dice::type_int>(2)));
+        });
+        runner.run("environment/call/id", [&]()
+        {
+            dice::do_not_optimize(env.call(add,
+                dice::make<dice::type_int>(1),
+                dice::make<dice::type_int>(2)));
+        });
+        runner.run("environment/call/conversion", [&]()
+        {
+            dice::do_not_optimize(env.call(add,
+                dice::make<dice::type_int>(1),
+                dice::make<dice::type_real>(2.0)));
+        });
+    }
+
+    void calculator_benchmarks(dice::benchmark_runner& runner)
+    {
+        std::stringstream errors;
+        for (auto&& item : corpus)
+        {
+            // a new calculator does not reuse values of the previous run
+            // (only the process-wide roll_cache is warm)
+            std::string script = item.second;
+            runner.run(std::string{ "calculator/evaluate/" } + item.first,
+                [&]()
+            {
+                dice::calculator calc{ 1 };
+                calc.log = dice::logger{ &errors };
+                dice::do_not_optimize(calc.evaluate(script));
+            });
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    dice::benchmark_runner runner;
+    try
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            if (arg == "--filter" && i + 1 < argc)
+            {
+                runner.filter = argv[++i];
+            }
+            else if (arg == "--min-time" && i + 1 < argc)
+            {
+                runner.min_time = std::stod(argv[++i]);
+            }
+            else if (arg == "--samples" && i + 1 < argc)
+            {
+                runner.samples = std::max<std::size_t>(
+                    std::stoul(argv[++i]), 1);
+            }
+            else
+            {
+                std::cerr << "Usage: " << argv[0]
+                    << " [--filter <name>] [--min-time <seconds>]"
+                    << " [--samples <count>]" << std::endl;
+                return 1;
+            }
+        }
+    }
+    catch (std::logic_error&)
+    {
+        std::cerr << "Invalid option value." << std::endl;
+        return 1;
+    }
+
+    random_variable_benchmarks(runner);
+    decomposition_benchmarks(runner);
+    parser_benchmarks(runner);
+    environment_benchmarks(runner);
+    calculator_benchmarks(runner);
+    runner.print_json(std::cout);
+    return 0;
+}
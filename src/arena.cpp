@@ -0,0 +1,43 @@
+#include "arena.hpp"
+
+const std::size_t dice::arena::default_capacity;
+
+thread_local dice::arena* dice::arena::current_ = nullptr;
+
+void* dice::arena::allocate(std::size_t size, std::size_t alignment)
+{
+    auto start = (used_ + alignment - 1) & ~(alignment - 1);
+    if (start < used_ || start > capacity_ || size > capacity_ - start)
+        return nullptr;
+
+    if (buffer_ == nullptr)
+    {
+        buffer_.reset(new unsigned char[capacity_]);
+    }
+    used_ = start + size;
+    return buffer_.get() + start;
+}
+
+void dice::arena::deallocate(void* ptr, std::size_t size)
+{
+    auto value = static_cast<unsigned char*>(ptr);
+    if (value + size == buffer_.get() + used_)
+    {
+        used_ = value - buffer_.get();
+    }
+}
+
+dice::arena* dice::arena::current()
+{
+    return current_;
+}
+
+dice::arena::scope::scope(arena* value) : previous_(current_)
+{
+    current_ = value;
+}
+
+dice::arena::scope::~scope()
+{
+    current_ = previous_;
+}
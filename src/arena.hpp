@@ -0,0 +1,205 @@
+/**
+ * @file arena.hpp
+ *
+ * Memory for temporary buffers of one evaluation.
+ */
+#ifndef DICE_ARENA_HPP_
+#define DICE_ARENA_HPP_
+
+#include <new>
+#include <vector>
+#include <memory>
+#include <cstddef>
+
+namespace dice
+{
+    /** @brief Memory of temporary buffers used during an evaluation.
+     *
+     * It is a bump allocator over 1 buffer. The last allocated block can
+     * be released (so buffers which are freed in the reverse order of
+     * allocation reuse the memory). Other blocks are only released by
+     * reset at the end of the evaluation. If an allocation does not fit
+     * into the buffer, arena_allocator uses the global allocator instead.
+     *
+     * An arena is made current for a thread by creating a scope object
+     * (see calculator::execute). It is not thread safe. Only the thread
+     * which owns it allocates memory in it.
+     */
+    class arena
+    {
+    public:
+        /** Default size of the buffer in bytes. */
+        static const std::size_t default_capacity = 1 << 20;
+
+        /** @brief Create an arena.
+         *
+         * The buffer is allocated by the first allocation.
+         *
+         * @param capacity size of the buffer in bytes
+         */
+        explicit arena(std::size_t capacity = default_capacity) :
+            capacity_(capacity) {}
+
+        arena(const arena&) = delete;
+        arena& operator=(const arena&) = delete;
+
+        /** @brief Allocate a block of memory.
+         *
+         * @param size of the block in bytes
+         * @param alignment of the block (a power of 2)
+         *
+         * @return pointer to the block or nullptr if it does not fit
+         */
+        void* allocate(std::size_t size, std::size_t alignment);
+
+        /** @brief Release a block of memory.
+         *
+         * Only the last allocated block is actually made available.
+         *
+         * @param ptr pointer returned by allocate
+         * @param size of the block in bytes
+         */
+        void deallocate(void* ptr, std::size_t size);
+
+        /** @brief Check whether a pointer points into this arena.
+         *
+         * @param ptr pointer
+         *
+         * @return true iff ptr points to the buffer of this arena
+         */
+        bool contains(const void* ptr) const
+        {
+            auto value = static_cast<const unsigned char*>(ptr);
+            return buffer_ != nullptr &&
+                value >= buffer_.get() &&
+                value < buffer_.get() + capacity_;
+        }
+
+        /** @brief Release all blocks. */
+        void reset()
+        {
+            used_ = 0;
+        }
+
+        /** @brief Get number of used bytes.
+         *
+         * @return number of bytes from the start of the buffer to the end
+         *         of the last allocated block
+         */
+        std::size_t used() const
+        {
+            return used_;
+        }
+
+        /** @brief Get size of the buffer.
+         *
+         * @return capacity in bytes
+         */
+        std::size_t capacity() const
+        {
+            return capacity_;
+        }
+
+        /** @brief Get arena of the calling thread.
+         *
+         * @return arena or nullptr if there is none
+         */
+        static arena* current();
+
+        /** @brief Make an arena current for the calling thread.
+         *
+         * The previous arena is restored when this object is destroyed.
+         */
+        class scope
+        {
+        public:
+            explicit scope(arena* value);
+            ~scope();
+
+            scope(const scope&) = delete;
+            scope& operator=(const scope&) = delete;
+        private:
+            arena* previous_;
+        };
+    private:
+        std::unique_ptr<unsigned char[]> buffer_;
+        std::size_t capacity_;
+        std::size_t used_ = 0;
+
+        static thread_local arena* current_;
+    };
+
+    /** @brief Allocator of temporary buffers in the current arena.
+     *
+     * The arena is chosen when the allocator is created. Containers with
+     * this allocator must not outlive the scope of the arena, thus they
+     * are only used for local variables of computations (never for
+     * values which are returned to the caller).
+     *
+     * @tparam T type of allocated objects
+     */
+    template<typename T>
+    class arena_allocator
+    {
+    public:
+        using value_type = T;
+
+        arena_allocator() : arena_(arena::current()) {}
+
+        template<typename U>
+        arena_allocator(const arena_allocator<U>& other) :
+            arena_(other.arena_) {}
+
+        T* allocate(std::size_t n)
+        {
+            if (n > max_size())
+                throw std::bad_alloc{};
+
+            if (arena_ != nullptr)
+            {
+                auto result = arena_->allocate(n * sizeof(T), alignof(T));
+                if (result != nullptr)
+                    return static_cast<T*>(result);
+            }
+            return static_cast<T*>(::operator new(n * sizeof(T)));
+        }
+
+        void deallocate(T* ptr, std::size_t n)
+        {
+            if (arena_ != nullptr && arena_->contains(ptr))
+            {
+                arena_->deallocate(ptr, n * sizeof(T));
+                return;
+            }
+            ::operator delete(ptr);
+        }
+
+        std::size_t max_size() const
+        {
+            return static_cast<std::size_t>(-1) / sizeof(T);
+        }
+
+        template<typename U>
+        bool operator==(const arena_allocator<U>& other) const
+        {
+            return arena_ == other.arena_;
+        }
+
+        template<typename U>
+        bool operator!=(const arena_allocator<U>& other) const
+        {
+            return arena_ != other.arena_;
+        }
+    private:
+        template<typename U>
+        friend class arena_allocator;
+
+        arena* arena_;
+    };
+
+    /** @brief Temporary vector allocated in the current arena. */
+    template<typename T>
+    using scratch_vector = std::vector<T, arena_allocator<T>>;
+}
+
+#endif // DICE_ARENA_HPP_
@@ -0,0 +1,144 @@
+/**
+ * @file block_pool.hpp
+ *
+ * Thread local free lists of small memory blocks.
+ */
+#ifndef DICE_BLOCK_POOL_HPP_
+#define DICE_BLOCK_POOL_HPP_
+
+#include <new>
+#include <cstddef>
+
+namespace dice
+{
+    /** @brief Free list of memory blocks of the same size.
+     *
+     * Released blocks are kept in a free list of the thread which released
+     * them and reused by the next allocation in that thread. Thus, small
+     * objects which are created and destroyed repeatedly (e.g., int
+     * values during evaluation) are not allocated on the heap once the
+     * list is warm and threads don't contend for the global allocator.
+     *
+     * A block can be released in a different thread than the one which
+     * allocated it. At most max_size blocks are kept in each list. The
+     * list is freed when its thread exits.
+     *
+     * @tparam Size size of a block in bytes
+     */
+    template<std::size_t Size>
+    class block_pool
+    {
+    public:
+        /** Maximal number of free blocks kept by a thread. */
+        static const std::size_t max_size = 1024;
+
+        /** @brief Allocate a block.
+         *
+         * @return pointer to a block of Size bytes
+         */
+        static void* allocate()
+        {
+            auto&& list = local();
+            if (list.head == nullptr)
+            {
+                return ::operator new(block_size);
+            }
+
+            auto result = list.head;
+            list.head = result->next;
+            --list.size;
+            return result;
+        }
+
+        /** @brief Release a block allocated by allocate.
+         *
+         * @param ptr pointer to the block
+         */
+        static void deallocate(void* ptr) noexcept
+        {
+            auto&& list = local();
+            if (list.is_closed || list.size >= max_size)
+            {
+                ::operator delete(ptr);
+                return;
+            }
+
+            auto released = static_cast<block*>(ptr);
+            released->next = list.head;
+            list.head = released;
+            ++list.size;
+        }
+
+        /** @brief Get number of free blocks of the calling thread.
+         *
+         * @return number of blocks in the free list
+         */
+        static std::size_t free_size()
+        {
+            return local().size;
+        }
+    private:
+        struct block
+        {
+            block* next;
+        };
+
+        static const std::size_t block_size =
+            Size < sizeof(block) ? sizeof(block) : Size;
+
+        // it is trivially destructible so that it can be used while other
+        // thread local objects are destroyed
+        struct free_list
+        {
+            block* head;
+            std::size_t size;
+            bool is_closed;
+            bool has_guard;
+        };
+
+        // free all blocks when the thread exits
+        struct guard
+        {
+            free_list* list;
+
+            ~guard()
+            {
+                while (list->head != nullptr)
+                {
+                    auto next = list->head->next;
+                    ::operator delete(list->head);
+                    list->head = next;
+                }
+                list->size = 0;
+                list->is_closed = true;
+            }
+        };
+
+        // Every thread which uses its list (to allocate or only to release
+        // blocks) creates the guard. The flag makes sure that the guard is
+        // not created again after it has been destroyed.
+        static free_list& local()
+        {
+            static thread_local free_list list{ nullptr, 0, false, false };
+            if (!list.has_guard)
+            {
+                list.has_guard = true;
+                create_guard(list);
+            }
+            return list;
+        }
+
+        static void create_guard(free_list& list)
+        {
+            static thread_local guard release_at_exit{ &list };
+        }
+    };
+
+    template<std::size_t Size>
+    const std::size_t block_pool<Size>::max_size;
+
+    template<std::size_t Size>
+    const std::size_t block_pool<Size>::block_size;
+}
+
+#endif // DICE_BLOCK_POOL_HPP_
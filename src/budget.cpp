@@ -0,0 +1,88 @@
+#include "budget.hpp"
+
+thread_local const dice::budget* dice::budget::current_ = nullptr;
+
+void dice::budget::check(const cost& estimate) const
+{
+    if (max_leaves > 0 && estimate.leaf_count > max_leaves)
+    {
+        throw budget_error{ 
+            "Decomposition of " + std::to_string(estimate.leaf_count) + 
+            " leafs exceeds the limit of " + std::to_string(max_leaves) + 
+            " leafs." };
+    }
+
+    if (max_bytes > 0 && estimate.bytes > max_bytes)
+    {
+        throw budget_error{ 
+            "Decomposition of " + std::to_string(estimate.bytes) + 
+            " bytes exceeds the limit of " + std::to_string(max_bytes) + 
+            " bytes." };
+    }
+}
+
+void dice::budget::check_current(const cost& estimate)
+{
+    if (current_ != nullptr)
+    {
+        current_->check(estimate);
+    }
+}
+
+void dice::budget::check_allocation(std::size_t bytes) const
+{
+    if (max_bytes > 0 && bytes > max_bytes)
+    {
+        throw budget_error{ 
+            "Allocation of " + std::to_string(bytes) + 
+            " bytes exceeds the limit of " + std::to_string(max_bytes) + 
+            " bytes." };
+    }
+}
+
+void dice::budget::check_allocation_current(std::size_t bytes)
+{
+    if (current_ != nullptr)
+    {
+        current_->check_allocation(bytes);
+    }
+}
+
+void dice::budget::record_usage(std::size_t bytes) const
+{
+    if (max_bytes > 0 && bytes > max_bytes)
+    {
+        throw budget_error{ 
+            "Value of " + std::to_string(bytes) + 
+            " bytes exceeds the limit of " + std::to_string(max_bytes) + 
+            " bytes." };
+    }
+
+    if (bytes > largest_value_bytes_)
+    {
+        largest_value_bytes_ = bytes;
+    }
+}
+
+void dice::budget::record_usage_current(std::size_t bytes)
+{
+    if (current_ != nullptr)
+    {
+        current_->record_usage(bytes);
+    }
+}
+
+const dice::budget* dice::budget::current()
+{
+    return current_;
+}
+
+dice::budget::scope::scope(const budget* value) : previous_(current_)
+{
+    current_ = value;
+}
+
+dice::budget::scope::~scope()
+{
+    current_ = previous_;
+}
@@ -0,0 +1,193 @@
+/**
+ * @file budget.hpp
+ *
+ * Limits of the size of decompositions computed during evaluation.
+ */
+#ifndef DICE_BUDGET_HPP_
+#define DICE_BUDGET_HPP_
+
+#include <limits>
+#include <string>
+#include <cstddef>
+#include <stdexcept>
+
+namespace dice
+{
+    /** @brief An error thrown if a computation would exceed its budget. */
+    class budget_error : public std::runtime_error
+    {
+    public:
+        explicit budget_error(const std::string& message) : 
+            std::runtime_error(message) {}
+    };
+
+    /** @brief Estimated size of a decomposition.
+     *
+     * Sizes saturate at the maximal value of std::size_t so that an
+     * astronomical size does not overflow.
+     */
+    struct cost
+    {
+        // number of leafs (conditional variables)
+        std::size_t leaf_count = 0;
+        // estimated memory in bytes
+        std::size_t bytes = 0;
+
+        /** @brief Compute a * b or the maximal value if it overflows.
+         *
+         * @param a first operand
+         * @param b second operand
+         *
+         * @return saturated product
+         */
+        static std::size_t multiply(std::size_t a, std::size_t b)
+        {
+            if (a != 0 && b > std::numeric_limits<std::size_t>::max() / a)
+                return std::numeric_limits<std::size_t>::max();
+            return a * b;
+        }
+
+        /** @brief Compute a + b or the maximal value if it overflows.
+         *
+         * @param a first operand
+         * @param b second operand
+         *
+         * @return saturated sum
+         */
+        static std::size_t add(std::size_t a, std::size_t b)
+        {
+            if (b > std::numeric_limits<std::size_t>::max() - a)
+                return std::numeric_limits<std::size_t>::max();
+            return a + b;
+        }
+    };
+
+    /** @brief Limits of decompositions computed by a calculator.
+     *
+     * Decompositions estimate the size of their result before they 
+     * allocate it (see decomposition::combine_cost and 
+     * decomposition::decomposition_cost). If the estimate is over the 
+     * budget of the calling thread, the operation fails with a 
+     * budget_error instead of exhausting the memory.
+     *
+     * Memory actually used by values is checked too: kernels check size 
+     * of the storage of a random variable before they allocate it and 
+     * each function result is checked after it is computed (see 
+     * random_variable::memory_usage and decomposition::memory_usage).
+     *
+     * The budget is made current for a thread by creating a scope object
+     * (see calculator::evaluate). There are no limits if there is no 
+     * current budget.
+     */
+    class budget
+    {
+    public:
+        /** Maximal number of leafs of a decomposition (0 for no limit). */
+        std::size_t max_leaves = 0;
+
+        /** Maximal memory of a single value in bytes (0 for no limit).
+         *
+         * This is a cap on each value and on each allocated storage. It
+         * does not limit the total memory of all live values.
+         */
+        std::size_t max_bytes = 0;
+
+        /** @brief Check whether an operation fits into this budget.
+         *
+         * @param estimate of the size of the result
+         *
+         * @throws budget_error if the estimate is over the budget
+         */
+        void check(const cost& estimate) const;
+
+        /** @brief Check an operation with the budget of the calling thread.
+         *
+         * @param estimate of the size of the result
+         *
+         * @throws budget_error if the estimate is over the budget
+         */
+        static void check_current(const cost& estimate);
+
+        /** @brief Check whether an allocation fits into this budget.
+         *
+         * @param bytes size of the allocated storage
+         *
+         * @throws budget_error if it is over the memory limit
+         */
+        void check_allocation(std::size_t bytes) const;
+
+        /** @brief Check an allocation with the budget of the calling thread.
+         *
+         * @param bytes size of the allocated storage
+         *
+         * @throws budget_error if it is over the memory limit
+         */
+        static void check_allocation_current(std::size_t bytes);
+
+        /** @brief Check memory of a computed value and update the largest
+         *         value.
+         *
+         * It is only called by the thread which evaluates a script (i.e.,
+         * not by threads of a thread_pool, which only call the const 
+         * check functions of the budget of the calling thread).
+         *
+         * @param bytes memory used by the value
+         *
+         * @throws budget_error if it is over the memory limit
+         */
+        void record_usage(std::size_t bytes) const;
+
+        /** @brief Record memory of a value with the budget of the calling
+         *         thread.
+         *
+         * @param bytes memory used by the value
+         *
+         * @throws budget_error if it is over the memory limit
+         */
+        static void record_usage_current(std::size_t bytes);
+
+        /** @brief Get the largest memory of a value passed to record_usage.
+         *
+         * @return memory of the largest value in bytes since the last 
+         *         reset_largest_value
+         */
+        std::size_t largest_value_bytes() const
+        {
+            return largest_value_bytes_;
+        }
+
+        /** @brief Start measuring the largest value again. */
+        void reset_largest_value()
+        {
+            largest_value_bytes_ = 0;
+        }
+
+        /** @brief Get budget of the calling thread.
+         *
+         * @return budget or nullptr if there is none
+         */
+        static const budget* current();
+
+        /** @brief Make a budget current for the calling thread.
+         *
+         * The previous budget is restored when this object is destroyed.
+         */
+        class scope
+        {
+        public:
+            explicit scope(const budget* value);
+            ~scope();
+
+            scope(const scope&) = delete;
+            scope& operator=(const scope&) = delete;
+        private:
+            const budget* previous_;
+        };
+    private:
+        mutable std::size_t largest_value_bytes_ = 0;
+
+        static thread_local const budget* current_;
+    };
+}
+
+#endif // DICE_BUDGET_HPP_
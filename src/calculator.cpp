@@ -7,13 +7,56 @@ void dice::calculator::enable_interactive_mode()
 
 dice::calculator::value_list dice::calculator::evaluate(std::istream* input)
 {
-    dice::lexer<dice::logger> lexer{ input, &log };
-    auto parser = dice::make_parser(&lexer, &log, &interpret);
-    return parser.parse();
+    return execute(prepare(input));
 }
 
 dice::calculator::value_list dice::calculator::evaluate(const std::string& command)
 {
-    std::stringstream input{ command };
-    return evaluate(&input);
+    return execute(prepare(command));
+}
+
+std::future<dice::calculator::value_list> dice::calculator::evaluate_async(
+    const std::string& script,
+    cancellation* token)
+{
+    return std::async(std::launch::async, [this, script, token]()
+    {
+        dice::cancellation::scope token_scope{ token };
+        return evaluate(script);
+    });
+}
+
+dice::plan dice::calculator::prepare(std::istream* input)
+{
+    dice::lexer<dice::logger> lexer{ input, &log };
+    dice::plan_builder builder{ &lexer.location() };
+    auto parser = dice::make_parser(&lexer, &log, &builder);
+    return plan{ parser.parse(), &interpret };
+}
+
+dice::plan dice::calculator::prepare(const std::string& script)
+{
+    // read the script directly from the string without copying it
+    dice::buffer_lexer<dice::logger> lexer{ script, &log };
+    dice::plan_builder builder{ &lexer.location() };
+    auto parser = dice::make_parser(&lexer, &log, &builder);
+    return plan{ parser.parse(), &interpret };
+}
+
+dice::calculator::value_list dice::calculator::execute(const plan& script)
+{
+    // temporaries of the previous evaluation have been destroyed already
+    scratch.reset();
+    limits.reset_largest_value();
+
+    dice::thread_pool::scope scope{ &pool };
+    dice::budget::scope budget_scope{ &limits };
+    dice::arena::scope arena_scope{ &scratch };
+    dice::profiler::scope profile_scope{ profiling ? &profile_ : nullptr };
+    if (samples > 0)
+    {
+        dice::sampler monte_carlo{ &env, &interpret, &log, &cache };
+        return monte_carlo.execute(script, samples, seed);
+    }
+    return script.execute(&interpret, &log, &cache);
 }
\ No newline at end of file
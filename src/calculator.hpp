@@ -4,6 +4,8 @@
 #include <vector>
 #include <string>
 #include <istream>
+#include <cstdint>
+#include <future>
 
 #include "logger.hpp"
 #include "environment.hpp"
@@ -11,6 +13,13 @@
 #include "lexer.hpp"
 #include "parser.hpp"
 #include "value.hpp"
+#include "thread_pool.hpp"
+#include "arena.hpp"
+#include "budget.hpp"
+#include "plan.hpp"
+#include "sampler.hpp"
+#include "profiler.hpp"
+#include "cancellation.hpp"
 
 namespace dice
 {
@@ -25,6 +34,14 @@ namespace dice
      *      result = c.evaluate(&file);
      * }
      * @endcode
+     *
+     * A calculator is not thread safe but there is no mutable state shared
+     * by calculators (each has its own environment, random number generator
+     * and thread pool). Thus, different calculators can evaluate scripts 
+     * concurrently. The only shared state is the roll_cache (which is 
+     * synchronized) and global configuration (e.g., the pruning policy or
+     * convolution::fft_threshold) which has to be set before evaluation 
+     * starts.
      */
     struct calculator
     {
@@ -34,10 +51,53 @@ namespace dice
         dice::environment env;
         dice::direct_interpreter<dice::environment> interpret;
 
-        calculator() : interpret(&env) {}
+        /** Threads which compute leafs of decompositions in parallel. */
+        dice::thread_pool pool;
+
+        /** Limits of decompositions computed by this calculator. 
+         * Evaluation of an expression over the budget fails with 
+         * a compiler_error. Its max_bytes is the memory limit of each
+         * value of an evaluation.
+         */
+        dice::budget limits;
+
+        /** Values of subexpressions shared by evaluated scripts. */
+        dice::plan_cache cache;
+
+        /** Memory of temporary buffers of an evaluation (e.g., buffers of
+         * the FFT). It is released at the start of each evaluation.
+         */
+        dice::arena scratch;
+
+        /** Number of samples of a Monte Carlo evaluation (see sampler). 
+         * Scripts are evaluated exactly if it is 0.
+         */
+        std::size_t samples = 0;
+
+        /** Seed of the random number generators of the sampler. The roll
+         * function has its own generator (see environment::seed).
+         */
+        std::uint64_t seed = 0;
+
+        /** If true, counters of evaluated operations are collected (see
+         * profile).
+         */
+        bool profiling = false;
+
+        /** @brief Create a calculator.
+         *
+         * @param threads number of threads used for evaluation (0 to use
+         *        all hardware threads, 1 to evaluate everything serially)
+         */
+        explicit calculator(std::size_t threads = 0) : 
+            interpret(&env), 
+            pool(threads) {}
 
         /** @brief Evaluate command in given input stream.
          *
+         * The script is parsed to a plan first (see prepare) so that 
+         * repeated subexpressions are computed once.
+         *
         * @param input character stream pointer
         * 
         * @return evaluated values
@@ -52,12 +112,92 @@ namespace dice
         */
         value_list evaluate(const std::string& command);
 
+        /** @brief Evaluate a script in a new thread.
+         *
+         * The calculator must not be used until the evaluation finishes
+         * (i.e., until the returned future is ready). If the token is 
+         * cancelled, the future rethrows a cancelled_error. Values of 
+         * variables assigned before that are kept.
+         *
+         * @param script as a string
+         * @param token cancellation token whose progress is updated by 
+         *        the evaluation (it has to exist until it finishes) or 
+         *        nullptr if the evaluation can't be cancelled
+         *
+         * @return future of the evaluated values
+         */
+        std::future<value_list> evaluate_async(
+            const std::string& script,
+            cancellation* token = nullptr);
+
+        /** @brief Parse a script without evaluating it.
+         *
+         * Parsing errors are reported when the script is parsed. The plan
+         * can be evaluated many times (see execute). Variables of the 
+         * environment can be used as its parameters.
+         *
+         * @param input character stream pointer
+         *
+         * @return parsed script
+         */
+        plan prepare(std::istream* input);
+
+        /** @brief Parse a script in a string without evaluating it.
+         *
+         * @param script as a string
+         *
+         * @return parsed script
+         */
+        plan prepare(const std::string& script);
+
+        /** @brief Evaluate a parsed script.
+         *
+         * The script is sampled if the number of samples is not 0.
+         *
+         * @param script parsed by prepare
+         *
+         * @return evaluated values
+         */
+        value_list execute(const plan& script);
+
         /** @brief Enable interactive mode.
          *
          * Interactive mode is optimized for repeated use of the environment.
          * It allows variable redefinition.
          */
         void enable_interactive_mode();
+
+        /** @brief Get memory of the largest value of the last evaluation.
+         *
+         * This is not the total memory used by the evaluation.
+         *
+         * @return largest memory of a value computed by a function in 
+         *         bytes (see decomposition::memory_usage)
+         */
+        std::size_t largest_value_memory() const
+        {
+            return limits.largest_value_bytes();
+        }
+
+        /** @brief Get counters of operations evaluated while profiling
+         *         was enabled.
+         *
+         * Counters are accumulated over evaluations until they are 
+         * cleared (profile().clear()).
+         *
+         * @return profile of evaluated scripts
+         */
+        dice::profiler& profile() 
+        {
+            return profile_;
+        }
+
+        const dice::profiler& profile() const
+        {
+            return profile_;
+        }
+    private:
+        dice::profiler profile_;
     };
 }
 
@@ -0,0 +1,68 @@
+#include "cancellation.hpp"
+
+#include <algorithm>
+
+thread_local dice::cancellation* dice::cancellation::current_ = nullptr;
+
+bool dice::cancellation::is_cancelled() const
+{
+    if (is_cancelled_)
+        return true;
+
+    auto deadline = deadline_.load();
+    return deadline != 0 &&
+        clock::now().time_since_epoch().count() >= deadline;
+}
+
+void dice::cancellation::check() const
+{
+    if (is_cancelled_)
+    {
+        throw cancelled_error{ "Evaluation has been cancelled." };
+    }
+
+    if (is_cancelled())
+    {
+        throw cancelled_error{ "Evaluation has exceeded its deadline." };
+    }
+}
+
+void dice::cancellation::start_statement(
+    std::size_t index,
+    std::size_t count,
+    std::size_t work_done,
+    std::size_t total_work)
+{
+    statement_ = index;
+    statement_count_ = count;
+    work_done_ = work_done;
+    total_work_ = total_work;
+}
+
+void dice::cancellation::finish()
+{
+    statement_ = statement_count_.load();
+    work_done_ = total_work_.load();
+}
+
+dice::cancellation::progress dice::cancellation::get_progress() const
+{
+    progress result;
+    result.statement = statement_;
+    result.statement_count = statement_count_;
+
+    auto total = total_work_.load();
+    result.fraction = total == 0 ? 0 : std::min(1.0,
+        static_cast<double>(work_done_) / static_cast<double>(total));
+    return result;
+}
+
+dice::cancellation::scope::scope(cancellation* value) : previous_(current_)
+{
+    current_ = value;
+}
+
+dice::cancellation::scope::~scope()
+{
+    current_ = previous_;
+}
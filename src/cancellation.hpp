@@ -0,0 +1,176 @@
+/**
+ * @file cancellation.hpp
+ *
+ * Cooperative cancellation and progress of an evaluation.
+ */
+#ifndef DICE_CANCELLATION_HPP_
+#define DICE_CANCELLATION_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <cstddef>
+#include <stdexcept>
+
+namespace dice
+{
+    /** @brief An error thrown if an evaluation has been cancelled. */
+    class cancelled_error : public std::runtime_error
+    {
+    public:
+        explicit cancelled_error(const std::string& message) :
+            std::runtime_error(message) {}
+    };
+
+    /** @brief Token which stops an evaluation.
+     *
+     * Long running loops (e.g., roll, decomposition::combine and
+     * decomposition::compute_decomposition) check the token of the calling
+     * thread and throw a cancelled_error if it has been cancelled or its
+     * deadline has passed. The error is not reported as a compiler_error,
+     * it stops the whole evaluation. The token of the calling thread is
+     * also current in threads of a thread_pool which execute its loops.
+     *
+     * The evaluation reports its progress to the token. The token can be
+     * cancelled and its progress can be read by any thread.
+     */
+    class cancellation
+    {
+    public:
+        using clock = std::chrono::steady_clock;
+
+        /** @brief Progress of an evaluation. */
+        struct progress
+        {
+            // index of the evaluated statement
+            std::size_t statement;
+            // number of statements of the script
+            std::size_t statement_count;
+            // estimated fraction of evaluated work (from 0 to 1)
+            double fraction;
+        };
+
+        cancellation() = default;
+
+        cancellation(const cancellation&) = delete;
+        cancellation& operator=(const cancellation&) = delete;
+
+        /** @brief Stop the evaluation at the next check. */
+        void cancel()
+        {
+            is_cancelled_ = true;
+        }
+
+        /** @brief Stop the evaluation if it is not finished at given time.
+         *
+         * @param deadline time point
+         */
+        void set_deadline(clock::time_point deadline)
+        {
+            deadline_ = deadline.time_since_epoch().count();
+        }
+
+        /** @brief Stop the evaluation if it takes longer than timeout.
+         *
+         * @param timeout maximal duration from now
+         */
+        void set_timeout(clock::duration timeout)
+        {
+            set_deadline(clock::now() + timeout);
+        }
+
+        /** @brief Check whether the evaluation should stop.
+         *
+         * @return true iff cancel has been called or the deadline has passed
+         */
+        bool is_cancelled() const;
+
+        /** @brief Stop the evaluation if it should stop.
+         *
+         * @throws cancelled_error if is_cancelled() is true
+         */
+        void check() const;
+
+        /** @brief Check the token of the calling thread (if there is one).
+         *
+         * @throws cancelled_error if the token has been cancelled
+         */
+        static void check_current()
+        {
+            if (current_ != nullptr)
+            {
+                current_->check();
+            }
+        }
+
+        /** @brief Start evaluation of a statement.
+         *
+         * @param index of the statement
+         * @param count number of statements
+         * @param work_done amount of work of the previous statements
+         * @param total_work amount of work of all statements
+         */
+        void start_statement(
+            std::size_t index,
+            std::size_t count,
+            std::size_t work_done,
+            std::size_t total_work);
+
+        /** @brief Add finished work of the current statement.
+         *
+         * @param amount of finished work
+         */
+        void add_work(std::size_t amount)
+        {
+            work_done_ += amount;
+        }
+
+        /** @brief Mark the evaluation as finished. */
+        void finish();
+
+        /** @brief Get progress of the evaluation.
+         *
+         * @return progress reported so far
+         */
+        progress get_progress() const;
+
+        /** @brief Get token of the calling thread.
+         *
+         * @return token or nullptr if the evaluation can't be cancelled
+         */
+        static cancellation* current()
+        {
+            return current_;
+        }
+
+        /** @brief Make a token current for the calling thread.
+         *
+         * The previous token is restored when this object is destroyed.
+         */
+        class scope
+        {
+        public:
+            explicit scope(cancellation* value);
+            ~scope();
+
+            scope(const scope&) = delete;
+            scope& operator=(const scope&) = delete;
+        private:
+            cancellation* previous_;
+        };
+    private:
+        std::atomic<bool> is_cancelled_{ false };
+        // ticks of the deadline since the epoch of the clock (0 if there
+        // is no deadline)
+        std::atomic<clock::rep> deadline_{ 0 };
+
+        std::atomic<std::size_t> statement_{ 0 };
+        std::atomic<std::size_t> statement_count_{ 0 };
+        std::atomic<std::size_t> work_done_{ 0 };
+        std::atomic<std::size_t> total_work_{ 0 };
+
+        static thread_local cancellation* current_;
+    };
+}
+
+#endif // DICE_CANCELLATION_HPP_
@@ -26,7 +26,7 @@ dice::conversions::value_type dice::conversions::convert(
     auto from = value->type();
     if (from == to)
     {
-        return std::move(value);
+        return value;
     }
 
     conversion_visitor conversion{ to };
@@ -0,0 +1,5 @@
+#include "convolution.hpp"
+
+std::size_t dice::convolution::fft_threshold = 128;
+
+const std::size_t dice::convolution::fft_cost_factor = 16;
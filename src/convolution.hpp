@@ -0,0 +1,462 @@
+/**
+ * @file convolution.hpp
+ *
+ * Convolution of probability mass functions stored in vectors.
+ */
+#ifndef DICE_CONVOLUTION_HPP_
+#define DICE_CONVOLUTION_HPP_
+
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <algorithm>
+#include <complex>
+#include <cassert>
+#include <cstddef>
+
+#include "simd.hpp"
+#include "arena.hpp"
+
+namespace dice
+{
+    /** @brief Convolution engine for dense probability vectors.
+     *
+     * Vectors passed to these functions are probabilities of consecutive
+     * values (i.e. a[i] is the probability of the i-th value). Convolution
+     * of a and b is the distribution of a sum of independent variables.
+     *
+     * Small inputs are convolved directly in O(n * m). If both inputs are
+     * large enough (see fft_threshold), the convolution is computed using
+     * the fast Fourier transform in O((n + m) log(n + m)).
+     *
+     * Precision: the direct method computes exactly what the naive
+     * algorithm would. Each probability computed using the FFT has an
+     * absolute error of at most error_bound(n + m) relative to the direct
+     * method (that is roughly 1e-15 for vectors with a few thousand
+     * values). Values whose probability is below this bound are rounded
+     * to 0 so that they don't appear in the result. The rounded off 
+     * probability is added to the optional rounded argument so that the
+     * caller can count it as discarded probability. The transform is
+     * computed in the accumulator type of T (i.e., at least in double) so
+     * that the error bound does not grow for float probabilities.
+     */
+    class convolution
+    {
+    public:
+        /** Minimal size of the smaller operand for which the FFT is used.
+         *
+         * For the k-fold convolution (see fft_compound), size of the result
+         * is compared with this threshold instead. Set this to 0 to use the
+         * FFT whenever it is estimated to be faster. Set it to 
+         * std::numeric_limits<std::size_t>::max() to disable the FFT.
+         */
+        static std::size_t fft_threshold;
+
+        /** @brief Convolve 2 probability vectors.
+         *
+         * It chooses the faster of the direct and the FFT method.
+         *
+         * @param a first vector
+         * @param b second vector
+         * @param rounded if not nullptr, probability rounded to 0 by the 
+         *        FFT is added to it
+         *
+         * @return vector c of size a.size() + b.size() - 1 where
+         *         c[k] = sum of a[i] * b[j] over i + j = k
+         *         (empty if a or b is empty)
+         */
+        template<typename T>
+        static std::vector<T> convolve(
+            const std::vector<T>& a,
+            const std::vector<T>& b,
+            T* rounded = nullptr)
+        {
+            if (use_fft(a.size(), b.size()))
+            {
+                return fft_convolve(a, b, rounded);
+            }
+            return direct_convolve(a, b);
+        }
+
+        /** @brief Compute convolution directly.
+         *
+         * @param a first vector
+         * @param b second vector
+         *
+         * @return convolution of a and b
+         */
+        template<typename T>
+        static std::vector<T> direct_convolve(
+            const std::vector<T>& a,
+            const std::vector<T>& b)
+        {
+            if (a.empty() || b.empty())
+                return std::vector<T>{};
+
+            std::vector<T> result(a.size() + b.size() - 1, 0);
+            for (std::size_t i = 0; i < a.size(); ++i)
+            {
+                if (a[i] == 0)
+                    continue;
+
+                // result[i + j] += a[i] * b[j]
+                simd::axpy(result.data() + i, b.data(), a[i], b.size());
+            }
+            return result;
+        }
+
+        /** @brief Compute convolution using the FFT.
+         *
+         * @param a first vector
+         * @param b second vector
+         * @param rounded if not nullptr, probability rounded to 0 is 
+         *        added to it
+         *
+         * @return convolution of a and b
+         */
+        template<typename T>
+        static std::vector<T> fft_convolve(
+            const std::vector<T>& a,
+            const std::vector<T>& b,
+            T* rounded = nullptr)
+        {
+            if (a.empty() || b.empty())
+                return std::vector<T>{};
+
+            auto result_size = a.size() + b.size() - 1;
+            auto size = fft_size(result_size);
+            auto data_a = transform(a, size);
+            auto data_b = transform(b, size);
+            for (std::size_t i = 0; i < size; ++i)
+            {
+                data_a[i] *= data_b[i];
+            }
+            return inverse_transform<T>(
+                std::move(data_a), 
+                result_size, 
+                rounded);
+        }
+
+        /** @brief Compute a mixture of k-fold convolutions of a vector.
+         *
+         * This is the distribution of a sum of K independent copies of
+         * a random variable where K is itself a random variable:
+         * result = sum of weights[i] * a^(*powers[i]) over all i.
+         * 
+         * The vector is transformed once. In the frequency domain, the 
+         * k-fold convolution is just the k-th pointwise power. Each value
+         * is raised to all exponents by squaring. Powers are visited in 
+         * ascending order and each one is computed from the previous one 
+         * using the cached squares (value^(2^j)). Thus the cost per value 
+         * is about log2(max power) plus the number of bits set in the 
+         * differences of consecutive exponents (see compound_steps). The 
+         * weighted sum is computed in the frequency domain as well so only
+         * 1 inverse transform is necessary.
+         *
+         * @param a probability vector
+         * @param powers list of exponents k (positive integers in 
+         *        ascending order)
+         * @param weights weight of each exponent
+         * @param rounded if not nullptr, probability rounded to 0 is 
+         *        added to it
+         *
+         * @return weighted sum of k-fold convolutions 
+         *         (of size (a.size() - 1) * max power + 1)
+         */
+        template<typename T>
+        static std::vector<T> fft_compound(
+            const std::vector<T>& a,
+            const std::vector<std::size_t>& powers,
+            const std::vector<T>& weights,
+            T* rounded = nullptr)
+        {
+            assert(powers.size() == weights.size());
+            if (a.empty() || powers.empty())
+                return std::vector<T>{};
+
+            assert(std::is_sorted(powers.begin(), powers.end()));
+            assert(powers.front() > 0);
+            auto max_power = powers.back();
+            auto result_size = (a.size() - 1) * max_power + 1;
+            auto data = transform(a, fft_size(result_size));
+
+            // squares[j] = value^(2^j)
+            using value_type = accumulator_t<T>;
+            complex_buffer<value_type> squares(log2(max_power) + 1);
+            for (auto&& value : data)
+            {
+                squares[0] = value;
+                for (std::size_t j = 1; j < squares.size(); ++j)
+                {
+                    squares[j] = squares[j - 1] * squares[j - 1];
+                }
+
+                std::complex<value_type> current{ 1 };
+                std::complex<value_type> sum{ 0 };
+                std::size_t current_power = 0;
+                for (std::size_t i = 0; i < powers.size(); ++i)
+                {
+                    auto diff = powers[i] - current_power;
+                    for (std::size_t j = 0; diff > 0; ++j, diff >>= 1)
+                    {
+                        if ((diff & 1) != 0)
+                        {
+                            current *= squares[j];
+                        }
+                    }
+                    current_power = powers[i];
+                    sum += static_cast<value_type>(weights[i]) * current;
+                }
+                value = sum;
+            }
+            return inverse_transform<T>(
+                std::move(data), 
+                result_size, 
+                rounded);
+        }
+
+        /** @brief Decide whether FFT is faster than the direct convolution.
+         *
+         * @param size_a size of the first vector
+         * @param size_b size of the second vector
+         *
+         * @return true iff we should use the FFT
+         */
+        static bool use_fft(std::size_t size_a, std::size_t size_b)
+        {
+            if (std::min(size_a, size_b) < fft_threshold ||
+                size_a == 0 || size_b == 0)
+            {
+                return false;
+            }
+
+            // 3 transforms, each costs about N log N complex operations
+            auto size = fft_size(size_a + size_b - 1);
+            auto fft_cost = fft_cost_factor * size * log2(size);
+            return size_a * size_b > fft_cost;
+        }
+
+        /** @brief Decide whether FFT is faster than repeated convolution.
+         *
+         * The alternative is a dynamic programming algorithm which adds 
+         * 1 copy at a time using prefix sums (see roll()).
+         *
+         * @param size of the vector
+         * @param powers list of exponents (positive integers in ascending
+         *        order)
+         *
+         * @return true iff we should use fft_compound
+         */
+        static bool use_fft_compound(
+            std::size_t size, 
+            const std::vector<std::size_t>& powers)
+        {
+            if (size == 0 || powers.empty())
+                return false;
+
+            auto max_power = powers.back();
+            auto result_size = (size - 1) * max_power + 1;
+            if (result_size < fft_threshold)
+                return false;
+
+            // each step of the dynamic programming algorithm is linear
+            auto direct_cost = result_size * max_power / 2;
+            
+            // 2 transforms and a few complex multiplications per value
+            auto size_n = fft_size(result_size);
+            auto fft_cost = fft_cost_factor * size_n * log2(size_n) * 2 / 3 +
+                4 * size_n * compound_steps(powers);
+            return direct_cost > fft_cost;
+        }
+
+        /** @brief Count complex multiplications per value in fft_compound
+         * 
+         * @param powers list of exponents in ascending order
+         * 
+         * @return number of multiplications
+         */
+        static std::size_t compound_steps(
+            const std::vector<std::size_t>& powers)
+        {
+            if (powers.empty())
+                return 0;
+
+            std::size_t result = log2(powers.back());
+            std::size_t current_power = 0;
+            for (auto&& k : powers)
+            {
+                for (auto diff = k - current_power; diff > 0; diff >>= 1)
+                {
+                    result += diff & 1;
+                }
+                current_power = k;
+            }
+            // add the multiplication by weight
+            return result + powers.size();
+        }
+
+        /** @brief Compute absolute error bound of the FFT convolution.
+         *
+         * @param size of the result
+         *
+         * @return bound of the absolute error of each probability
+         */
+        template<typename T>
+        static T error_bound(std::size_t size)
+        {
+            auto n = fft_size(size);
+            return std::numeric_limits<T>::epsilon() *
+                static_cast<T>(4 * (log2(n) + 1));
+        }
+
+        /** @brief Find the smallest power of 2 that is at least size.
+         *
+         * @param size
+         *
+         * @return size of the FFT buffer
+         */
+        static std::size_t fft_size(std::size_t size)
+        {
+            std::size_t result = 1;
+            while (result < size)
+            {
+                result <<= 1;
+            }
+            return result;
+        }
+
+        /** @brief Compute in place discrete Fourier transform.
+         *
+         * Iterative radix-2 Cooley-Tukey algorithm.
+         *
+         * @param data vector whose size is a power of 2
+         * @param inverse if true, compute the inverse transform (including
+         *        the 1/n normalization)
+         */
+        template<typename T, typename Allocator>
+        static void fft(
+            std::vector<std::complex<T>, Allocator>& data, 
+            bool inverse)
+        {
+            const auto n = data.size();
+            assert((n & (n - 1)) == 0);
+
+            // bit reversal permutation
+            for (std::size_t i = 1, j = 0; i < n; ++i)
+            {
+                auto bit = n >> 1;
+                for (; (j & bit) != 0; bit >>= 1)
+                {
+                    j ^= bit;
+                }
+                j ^= bit;
+                if (i < j)
+                {
+                    std::swap(data[i], data[j]);
+                }
+            }
+
+            // Precompute the roots of unity. They are computed directly
+            // (not by repeated multiplication) to avoid accumulating the
+            // rounding error.
+            const T pi = std::acos(static_cast<T>(-1));
+            const T sign = inverse ? 1 : -1;
+            complex_buffer<T> roots(n / 2);
+            for (std::size_t i = 0; i < roots.size(); ++i)
+            {
+                roots[i] = std::polar(
+                    static_cast<T>(1),
+                    sign * 2 * pi * static_cast<T>(i) / static_cast<T>(n));
+            }
+
+            for (std::size_t length = 2; length <= n; length <<= 1)
+            {
+                auto half = length / 2;
+                auto step = n / length;
+                for (std::size_t i = 0; i < n; i += length)
+                {
+                    for (std::size_t j = 0; j < half; ++j)
+                    {
+                        auto u = data[i + j];
+                        auto v = data[i + j + half] * roots[j * step];
+                        data[i + j] = u + v;
+                        data[i + j + half] = u - v;
+                    }
+                }
+            }
+
+            if (inverse)
+            {
+                for (auto&& value : data)
+                {
+                    value /= static_cast<T>(n);
+                }
+            }
+        }
+    private:
+        // temporary buffer of complex values in the current arena
+        template<typename T>
+        using complex_buffer = scratch_vector<std::complex<T>>;
+
+        // relative cost of 1 FFT operation compared to 1 multiply-add
+        static const std::size_t fft_cost_factor;
+
+        static std::size_t log2(std::size_t value)
+        {
+            std::size_t result = 0;
+            while (value > 1)
+            {
+                value >>= 1;
+                ++result;
+            }
+            return result;
+        }
+
+        template<typename T>
+        static complex_buffer<accumulator_t<T>> transform(
+            const std::vector<T>& data,
+            std::size_t size)
+        {
+            complex_buffer<accumulator_t<T>> result(size);
+            std::copy(data.begin(), data.end(), result.begin());
+            fft(result, false);
+            return result;
+        }
+
+        template<typename T>
+        static std::vector<T> inverse_transform(
+            complex_buffer<accumulator_t<T>>&& data,
+            std::size_t result_size,
+            T* rounded)
+        {
+            fft(data, true);
+
+            // round values below the error bound to zero (negative values
+            // are just the rounding error)
+            auto bound = error_bound<accumulator_t<T>>(result_size);
+            compensated_sum<accumulator_t<T>> rounded_sum;
+            std::vector<T> result(result_size);
+            for (std::size_t i = 0; i < result_size; ++i)
+            {
+                auto value = data[i].real();
+                if (value > bound)
+                {
+                    result[i] = static_cast<T>(value);
+                }
+                else if (value > 0)
+                {
+                    result[i] = 0;
+                    rounded_sum += value;
+                }
+            }
+
+            if (rounded != nullptr)
+            {
+                *rounded += static_cast<T>(rounded_sum.value());
+            }
+            return result;
+        }
+    };
+}
+
+#endif // DICE_CONVOLUTION_HPP_
@@ -1,6 +1,7 @@
 #ifndef DICE_DECOMPOSITION_HPP_
 #define DICE_DECOMPOSITION_HPP_
 
+#include <atomic>
 #include <memory>
 #include <vector>
 #include <cassert>
@@ -8,6 +9,10 @@
 
 #include "utils.hpp"
 #include "random_variable.hpp"
+#include "thread_pool.hpp"
+#include "arena.hpp"
+#include "budget.hpp"
+#include "cancellation.hpp"
 
 namespace dice
 {
@@ -162,6 +167,65 @@ namespace dice
             });
         }
 
+        /** @brief Add a random variable to this variable.
+         *
+         * The result is the same as operator+ but if the other variable 
+         * does not have any dependencies (e.g., it is a constant), leafs
+         * of this variable are updated in place.
+         *
+         * @param other random variable (RHS of the operator)
+         *
+         * @return this variable
+         */
+        decomposition& operator+=(const decomposition& other)
+        {
+            return combine_into(other, [](auto&& var_a, auto&& var_b)
+            {
+                var_a += var_b;
+            }, [](auto&& var_a, auto&& var_b)
+            {
+                return var_a + var_b;
+            });
+        }
+
+        /** @brief Subtract a random variable from this variable.
+         *
+         * See operator+=.
+         *
+         * @param other random variable (RHS of the operator)
+         *
+         * @return this variable
+         */
+        decomposition& operator-=(const decomposition& other)
+        {
+            return combine_into(other, [](auto&& var_a, auto&& var_b)
+            {
+                var_a -= var_b;
+            }, [](auto&& var_a, auto&& var_b)
+            {
+                return var_a - var_b;
+            });
+        }
+
+        /** @brief Multiply this variable by a random variable.
+         *
+         * See operator+=.
+         *
+         * @param other random variable (RHS of the operator)
+         *
+         * @return this variable
+         */
+        decomposition& operator*=(const decomposition& other)
+        {
+            return combine_into(other, [](auto&& var_a, auto&& var_b)
+            {
+                var_a *= var_b;
+            }, [](auto&& var_a, auto&& var_b)
+            {
+                return var_a * var_b;
+            });
+        }
+
         /** @brief Multiply this random variable with -1.
          *
          * @return negated random variable
@@ -170,6 +234,13 @@ namespace dice
         {
             decomposition result;
             result.deps_ = deps_;
+            if (is_compact())
+            {
+                result.compact_ = compact_;
+                result.compact_.negate();
+                return result;
+            }
+
             for (auto&& var : vars_)
             {
                 result.vars_.push_back(-var);
@@ -296,10 +367,14 @@ namespace dice
         {
             decomposition result;
             result.deps_ = deps_;
-            for (auto&& var : vars_)
+            for (std::size_t i = 0; i < leaf_count(); ++i)
             {
-                result.vars_.push_back(var.in(lower_bound, upper_bound));
+                result.vars_.push_back(with_leaf(i, [&](auto&& var)
+                {
+                    return var.in(lower_bound, upper_bound);
+                }));
             }
+            result.compact();
             return result;
         }
         
@@ -325,35 +400,54 @@ namespace dice
         }
 
         /** @biref Compute expected value of this random variable.
+         *
+         * Probabilities are normalized by their sum (which is less than 1
+         * if some probability has been discarded by pruning) as in
+         * random_variable::expected_value.
          *
          * @return expected value of this variable
          */
         auto expected_value() const
         {
-            ProbabilityType expectation = 0;
-            for (auto it = begin(); it != end(); ++it)
+            using sum_type = accumulator_t<probability_type>;
+            compensated_sum<sum_type> expectation;
+            compensated_sum<sum_type> total;
+            fold([&](auto&& value, auto&& probability)
             {
-                auto value = static_cast<probability_type>(it->first);
-                expectation += value * it->second;
-            }
-            return expectation;
+                auto real_probability = static_cast<sum_type>(probability);
+                expectation += static_cast<sum_type>(value) * real_probability;
+                total += real_probability;
+            });
+            if (total.value() <= 0)
+                return static_cast<sum_type>(0);
+            return expectation.value() / total.value();
         }
 
         /** @brief Compute variance of this random variable.
+         *
+         * Probabilities are normalized by their sum as in 
+         * random_variable::variance.
          *
          * @return variance of this variable
          */
         auto variance() const
         {
-            ProbabilityType sum_sq = 0;
-            ProbabilityType sum = 0;
-            for (auto it = begin(); it != end(); ++it)
+            using sum_type = accumulator_t<probability_type>;
+            compensated_sum<sum_type> sum_sq;
+            compensated_sum<sum_type> sum;
+            compensated_sum<sum_type> total;
+            fold([&](auto&& value, auto&& probability)
             {
-                auto value = static_cast<probability_type>(it->first);
-                sum_sq += value * value * it->second;
-                sum += value * it->second;
-            }
-            return sum_sq - sum * sum;
+                auto real_value = static_cast<sum_type>(value);
+                auto real_probability = static_cast<sum_type>(probability);
+                sum_sq += real_value * real_value * real_probability;
+                sum += real_value * real_probability;
+                total += real_probability;
+            });
+            if (total.value() <= 0)
+                return static_cast<sum_type>(0);
+            auto mean = sum.value() / total.value();
+            return sum_sq.value() / total.value() - mean * mean;
         }
 
         /** @brief Compute standard deviation of this random variable.
@@ -365,6 +459,83 @@ namespace dice
             return std::sqrt(variance());
         }
 
+        /** @brief Call a function with all values of all leafs.
+         *
+         * This visits the same pairs as the probability_iterator but the 
+         * weight of a leaf (probability of values of its dependencies) is 
+         * computed once per leaf rather than once per value.
+         *
+         * @param function called with a value and its probability
+         */
+        template<typename Function>
+        void fold(Function&& function) const
+        {
+            fold(0, leaf_count(), function);
+        }
+
+        /** @brief Call a function with all values of a range of leafs.
+         *
+         * @param first index of the first leaf
+         * @param last index after the last leaf
+         * @param function called with a value and its probability
+         */
+        template<typename Function>
+        void fold(std::size_t first, std::size_t last, Function&& function) 
+            const
+        {
+            const auto deps_count = deps_.size();
+
+            // probabilities of dependencies in the order of iteration
+            std::vector<std::vector<probability_type>> dep_probs(deps_count);
+            for (std::size_t j = 0; j < deps_count; ++j)
+            {
+                for (auto&& pair : deps_[j].variable())
+                {
+                    dep_probs[j].push_back(pair.second);
+                }
+            }
+
+            // values of dependencies of the first leaf
+            scratch_vector<std::size_t> digits(deps_count);
+            auto rest = first;
+            for (std::size_t j = 0; j < deps_count; ++j)
+            {
+                digits[j] = rest % dep_probs[j].size();
+                rest /= dep_probs[j].size();
+            }
+
+            // weights[j] is the probability of digits j, j + 1, ... so that 
+            // only weights of the changed digits are recomputed
+            scratch_vector<probability_type> weights(deps_count + 1, 1);
+            auto update_weights = [&](std::size_t count)
+            {
+                for (auto j = count; j-- > 0;)
+                {
+                    weights[j] = weights[j + 1] * dep_probs[j][digits[j]];
+                }
+            };
+            update_weights(deps_count);
+
+            for (auto leaf = first; leaf < last; ++leaf)
+            {
+                auto weight = weights[0];
+                for_each_value(leaf, [&](auto&& value, auto&& probability)
+                {
+                    function(value, probability * weight);
+                });
+
+                // move to the next value of the deps_ vector
+                std::size_t j = 0;
+                for (; j < deps_count; ++j)
+                {
+                    if (++digits[j] < dep_probs[j].size())
+                        break;
+                    digits[j] = 0;
+                }
+                update_weights(std::min(j + 1, deps_count));
+            }
+        }
+
         /** @brief Compute quantile of this random variable.
          *
          * @param probability between 0 and 1 (not including 0 and 1)
@@ -373,8 +544,51 @@ namespace dice
          */
         auto quantile(ProbabilityType probability) const
         {
-            auto var = to_random_variable();
-            return var.quantile(probability);
+            return marginal().quantile(probability);
+        }
+
+        /** @brief Compute function of 2 random variables in place.
+         *
+         * If B does not have any dependencies, the combination is applied
+         * to the leafs of this variable so that the list of leafs is 
+         * reused. Otherwise, this is the same as assigning the result of
+         * combine. If the update throws, the value of this variable is
+         * unspecified.
+         *
+         * @param other random variable B
+         * @param update function which modifies its first argument (a leaf
+         *        of A) to be the combination with its second argument
+         * @param combination function of 2 independent random variables
+         *        (see combine)
+         *
+         * @return this variable
+         */
+        template<typename UpdateFunction, typename CombinationFunction>
+        decomposition& combine_into(
+            const decomposition& other,
+            UpdateFunction update,
+            CombinationFunction combination)
+        {
+            if (this == &other || is_compact() || 
+                !other.deps_.empty() || other.leaf_count() != 1)
+            {
+                *this = combine(other, combination);
+                return *this;
+            }
+
+            budget::check_current(combine_cost(other));
+
+            auto&& constant = other.leaf(0);
+            marginal_.reset();
+            thread_pool::for_each(vars_.size(), [&](auto first, auto last)
+            {
+                for (auto i = first; i < last; ++i)
+                {
+                    update(vars_[i], constant);
+                }
+            });
+            compact();
+            return *this;
         }
 
         /** @brief Compute function of 2 random variables: A and B.
@@ -395,8 +609,55 @@ namespace dice
             const decomposition& other, 
             VariableCombinationFunction combination) const
         {
+            budget::check_current(combine_cost(other));
+
             decomposition result;
 
+            // If one of the variables does not have any dependencies (e.g.,
+            // it is a constant), conditional variables of the other variable
+            // are combined with it directly.
+            if (other.deps_.empty() && other.leaf_count() == 1)
+            {
+                auto&& constant = other.leaf(0);
+                result.deps_ = deps_;
+                result.vars_.resize(leaf_count());
+                thread_pool::for_each(leaf_count(), [&](auto first, auto last)
+                {
+                    for (auto i = first; i < last; ++i)
+                    {
+                        cancellation::check_current();
+                        result.vars_[i] = with_leaf(i, [&](auto&& var)
+                        {
+                            return combination(var, constant);
+                        });
+                    }
+                });
+                result.compact();
+                return result;
+            }
+
+            if (deps_.empty() && leaf_count() == 1)
+            {
+                auto&& constant = leaf(0);
+                result.deps_ = other.deps_;
+                result.vars_.resize(other.leaf_count());
+                thread_pool::for_each(
+                    other.leaf_count(), 
+                    [&](auto first, auto last)
+                {
+                    for (auto i = first; i < last; ++i)
+                    {
+                        cancellation::check_current();
+                        result.vars_[i] = other.with_leaf(i, [&](auto&& var)
+                        {
+                            return combination(constant, var);
+                        });
+                    }
+                });
+                result.compact();
+                return result;
+            }
+
             // compute union of the deps_ sets
             result.deps_ = sorted_union(deps_, other.deps_);
 
@@ -407,80 +668,86 @@ namespace dice
                 num_values *= var->size();
             }
 
-            // determine which dependencies are in A and which are in B
-            const std::uint8_t A = 1;
-            const std::uint8_t B = 2;
-            std::vector<std::uint8_t> is_in;
+            // Values of result.deps_ are enumerated like digits of a 
+            // mixed-radix number (the first dependency is the least 
+            // significant digit). Index of a conditional variable in A (B)
+            // changes by stride_a[j] (stride_b[j]) if the j-th digit is 
+            // incremented. The stride is 0 if A (B) does not depend on it.
+            const auto deps_count = result.deps_.size();
+            scratch_vector<std::size_t> radix(deps_count);
+            scratch_vector<std::size_t> stride_a(deps_count, 0);
+            scratch_vector<std::size_t> stride_b(deps_count, 0);
+            std::size_t size_a = 1;
+            std::size_t size_b = 1;
             auto left = deps_.begin();
             auto right = other.deps_.begin();
-            for (;;)
+            for (std::size_t j = 0; j < deps_count; ++j)
             {
-                if (left == deps_.end() && right == other.deps_.end())
-                {
-                    break;
-                }
-                else if (left == deps_.end())
+                auto&& var = result.deps_[j];
+                radix[j] = var->size();
+                if (left != deps_.end() && *left == var)
                 {
-                    is_in.push_back(B);
-                    ++right;
-                }
-                else if (right == other.deps_.end())
-                {
-                    is_in.push_back(A);
+                    stride_a[j] = size_a;
+                    size_a *= radix[j];
                     ++left;
                 }
-                else if (*left < *right)
+                if (right != other.deps_.end() && *right == var)
                 {
-                    is_in.push_back(A);
-                    ++left;
-                }
-                else if (*right < *left)
-                {
-                    is_in.push_back(B);
-                    ++right;
-                }
-                else // *right == *left 
-                {
-                    is_in.push_back(A | B);
-                    ++left;
+                    stride_b[j] = size_b;
+                    size_b *= radix[j];
                     ++right;
                 }
             }
 
-            assert(is_in.size() == result.deps_.size());
+            assert(left == deps_.end() && right == other.deps_.end());
 
-            // compute the conditional random variables
-            for (std::size_t i = 0; i < num_values; ++i)
+            // Compute the conditional random variables. They are 
+            // independent so ranges of them are computed in parallel.
+            result.vars_.resize(num_values);
+            thread_pool::for_each(num_values, [&](auto first, auto last)
             {
+                // find digits of the first index in the range
+                std::vector<std::size_t> digits(deps_count, 0);
                 std::size_t index_a = 0;
                 std::size_t index_b = 0;
+                auto rest = first;
+                for (std::size_t j = 0; j < deps_count; ++j)
+                {
+                    digits[j] = rest % radix[j];
+                    rest /= radix[j];
+                    index_a += digits[j] * stride_a[j];
+                    index_b += digits[j] * stride_b[j];
+                }
 
-                // find corresponding variables in both trees
-                std::size_t index_result = i;
-                std::size_t size_a = 1;
-                std::size_t size_b = 1;
-                for (std::size_t j = 0; j < result.deps_.size(); ++j)
+                for (auto i = first; i < last; ++i)
                 {
-                    auto&& var = result.deps_[j];
-                    auto var_values_count = var->size();
-                    if ((is_in[j] & A) != 0)
+                    cancellation::check_current();
+
+                    // combine corresponding variables in both trees
+                    result.vars_[i] = with_leaf(index_a, [&](auto&& var_a)
                     {
-                        index_a += (index_result % var_values_count) * size_a;
-                        size_a *= var_values_count;
-                    }
-                    if ((is_in[j] & B) != 0)
+                        return other.with_leaf(index_b, [&](auto&& var_b)
+                        {
+                            return combination(var_a, var_b);
+                        });
+                    });
+
+                    // move to the next value of the deps_ vector
+                    for (std::size_t j = 0; j < deps_count; ++j)
                     {
-                        index_b += (index_result % var_values_count) * size_b;
-                        size_b *= var_values_count;
+                        index_a += stride_a[j];
+                        index_b += stride_b[j];
+                        if (++digits[j] < radix[j])
+                            break;
+
+                        digits[j] = 0;
+                        index_a -= stride_a[j] * radix[j];
+                        index_b -= stride_b[j] * radix[j];
                     }
-                    index_result /= var_values_count;
                 }
+            });
 
-                // combine them
-                result.vars_.push_back(
-                    combination(vars_[index_a], other.vars_[index_b]));
-            }
-
+            result.compact();
             return result;
         }
 
@@ -493,12 +760,33 @@ namespace dice
          */
         var_type to_random_variable() const 
         {
-            var_type result;
-            for (auto it = begin(); it != end(); ++it)
+            return marginal();
+        }
+
+        /** @brief Get distribution of this random variable.
+         *
+         * It is computed on the first call and cached. The cache is shared
+         * by copies of this decomposition (so that e.g. the sampling table
+         * of a variable is not rebuilt whenever the variable is used). It 
+         * is safe to call this concurrently (the distribution may be 
+         * computed more than once in that case).
+         * 
+         * @return plain random variable
+         */
+        const var_type& marginal() const
+        {
+            auto result = std::atomic_load(&marginal_);
+            if (result == nullptr)
             {
-                result.add_probability(it->first, it->second);
+                auto value = std::make_shared<const var_type>(
+                    compute_marginal());
+                if (std::atomic_compare_exchange_strong(
+                    &marginal_, &result, value))
+                {
+                    result = value;
+                }
             }
-            return result;
+            return *result;
         }
 
         /** @brief Check whether this decomposition depends on other random 
@@ -515,21 +803,37 @@ namespace dice
          *
          * Random variables in leafs (in the vars_ list) are made constants.
          * This makes them independent at the cost of adding new dependencies
-         * and thus increasing the size.
+         * and thus increasing the size. Leafs are pruned first (see the 
+         * pruning class) so that the size does not grow because of values 
+         * with negligible probability. The constants are stored in the 
+         * compact leaf buffer (see leaf_buffer).
          * 
          * @return new decomposition
          */
         auto compute_decomposition() const
         {
+            budget::check_current(decomposition_cost());
+
             decomposition result;
             result.deps_ = deps_;
 
-            std::vector<
-                typename std::unordered_map<
-                    ValueType, ProbabilityType>::const_iterator> state;
+            std::vector<var_type> leaves(leaf_count());
+            thread_pool::for_each(leaf_count(), [&](auto first, auto last)
+            {
+                for (auto i = first; i < last; ++i)
+                {
+                    cancellation::check_current();
+                    leaves[i] = with_leaf(i, [](auto&& var)
+                    {
+                        return var.pruned();
+                    });
+                }
+            });
+
+            std::vector<typename var_type::const_iterator> state;
 
             // add new dependencies
-            for (auto&& var : vars_)
+            for (auto&& var : leaves)
             {
                 if (!var.is_constant())
                 {
@@ -546,27 +850,219 @@ namespace dice
             }
             
             // add values
+            result.compact_.reserve(num_values, num_values);
             for (std::size_t i = 0; i < num_values / state.size(); ++i)
             {
+                if (i % check_interval == 0)
+                {
+                    cancellation::check_current();
+                }
+
                 for (std::size_t j = 0; j < state.size(); ++j)
                 { 
-                    result.vars_.emplace_back(constant_tag{}, state[j]->first);
+                    result.compact_.push_constant(state[j]->first);
                 }
 
                 // update state
                 for (std::size_t j = 0; j < state.size(); ++j)
                 {
                     ++state[j];
-                    if (state[j] != vars_[j].end())
+                    if (state[j] != leaves[j].end())
                     {
                         break;
                     }
-                    state[j] = vars_[j].begin();
+                    state[j] = leaves[j].begin();
+                }
+            }
+            return result;
+        }
+
+        /** @brief Estimate size of the result of combine().
+         *
+         * The number of leafs is exact. The number of values in a leaf of
+         * the result is estimated as a sum of average leaf sizes of the 
+         * operands (which is exact for a sum of constants).
+         *
+         * @param other random variable B
+         *
+         * @return estimated size of the result
+         */
+        cost combine_cost(const decomposition& other) const
+        {
+            cost result;
+            if (other.deps_.empty() && other.leaf_count() == 1)
+            {
+                result.leaf_count = leaf_count();
+            }
+            else if (deps_.empty() && leaf_count() == 1)
+            {
+                result.leaf_count = other.leaf_count();
+            }
+            else 
+            {
+                result.leaf_count = count_values(
+                    sorted_union(deps_, other.deps_));
+            }
+
+            auto leaf_size = cost::add(
+                average_leaf_size(), 
+                other.average_leaf_size());
+            auto leaf_bytes = cost::add(
+                sizeof(var_type), 
+                cost::multiply(leaf_size, value_bytes));
+            result.bytes = cost::multiply(result.leaf_count, leaf_bytes);
+            return result;
+        }
+
+        /** @brief Estimate size of the result of compute_decomposition().
+         *
+         * Pruning is not taken into account so this is an upper bound.
+         *
+         * @return estimated size of the result
+         */
+        cost decomposition_cost() const
+        {
+            cost result;
+            result.leaf_count = count_values(deps_);
+
+            std::size_t dep_bytes = 0;
+            for (std::size_t i = 0; i < leaf_count(); ++i)
+            {
+                std::size_t size = 0;
+                auto lower_bound = std::numeric_limits<value_type>::max();
+                auto upper_bound = std::numeric_limits<value_type>::lowest();
+                leaf_bounds(i, lower_bound, upper_bound, size);
+                if (size <= 1)
+                    continue;
+
+                // each non-constant leaf becomes a new dependency
+                result.leaf_count = cost::multiply(result.leaf_count, size);
+                dep_bytes = cost::add(
+                    dep_bytes, 
+                    sizeof(var_type) + size * value_bytes);
+            }
+
+            // the result is stored in the leaf_buffer
+            result.bytes = cost::add(
+                dep_bytes,
+                cost::multiply(
+                    result.leaf_count, 
+                    value_bytes + sizeof(std::size_t)));
+            return result;
+        }
+
+        /** @brief Sum a dependency out of this decomposition.
+         *
+         * Leafs which differ only in the value of the dependency are 
+         * merged into a mixture weighted by probabilities of its values.
+         * Distribution of the result is the same. The result no longer 
+         * depends on the variable so it won't be correlated with other 
+         * values (or itself) through it.
+         *
+         * @param index of the dependency (see dependency_count)
+         *
+         * @return new decomposition with 1 less dependency
+         */
+        decomposition marginalize(std::size_t index) const
+        {
+            assert(index < deps_.size());
+
+            decomposition result;
+            for (std::size_t j = 0; j < deps_.size(); ++j)
+            {
+                if (j != index)
+                {
+                    result.deps_.push_back(deps_[j]);
                 }
             }
+
+            // leaf i = low + k * stride + high * stride * radix where k is
+            // the index of a value of the removed dependency
+            auto&& dep = deps_[index].variable();
+            const auto radix = dep.size();
+            std::size_t stride = 1;
+            for (std::size_t j = 0; j < index; ++j)
+            {
+                stride *= deps_[j]->size();
+            }
+
+            std::vector<probability_type> weights;
+            for (auto&& pair : dep)
+            {
+                weights.push_back(pair.second);
+            }
+
+            result.vars_.resize(leaf_count() / radix);
+            thread_pool::for_each(
+                result.vars_.size(), 
+                [&](auto first, auto last)
+            {
+                for (auto i = first; i < last; ++i)
+                {
+                    auto base = i % stride + (i / stride) * stride * radix;
+                    result.vars_[i] = mixture(
+                        base, 
+                        stride, 
+                        weights, 
+                        dep.discarded_probability());
+                }
+            });
+            result.compact();
             return result;
         }
 
+        /** @brief Sum out dependencies which are not shared.
+         *
+         * A dependency is not shared if no other decomposition depends on 
+         * it (e.g., the variable it has been created for was redefined).
+         * It can still correlate this value with itself. Thus this is 
+         * only valid if the result is not combined with itself (or if it
+         * is decomposed again).
+         *
+         * @return new decomposition without unshared dependencies
+         */
+        decomposition marginalize_unshared() const
+        {
+            std::vector<std::size_t> unshared;
+            for (std::size_t j = 0; j < deps_.size(); ++j)
+            {
+                if (deps_[j].use_count() <= 1)
+                {
+                    unshared.push_back(j);
+                }
+            }
+
+            // remove them from the last one so that indices don't change
+            auto result = *this;
+            for (auto it = unshared.rbegin(); it != unshared.rend(); ++it)
+            {
+                result = result.marginalize(*it);
+            }
+            return result;
+        }
+
+        /** @brief Get number of dependencies.
+         *
+         * @return number of variables on which this variable depends
+         */
+        std::size_t dependency_count() const
+        {
+            return deps_.size();
+        }
+
+        /** @brief Count dependencies which are not shared.
+         *
+         * @return number of dependencies on which no other 
+         *         decomposition depends
+         */
+        std::size_t unshared_dependencies() const
+        {
+            return static_cast<std::size_t>(std::count_if(
+                deps_.begin(), 
+                deps_.end(), 
+                [](auto&& dep) { return dep.use_count() <= 1; }));
+        }
+
         /** @brief Check whether this is exactly equal to other decomposition.
          *
          * @attention This test is exact and expensive. It is mainly provided 
@@ -577,12 +1073,20 @@ namespace dice
          */
         bool operator==(const decomposition& other) const
         {
-            return deps_ == other.deps_ && vars_ == other.vars_;
+            if (deps_ != other.deps_ || leaf_count() != other.leaf_count())
+                return false;
+
+            for (std::size_t i = 0; i < leaf_count(); ++i)
+            {
+                if (leaf(i) != other.leaf(i))
+                    return false;
+            }
+            return true;
         }
 
         bool operator!=(const decomposition& other) const
         {
-            return deps_ != other.deps_ || vars_ != other.vars_; 
+            return !operator==(other);
         }
 
         // Container interface
@@ -599,13 +1103,136 @@ namespace dice
 
         std::size_t size() const
         {
-            return vars_.size();
+            return leaf_count();
+        }
+
+        /** @brief Get number of values in all leafs.
+         *
+         * @return sum of the number of values of each leaf
+         */
+        std::size_t value_count() const
+        {
+            if (is_compact())
+                return compact_.last(compact_.size() - 1);
+
+            std::size_t count = 0;
+            for (auto&& var : vars_)
+            {
+                count += var.size();
+            }
+            return count;
+        }
+
+        /** @brief Compute memory used by this decomposition.
+         *
+         * It includes leafs, the marginal distribution (if it has been 
+         * computed) and dependencies. Dependencies are shared with other
+         * decompositions but they are counted in each of them (so that the
+         * result is an upper bound of memory which is freed if this is the
+         * last decomposition which uses them).
+         *
+         * @return number of bytes
+         */
+        std::size_t memory_usage() const
+        {
+            std::size_t result = sizeof(*this);
+            result += deps_.capacity() * sizeof(var_ptr);
+            for (auto&& dep : deps_)
+            {
+                result += dep.memory_usage();
+            }
+
+            result += vars_.capacity() * sizeof(var_type);
+            for (auto&& var : vars_)
+            {
+                result += var.memory_usage() - sizeof(var_type);
+            }
+            result += compact_.memory_usage();
+
+            auto marginal = std::atomic_load(&marginal_);
+            if (marginal != nullptr)
+            {
+                result += marginal->memory_usage();
+            }
+            return result;
+        }
+
+        /** @brief Check whether leafs are stored in the compact buffer.
+         *
+         * @return true iff leafs are in the leaf_buffer
+         */
+        bool is_compact() const
+        {
+            return !compact_.empty();
         }
 
         // for debugging only
-        auto& variables_internal() { return vars_; }
-        auto& dependencies_internal() { return deps_; }
+        auto& variables_internal()
+        {
+            marginal_.reset();
+            expand();
+            return vars_;
+        }
+
+        auto& dependencies_internal()
+        {
+            marginal_.reset();
+            return deps_;
+        }
     private:
+        /** @brief Compute distribution of this random variable.
+         *
+         * @return plain random variable
+         */
+        var_type compute_marginal() const
+        {
+            var_type result;
+
+            // find range of the result so we can choose its storage
+            auto lower_bound = std::numeric_limits<value_type>::max();
+            auto upper_bound = std::numeric_limits<value_type>::lowest();
+            std::size_t count = 0;
+            for (std::size_t i = 0; i < leaf_count(); ++i)
+            {
+                leaf_bounds(i, lower_bound, upper_bound, count);
+            }
+
+            if (count == 0)
+            {
+                return result;
+            }
+
+            result.init_storage(lower_bound, upper_bound, count);
+            if (leaf_count() < thread_pool::min_parallel_size)
+            {
+                fold([&](auto&& value, auto&& probability)
+                {
+                    result.add_probability(value, probability);
+                });
+            }
+            else 
+            {
+                add_leaf_blocks(result, lower_bound, upper_bound, count);
+            }
+
+            // upper bound of the probability removed by pruning
+            for (auto&& dep : deps_)
+            {
+                result.discarded_ += dep->discarded_probability();
+            }
+
+            probability_type leaf_discarded = 0;
+            for (auto&& var : vars_)
+            {
+                leaf_discarded = std::max(
+                    leaf_discarded, 
+                    var.discarded_probability());
+            }
+            result.discarded_ += leaf_discarded;
+            result.normalize();
+            return result;
+        }
+
         struct var_ptr
         {
             using value_type = std::pair<std::size_t, var_type>;
@@ -640,11 +1267,26 @@ namespace dice
                 return data_->second;
             }
 
+            // memory of the shared pair (including its reference counters)
+            std::size_t memory_usage() const
+            {
+                if (data_ == nullptr)
+                    return 0;
+                return sizeof(value_type) + 2 * sizeof(long) + 
+                    variable().memory_usage() - sizeof(var_type);
+            }
+
             std::size_t id() const
             {
                 return data_ == nullptr ? 0 : data_->first;
             }
 
+            // number of pointers to this variable
+            std::size_t use_count() const
+            {
+                return static_cast<std::size_t>(data_.use_count());
+            }
+
             const var_type* get() const
             {
                 return &variable();
@@ -678,9 +1320,429 @@ namespace dice
             }
         private:
             pointer_type data_;
-            static std::size_t counter_;
+            // ids are unique even if variables are created concurrently
+            static std::atomic<std::size_t> counter_;
+        };
+
+        /** @brief Flat storage of small leafs.
+         *
+         * Leafs after compute_decomposition() are constants. Storing each of
+         * them in a random_variable costs a heap allocation and a lot more 
+         * memory than the value itself. This buffer stores values and 
+         * probabilities of all leafs in 2 shared arrays. Values of the i-th
+         * leaf are at positions [offsets_[i], offsets_[i + 1]).
+         */
+        class leaf_buffer
+        {
+        public:
+            leaf_buffer() : offsets_({ 0 }) {}
+
+            /** @brief Get number of leafs.
+             *
+             * @return number of leafs in this buffer
+             */
+            std::size_t size() const
+            {
+                return offsets_.size() - 1;
+            }
+
+            bool empty() const
+            {
+                return size() == 0;
+            }
+
+            /** @brief Get memory of the arrays of this buffer.
+             *
+             * @return number of allocated bytes
+             */
+            std::size_t memory_usage() const
+            {
+                return values_.capacity() * sizeof(value_type) +
+                    probabilities_.capacity() * sizeof(probability_type) +
+                    offsets_.capacity() * sizeof(std::size_t);
+            }
+
+            /** @brief Allocate memory for leafs.
+             *
+             * @param leaf_count expected number of leafs
+             * @param value_count expected number of values in all leafs
+             */
+            void reserve(std::size_t leaf_count, std::size_t value_count)
+            {
+                offsets_.reserve(leaf_count + 1);
+                values_.reserve(value_count);
+                probabilities_.reserve(value_count);
+            }
+
+            /** @brief Append a leaf.
+             *
+             * @param var distribution of the leaf
+             */
+            void push_back(const var_type& var)
+            {
+                for (auto&& pair : var)
+                {
+                    values_.push_back(pair.first);
+                    probabilities_.push_back(pair.second);
+                }
+                offsets_.push_back(values_.size());
+            }
+
+            /** @brief Append a constant leaf.
+             *
+             * @param value of the constant
+             */
+            void push_constant(const value_type& value)
+            {
+                values_.push_back(value);
+                probabilities_.push_back(1);
+                offsets_.push_back(values_.size());
+            }
+
+            /** @brief Multiply all values with -1.
+             *
+             * Values in each leaf are reversed so that they are in the 
+             * same order as values of a negated random_variable.
+             */
+            void negate()
+            {
+                for (std::size_t i = 0; i < size(); ++i)
+                {
+                    std::reverse(
+                        values_.begin() + first(i), 
+                        values_.begin() + last(i));
+                    std::reverse(
+                        probabilities_.begin() + first(i), 
+                        probabilities_.begin() + last(i));
+                }
+
+                for (auto&& value : values_)
+                {
+                    value = -value;
+                }
+            }
+
+            // position of the first value of a leaf
+            std::size_t first(std::size_t leaf) const
+            {
+                return offsets_[leaf];
+            }
+
+            // position after the last value of a leaf
+            std::size_t last(std::size_t leaf) const
+            {
+                return offsets_[leaf + 1];
+            }
+
+            const value_type& value(std::size_t position) const
+            {
+                return values_[position];
+            }
+
+            const probability_type& probability(std::size_t position) const
+            {
+                return probabilities_[position];
+            }
+        private:
+            std::vector<value_type> values_;
+            std::vector<probability_type> probabilities_;
+            std::vector<std::size_t> offsets_;
         };
 
+        /** Maximal number of values of a leaf stored in the leaf_buffer. */
+        static const std::size_t max_compact_leaf_size = 4;
+
+        /** Number of constant leafs appended between cancellation checks. */
+        static const std::size_t check_interval = 4096;
+
+        /** @brief Add weighted leafs to the marginal distribution.
+         *
+         * Leafs are split into a fixed number of blocks. Each block is 
+         * added to its own partial distribution (in parallel if there is a
+         * thread pool) and the partial distributions are added in order. 
+         * Thus the result does not depend on the number of threads.
+         *
+         * @param result distribution with initialized storage
+         * @param lower_bound of values in leafs
+         * @param upper_bound of values in leafs
+         * @param count number of values in leafs
+         */
+        void add_leaf_blocks(
+            var_type& result,
+            const value_type& lower_bound,
+            const value_type& upper_bound,
+            std::size_t count) const
+        {
+            const std::size_t block_count = 16;
+
+            std::vector<var_type> partial(block_count);
+            auto add_blocks = [&](std::size_t first, std::size_t last)
+            {
+                for (auto block = first; block < last; ++block)
+                {
+                    auto&& dist = partial[block];
+                    dist.init_storage(lower_bound, upper_bound, count);
+                    fold(
+                        leaf_count() * block / block_count,
+                        leaf_count() * (block + 1) / block_count,
+                        [&](auto&& value, auto&& probability)
+                    {
+                        dist.add_probability(value, probability);
+                    });
+                }
+            };
+
+            auto pool = thread_pool::current();
+            if (pool != nullptr)
+            {
+                pool->parallel_for(block_count, add_blocks);
+            }
+            else 
+            {
+                add_blocks(0, block_count);
+            }
+
+            for (auto&& dist : partial)
+            {
+                for (auto&& pair : dist)
+                {
+                    result.add_probability(pair.first, pair.second);
+                }
+            }
+        }
+
+        /** @brief Compute a mixture of leafs.
+         *
+         * @param first index of the first leaf
+         * @param stride distance of consecutive leafs
+         * @param weights of the leafs
+         * @param discarded probability of the weights (see pruning)
+         *
+         * @return sum of weights[k] * leaf (first + k * stride)
+         */
+        var_type mixture(
+            std::size_t first,
+            std::size_t stride,
+            const std::vector<probability_type>& weights,
+            probability_type discarded) const
+        {
+            var_type result;
+
+            auto lower_bound = std::numeric_limits<value_type>::max();
+            auto upper_bound = std::numeric_limits<value_type>::lowest();
+            std::size_t count = 0;
+            probability_type leaf_discarded = 0;
+            for (std::size_t k = 0; k < weights.size(); ++k)
+            {
+                auto leaf = first + k * stride;
+                leaf_bounds(leaf, lower_bound, upper_bound, count);
+                if (!is_compact())
+                {
+                    leaf_discarded = std::max(
+                        leaf_discarded, 
+                        vars_[leaf].discarded_probability());
+                }
+            }
+
+            if (count == 0)
+            {
+                return result;
+            }
+
+            result.init_storage(lower_bound, upper_bound, count);
+            for (std::size_t k = 0; k < weights.size(); ++k)
+            {
+                auto leaf = first + k * stride;
+                for_each_value(leaf, [&](auto&& value, auto&& prob)
+                {
+                    result.add_probability(value, prob * weights[k]);
+                });
+            }
+            result.discarded_ = discarded + leaf_discarded;
+            result.normalize();
+            return result;
+        }
+
+        /** Estimated memory of 1 value of a leaf in bytes. */
+        static const std::size_t value_bytes = 
+            sizeof(value_type) + sizeof(probability_type);
+
+        /** @brief Compute number of values of a vector of dependencies.
+         *
+         * @param deps list of dependencies
+         *
+         * @return saturated product of sizes of the dependencies
+         */
+        static std::size_t count_values(const std::vector<var_ptr>& deps)
+        {
+            std::size_t result = 1;
+            for (auto&& dep : deps)
+            {
+                result = cost::multiply(result, dep->size());
+            }
+            return result;
+        }
+
+        // average number of values of a leaf (rounded up)
+        std::size_t average_leaf_size() const
+        {
+            if (leaf_count() == 0)
+                return 0;
+            return (value_count() + leaf_count() - 1) / leaf_count();
+        }
+
+        // number of leafs (conditional variables)
+        std::size_t leaf_count() const
+        {
+            return is_compact() ? compact_.size() : vars_.size();
+        }
+
+        /** @brief Get distribution of a leaf.
+         *
+         * @param index of the leaf
+         *
+         * @return copy of the leaf (a new variable for compact leafs)
+         */
+        var_type leaf(std::size_t index) const
+        {
+            if (!is_compact())
+                return vars_[index];
+
+            var_type result;
+            auto lower_bound = std::numeric_limits<value_type>::max();
+            auto upper_bound = std::numeric_limits<value_type>::lowest();
+            std::size_t count = 0;
+            leaf_bounds(index, lower_bound, upper_bound, count);
+            if (count == 0)
+                return result;
+
+            result.init_storage(lower_bound, upper_bound, count);
+            for_each_value(index, [&](auto&& value, auto&& prob)
+            {
+                result.add_probability(value, prob);
+            });
+            result.normalize_storage();
+            return result;
+        }
+
+        /** @brief Call a function with a leaf.
+         *
+         * Compact leafs are converted to a random_variable first. Other 
+         * leafs are not copied.
+         *
+         * @param index of the leaf
+         * @param function called with the leaf
+         *
+         * @return value returned by the function
+         */
+        template<typename Function>
+        auto with_leaf(std::size_t index, Function&& function) const
+        {
+            if (is_compact())
+                return function(leaf(index));
+            return function(vars_[index]);
+        }
+
+        /** @brief Call a function with each value of a leaf.
+         *
+         * @param index of the leaf
+         * @param function called with a value and its probability
+         */
+        template<typename Function>
+        void for_each_value(std::size_t index, Function&& function) const
+        {
+            if (is_compact())
+            {
+                auto last = compact_.last(index);
+                for (auto i = compact_.first(index); i < last; ++i)
+                {
+                    function(compact_.value(i), compact_.probability(i));
+                }
+                return;
+            }
+
+            for (auto&& pair : vars_[index])
+            {
+                function(pair.first, pair.second);
+            }
+        }
+
+        /** @brief Extend a range of values by values of a leaf.
+         *
+         * @param index of the leaf
+         * @param lower_bound minimal value (updated)
+         * @param upper_bound maximal value (updated)
+         * @param count number of values (updated)
+         */
+        void leaf_bounds(
+            std::size_t index, 
+            value_type& lower_bound, 
+            value_type& upper_bound, 
+            std::size_t& count) const
+        {
+            if (is_compact())
+            {
+                auto last = compact_.last(index);
+                for (auto i = compact_.first(index); i < last; ++i)
+                {
+                    lower_bound = std::min(lower_bound, compact_.value(i));
+                    upper_bound = std::max(upper_bound, compact_.value(i));
+                    ++count;
+                }
+                return;
+            }
+
+            auto&& var = vars_[index];
+            if (var.empty())
+                return;
+            lower_bound = std::min(lower_bound, var.min_value());
+            upper_bound = std::max(upper_bound, var.max_value());
+            count += var.size();
+        }
+
+        /** @brief Move leafs to the leaf_buffer if all of them are small.
+         *
+         * Leafs with a pruned probability are kept in vars_ so that the 
+         * probability is not lost.
+         */
+        void compact()
+        {
+            if (vars_.empty())
+                return;
+
+            std::size_t count = 0;
+            for (auto&& var : vars_)
+            {
+                if (var.empty() || 
+                    var.size() > max_compact_leaf_size ||
+                    var.discarded_probability() > 0)
+                    return;
+                count += var.size();
+            }
+
+            compact_.reserve(vars_.size(), count);
+            for (auto&& var : vars_)
+            {
+                compact_.push_back(var);
+            }
+            vars_.clear();
+            vars_.shrink_to_fit();
+        }
+
+        /** @brief Move leafs from the leaf_buffer to vars_. */
+        void expand()
+        {
+            if (!is_compact())
+                return;
+
+            vars_.reserve(compact_.size());
+            for (std::size_t i = 0; i < compact_.size(); ++i)
+            {
+                vars_.push_back(leaf(i));
+            }
+            compact_ = leaf_buffer{};
+        }
+
         var_ptr make_variable_ptr(var_type var) const
         {
             return var_ptr{ std::move(var) };
@@ -706,12 +1768,22 @@ namespace dice
          * -# A | X = 2, Y = 1 
          * -# A | X = 1, Y = 2 
          * -# A | X = 2, Y = 2
+         *
+         * It is empty if the leafs are stored in compact_.
          */
         std::vector<var_type> vars_;
+
+        /** Leafs in the compact representation (in the same order as in 
+         * vars_). It is empty if the leafs are stored in vars_.
+         */
+        leaf_buffer compact_;
+
+        /** Lazily computed distribution (see marginal()). */
+        mutable std::shared_ptr<const var_type> marginal_;
     };
 
     template<typename T, typename U>
-    std::size_t decomposition<T, U>::var_ptr::counter_ = 1;
+    std::atomic<std::size_t> decomposition<T, U>::var_ptr::counter_{ 1 };
 
     /** @brief Decompositon value iterator.
      *
@@ -732,7 +1804,7 @@ namespace dice
         {
             if (is_end)
             {
-                leaf_it_ = leaf_end();
+                leaf_ = leaf_end();
                 return;
             }
 
@@ -743,10 +1815,10 @@ namespace dice
             }
 
             // initialzie leaf and value iterators
-            leaf_it_ = decomposition_->vars_.begin();
-            if (leaf_it_ != leaf_end())
+            leaf_ = 0;
+            if (leaf_ != leaf_end())
             {
-                value_it_ = leaf_it_->begin();
+                start_leaf();
             }
 
             // precompute first value
@@ -762,14 +1834,25 @@ namespace dice
         decomposition_iterator& operator++()
         {
             // move to the next value in current leaf node
-            ++value_it_;
-            if (value_it_ == leaf_it_->end())
+            bool is_leaf_end; 
+            if (decomposition_->is_compact())
+            {
+                ++position_;
+                is_leaf_end = position_ == decomposition_->compact_.last(leaf_);
+            }
+            else 
+            {
+                ++value_it_;
+                is_leaf_end = value_it_ == decomposition_->vars_[leaf_].end();
+            }
+
+            if (is_leaf_end)
             {
                 // move to the next leaf node
-                ++leaf_it_;
-                if (leaf_it_ != leaf_end())
+                ++leaf_;
+                if (leaf_ != leaf_end())
                 {
-                    value_it_ = leaf_it_->begin();
+                    start_leaf();
                 }
 
                 // move inner node iterators
@@ -815,10 +1898,12 @@ namespace dice
          */
         bool operator==(const decomposition_iterator& other) const
         {
-            if (leaf_it_ == other.leaf_it_)
+            if (leaf_ == other.leaf_)
             {
-                if (leaf_it_ == leaf_end())
+                if (leaf_ == leaf_end())
                     return true;
+                if (decomposition_->is_compact())
+                    return position_ == other.position_;
                 return value_it_ == other.value_it_;
             }
             return false;
@@ -830,18 +1915,18 @@ namespace dice
         }
     private:
         using rand_var = random_variable<ValueType, ProbabilityType>;
-        using var_iterator = typename std::vector<rand_var>::const_iterator;
-        using value_iterator = 
-            typename std::unordered_map<ValueType, ProbabilityType>::const_iterator;
+        using value_iterator = typename rand_var::const_iterator;
 
         // current decomposition object pointer
         const decomposition_type* decomposition_;
         // inner node value iterators
         std::vector<value_iterator> inner_it_;
-        // leaf node variable iterator
-        var_iterator leaf_it_;
-        // value in this variable
+        // index of the leaf node
+        std::size_t leaf_ = 0;
+        // value in this variable (if leafs are not compact)
         value_iterator value_it_;
+        // position of the value in the leaf buffer (if leafs are compact)
+        std::size_t position_ = 0;
         // current value
         value_type current_value_;
 
@@ -855,17 +1940,41 @@ namespace dice
             return decomposition_->deps_[index]->begin();
         }
 
-        auto leaf_end() const
+        std::size_t leaf_end() const
         {
-            return decomposition_->vars_.cend();
+            return decomposition_->leaf_count();
+        }
+
+        // move to the first value of current leaf
+        void start_leaf()
+        {
+            if (decomposition_->is_compact())
+            {
+                position_ = decomposition_->compact_.first(leaf_);
+            }
+            else 
+            {
+                value_it_ = decomposition_->vars_[leaf_].begin();
+            }
         }
 
         void precompute_value()
         {
-            if (leaf_it_ == leaf_end())
+            if (leaf_ == leaf_end())
                 return;
 
-            current_value_ = *value_it_;
+            if (decomposition_->is_compact())
+            {
+                auto&& leafs = decomposition_->compact_;
+                current_value_ = std::make_pair(
+                    leafs.value(position_), 
+                    leafs.probability(position_));
+            }
+            else 
+            {
+                current_value_ = *value_it_;
+            }
+
             for (auto&& it : inner_it_)
             {
                 current_value_.second *= it->second;
@@ -5,8 +5,10 @@
 #include <memory>
 #include <sstream>
 #include <cassert>
+#include <functional>
 
 #include "value.hpp"
+#include "lexer.hpp"
 #include "symbols.hpp"
 #include "environment.hpp"
 
@@ -26,13 +28,39 @@ namespace dice
         using value_type = std::unique_ptr<base_value>;
         using value_list = std::vector<value_type>;
 
-        explicit direct_interpreter(Environment* env) : env_(env) {}
+        explicit direct_interpreter(Environment* env) : 
+            env_(env),
+            add_id_(env->find_function("+")),
+            sub_id_(env->find_function("-")),
+            mult_id_(env->find_function("*")),
+            div_id_(env->find_function("/")),
+            unary_minus_id_(env->find_function("unary-")),
+            in_id_(env->find_function("in")),
+            roll_id_(env->find_function("roll_op")) {}
 
         void enter_assign()
         {
             is_definition_ = true;
         }
 
+        /** @brief Check whether a definition is being evaluated.
+         *
+         * @return true iff enter_assign has been called and the value has
+         *         not been assigned yet
+         */
+        bool is_definition() const
+        {
+            return is_definition_;
+        }
+
+        /** @brief Set location of the next operation.
+         *
+         * Errors are reported by the parser so the location is not used.
+         *
+         * @param location of the operator in the input
+         */
+        void set_location(const lexer_location&) {}
+
         /** @brief Create a new default value.
          *
          * This is used when there is a parsing error.
@@ -91,7 +119,7 @@ namespace dice
         value_type add(value_type left, value_type right)
         {
             prepare_operands(left.get(), right.get());
-            return env_->call("+", std::move(left), std::move(right));
+            return env_->call(add_id_, std::move(left), std::move(right));
         }
 
         /** @brief Subtract right hand side from the left hand side.
@@ -109,7 +137,7 @@ namespace dice
         value_type sub(value_type left, value_type right)
         {
             prepare_operands(left.get(), right.get());
-            return env_->call("-", std::move(left), std::move(right));
+            return env_->call(sub_id_, std::move(left), std::move(right));
         }
 
         /** @brief Multiply left hand side with the right hand side
@@ -127,7 +155,7 @@ namespace dice
         value_type mult(value_type left, value_type right)
         {
             prepare_operands(left.get(), right.get());
-            return env_->call("*", std::move(left), std::move(right));
+            return env_->call(mult_id_, std::move(left), std::move(right));
         }
 
         /** @brief Divide left hand side with the right hand side
@@ -145,7 +173,7 @@ namespace dice
         value_type div(value_type left, value_type right)
         {
             prepare_operands(left.get(), right.get());
-            return env_->call("/", std::move(left), std::move(right));
+            return env_->call(div_id_, std::move(left), std::move(right));
         }
 
         /** @brief Negate value.
@@ -161,7 +189,7 @@ namespace dice
          */
         value_type unary_minus(value_type value)
         {
-            return env_->call("unary-", std::move(value));
+            return env_->call(unary_minus_id_, std::move(value));
         }
 
         /** @brief Compute a binary relational operator.
@@ -206,7 +234,7 @@ namespace dice
             value_type lower_bound, 
             value_type upper_bound)
         {
-            return env_->call("in", 
+            return env_->call(in_id_, 
                 std::move(value), 
                 std::move(lower_bound), 
                 std::move(upper_bound));
@@ -227,7 +255,7 @@ namespace dice
         value_type roll(value_type left, value_type right)
         {
             prepare_operands(left.get(), right.get());
-            return env_->call("roll_op", std::move(left), std::move(right));
+            return env_->call(roll_id_, std::move(left), std::move(right));
         }
 
         /** @brief Assing value to variable with given name.
@@ -251,11 +279,41 @@ namespace dice
                 throw compiler_error("Variable '" + name + "' redefinition.");
             }
 
+            env_->set_var(name, finish_definition(std::move(value)));
+            return nullptr;
+        }
+
+        /** @brief Prepare a computed value of a variable.
+         *
+         * It has to be called after the value of a definition (see 
+         * enter_assign) has been computed.
+         *
+         * @param value of the variable
+         *
+         * @return value which can be stored in the environment
+         */
+        value_type finish_definition(value_type value)
+        {
             decomposition_visitor decomp;
             value->accept(&decomp);
-            env_->set_var(name, std::move(value));
             is_definition_ = false;
-            return nullptr;
+            return value;
+        }
+
+        /** @brief Record how the value of a variable has been computed.
+         *
+         * See environment::set_definition.
+         *
+         * @param name of the variable
+         * @param inputs names of variables it has been computed from
+         * @param compute function which computes its value again
+         */
+        void set_definition(
+            const std::string& name,
+            std::vector<std::string> inputs,
+            std::function<value_type()> compute)
+        {
+            env_->set_definition(name, std::move(inputs), std::move(compute));
         }
 
         /** @brief Call a function with given arguments.
@@ -318,7 +376,17 @@ namespace dice
             return variable_redefinition_;
         }
     private:
+        using function_id = typename Environment::function_id;
+
         Environment* env_;
+        // ids of operator functions so that they are not looked up by name
+        function_id add_id_;
+        function_id sub_id_;
+        function_id mult_id_;
+        function_id div_id_;
+        function_id unary_minus_id_;
+        function_id in_id_;
+        function_id roll_id_;
         bool is_definition_ = false;
         bool variable_redefinition_ = false;
 
@@ -330,7 +398,16 @@ namespace dice
             inline void visit(type_real*) override {}
             inline void visit(type_rand_var* var) override
             {
-                var->data() = var->data().compute_decomposition();
+                try
+                {
+                    auto&& data = 
+                        static_cast<const type_rand_var*>(var)->data();
+                    *var = type_rand_var{ data.compute_decomposition() };
+                }
+                catch (budget_error& error)
+                {
+                    throw compiler_error{ error.what() };
+                }
             }
         };
 
@@ -342,7 +419,8 @@ namespace dice
             inline void visit(type_real*) override {}
             inline void visit(type_rand_var* var) override
             {
-                if (var->data().has_dependencies())
+                auto&& data = static_cast<const type_rand_var*>(var)->data();
+                if (data.has_dependencies())
                     ++counter_;
             }
 
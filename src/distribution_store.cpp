@@ -0,0 +1,296 @@
+#include "distribution_store.hpp"
+
+#include <cstring>
+#include <fstream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace
+{
+    const char magic[8] = { 'D', 'I', 'C', 'E', 'P', 'M', 'F', '\0' };
+    const std::size_t header_size = 16;
+    const std::size_t field_size = 8;
+
+    std::size_t padded(std::size_t size)
+    {
+        return (size + field_size - 1) & ~(field_size - 1);
+    }
+
+    template<typename T>
+    void write_field(std::string& output, T value)
+    {
+        static_assert(sizeof(T) == field_size, "Fields are 8 bytes long.");
+        output.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    template<typename T>
+    T read_field(const unsigned char* data)
+    {
+        T value;
+        std::memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    std::string make_header()
+    {
+        std::string result{ magic, sizeof(magic) };
+        write_field<std::uint64_t>(result, dice::distribution_store::version);
+        return result;
+    }
+}
+
+const std::uint64_t dice::distribution_store::version;
+
+dice::distribution_store::~distribution_store()
+{
+    close();
+}
+
+dice::distribution_store& dice::distribution_store::instance()
+{
+    static distribution_store store;
+    return store;
+}
+
+bool dice::distribution_store::open(const std::string& path)
+{
+    close();
+    path_ = path;
+    if (!map_file() || !read_index())
+    {
+        close();
+        return false;
+    }
+    is_open_ = true;
+    return true;
+}
+
+void dice::distribution_store::close()
+{
+    std::lock_guard<std::mutex> lock{ mutex_ };
+    unmap_file();
+    mapped_.clear();
+    saved_.clear();
+    is_open_ = false;
+}
+
+bool dice::distribution_store::find(
+    const std::string& key,
+    view& out_view) const
+{
+    if (!is_open_)
+        return false;
+
+    auto it = mapped_.find(key);
+    if (it != mapped_.end())
+    {
+        out_view = it->second;
+        return true;
+    }
+
+    std::lock_guard<std::mutex> lock{ mutex_ };
+    auto saved = saved_.find(key);
+    if (saved == saved_.end())
+        return false;
+    out_view = view{
+        saved->second.offset,
+        saved->second.probabilities.size(),
+        saved->second.discarded,
+        saved->second.probabilities.data()
+    };
+    return true;
+}
+
+void dice::distribution_store::insert(
+    const std::string& key,
+    std::int64_t offset,
+    std::vector<double> probabilities,
+    double discarded)
+{
+    if (!is_open_ || !is_writable_ || mapped_.find(key) != mapped_.end())
+        return;
+
+    std::string data;
+    write_field<std::uint64_t>(data, key.size());
+    data += key;
+    data.resize(padded(data.size()), '\0');
+    write_field<std::int64_t>(data, offset);
+    write_field<std::uint64_t>(data, probabilities.size());
+    write_field<double>(data, discarded);
+    data.append(
+        reinterpret_cast<const char*>(probabilities.data()),
+        probabilities.size() * sizeof(double));
+
+    std::lock_guard<std::mutex> lock{ mutex_ };
+    if (saved_.find(key) != saved_.end())
+        return;
+    if (append(data))
+    {
+        saved_.emplace(
+            key, 
+            entry{ offset, std::move(probabilities), discarded });
+    }
+}
+
+std::size_t dice::distribution_store::size() const
+{
+    std::lock_guard<std::mutex> lock{ mutex_ };
+    return mapped_.size() + saved_.size();
+}
+
+bool dice::distribution_store::read_index()
+{
+    if (data_size_ < header_size ||
+        std::memcmp(data_, magic, sizeof(magic)) != 0 ||
+        read_field<std::uint64_t>(data_ + sizeof(magic)) != version)
+        return false;
+
+    std::size_t position = header_size;
+    // entries after an incomplete entry (e.g., if a process has crashed
+    // while it was writing it) could not be read
+    is_writable_ = false;
+    while (data_size_ - position >= field_size)
+    {
+        auto key_size = read_field<std::uint64_t>(data_ + position);
+        auto remaining = data_size_ - position - field_size;
+        if (key_size > remaining ||
+            padded(key_size) > remaining ||
+            remaining - padded(key_size) < 3 * field_size)
+            break;
+
+        auto key = data_ + position + field_size;
+        auto fields = key + padded(key_size);
+        view entry{
+            read_field<std::int64_t>(fields),
+            read_field<std::uint64_t>(fields + field_size),
+            read_field<double>(fields + 2 * field_size),
+            reinterpret_cast<const double*>(fields + 3 * field_size)
+        };
+
+        remaining -= padded(key_size) + 3 * field_size;
+        if (entry.count > remaining / sizeof(double))
+            break;
+
+        mapped_.emplace(
+            std::string{ reinterpret_cast<const char*>(key), key_size },
+            entry);
+        position = static_cast<std::size_t>(
+            fields + 3 * field_size + entry.count * sizeof(double) - data_);
+    }
+    is_writable_ = position == data_size_;
+    return true;
+}
+
+#ifdef _WIN32
+
+// read a copy of the file (and create it if it does not exist)
+bool dice::distribution_store::map_file()
+{
+    {
+        std::ofstream create{ path_, std::ios::binary | std::ios::app };
+        if (!create)
+            return false;
+    }
+
+    std::ifstream input{ path_, std::ios::binary | std::ios::ate };
+    if (!input)
+        return false;
+    auto size = static_cast<std::size_t>(input.tellg());
+    if (size == 0)
+    {
+        if (!append(make_header()))
+            return false;
+        return map_file();
+    }
+
+    buffer_.assign((size + field_size - 1) / field_size, 0);
+    input.seekg(0);
+    input.read(reinterpret_cast<char*>(buffer_.data()), size);
+    data_ = reinterpret_cast<const unsigned char*>(buffer_.data());
+    data_size_ = size;
+    return static_cast<bool>(input);
+}
+
+void dice::distribution_store::unmap_file()
+{
+    buffer_.clear();
+    data_ = nullptr;
+    data_size_ = 0;
+}
+
+bool dice::distribution_store::append(const std::string& data)
+{
+    std::ofstream output{ path_, std::ios::binary | std::ios::app };
+    output.write(data.data(), data.size());
+    return static_cast<bool>(output);
+}
+
+#else
+
+bool dice::distribution_store::map_file()
+{
+    auto file = ::open(path_.c_str(), O_RDWR | O_CREAT, 0644);
+    if (file < 0)
+        return false;
+
+    // write the header of a new file (other processes might open it too)
+    struct stat info;
+    bool is_valid = flock(file, LOCK_EX) == 0 && fstat(file, &info) == 0;
+    if (is_valid && info.st_size == 0)
+    {
+        auto header = make_header();
+        is_valid = write(file, header.data(), header.size()) ==
+            static_cast<ssize_t>(header.size()) && fstat(file, &info) == 0;
+    }
+    flock(file, LOCK_UN);
+
+    if (is_valid && info.st_size > 0)
+    {
+        auto size = static_cast<std::size_t>(info.st_size);
+        auto data = mmap(nullptr, size, PROT_READ, MAP_SHARED, file, 0);
+        if (data != MAP_FAILED)
+        {
+            data_ = static_cast<const unsigned char*>(data);
+            data_size_ = size;
+        }
+    }
+    ::close(file);
+    return data_ != nullptr;
+}
+
+void dice::distribution_store::unmap_file()
+{
+    if (data_ != nullptr)
+    {
+        munmap(const_cast<unsigned char*>(data_), data_size_);
+    }
+    data_ = nullptr;
+    data_size_ = 0;
+}
+
+// append data to the file in 1 write (so that entries of 2 processes
+// don't interleave)
+bool dice::distribution_store::append(const std::string& data)
+{
+    auto file = ::open(path_.c_str(), O_WRONLY | O_APPEND);
+    if (file < 0)
+        return false;
+
+    bool is_written = false;
+    if (flock(file, LOCK_EX) == 0)
+    {
+        is_written = write(file, data.data(), data.size()) ==
+            static_cast<ssize_t>(data.size());
+        flock(file, LOCK_UN);
+    }
+    ::close(file);
+    return is_written;
+}
+
+#endif
@@ -0,0 +1,242 @@
+/**
+ * @file distribution_store.hpp
+ *
+ * File with distributions shared by processes.
+ */
+#ifndef DICE_DISTRIBUTION_STORE_HPP_
+#define DICE_DISTRIBUTION_STORE_HPP_
+
+#include <mutex>
+#include <string>
+#include <vector>
+#include <limits>
+#include <cstdint>
+#include <cstddef>
+#include <unordered_map>
+
+#include "random_variable.hpp"
+
+namespace dice
+{
+    /** @brief Persistent store of dense distributions.
+     *
+     * Distributions are saved to a file so that other processes (or later
+     * runs of the same program) don't have to compute them again. The file
+     * is mapped to memory when it is opened. Only headers of entries are
+     * read at that point. Probabilities are copied from the mapped memory
+     * when an entry is loaded.
+     *
+     * The file starts with a magic number and a version (a file with a
+     * different version is not used). Each entry is a sequence of 8-byte
+     * fields in native byte order: size of the key, the key (padded to 8
+     * bytes), the smallest value, number of values, probability removed
+     * by pruning and probabilities of consecutive values. New entries are
+     * appended to the file. Entries appended by other processes are only
+     * visible after the file is opened again.
+     *
+     * Keys have to identify the distribution including the configuration
+     * it has been computed with (e.g., the pruning policy). The load and 
+     * save functions add the precision of the probability type to the key
+     * (see typed_key) so that programs built with a different 
+     * probability type (see DICE_PROBABILITY) can share a file without 
+     * loading each other's entries. Probabilities are always saved in 
+     * double (i.e., long double probabilities are rounded). Loading and
+     * saving entries is thread safe. Opening or closing the store is not.
+     */
+    class distribution_store
+    {
+    public:
+        /** Version of the file format. */
+        static const std::uint64_t version = 1;
+
+        /** @brief Mapped distribution. */
+        struct view
+        {
+            // value whose probability is probabilities[0]
+            std::int64_t offset;
+            // number of probabilities
+            std::uint64_t count;
+            // probability removed by pruning
+            double discarded;
+            // probabilities of values offset, offset + 1, ...
+            const double* probabilities;
+        };
+
+        distribution_store() = default;
+        ~distribution_store();
+
+        distribution_store(const distribution_store&) = delete;
+        distribution_store& operator=(const distribution_store&) = delete;
+
+        /** @brief Get the process-wide store.
+         *
+         * It is closed until it is opened by the application.
+         *
+         * @return store shared by all caches
+         */
+        static distribution_store& instance();
+
+        /** @brief Open a file (it is created if it does not exist).
+         *
+         * The previous file is closed first.
+         *
+         * @param path of the file
+         *
+         * @return true iff the file can be used (false if it can't be
+         *         created or it has a different format)
+         */
+        bool open(const std::string& path);
+
+        /** @brief Close the file.
+         *
+         * Views returned by find are invalid afterwards.
+         */
+        void close();
+
+        /** @brief Check whether a file is open.
+         *
+         * @return true iff entries are loaded from and saved to a file
+         */
+        bool is_open() const
+        {
+            return is_open_;
+        }
+
+        /** @brief Find an entry.
+         *
+         * @param key of the distribution
+         * @param out_view found distribution (valid until close is called)
+         *
+         * @return true iff the entry has been found
+         */
+        bool find(const std::string& key, view& out_view) const;
+
+        /** @brief Append an entry to the file.
+         *
+         * Nothing is saved if the store is closed, the file is damaged or
+         * there already is an entry with the same key.
+         *
+         * @param key of the distribution
+         * @param offset value whose probability is probabilities[0]
+         * @param probabilities of consecutive values
+         * @param discarded probability removed by pruning
+         */
+        void insert(
+            const std::string& key,
+            std::int64_t offset,
+            std::vector<double> probabilities,
+            double discarded);
+
+        /** @brief Get number of entries.
+         *
+         * @return number of entries in the file and entries saved since
+         *         the file has been opened
+         */
+        std::size_t size() const;
+
+        /** @brief Get key of an entry with given probability type.
+         *
+         * @param key of the distribution
+         *
+         * @return key prefixed with the number of binary digits of 
+         *         ProbabilityType
+         */
+        template<typename ProbabilityType>
+        static std::string typed_key(const std::string& key)
+        {
+            return "p" + std::to_string(
+                std::numeric_limits<ProbabilityType>::digits) + " " + key;
+        }
+
+        /** @brief Load a random variable.
+         *
+         * The entry has to be saved with the same probability type.
+         *
+         * @param key of the distribution
+         * @param out_var loaded variable
+         *
+         * @return true iff the entry has been found
+         */
+        template<typename ValueType, typename ProbabilityType>
+        bool load(
+            const std::string& key,
+            random_variable<ValueType, ProbabilityType>& out_var) const
+        {
+            view entry;
+            if (!find(typed_key<ProbabilityType>(key), entry))
+                return false;
+
+            out_var = random_variable<ValueType, ProbabilityType>{
+                dense_tag{},
+                static_cast<ValueType>(entry.offset),
+                entry.probabilities,
+                entry.probabilities + entry.count,
+                static_cast<ProbabilityType>(entry.discarded)
+            };
+            return true;
+        }
+
+        /** @brief Save a random variable.
+         *
+         * Only variables which use the dense storage are saved (other
+         * variables would waste a lot of space in the file).
+         *
+         * @param key of the distribution
+         * @param var saved variable
+         */
+        template<typename ValueType, typename ProbabilityType>
+        void save(
+            const std::string& key,
+            const random_variable<ValueType, ProbabilityType>& var)
+        {
+            if (!is_open_ || !var.is_dense() || var.empty())
+                return;
+
+            auto offset = static_cast<std::int64_t>(var.min_value());
+            std::vector<double> probabilities(static_cast<std::size_t>(
+                static_cast<std::int64_t>(var.max_value()) - offset + 1), 0);
+            for (auto&& pair : var)
+            {
+                auto index = static_cast<std::int64_t>(pair.first) - offset;
+                probabilities[static_cast<std::size_t>(index)] =
+                    static_cast<double>(pair.second);
+            }
+            insert(
+                typed_key<ProbabilityType>(key),
+                offset,
+                std::move(probabilities),
+                static_cast<double>(var.discarded_probability()));
+        }
+    private:
+        struct entry
+        {
+            std::int64_t offset;
+            std::vector<double> probabilities;
+            double discarded;
+        };
+
+        bool is_open_ = false;
+        // false if the file ends with an incomplete entry
+        bool is_writable_ = false;
+        std::string path_;
+
+        // mapped file (or its copy if the platform can't map files)
+        const unsigned char* data_ = nullptr;
+        std::size_t data_size_ = 0;
+        std::vector<std::uint64_t> buffer_;
+
+        // entries of the file when it was opened
+        std::unordered_map<std::string, view> mapped_;
+
+        // entries saved since the file has been opened
+        mutable std::mutex mutex_;
+        std::unordered_map<std::string, entry> saved_;
+
+        bool map_file();
+        void unmap_file();
+        bool read_index();
+        bool append(const std::string& data);
+    };
+}
+
+#endif // DICE_DISTRIBUTION_STORE_HPP_
@@ -1,16 +1,87 @@
 #include "environment.hpp"
+#include "roll_cache.hpp"
+#include "profiler.hpp"
+
+#include <mutex>
+#include <limits>
 
 namespace 
 {
     using fn = dice::execution_context;
 
+    /** @brief Get data of an argument without modifying it.
+     *
+     * Random variables are shared by copies of a value (e.g., by all uses
+     * of a variable) so the data is not copied by read only access.
+     *
+     * @param context of the call
+     * @param index of the argument
+     *
+     * @return data of the argument
+     */
+    template<typename T>
+    const typename T::value_type& read(
+        fn::context_type& context, 
+        std::size_t index)
+    {
+        const T* value = context.arg<T>(index);
+        return value->data();
+    }
+
+    /** @brief Get data of an argument which can be modified in place.
+     *
+     * @param context of the call
+     * @param index of the argument
+     *
+     * @return data of the argument or nullptr if it is shared with other
+     *         values
+     */
+    template<typename T>
+    typename T::value_type* modifiable(
+        fn::context_type& context, 
+        std::size_t index)
+    {
+        auto value = context.arg<T>(index);
+        return value->is_shared() ? nullptr : std::addressof(value->data());
+    }
+
+    // number of values of a value (see profiler::counters)
+    std::size_t support_size(const dice::base_value* value)
+    {
+        auto var = dynamic_cast<const dice::type_rand_var*>(value);
+        if (var != nullptr)
+            return var->data().value_count();
+        return value == nullptr ? 0 : 1;
+    }
+
+    // check memory of a function result with the current budget
+    fn::return_type check_memory(fn::return_type value)
+    {
+        if (dice::budget::current() == nullptr)
+            return value;
+
+        auto var = dynamic_cast<const dice::type_rand_var*>(value.get());
+        if (var != nullptr)
+        {
+            dice::budget::record_usage_current(var->data().memory_usage());
+        }
+        return value;
+    }
+
+    // number of leafs of a decomposition (0 if value is not a variable)
+    std::size_t leaf_count(const dice::base_value* value)
+    {
+        auto var = dynamic_cast<const dice::type_rand_var*>(value);
+        return var == nullptr ? 0 : var->data().size();
+    }
+
     // functions implementation
 
     fn::return_type dice_expectation(fn::context_type& context)
     {
         using namespace dice;
         return make<type_real>(
-            context.arg<type_rand_var>(0)->data().expected_value()
+            read<type_rand_var>(context, 0).expected_value()
         );
     }
 
@@ -18,7 +89,7 @@ namespace
     {
         using namespace dice;
         return dice::make<type_real>(
-            context.arg<type_rand_var>(0)->data().variance()
+            read<type_rand_var>(context, 0).variance()
         );
     }
 
@@ -26,7 +97,7 @@ namespace
     {
         using namespace dice;
         return make<type_real>(
-            context.arg<type_rand_var>(0)->data().deviation()
+            read<type_rand_var>(context, 0).deviation()
         );
     }
 
@@ -34,63 +105,72 @@ namespace
     {
         using namespace dice;
         auto prob = dice::clamp(
-            context.arg<type_real>(1)->data(), 0.0, 1.0);
+            read<type_real>(context, 1), 0.0, 1.0);
         return dice::make<type_int>(
-            context.arg<type_rand_var>(0)->data().quantile(prob)
+            read<type_rand_var>(context, 0).quantile(prob)
         );
     }
 
     // operator functions
 
+    // Operators update the first argument in place unless it is shared
+    // (e.g., it is a value of a variable).
+
     template<typename T>
     fn::return_type dice_add(fn::context_type& context)
     {
-        auto& a = context.arg<T>(0)->data();
-        auto& b = context.arg<T>(1)->data();
-        a = a + b;
-        return std::move(context.raw_arg(0));
+        auto&& b = read<T>(context, 1);
+        if (auto a = modifiable<T>(context, 0))
+        {
+            *a += b;
+            return std::move(context.raw_arg(0));
+        }
+        return dice::make<T>(read<T>(context, 0) + b);
     }
 
     template<typename T>
     fn::return_type dice_sub(fn::context_type& context)
     {
-        auto& a = context.arg<T>(0)->data();
-        auto& b = context.arg<T>(1)->data();
-        a = a - b;
-        return std::move(context.raw_arg(0));
+        auto&& b = read<T>(context, 1);
+        if (auto a = modifiable<T>(context, 0))
+        {
+            *a -= b;
+            return std::move(context.raw_arg(0));
+        }
+        return dice::make<T>(read<T>(context, 0) - b);
     }
 
     template<typename T>
     fn::return_type dice_mult(fn::context_type& context)
     {
-        auto& a = context.arg<T>(0)->data();
-        auto& b = context.arg<T>(1)->data();
-        a = a * b;
-        return std::move(context.raw_arg(0));
+        auto&& b = read<T>(context, 1);
+        if (auto a = modifiable<T>(context, 0))
+        {
+            *a *= b;
+            return std::move(context.raw_arg(0));
+        }
+        return dice::make<T>(read<T>(context, 0) * b);
     }
 
     template<typename T>
     fn::return_type dice_div(fn::context_type& context)
     {
-        auto& a = context.arg<T>(0)->data();
-        auto& b = context.arg<T>(1)->data();
-        a = a / b;
-        return std::move(context.raw_arg(0));
+        auto&& a = read<T>(context, 0);
+        auto&& b = read<T>(context, 1);
+        return dice::make<T>(a / b);
     }
 
     template<typename T>
     fn::return_type dice_unary_minus(fn::context_type& context)
     {
-        auto& a = context.arg<T>(0)->data();
-        a = -a;
-        return std::move(context.raw_arg(0));
+        return dice::make<T>(-read<T>(context, 0));
     }
 
     fn::return_type dice_roll_op(fn::context_type& context)
     {
         using namespace dice;
-        auto& dice_count = context.arg<type_rand_var>(0)->data();
-        auto& dice_faces = context.arg<type_rand_var>(1)->data();
+        auto&& dice_count = read<type_rand_var>(context, 0);
+        auto&& dice_faces = read<type_rand_var>(context, 1);
 
         if (dice_count.size() == 0)
         {
@@ -123,84 +203,150 @@ namespace
             }
         }
 
-        // calculate the roll
-        dice_count = roll(dice_count, dice_faces);
-        return std::move(context.raw_arg(0));
+        // calculate the roll (distributions of constant rolls are cached)
+        auto roll = [](auto&& a, auto&& b)
+        {
+            using cache_type = roll_cache<
+                storage::int_type, 
+                storage::probability_type>;
+            return *cache_type::instance().get(a, b);
+        };
+        if (auto count = modifiable<type_rand_var>(context, 0))
+        {
+            count->combine_into(dice_faces, [&](auto&& a, auto&& b)
+            {
+                a = roll(a, b);
+            }, roll);
+            return std::move(context.raw_arg(0));
+        }
+        return make<type_rand_var>(dice_count.combine(dice_faces, roll));
+    }
+
+    // keep the highest (or lowest) dice of a roll
+    template<bool Highest>
+    fn::return_type dice_keep(fn::context_type& context)
+    {
+        using namespace dice;
+        auto&& dice_count = read<type_rand_var>(context, 0);
+        auto&& dice_faces = read<type_rand_var>(context, 1);
+        auto&& kept = read<type_int>(context, 2);
+
+        if (dice_count.size() == 0)
+        {
+            throw compiler_error{ "No value for dice count" };
+        }
+
+        if (dice_faces.size() == 0)
+        {
+            throw compiler_error{ "No value for faces count" };
+        }
+
+        if (kept < 0)
+        {
+            throw compiler_error{ 
+                "Number of kept dice has to be a non-negative integer, got " + 
+                std::to_string(kept) };
+        }
+
+        for (auto&& pair : dice_count)
+        {
+            if (pair.first <= 0)
+            {
+                throw compiler_error{ 
+                    "Number of dice has to be a positive integer, got " + 
+                    std::to_string(pair.first) };
+            }
+        }
+
+        for (auto&& pair : dice_faces)
+        {
+            if (pair.first <= 0)
+            {
+                throw compiler_error{ 
+                    "Number of dice faces has to be a positive integer, got " + 
+                    std::to_string(pair.first) };
+            }
+        }
+
+        return make<type_rand_var>(dice_count.combine(dice_faces, 
+            [&kept](auto&& a, auto&& b)
+        {
+            return Highest ? keep_highest(a, b, kept) : keep_lowest(a, b, kept);
+        }));
     }
 
     template<typename T>
     fn::return_type dice_rand_var_in(fn::context_type& context)
     {
-        auto& var = context.arg<dice::type_rand_var>(0)->data();
-        auto& lower_bound = context.arg<T>(1)->data();
-        auto& upper_bound = context.arg<T>(2)->data();
-        var = var.in(lower_bound, upper_bound);
-        return std::move(context.raw_arg(0));
+        auto&& var = read<dice::type_rand_var>(context, 0);
+        auto&& lower_bound = read<T>(context, 1);
+        auto&& upper_bound = read<T>(context, 2);
+        return dice::make<dice::type_rand_var>(
+            var.in(lower_bound, upper_bound));
     }
 
     fn::return_type dice_less_than(fn::context_type& context)
     {
         using namespace dice;
-        auto& a = context.arg<type_rand_var>(0)->data();
-        auto& b = context.arg<type_rand_var>(1)->data();
-        a = a.less_than(b);
-        return std::move(context.raw_arg(0));
+        auto&& a = read<type_rand_var>(context, 0);
+        auto&& b = read<type_rand_var>(context, 1);
+        return make<type_rand_var>(a.less_than(b));
     }
 
     fn::return_type dice_less_than_or_equal(fn::context_type& context)
     {
         using namespace dice;
-        auto& a = context.arg<type_rand_var>(0)->data();
-        auto& b = context.arg<type_rand_var>(1)->data();
-        a = a.less_than_or_equal(b);
-        return std::move(context.raw_arg(0));
+        auto&& a = read<type_rand_var>(context, 0);
+        auto&& b = read<type_rand_var>(context, 1);
+        return make<type_rand_var>(a.less_than_or_equal(b));
     }
 
     fn::return_type dice_equal(fn::context_type& context)
     {
         using namespace dice;
-        auto& a = context.arg<type_rand_var>(0)->data();
-        auto& b = context.arg<type_rand_var>(1)->data();
-        a = a.equal(b);
-        return std::move(context.raw_arg(0));
+        auto&& a = read<type_rand_var>(context, 0);
+        auto&& b = read<type_rand_var>(context, 1);
+        return make<type_rand_var>(a.equal(b));
     }
 
     fn::return_type dice_not_equal(fn::context_type& context)
     {
         using namespace dice;
-        auto& a = context.arg<type_rand_var>(0)->data();
-        auto& b = context.arg<type_rand_var>(1)->data();
-        a = a.not_equal(b);
-        return std::move(context.raw_arg(0));
+        auto&& a = read<type_rand_var>(context, 0);
+        auto&& b = read<type_rand_var>(context, 1);
+        return make<type_rand_var>(a.not_equal(b));
     }
 
     fn::return_type dice_greater_than(fn::context_type& context)
     {
         using namespace dice;
-        auto& a = context.arg<type_rand_var>(0)->data();
-        auto& b = context.arg<type_rand_var>(1)->data();
-        a = a.greater_than(b);
-        return std::move(context.raw_arg(0));
+        auto&& a = read<type_rand_var>(context, 0);
+        auto&& b = read<type_rand_var>(context, 1);
+        return make<type_rand_var>(a.greater_than(b));
     }
 
     fn::return_type dice_greater_than_or_equal(fn::context_type& context)
     {
         using namespace dice;
-        auto& a = context.arg<type_rand_var>(0)->data();
-        auto& b = context.arg<type_rand_var>(1)->data();
-        a = a.greater_than_or_equal(b);
-        return std::move(context.raw_arg(0));
+        auto&& a = read<type_rand_var>(context, 0);
+        auto&& b = read<type_rand_var>(context, 1);
+        return make<type_rand_var>(a.greater_than_or_equal(b));
     }
 
+    // min and max take any number of arguments (at least 2)
     template<typename T>
     fn::return_type dice_min(fn::context_type& context)
     {
         using namespace dice;
         using namespace std;
-        auto& a = context.arg<T>(0)->data();
-        auto& b = context.arg<T>(1)->data();
-        a = min(a, b);
-        return std::move(context.raw_arg(0));
+        typename T::value_type result = min(
+            read<T>(context, 0), 
+            read<T>(context, 1));
+        for (std::size_t i = 2; i < context.argc(); ++i)
+        {
+            result = min(result, read<T>(context, i));
+        }
+        return make<T>(std::move(result));
     }
 
     template<typename T>
@@ -208,38 +354,118 @@ namespace
     {
         using namespace dice;
         using namespace std;
-        auto& a = context.arg<T>(0)->data();
-        auto& b = context.arg<T>(1)->data();
-        a = max(a, b);
-        return std::move(context.raw_arg(0));
+        typename T::value_type result = max(
+            read<T>(context, 0), 
+            read<T>(context, 1));
+        for (std::size_t i = 2; i < context.argc(); ++i)
+        {
+            result = max(result, read<T>(context, i));
+        }
+        return make<T>(std::move(result));
     }
 
     // generate a random number
     #ifndef DISABLE_RNG
 
-    std::random_device dev;
+    // random_device is not guaranteed to be thread safe
+    unsigned random_seed()
+    {
+        static std::mutex lock;
+        static std::random_device dev;
+        std::lock_guard<std::mutex> guard{ lock };
+        return dev();
+    }
 
-    template<typename ProbType = dice::storage::real_type>
+    // draw a random value from a distribution
     struct dice_roll 
     {
-        std::default_random_engine engine;
-        std::uniform_real_distribution<ProbType> dist;
-
-        dice_roll() : engine(dev()), dist(0, 1) {}
-        // create a new random engine and distribution on copy
-        dice_roll(const dice_roll&) : engine(dev()), dist(0, 1) {}
+        // generator shared by all roll functions of an environment
+        std::shared_ptr<dice::sample_engine> engine;
 
         fn::return_type operator()(fn::context_type& context)
         {
             using namespace dice;
 
-            auto value = dist(engine);
-            auto var = context.arg<type_rand_var>(0)->data()
-                .to_random_variable(); 
-            return make<type_int>(var.random_value(value));
+            // distribution and its sampling table are cached in the value
+            auto&& var = read<type_rand_var>(context, 0).marginal(); 
+            return make<type_int>(var.sample(*engine));
         } 
     };
 
+    // draw n random values and compute their empirical distribution
+    struct dice_roll_batch
+    {
+        // values are counted in a vector if their range is at most this big
+        static const std::int64_t max_dense_range = 1 << 16;
+
+        std::shared_ptr<dice::sample_engine> engine;
+
+        fn::return_type operator()(fn::context_type& context)
+        {
+            using namespace dice;
+            using var_type = storage::random_variable_type::var_type;
+
+            auto&& var = read<type_rand_var>(context, 0).marginal(); 
+            auto&& count = read<type_int>(context, 1);
+            if (count <= 0)
+            {
+                throw compiler_error{ 
+                    "Number of rolls has to be a positive integer, got " +
+                    std::to_string(count) };
+            }
+
+            // values are drawn in batches so that they are not stored
+            std::unordered_map<int, std::size_t> frequency;
+            std::vector<std::size_t> dense_frequency;
+            const int min_value = var.min_value();
+            const auto range = static_cast<std::int64_t>(var.max_value()) - 
+                min_value + 1;
+            if (range <= max_dense_range)
+            {
+                dense_frequency.resize(static_cast<std::size_t>(range));
+            }
+
+            std::vector<storage::int_type> batch(1024);
+            auto remaining = static_cast<std::size_t>(count);
+            while (remaining > 0)
+            {
+                auto size = std::min(remaining, batch.size());
+                var.sample_batch(*engine, batch.begin(), batch.begin() + size);
+                for (std::size_t i = 0; i < size; ++i)
+                {
+                    const int value = batch[i];
+                    if (dense_frequency.empty())
+                    {
+                        ++frequency[value];
+                    }
+                    else
+                    {
+                        ++dense_frequency[
+                            static_cast<std::size_t>(value - min_value)];
+                    }
+                }
+                remaining -= size;
+            }
+
+            var_type::frequency_list list;
+            for (auto&& pair : frequency)
+            {
+                list.emplace_back(pair.first, pair.second);
+            }
+            for (std::size_t i = 0; i < dense_frequency.size(); ++i)
+            {
+                if (dense_frequency[i] > 0)
+                {
+                    list.emplace_back(
+                        min_value + static_cast<int>(i), 
+                        dense_frequency[i]);
+                }
+            }
+            return make<type_rand_var>(
+                storage::random_variable_type{ var_type{ list } });
+        }
+    };
+
     #endif // DISABLE_RNG
 }
 
@@ -344,52 +570,108 @@ dice::environment::environment()
         dice_quantile, { type_rand_var::id(), type_real::id() }
     });
 
+    add_function("keep_highest", {
+        dice_keep<true>, { 
+            type_rand_var::id(), 
+            type_rand_var::id(), 
+            type_int::id() }
+    });
+    add_function("keep_lowest", {
+        dice_keep<false>, { 
+            type_rand_var::id(), 
+            type_rand_var::id(), 
+            type_int::id() }
+    });
+
 #ifndef DISABLE_RNG
+    engine_ = std::make_shared<sample_engine>(random_seed());
+    add_function("roll", {
+        dice_roll{ engine_ }, { type_rand_var::id() }
+    });
     add_function("roll", {
-        dice_roll<dice::storage::real_type>{}, { type_rand_var::id() }
+        dice_roll_batch{ engine_ }, { type_rand_var::id(), type_int::id() }
     });
 #endif // DISABLE_RNG
 
     // Compute minimum of 2 values
     add_function("min", {
-        dice_min<type_rand_var>, { type_rand_var::id(), type_rand_var::id() }
+        variadic_tag{}, dice_min<type_rand_var>, { type_rand_var::id(), type_rand_var::id() }
     });
     add_function("min", {
-        dice_min<type_int>, { type_int::id(), type_int::id() }
+        variadic_tag{}, dice_min<type_int>, { type_int::id(), type_int::id() }
     });
     add_function("min", {
-        dice_min<type_real>, { type_real::id(), type_real::id() }
+        variadic_tag{}, dice_min<type_real>, { type_real::id(), type_real::id() }
     });
     
     // Compute maximum of 2 values
     add_function("max", {
-        dice_max<type_rand_var>, { type_rand_var::id(), type_rand_var::id() }
+        variadic_tag{}, dice_max<type_rand_var>, { type_rand_var::id(), type_rand_var::id() }
     });
     add_function("max", {
-        dice_max<type_int>, { type_int::id(), type_int::id() }
+        variadic_tag{}, dice_max<type_int>, { type_int::id(), type_int::id() }
     });
     add_function("max", {
-        dice_max<type_real>, { type_real::id(), type_real::id() }
+        variadic_tag{}, dice_max<type_real>, { type_real::id(), type_real::id() }
     });
 }
 
+const dice::environment::function_id dice::environment::no_function = 
+    std::numeric_limits<dice::environment::function_id>::max();
+
+void dice::environment::seed(std::uint64_t value)
+{
+    if (engine_ != nullptr)
+    {
+        *engine_ = sample_engine{ value };
+    }
+}
+
 void dice::environment::add_function(
     const std::string& name, 
     function_definition function)
 {
-    auto result = functions_.insert(std::make_pair(
+    auto result = function_ids_.insert(std::make_pair(
         name, 
-        std::vector<function_definition>{}
+        functions_.size()
     ));
-    result.first->second.push_back(std::move(function));
+    if (result.second)
+    {
+        functions_.push_back(function_entry{ name, {}, {} });
+    }
+
+    auto&& entry = functions_[result.first->second];
+    entry.overloads.push_back(std::move(function));
+    entry.dispatch.clear();
+}
+
+dice::environment::function_id dice::environment::find_function(
+    const std::string& name) const
+{
+    auto it = function_ids_.find(name);
+    if (it == function_ids_.end())
+        return no_function;
+    return it->second;
+}
+
+void dice::environment::clear_variables()
+{
+    variables_.clear();
+    definitions_.clear();
 }
 
 void dice::environment::set_var(const std::string& name, value_type value)
 {
+    definitions_.erase(name);
+    invalidate_dependents(name);
+
     auto it = variables_.find(name);
     if (it != variables_.end())
     {
         it->second = std::move(value);
+
+        // dependencies of the old value might not be shared anymore
+        release_dependencies();
     }
     else 
     {
@@ -400,11 +682,112 @@ void dice::environment::set_var(const std::string& name, value_type value)
     }
 }
 
+void dice::environment::set_definition(
+    const std::string& name, 
+    std::vector<std::string> inputs,
+    std::function<value_type()> compute)
+{
+    assert(variables_.find(name) != variables_.end());
+
+    for (auto&& input : inputs)
+    {
+        if (input == name || depends_on(input, name))
+            return;
+    }
+
+    definitions_[name] = definition{ 
+        std::move(inputs), 
+        std::move(compute), 
+        false 
+    };
+}
+
+bool dice::environment::is_stale(const std::string& name) const
+{
+    auto it = definitions_.find(name);
+    return it != definitions_.end() && it->second.is_stale;
+}
+
+void dice::environment::invalidate_dependents(const std::string& name)
+{
+    for (auto&& pair : definitions_)
+    {
+        auto&& def = pair.second;
+        if (def.is_stale || 
+            std::find(def.inputs.begin(), def.inputs.end(), name) == 
+                def.inputs.end())
+            continue;
+
+        // dependents of a stale definition are stale already
+        def.is_stale = true;
+        invalidate_dependents(pair.first);
+    }
+}
+
+bool dice::environment::depends_on(
+    const std::string& name, 
+    const std::string& input) const
+{
+    auto it = definitions_.find(name);
+    if (it == definitions_.end())
+        return false;
+
+    for (auto&& value : it->second.inputs)
+    {
+        if (value == input || depends_on(value, input))
+            return true;
+    }
+    return false;
+}
+
+void dice::environment::release_dependencies()
+{
+    for (auto&& pair : variables_)
+    {
+        auto var = dynamic_cast<type_rand_var*>(pair.second.get());
+        if (var == nullptr)
+            continue;
+
+        // a single dependency can't be simplified
+        auto&& data = static_cast<const type_rand_var*>(var)->data();
+        auto count = data.dependency_count();
+        if (count > 1 && data.unshared_dependencies() == count)
+        {
+            try
+            {
+                // replace the value so that shared data is not copied
+                *var = type_rand_var{ 
+                    data.marginalize_unshared().compute_decomposition() };
+            }
+            catch (budget_error&)
+            {
+                // the simplification is optional, keep the old value
+            }
+        }
+    }
+}
+
 dice::base_value* dice::environment::get_var(const std::string& name)
 {
     auto it = variables_.find(name);
     if (it == variables_.end())
         return nullptr;
+
+    auto def = definitions_.find(name);
+    if (def != definitions_.end() && def->second.is_stale)
+    {
+        // compute the value from the current values of its inputs (which
+        // are updated recursively if they are stale too)
+        def->second.is_stale = false;
+        auto compute = def->second.compute;
+        auto value = compute();
+        if (value != nullptr)
+        {
+            it = variables_.find(name);
+            it->second = std::move(value);
+            release_dependencies();
+        }
+    }
     return it->second.get();
 }
 
@@ -416,33 +799,70 @@ const dice::base_value* dice::environment::get_var(const std::string& name) cons
     return it->second.get();
 }
 
+namespace 
+{
+    // number of bits used to encode a type_id in a dispatch key
+    const std::size_t type_bits = 2;
+    // number of bits used to encode the number of arguments
+    const std::size_t argc_bits = 8;
+
+    /** @brief Encode number and types of arguments as an integer.
+     *
+     * @param context of a function call
+     * @param key computed key
+     *
+     * @return false if there are too many arguments to fit in the key
+     */
+    bool dispatch_key(
+        const dice::execution_context& context, 
+        std::uint64_t& key)
+    {
+        auto argc = context.argc();
+        if (argc > (64 - argc_bits) / type_bits)
+            return false;
+
+        key = argc;
+        for (std::size_t i = 0; i < argc; ++i)
+        {
+            auto type = static_cast<std::uint64_t>(context.arg_type(i));
+            key |= type << (argc_bits + i * type_bits);
+        }
+        return true;
+    }
+}
+
 fn::return_type dice::environment::call_prepared(
     const std::string& name, 
     execution_context& context)
 {
-    auto expected_argc = context.argc();
-
-    // find functions in the function table
-    auto it = functions_.find(name);
-    if (it == functions_.end())
+    auto id = find_function(name);
+    if (id == no_function)
     {
         throw compiler_error("Function '" + name + "' was not defined.");
     }
-    auto&& functions = it->second;
+    return call_prepared(id, context);
+}
+
+dice::environment::overload_choice dice::environment::resolve(
+    const function_entry& entry, 
+    const execution_context& context) const
+{
+    auto expected_argc = context.argc();
 
     // choose function with the lowest conversion cost
-    function_definition* min_func = nullptr;
+    overload_choice result{ std::numeric_limits<std::size_t>::max(), false };
     auto min_cost = conversions::max_cost;
-    for (auto&& function : functions)
+    for (std::size_t j = 0; j < entry.overloads.size(); ++j)
     {
-        if (function.argc() != expected_argc)
+        auto&& function = entry.overloads[j];
+        if (!function.accepts(expected_argc))
         {
             continue;
         }
 
         // calculate conversion cost for this function
         conversions::cost_type cost = 0;
-        for (std::size_t i = 0; i < function.argc(); ++i)
+        for (std::size_t i = 0; i < expected_argc; ++i)
         {
             auto to_type = function.arg_type(i);
             auto from_type = context.arg_type(i);
@@ -459,15 +879,45 @@ fn::return_type dice::environment::call_prepared(
         if (cost < min_cost)
         {
             min_cost = cost;
-            min_func = &function;
+            result.index = j;
+            result.convert = cost > 0;
+        }
+    }
+    return result;
+}
+
+fn::return_type dice::environment::call_prepared(
+    function_id id, 
+    execution_context& context)
+{
+    assert(id < functions_.size());
+    auto&& entry = functions_[id];
+
+    // find the overload in the dispatch cache
+    std::uint64_t key = 0;
+    overload_choice choice;
+    if (!dispatch_key(context, key))
+    {
+        choice = resolve(entry, context);
+    }
+    else 
+    {
+        auto it = entry.dispatch.find(key);
+        if (it == entry.dispatch.end())
+        {
+            it = entry.dispatch.insert(std::make_pair(
+                key, 
+                resolve(entry, context)
+            )).first;
         }
+        choice = it->second;
     }
 
     // if there is no suitable conversion, the function call fails
-    if (min_func == nullptr)
+    if (choice.index >= entry.overloads.size())
     {
         std::string error_message = "No matching function for: " ;
-        error_message += name + "(";
+        error_message += entry.name + "(";
         if (context.argc() > 0)
         {
             error_message += to_string(context.arg_type(0));
@@ -479,23 +929,49 @@ fn::return_type dice::environment::call_prepared(
         error_message += ")";
         throw compiler_error(error_message);
     }
+    auto&& function = entry.overloads[choice.index];
 
     // convert arguments
-    for (std::size_t i = 0; i < context.argc(); ++i)
+    if (choice.convert)
     {
-        type_id to = min_func->arg_type(i);
-        context.raw_arg(i) = conversions_.convert(to, 
-            std::move(context.raw_arg(i)));
+        for (std::size_t i = 0; i < context.argc(); ++i)
+        {
+            type_id to = function.arg_type(i);
+            context.raw_arg(i) = conversions_.convert(to, 
+                std::move(context.raw_arg(i)));
+        }
     }
 
     // execute it
     try
     {
-        return (*min_func)(context);
+        auto profile = profiler::current();
+        if (profile == nullptr)
+        {
+            return check_memory(function(context));
+        }
+
+        profiler::measurement measure{ profile };
+        std::size_t input_size = 0;
+        for (std::size_t i = 0; i < context.argc(); ++i)
+        {
+            input_size += support_size(context.raw_arg(i).get());
+        }
+        auto result = check_memory(function(context));
+        auto value = measure.stop(profile);
+        value.input_size = input_size;
+        value.output_size = support_size(result.get());
+        value.max_leaves = leaf_count(result.get());
+        profile->record_call(entry.name, value);
+        return result;
     }
     catch (safe_int_error& error)
     {
         throw compiler_error{
             is_overflow_error(error) ? "Overflow" : "Division by Zero" };
     }
+    catch (budget_error& error)
+    {
+        throw compiler_error{ error.what() };
+    }
 }
\ No newline at end of file
@@ -3,6 +3,7 @@
 
 #include <memory>
 #include <vector>
+#include <cstdint>
 #include <string>
 #include <functional>
 #include <cassert>
@@ -15,6 +16,7 @@
 #include "functions.hpp"
 #include "conversions.hpp"
 #include "random_variable.hpp"
+#include "sample_engine.hpp"
 
 namespace dice
 {
@@ -55,16 +57,48 @@ namespace dice
         using value_type = std::unique_ptr<base_value>;
         using fn = execution_context;
 
+        /** Interned name of a function (see find_function). */
+        using function_id = std::size_t;
+
+        /** Id returned by find_function for undefined functions. */
+        static const function_id no_function;
+
         environment();
 
         /** @brief Set value of a variable.
+         *
+         * If the variable already exists, random variables which no longer
+         * share any dependency with other variables are simplified (see 
+         * release_dependencies). Definitions of other variables which
+         * depend on it are recomputed when they are used next time (see
+         * set_definition). The definition of this variable is removed.
          *
          * @param name of a variable
          * @param value of the variable
          */
         void set_var(const std::string& name, value_type value);
 
+        /** @brief Record how the value of a variable has been computed.
+         *
+         * If some of the inputs is set later, the value of this variable
+         * is computed again by calling compute when it is used next time
+         * (that is, the variable behaves like a formula). Variables which
+         * don't depend on it keep their values. A definition which would
+         * depend on itself (e.g., var X = X + 1) is not recorded.
+         *
+         * @param name of a variable (it has to exist)
+         * @param inputs names of variables the value is computed from
+         * @param compute function which computes the value
+         */
+        void set_definition(
+            const std::string& name, 
+            std::vector<std::string> inputs,
+            std::function<value_type()> compute);
+
         /** @brief Get value of a variable.
+         *
+         * The value is computed again if some input of its definition has
+         * changed since it was computed (see set_definition).
          *
          * @param name of a variable
          * 
@@ -74,6 +108,8 @@ namespace dice
         base_value* get_var(const std::string& name);
 
         /** @brief Get value of a variable.
+         *
+         * The value is not updated even if its inputs have changed.
          *
          * @param name of a variable
          * 
@@ -82,6 +118,21 @@ namespace dice
          */
         const base_value* get_var(const std::string& name) const;
 
+        /** @brief Check whether a variable has to be computed again.
+         *
+         * @param name of a variable
+         *
+         * @return true iff some input of its definition has changed
+         */
+        bool is_stale(const std::string& name) const;
+
+        /** @brief Remove all variables.
+         *
+         * Functions are kept. It is used to evaluate unrelated scripts in
+         * the same environment.
+         */
+        void clear_variables();
+
         /** @brief Add a function to the environment.
          *
          * Added function will be available in dice expressions.
@@ -91,6 +142,26 @@ namespace dice
          */
         void add_function(const std::string& name, function_definition function);
 
+        /** @brief Set seed of the generator of the roll functions.
+         *
+         * The generator is seeded by a random device when the environment
+         * is created. Setting the seed makes the rolls reproducible.
+         *
+         * @param value of the seed
+         */
+        void seed(std::uint64_t value);
+
+        /** @brief Find id of a function.
+         *
+         * Calling a function by its id skips the lookup of its name. Ids
+         * are valid for the whole lifetime of the environment.
+         *
+         * @param name of the function
+         *
+         * @return id of the function or no_function if it is not defined
+         */
+        function_id find_function(const std::string& name) const;
+
         /** @brief Call a function with the same arguments.
          * 
          * @param name of the function
@@ -152,17 +223,135 @@ namespace dice
             return value;
         }
 
+        /** @brief Call a function given by its id with the same arguments.
+         *
+         * @param id of the function (see find_function)
+         * @param first_arg first argument
+         * @param rest of the arguments passed to the function
+         *
+         * @return computed value
+         *
+         * @throws compiler_error when an error occurs during the function call
+         */
+        template<typename Arg, typename ...Args>
+        value_type call(function_id id, Arg&& first_arg, Args&&... rest)
+        {
+            args_.push_back(std::forward<Arg>(first_arg));
+            return call(id, std::forward<Args>(rest)...);
+        }
+
+        /** @brief Call a function given by its id without arguments.
+         *
+         * @attention arguments in the args_ vector are still passed to the call
+         *
+         * @param id of the function
+         *
+         * @return computed result
+         */
+        inline value_type call(function_id id)
+        {
+            try 
+            {
+                auto value = call_var(id, args_.begin(), args_.end());
+                args_.clear();
+                return value;
+            }
+            catch (...)
+            {
+                args_.clear();
+                throw;
+            }
+        }
+
+        /** Call a function given by its id with arguments in a list.
+         * @param id of the function
+         * @param first argument iterator
+         * @param last argument iterator
+         * @return computed value
+         */
+        inline value_type call_var(
+            function_id id, 
+            fn::arg_iterator first,
+            fn::arg_iterator last)
+        {
+            execution_context context{ first, last };
+            return call_prepared(id, context);
+        }
+
     private:
         // type conversions
         conversions conversions_;
-        // available functions    
-        std::unordered_map<
-            std::string, 
-            std::vector<function_definition>> functions_;
+        /** @brief Overload chosen for a combination of argument types. */
+        struct overload_choice
+        {
+            // index of the overload or max value if none matches
+            std::size_t index;
+            // true iff some argument has to be converted
+            bool convert;
+        };
+
+        /** @brief Overloads of a function with a dispatch cache.
+         *
+         * The cache maps argument types (see dispatch_key) to the overload
+         * with the lowest conversion cost. It is cleared whenever a new
+         * overload is added.
+         */
+        struct function_entry
+        {
+            std::string name;
+            std::vector<function_definition> overloads;
+            std::unordered_map<std::uint64_t, overload_choice> dispatch;
+        };
+
+        // available functions indexed by function_id
+        std::vector<function_entry> functions_;
+        // ids of function names
+        std::unordered_map<std::string, function_id> function_ids_;
+        /** @brief Formula of a variable (see set_definition). */
+        struct definition
+        {
+            std::vector<std::string> inputs;
+            std::function<value_type()> compute;
+            // true iff some input has changed since it was computed
+            bool is_stale;
+        };
+
         // available variables
         std::unordered_map<std::string, value_type> variables_;
+        // definitions of variables which are updated if an input changes
+        std::unordered_map<std::string, definition> definitions_;
         // auxiliary vector of function arguments
         std::vector<fn::value_type> args_;
+        // generator of the roll functions (null if they are disabled)
+        std::shared_ptr<sample_engine> engine_;
+
+        /** @brief Simplify variables whose dependencies are not shared.
+         *
+         * If no other value depends on the dependencies of a random 
+         * variable (e.g., the variables it was computed from have been 
+         * redefined), all its dependencies are summed out and the result 
+         * is decomposed again. This replaces the product of its 
+         * dependencies by a single dependency on its own distribution.
+         */
+        void release_dependencies();
+
+        /** @brief Mark definitions which depend on a variable as stale.
+         *
+         * @param name of a changed variable
+         */
+        void invalidate_dependents(const std::string& name);
+
+        /** @brief Check whether a variable depends on another variable.
+         *
+         * @param name of a variable
+         * @param input name of the other variable
+         *
+         * @return true iff the definition of name uses input (directly or 
+         *         through definitions of other variables)
+         */
+        bool depends_on(
+            const std::string& name, 
+            const std::string& input) const;
 
         /** Call a function with prepared context.
          * @param name of the function
@@ -172,6 +361,24 @@ namespace dice
         fn::return_type call_prepared(
             const std::string& name, 
             execution_context& context);
+
+        /** Call a function given by its id with prepared context.
+         * @param id of the function
+         * @param context of execution of this call
+         * @return computed value
+         */
+        fn::return_type call_prepared(
+            function_id id, 
+            execution_context& context);
+
+        /** Choose an overload with the lowest conversion cost.
+         * @param entry of the function
+         * @param context of execution of this call
+         * @return chosen overload
+         */
+        overload_choice resolve(
+            const function_entry& entry, 
+            const execution_context& context) const;
     };
 }
 
@@ -10,6 +10,8 @@
 
 namespace dice 
 {
+    class variadic_tag{};
+
     /** @brief Context of dice user function execution.
      * 
      * This is the only argument passed to every user function call.
@@ -160,6 +162,26 @@ namespace dice
             std::vector<type_id>&& arg_types) : 
             callable_(std::move(callable)), arg_types_(std::move(arg_types)) {}
 
+        /** @brief Create function with variable number of arguments
+         *
+         * The last argument type can repeat any number of times (i.e., the
+         * function takes at least arg_types.size() arguments).
+         * 
+         * @param callable function implementation.
+         * @param arg_types vector of argument types of this function.
+         *        It must not be empty.
+         */
+        function_definition(
+            variadic_tag,
+            fn::callable_type callable, 
+            std::vector<type_id>&& arg_types) : 
+            callable_(std::move(callable)), 
+            arg_types_(std::move(arg_types)),
+            is_variadic_(true) 
+        {
+            assert(!arg_types_.empty());
+        }
+
         // disallow copy
         function_definition(const function_definition&) = delete;
         void operator=(const function_definition&) = delete;
@@ -185,20 +207,36 @@ namespace dice
          */
         inline type_id arg_type(std::size_t index) const 
         {
-            assert(index < argc());
+            if (index >= argc())
+            {
+                assert(is_variadic_);
+                return arg_types_.back();
+            }
             return arg_types_[index]; 
         }
 
         /** Get number of function arguments.
-         * @return number of arguemtns of this function
+         * @return number of arguemtns of this function 
+         *         (minimal number of arguments of a variadic function)
          */
         inline std::size_t argc() const { return arg_types_.size(); }
 
+        /** Check whether this function takes given number of arguments.
+         * @param count number of arguments
+         * @return true iff this function can be called with count arguments
+         */
+        inline bool accepts(std::size_t count) const 
+        { 
+            return is_variadic_ ? count >= argc() : count == argc(); 
+        }
+
     private:
         // code of the function
         fn::callable_type callable_;
         // argument types for type checking
         std::vector<type_id> arg_types_;
+        // true iff the last argument can repeat
+        bool is_variadic_ = false;
     };
 }
 
@@ -24,38 +24,122 @@ namespace dice
         lexer_location(int line, int col) : line(line), col(col) {}
     };
 
+    /** @brief Input of a lexer which reads characters from a stream.
+     */
+    class stream_input
+    {
+    public:
+        stream_input(std::istream* input) : input_(input) {}
+
+        /** @brief Read next character.
+         *
+         * @return the character or EOF at the end of the input
+         */
+        inline int get()
+        {
+            return input_->get();
+        }
+
+        /** @brief Get next character without reading it.
+         *
+         * @return the character or EOF at the end of the input
+         */
+        inline int peek()
+        {
+            return input_->peek();
+        }
+
+        /** @brief Read a sequence of characters.
+         *
+         * @param first character of the sequence (it has already been read)
+         * @param pred predicate which is true for characters of the sequence
+         *
+         * @return read characters
+         */
+        template<typename Predicate>
+        std::string read_while(char first, Predicate pred)
+        {
+            std::string value(1, first);
+            while (input_->peek() != EOF && pred(input_->peek()))
+            {
+                value += static_cast<char>(input_->get());
+            }
+            return value;
+        }
+    private:
+        std::istream* input_;
+    };
+
+    /** @brief Input of a lexer which reads characters from a contiguous
+     *         buffer in memory (e.g., a string or a memory mapped file).
+     *
+     * Characters are read using a pointer to the buffer so there is no 
+     * virtual call or copy of the input. The buffer has to outlive the 
+     * lexer.
+     */
+    class buffer_input
+    {
+    public:
+        buffer_input(const char* first, const char* last) : 
+            current_(first), 
+            last_(last) {}
+
+        buffer_input(const std::string& buffer) : 
+            buffer_input(buffer.data(), buffer.data() + buffer.size()) {}
+
+        inline int get()
+        {
+            if (current_ == last_)
+                return EOF;
+            return static_cast<unsigned char>(*current_++);
+        }
+
+        inline int peek() const
+        {
+            if (current_ == last_)
+                return EOF;
+            return static_cast<unsigned char>(*current_);
+        }
+
+        template<typename Predicate>
+        std::string read_while(char, Predicate pred)
+        {
+            // the first character is right before the current position
+            auto first = current_ - 1;
+            while (current_ != last_ && 
+                pred(static_cast<unsigned char>(*current_)))
+            {
+                ++current_;
+            }
+            return std::string(first, current_);
+        }
+    private:
+        const char* current_;
+        const char* last_;
+    };
+
     /** @brief Lexer of a dice script.
      *
+     * @tparam Input source of characters (stream_input or buffer_input)
      * @tparam Logger the logger type
      */
-    template<typename Logger>
-    class lexer 
+    template<typename Input, typename Logger>
+    class basic_lexer 
     {
     public:
-        lexer(std::istream* input, Logger* log) : 
+        basic_lexer(Input input, Logger* log) : 
             input_(input), 
             log_(log) {}
-        ~lexer() = default;
+        ~basic_lexer() = default;
 
         // disallow copy so that 2 lexers don't read from the same input
-        lexer(const lexer&) = delete;
-        void operator=(const lexer&) = delete;
+        basic_lexer(const basic_lexer&) = delete;
+        void operator=(const basic_lexer&) = delete;
 
         // allow move
-        lexer(lexer&&) = default;
-        lexer& operator=(lexer&&) = default;
+        basic_lexer(basic_lexer&&) = default;
+        basic_lexer& operator=(basic_lexer&&) = default;
 
-        /** @brief Read token at current location.
-         *
-         * Decode a sequance of characters as a token and advance in the input 
-         * stream. Skip all whitespace characters after the token (that is
-         * location after calling read_token points to the beginning of the 
-         * next token).
-         * 
-         * All errors will be logged with given logger.
-         * 
-         * @return token at current position
-         */
         symbol read_token()
         {
             auto token = read_token_internal();
@@ -72,7 +156,7 @@ namespace dice
             return location_; 
         }
     private:
-        std::istream* input_;
+        Input input_;
         Logger* log_;
         lexer_location location_;
 
@@ -83,10 +167,10 @@ namespace dice
                 skip_space();
 
                 const auto current = get_char();
-                if (input_->fail())
+                if (current == EOF)
                     return symbol{ symbol_type::end };
 
-                const auto next = input_->peek();
+                const auto next = input_.peek();
 
                 // skip comments
                 if (current == '/' && next == '/')
@@ -94,7 +178,7 @@ namespace dice
                     for (;;)
                     {
                         auto value = get_char();
-                        if (value == '\n' || input_->fail())
+                        if (value == '\n' || value == EOF)
                         {
                             break;
                         }
@@ -155,16 +239,11 @@ namespace dice
                 if (std::isalpha(current))
                 {
                     // read a string value
-                    std::string value(1, current);
-                    for (;;)
+                    auto value = input_.read_while(current, [](int c)
                     {
-                        if (input_->peek() == EOF)
-                            break;
-                        if (!std::isalnum(input_->peek()) && 
-                            input_->peek() != '_')
-                            break;
-                        value += static_cast<char>(get_char());
-                    }
+                        return std::isalnum(c) || c == '_';
+                    });
+                    location_.col += static_cast<int>(value.size()) - 1;
 
                     // check if it's a reserved keyword
                     if (value == "in")
@@ -174,7 +253,7 @@ namespace dice
 
                     // distinguish function and other identifiers
                     skip_space();
-                    if (input_->peek() == '(')
+                    if (input_.peek() == '(')
                         return symbol{ symbol_type::func_id, value };
 
                     // otherwise, it's an identifier
@@ -193,11 +272,11 @@ namespace dice
             std::size_t invalid_pos = 0;
             for (;;)
             {
-                if (std::isdigit(input_->peek()))
+                if (std::isdigit(input_.peek()))
                 {
                     value += static_cast<char>(get_char());
                 }
-                else if (input_->peek() == '.')
+                else if (input_.peek() == '.')
                 {
                     if (num_dots == 1)
                     {
@@ -281,9 +360,9 @@ namespace dice
         {
             for (;;)
             {
-                if (input_->peek() == EOF)
+                if (input_.peek() == EOF)
                     break;
-                if (!std::isspace(input_->peek()))
+                if (!std::isspace(input_.peek()))
                     break;
                 get_char();
             }
@@ -292,7 +371,7 @@ namespace dice
         // get character at current location
         int get_char()
         {
-            auto c = input_->get();
+            auto c = input_.get();
             if (c == '\n')
             {
                 ++location_.line;
@@ -325,6 +404,20 @@ namespace dice
                 std::string(1, digits[value & 0xF]) + ").");
         }
     };
+
+    /** @brief Lexer which reads a script from an input stream.
+     *
+     * @tparam Logger the logger type
+     */
+    template<typename Logger>
+    using lexer = basic_lexer<stream_input, Logger>;
+
+    /** @brief Lexer which reads a script from a buffer in memory.
+     *
+     * @tparam Logger the logger type
+     */
+    template<typename Logger>
+    using buffer_lexer = basic_lexer<buffer_input, Logger>;
 }
 
 #endif // DICE_LEXER_HPP_
\ No newline at end of file
@@ -6,6 +6,32 @@
 #include <iomanip>
 #include <cassert>
 #include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
+#include <unordered_map>
+#include <memory>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <windows.h>
+#include <io.h>
+#include <fcntl.h>
+#pragma comment(lib, "Ws2_32.lib")
+#else
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#endif
 
 #include <linenoise.h>
 #include <termcolor.hpp>
@@ -16,6 +42,10 @@
 #include "environment.hpp"
 #include "direct_interpreter.hpp"
 #include "calculator.hpp"
+#include "pruning.hpp"
+#include "roll_cache.hpp"
+#include "distribution_store.hpp"
+#include "cancellation.hpp"
 
 /** Format probability as a human readable string.
  * @param probability
@@ -30,18 +60,58 @@ std::string format_probability(dice::storage::real_type probability)
     return std::to_string(probability * 100) + " %";
 }
 
-// Format any value type and print it to standard output.
+/** Sort values of a distribution.
+ * @param var distribution
+ * @return pairs (value, probability) sorted by value
+ */
+dice::storage::random_variable_type::probability_list sorted_distribution(
+    const dice::storage::random_variable_type::var_type& var)
+{
+    dice::storage::random_variable_type::probability_list values{
+        var.begin(),
+        var.end()
+    };
+    std::sort(values.begin(), values.end(), [](auto&& a, auto&& b)
+    {
+        return a.first < b.first;
+    });
+    return values;
+}
+
+/** Format a number so that it can be parsed without losing precision.
+ * @param number
+ * @return shortest decimal representation with 17 significant digits
+ */
+std::string format_number(double number)
+{
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%.17g", number);
+    return buffer;
+}
+
+// Format any value type and print it to an output stream.
 class formatting_visitor : public dice::value_visitor
 {
 public:
+    /** Create a visitor.
+     * @param output stream
+     * @param samples number of samples of the distributions (0 if they
+     *        have been computed exactly)
+     */
+    explicit formatting_visitor(
+        std::ostream* output = &std::cout, 
+        std::size_t samples = 0) : 
+        output_(output),
+        samples_(samples) {}
+
     void visit(dice::type_int* value) override
     {
-        std::cout << value->data() << std::endl;
+        *output_ << value->data() << '\n';
     }
     
     void visit(dice::type_real* value) override
     {
-        std::cout << value->data() << std::endl;
+        *output_ << value->data() << '\n';
     }
 
     void visit(dice::type_rand_var* value) override
@@ -49,24 +119,24 @@ public:
         const int width_value = 10;
         const int width_prob = 15;
         const int width_cdf = 15;
+        const int width_interval = 15;
     
         // print table header
-        std::cout << std::endl << termcolor::bold
+        *output_ << '\n' << termcolor::bold
             << std::setw(width_value) << "Value" 
             << std::setw(width_prob) << "PMF"  
-            << std::setw(width_cdf) << "CDF"
-            << std::endl << termcolor::reset;
+            << std::setw(width_cdf) << "CDF";
+        if (samples_ > 0)
+        {
+            *output_ 
+                << std::setw(width_interval) << "95% CI lower"
+                << std::setw(width_interval) << "95% CI upper";
+        }
+        *output_ << '\n' << termcolor::reset;
     
         // sort PMF by value
         auto var = value->data().to_random_variable();
-        dice::storage::random_variable_type::probability_list values{
-            var.begin(),
-            var.end()
-        };
-        std::sort(values.begin(), values.end(), [](auto&& a, auto&& b)
-        {
-            return a.first < b.first;
-        });
+        auto values = sorted_distribution(var);
     
         // print the random variable
         if (values.empty())
@@ -76,15 +146,332 @@ public:
         for (auto it = values.begin(); it != values.end(); ++it)
         {
             sum += it->second;
-            std::cout 
+            *output_ 
                 << std::setw(width_value) << it->first 
                 << std::setw(width_prob) << format_probability(it->second)
-                << std::setw(width_cdf) << format_probability(sum)
-                << std::endl;
+                << std::setw(width_cdf) << format_probability(sum);
+            if (samples_ > 0)
+            {
+                auto interval = dice::estimate_interval(it->second, samples_);
+                *output_ 
+                    << std::setw(width_interval) 
+                    << format_probability(interval.lower)
+                    << std::setw(width_interval) 
+                    << format_probability(interval.upper);
+            }
+            *output_ << '\n';
+        }
+
+        if (var.discarded_probability() > 0)
+        {
+            *output_ << "Pruned probability: " 
+                << format_probability(var.discarded_probability())
+                << '\n';
+        }
+    }
+private:
+    std::ostream* output_;
+    std::size_t samples_;
+};
+
+/** Format of printed values. */
+enum class output_format
+{
+    // human readable tables
+    table,
+    // comma separated values (1 row per value of a distribution)
+    csv,
+    // 1 JSON object per printed value
+    json,
+    // dense blocks of native 64-bit numbers which can be mapped to memory
+    binary
+};
+
+/** Print values as comma separated values. 
+ *
+ * A number is printed on a single line. A distribution is printed as a 
+ * table with a header line ("value,pmf,cdf" and "ci_lower,ci_upper" if 
+ * the distribution has been sampled) followed by an empty line.
+ */
+class csv_visitor : public dice::value_visitor
+{
+public:
+    explicit csv_visitor(std::ostream* output, std::size_t samples) : 
+        output_(output),
+        samples_(samples) {}
+
+    void visit(dice::type_int* value) override
+    {
+        *output_ << value->data() << '\n';
+    }
+    
+    void visit(dice::type_real* value) override
+    {
+        *output_ << format_number(value->data()) << '\n';
+    }
+
+    void visit(dice::type_rand_var* value) override
+    {
+        auto var = value->data().to_random_variable();
+
+        // the dense storage is already sorted
+        if (var.is_dense())
+        {
+            print(var);
+        }
+        else 
+        {
+            print(sorted_distribution(var));
+        }
+    }
+private:
+    std::ostream* output_;
+    std::size_t samples_;
+
+    // print (value, probability) pairs in ascending order of values
+    template<typename List>
+    void print(const List& values)
+    {
+        std::string buffer = samples_ > 0 ? 
+            "value,pmf,cdf,ci_lower,ci_upper\n" : 
+            "value,pmf,cdf\n";
+        dice::storage::real_type sum = 0;
+        for (auto&& pair : values)
+        {
+            sum += pair.second;
+            buffer += std::to_string(static_cast<int>(pair.first));
+            buffer += ',';
+            buffer += format_number(pair.second);
+            buffer += ',';
+            buffer += format_number(sum);
+            if (samples_ > 0)
+            {
+                auto interval = dice::estimate_interval(pair.second, samples_);
+                buffer += ',';
+                buffer += format_number(interval.lower);
+                buffer += ',';
+                buffer += format_number(interval.upper);
+            }
+            buffer += '\n';
+        }
+        buffer += '\n';
+        output_->write(buffer.data(), buffer.size());
+    }
+};
+
+/** Print each value as a JSON object on a single line.
+ *
+ * Numbers are printed as {"type":"int","value":1} (or "real"). 
+ * Distributions are printed as {"type":"rand_var","values":[...],
+ * "pmf":[...],"pruned":0} with values sorted in ascending order. Sampled
+ * distributions have "ci_lower" and "ci_upper" arrays as well.
+ */
+class json_visitor : public dice::value_visitor
+{
+public:
+    explicit json_visitor(std::ostream* output, std::size_t samples) : 
+        output_(output),
+        samples_(samples) {}
+
+    void visit(dice::type_int* value) override
+    {
+        *output_ << "{\"type\":\"int\",\"value\":" << value->data() 
+            << "}\n";
+    }
+    
+    void visit(dice::type_real* value) override
+    {
+        *output_ << "{\"type\":\"real\",\"value\":" 
+            << format_real(value->data()) << "}\n";
+    }
+
+    void visit(dice::type_rand_var* value) override
+    {
+        auto var = value->data().to_random_variable();
+
+        // the dense storage is already sorted
+        if (var.is_dense())
+        {
+            print(var, var);
+        }
+        else 
+        {
+            print(sorted_distribution(var), var);
+        }
+    }
+private:
+    std::ostream* output_;
+    std::size_t samples_;
+
+    // print (value, probability) pairs in ascending order of values
+    template<typename List>
+    void print(
+        const List& values, 
+        const dice::storage::random_variable_type::var_type& var)
+    {
+        std::string buffer = "{\"type\":\"rand_var\",\"values\":[";
+        append_list(buffer, values, [](auto&& pair)
+        {
+            return std::to_string(static_cast<int>(pair.first));
+        });
+        buffer += "],\"pmf\":[";
+        append_list(buffer, values, [](auto&& pair)
+        {
+            return format_number(pair.second);
+        });
+        buffer += "]";
+        if (samples_ > 0)
+        {
+            auto samples = samples_;
+            buffer += ",\"ci_lower\":[";
+            append_list(buffer, values, [samples](auto&& pair)
+            {
+                return format_number(
+                    dice::estimate_interval(pair.second, samples).lower);
+            });
+            buffer += "],\"ci_upper\":[";
+            append_list(buffer, values, [samples](auto&& pair)
+            {
+                return format_number(
+                    dice::estimate_interval(pair.second, samples).upper);
+            });
+            buffer += "]";
+        }
+        buffer += ",\"pruned\":";
+        buffer += format_number(var.discarded_probability());
+        buffer += "}\n";
+        output_->write(buffer.data(), buffer.size());
+    }
+
+    // JSON does not have infinity or NaN
+    static std::string format_real(double value)
+    {
+        return std::isfinite(value) ? format_number(value) : "null";
+    }
+
+    template<typename List, typename Format>
+    static void append_list(std::string& buffer, List&& list, Format format)
+    {
+        for (auto it = list.begin(); it != list.end(); ++it)
+        {
+            if (it != list.begin())
+            {
+                buffer += ',';
+            }
+            buffer += format(*it);
+        }
+    }
+};
+
+/** Print values as blocks of 64-bit numbers in native byte order.
+ *
+ * Each block starts with its kind (0 = int, 1 = real, 2 = distribution, 
+ * 3 = sparse distribution). An int is followed by int64 value. A real is 
+ * followed by double value. A distribution is followed by int64 offset 
+ * (the smallest value), uint64 count, double pruned probability and count
+ * doubles with probabilities of values offset, offset + 1, ..., offset + 
+ * count - 1. A sparse distribution is followed by uint64 count, double 
+ * pruned probability and count pairs of int64 value and double 
+ * probability in ascending order of values. All fields are 8 bytes long 
+ * so that all blocks of a mapped file are aligned.
+ */
+class binary_visitor : public dice::value_visitor
+{
+public:
+    explicit binary_visitor(std::ostream* output) : output_(output) {}
+
+    void visit(dice::type_int* value) override
+    {
+        write_field<std::uint64_t>(0);
+        write_field<std::int64_t>(static_cast<int>(value->data()));
+    }
+    
+    void visit(dice::type_real* value) override
+    {
+        write_field<std::uint64_t>(1);
+        write_field<double>(value->data());
+    }
+
+    void visit(dice::type_rand_var* value) override
+    {
+        auto var = value->data().to_random_variable();
+        if (!var.is_dense())
+        {
+            // values may be spread over a large range
+            auto values = sorted_distribution(var);
+            write_field<std::uint64_t>(3);
+            write_field<std::uint64_t>(values.size());
+            write_field<double>(var.discarded_probability());
+            for (auto&& pair : values)
+            {
+                write_field<std::int64_t>(static_cast<int>(pair.first));
+                write_field<double>(pair.second);
+            }
+            return;
+        }
+
+        std::int64_t offset = 0;
+        std::uint64_t count = 0;
+        if (!var.empty())
+        {
+            offset = static_cast<int>(var.min_value());
+            count = static_cast<std::uint64_t>(
+                static_cast<int>(var.max_value()) - offset + 1);
         }
+
+        write_field<std::uint64_t>(2);
+        write_field<std::int64_t>(offset);
+        write_field<std::uint64_t>(count);
+        write_field<double>(var.discarded_probability());
+
+        // the dense storage is sorted, only skipped zeros are filled in
+        std::vector<double> buffer;
+        buffer.reserve(std::min<std::uint64_t>(count, buffer_size));
+        auto append = [&](double probability)
+        {
+            buffer.push_back(probability);
+            if (buffer.size() >= buffer_size)
+            {
+                write_buffer(buffer);
+            }
+        };
+
+        auto next = offset;
+        for (auto&& pair : var)
+        {
+            for (; next < static_cast<int>(pair.first); ++next)
+            {
+                append(0);
+            }
+            append(static_cast<double>(pair.second));
+            ++next;
+        }
+        write_buffer(buffer);
+    }
+private:
+    std::ostream* output_;
+
+    // number of probabilities written at once
+    static const std::size_t buffer_size = 4096;
+
+    template<typename T>
+    void write_field(T value)
+    {
+        static_assert(sizeof(T) == 8, "All fields have to be 8 bytes long.");
+        output_->write(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    void write_buffer(std::vector<double>& buffer)
+    {
+        output_->write(
+            reinterpret_cast<const char*>(buffer.data()),
+            buffer.size() * sizeof(double));
+        buffer.clear();
     }
 };
 
+const std::size_t binary_visitor::buffer_size;
+
 struct options
 {
     // Command line arguments
@@ -93,6 +480,28 @@ struct options
     std::istream* input;
     // File path if input is a file, "<arguments>" otherwise
     std::string input_name;
+    // Number of threads (0 to use all hardware threads)
+    std::size_t threads = 0;
+    // Limits of decompositions (0 for no limit)
+    dice::budget limits;
+    // Number of Monte Carlo samples (0 to compute distributions exactly)
+    std::size_t samples = 0;
+    // Seed of the Monte Carlo sampler and of the roll function
+    std::uint64_t seed = 0;
+    // True iff the seed has been set
+    bool has_seed = false;
+    // List of scripts of the batch mode (a file, a directory or "-")
+    std::string batch;
+    // Port of the server mode (0 if it is disabled)
+    unsigned short port = 0;
+    // Format of printed values
+    output_format format = output_format::table;
+    // File with distributions shared by processes (empty not to use it)
+    std::string cache_file;
+    // True iff a profile of the evaluation is printed
+    bool profile = false;
+    // Maximal duration of an evaluation in seconds (0 for no limit)
+    double timeout = 0;
 
     options(int argc, char** argv) : 
         args(argv, argv + argc), 
@@ -105,6 +514,30 @@ private:
     std::ifstream input_file_;
     std::stringstream input_mem_;
 
+    // move to the value of an option and return it
+    const std::string& option_value(std::vector<std::string>::iterator& it)
+    {
+        if (it + 1 == args.end())
+        {
+            throw std::invalid_argument{ 
+                "Missing value for the " + *it + " option." };
+        }
+        return *++it;
+    }
+
+    static output_format parse_format(const std::string& name)
+    {
+        if (name == "table")
+            return output_format::table;
+        if (name == "csv")
+            return output_format::csv;
+        if (name == "json")
+            return output_format::json;
+        if (name == "binary")
+            return output_format::binary;
+        throw std::invalid_argument{ "Unknown output format: " + name };
+    }
+
     void parse()
     {
         auto it = args.begin() + 1; // first arg is the file path
@@ -125,6 +558,75 @@ private:
                 input = &input_file_;
                 load_from_file = true;
             }
+            else if (*it == "--prune-epsilon") // pruning of tails
+            {
+                dice::pruning::epsilon = std::stod(option_value(it));
+            }
+            else if (*it == "--max-support") // maximal number of values
+            {
+                dice::pruning::max_size = std::stoul(option_value(it));
+            }
+            else if (*it == "--threads") // number of threads
+            {
+                threads = std::stoul(option_value(it));
+            }
+            else if (*it == "--max-leaves") // budget of decomposition leafs
+            {
+                limits.max_leaves = std::stoul(option_value(it));
+            }
+            else if (*it == "--max-memory") // memory limit of a value
+            {
+                limits.max_bytes = std::stoul(option_value(it));
+            }
+            else if (*it == "--sample") // number of Monte Carlo samples
+            {
+                samples = std::stoul(option_value(it));
+                if (samples == 0)
+                {
+                    throw std::invalid_argument{ 
+                        "Number of samples has to be a positive integer." };
+                }
+            }
+            else if (*it == "--batch") // evaluate many scripts
+            {
+                batch = option_value(it);
+            }
+            else if (*it == "--serve") // evaluate requests from a socket
+            {
+                auto value = std::stoul(option_value(it));
+                if (value == 0 || value > 65535)
+                {
+                    throw std::invalid_argument{ 
+                        "Invalid port number: " + std::to_string(value) };
+                }
+                port = static_cast<unsigned short>(value);
+            }
+            else if (*it == "--format") // machine readable output
+            {
+                format = parse_format(option_value(it));
+            }
+            else if (*it == "--cache-file") // persistent distributions
+            {
+                cache_file = option_value(it);
+            }
+            else if (*it == "--timeout") // deadline of an evaluation
+            {
+                timeout = std::stod(option_value(it));
+                if (timeout <= 0)
+                {
+                    throw std::invalid_argument{ 
+                        "Timeout has to be a positive number of seconds." };
+                }
+            }
+            else if (*it == "--profile") // print the hottest operations
+            {
+                profile = true;
+            }
+            else if (*it == "--seed") // seed of the sampler
+            {
+                seed = std::stoull(option_value(it));
+                has_seed = true;
+            }
             else 
             {
                 break;
@@ -172,18 +674,721 @@ struct command_reader
     }
 };
 
-/** Print computed values to standard output.
+/** Print computed values to an output stream.
+ *
+ * The output is only flushed after all values have been printed.
+ *
  * @param values list (result of the dice::parser::parse() method)
+ * @param samples number of samples of the values (0 if they are exact)
+ * @param format of the values
+ * @param output stream
  */
 template<typename ValueList>
-void print_values(const ValueList& values)
+void print_values(
+    const ValueList& values, 
+    std::size_t samples, 
+    output_format format = output_format::table,
+    std::ostream* output = &std::cout)
 {
-    formatting_visitor format;
+    formatting_visitor table{ output, samples };
+    csv_visitor csv{ output, samples };
+    json_visitor json{ output, samples };
+    binary_visitor binary{ output };
+
+    dice::value_visitor* visitor = &table;
+    if (format == output_format::csv)
+    {
+        visitor = &csv;
+    }
+    else if (format == output_format::json)
+    {
+        visitor = &json;
+    }
+    else if (format == output_format::binary)
+    {
+        visitor = &binary;
+    }
+
     for (auto&& value : values)
     {
         if (value == nullptr)
             continue;
-        value->accept(&format);
+        value->accept(visitor);
+    }
+    output->flush();
+}
+
+// Set options of a calculator
+void configure(dice::calculator& calc, const options& opt)
+{
+    calc.limits = opt.limits;
+    calc.samples = opt.samples;
+    calc.seed = opt.seed;
+    if (dice::distribution_store::instance().is_open())
+    {
+        calc.cache.store = &dice::distribution_store::instance();
+    }
+    if (opt.has_seed)
+    {
+        calc.env.seed(opt.seed);
+    }
+}
+
+/** Start measuring the timeout of an evaluation.
+ * @param token cancellation token of the evaluation
+ * @param timeout in seconds (0 for no limit)
+ * @return token if there is a timeout, nullptr otherwise
+ */
+dice::cancellation* start_timeout(dice::cancellation& token, double timeout)
+{
+    if (timeout <= 0)
+        return nullptr;
+
+    token.set_timeout(std::chrono::duration_cast<
+        dice::cancellation::clock::duration>(
+            std::chrono::duration<double>(timeout)));
+    return &token;
+}
+
+/** List script files (*.dice) in a directory.
+ * @param path of the directory
+ * @param out_files sorted paths of the scripts
+ * @return true iff path is a directory
+ */
+bool list_directory(
+    const std::string& path, 
+    std::vector<std::string>& out_files)
+{
+    const std::string extension = ".dice";
+    auto is_script = [&](const std::string& name) 
+    {
+        return name.size() > extension.size() && 
+            name.compare(name.size() - extension.size(), 
+                extension.size(), extension) == 0;
+    };
+
+#ifdef _WIN32
+    WIN32_FIND_DATAA entry;
+    auto handle = FindFirstFileA((path + "\\*").c_str(), &entry);
+    if (handle == INVALID_HANDLE_VALUE)
+        return false;
+    do
+    {
+        std::string name = entry.cFileName;
+        if ((entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0 && 
+            is_script(name))
+        {
+            out_files.push_back(path + "\\" + name);
+        }
+    } while (FindNextFileA(handle, &entry));
+    FindClose(handle);
+#else
+    auto dir = opendir(path.c_str());
+    if (dir == nullptr)
+        return false;
+    while (auto entry = readdir(dir))
+    {
+        std::string name = entry->d_name;
+        if (is_script(name))
+        {
+            out_files.push_back(path + "/" + name);
+        }
+    }
+    closedir(dir);
+#endif
+
+    std::sort(out_files.begin(), out_files.end());
+    return true;
+}
+
+/** Read paths of scripts of the batch mode.
+ * @param batch directory with scripts, file with 1 path per line or "-" 
+ *        to read the paths from the standard input
+ * @return paths of the scripts
+ */
+std::vector<std::string> batch_scripts(const std::string& batch)
+{
+    std::vector<std::string> result;
+    if (batch != "-" && list_directory(batch, result))
+        return result;
+
+    std::ifstream file;
+    std::istream* input = &std::cin;
+    if (batch != "-")
+    {
+        file.open(batch);
+        if (file.fail())
+        {
+            throw std::invalid_argument{ "File not found: " + batch };
+        }
+        input = &file;
+    }
+
+    std::string line;
+    while (std::getline(*input, line))
+    {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if (!line.empty())
+            result.push_back(line);
+    }
+    return result;
+}
+
+// Script evaluated in the batch mode
+struct batch_job
+{
+    std::string path;
+    // printed values
+    std::stringstream output;
+    // reported errors
+    std::stringstream errors;
+    // true iff the script could not be read
+    bool failed = false;
+    // true iff the script has been evaluated
+    bool is_done = false;
+};
+
+/** Evaluate many scripts in parallel.
+ *
+ * Each worker thread has its own calculator (the roll cache is shared). 
+ * Results are printed in input order. Output of each script is preceded 
+ * by a line with its path. Errors are printed to the standard error 
+ * output (each line starts with the path of the script).
+ *
+ * @param opt options of the program
+ * @return exit code
+ */
+int evaluate_batch(const options& opt)
+{
+    auto scripts = batch_scripts(opt.batch);
+    std::vector<batch_job> jobs(scripts.size());
+    for (std::size_t i = 0; i < jobs.size(); ++i)
+    {
+        jobs[i].path = scripts[i];
+    }
+
+    std::mutex lock;
+    std::condition_variable done;
+    std::atomic<std::size_t> next{ 0 };
+    auto work = [&]()
+    {
+        dice::calculator calc{ 1 };
+        configure(calc, opt);
+        for (;;)
+        {
+            auto index = next++;
+            if (index >= jobs.size())
+                break;
+
+            auto&& job = jobs[index];
+            calc.log = dice::logger{ &job.errors };
+            calc.env.clear_variables();
+            if (opt.has_seed)
+            {
+                // rolls don't depend on the worker which runs the script
+                calc.env.seed(dice::sample_engine::mix(opt.seed + index));
+            }
+
+            std::ifstream input{ job.path };
+            if (input.fail())
+            {
+                job.errors << "File not found" << std::endl;
+                job.failed = true;
+            }
+            else
+            {
+                print_values(calc.evaluate(&input), calc.samples, opt.format, 
+                    &job.output);
+            }
+
+            std::lock_guard<std::mutex> guard{ lock };
+            job.is_done = true;
+            done.notify_all();
+        }
+    };
+
+    auto count = opt.threads > 0 ? 
+        opt.threads : 
+        std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+    count = std::min(count, std::max<std::size_t>(jobs.size(), 1));
+    std::vector<std::thread> workers;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        workers.emplace_back(work);
+    }
+
+    int result = 0;
+    for (auto&& job : jobs)
+    {
+        {
+            std::unique_lock<std::mutex> guard{ lock };
+            done.wait(guard, [&]() { return job.is_done; });
+        }
+
+        std::cout << "# " << job.path << std::endl << job.output.str();
+        std::cout.flush();
+        // tag errors by the script
+        std::string error;
+        while (std::getline(job.errors, error))
+        {
+            std::cerr << job.path << ": " << error << std::endl;
+        }
+        if (job.failed)
+        {
+            result = 1;
+        }
+
+        // release the output of printed scripts
+        job.output.str("");
+        job.errors.str("");
+    }
+
+    for (auto&& worker : workers)
+    {
+        worker.join();
+    }
+    return result;
+}
+
+#ifdef _WIN32
+using socket_type = SOCKET;
+const socket_type invalid_socket = INVALID_SOCKET;
+
+void close_socket(socket_type socket)
+{
+    closesocket(socket);
+}
+#else
+using socket_type = int;
+const socket_type invalid_socket = -1;
+
+void close_socket(socket_type socket)
+{
+    close(socket);
+}
+#endif
+
+/** Send the whole string to a socket.
+ * @param socket connected socket
+ * @param data sent data
+ * @return true iff all data has been sent
+ */
+bool send_all(socket_type socket, const std::string& data)
+{
+#ifdef MSG_NOSIGNAL
+    const int flags = MSG_NOSIGNAL; // don't kill the server if a client quits
+#else
+    const int flags = 0;
+#endif
+
+    std::size_t sent = 0;
+    while (sent < data.size())
+    {
+        auto size = std::min<std::size_t>(data.size() - sent, 1 << 16);
+        auto result = send(socket, data.data() + sent, 
+            static_cast<int>(size), flags);
+        if (result <= 0)
+            return false;
+        sent += static_cast<std::size_t>(result);
+    }
+    return true;
+}
+
+/** Normalize text of a script so that equivalent scripts have the same key.
+ *
+ * Whitespace next to an operator (or a parenthesis, a comma, ...) is 
+ * removed unless it separates 2 operators (e.g., "< =" is not "<="). 
+ * Other whitespace is replaced by 1 space.
+ *
+ * @param script text of a script
+ * @return normalized text
+ */
+std::string normalize_script(const std::string& script)
+{
+    auto is_space = [](char c) 
+    { 
+        return std::isspace(static_cast<unsigned char>(c)) != 0; 
+    };
+    auto is_operator = [](char c)
+    {
+        return std::ispunct(static_cast<unsigned char>(c)) != 0 && 
+            c != '_' && c != '.';
+    };
+
+    std::string result;
+    for (std::size_t i = 0; i < script.size(); ++i)
+    {
+        if (!is_space(script[i]))
+        {
+            result += script[i];
+            continue;
+        }
+
+        auto next = i;
+        while (next < script.size() && is_space(script[next]))
+            ++next;
+        if (!result.empty() && next < script.size())
+        {
+            auto before = is_operator(result.back());
+            auto after = is_operator(script[next]);
+            if (before == after)
+            {
+                result += ' ';
+            }
+        }
+        i = next - 1;
+    }
+    return result;
+}
+
+/** Calculators and a cache of results of the server mode.
+ *
+ * Requests are evaluated concurrently by a fixed set of calculators which
+ * are created once (so each request only parses and evaluates a script).
+ * Results of scripts which don't call a function with side effects are 
+ * cached by their normalized text. The cache is cleared if it gets larger
+ * than max_cache_size.
+ */
+class server
+{
+public:
+    /** Maximal number of cached results. */
+    static const std::size_t max_cache_size = 4096;
+
+    /** Maximal length of a request line in bytes. */
+    static const std::size_t max_line_size = 64 * 1024;
+
+    /** Maximal number of connected clients. */
+    static const std::size_t max_connections = 64;
+
+    /** Create calculators.
+     * @param opt options of the program (the number of threads is the
+     *        number of requests which are evaluated concurrently)
+     */
+    explicit server(const options& opt) : 
+        timeout_(opt.timeout), 
+        format_(opt.format)
+    {
+        // responses are terminated by a line with a dot
+        if (format_ == output_format::binary)
+        {
+            throw std::invalid_argument{ 
+                "Binary output can't be used in the server mode." };
+        }
+
+        auto count = opt.threads > 0 ? 
+            opt.threads : 
+            std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            calculators_.push_back(std::make_unique<dice::calculator>(1));
+            configure(*calculators_.back(), opt);
+            free_.push_back(calculators_.back().get());
+        }
+    }
+
+    /** Evaluate a script.
+     * @param script text of the script
+     * @return printed values followed by errors
+     */
+    std::string evaluate(const std::string& script)
+    {
+        auto start = std::chrono::steady_clock::now();
+        auto key = normalize_script(script);
+        std::string result;
+        bool is_hit = false;
+        std::size_t largest_value = 0;
+        {
+            std::lock_guard<std::mutex> guard{ cache_lock_ };
+            auto it = cache_.find(key);
+            if (it != cache_.end())
+            {
+                result = it->second;
+                is_hit = true;
+            }
+        }
+
+        if (!is_hit)
+        {
+            bool is_deterministic = false;
+            auto calc = acquire();
+            try
+            {
+                std::stringstream output;
+                std::stringstream errors;
+                calc->log = dice::logger{ &errors };
+                calc->env.clear_variables();
+                dice::cancellation token;
+                dice::cancellation::scope token_scope{ 
+                    start_timeout(token, timeout_) };
+                auto plan = calc->prepare(script);
+                is_deterministic = plan.is_deterministic();
+                print_values(calc->execute(plan), calc->samples, format_, 
+                    &output);
+                result = output.str() + errors.str();
+                largest_value = calc->largest_value_memory();
+            }
+            catch (...)
+            {
+                release(calc);
+                throw;
+            }
+            release(calc);
+
+            if (is_deterministic)
+            {
+                std::lock_guard<std::mutex> guard{ cache_lock_ };
+                if (cache_.size() >= max_cache_size)
+                {
+                    cache_.clear();
+                }
+                cache_[key] = result;
+            }
+        }
+
+        auto latency = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        std::lock_guard<std::mutex> guard{ stats_lock_ };
+        ++requests_;
+        if (is_hit)
+        {
+            ++hits_;
+        }
+        total_latency_ += latency;
+        max_latency_ = std::max<std::int64_t>(max_latency_, latency);
+        largest_value_ = std::max(largest_value_, largest_value);
+        return result;
+    }
+
+    /** Format statistics of the server.
+     * @return 1 statistic per line
+     */
+    std::string statistics()
+    {
+        std::size_t cache_size = 0;
+        {
+            std::lock_guard<std::mutex> guard{ cache_lock_ };
+            cache_size = cache_.size();
+        }
+
+        std::lock_guard<std::mutex> guard{ stats_lock_ };
+        std::stringstream result;
+        result << "requests: " << requests_ << std::endl
+            << "cache hits: " << hits_ << std::endl
+            << "cache misses: " << requests_ - hits_ << std::endl
+            << "cache size: " << cache_size << std::endl
+            << "mean latency: " << (requests_ == 0 ? 0 : 
+                total_latency_ / static_cast<std::int64_t>(requests_))
+            << " us" << std::endl
+            << "max latency: " << max_latency_ << " us" << std::endl
+            << "largest value: " << largest_value_ << " bytes" << std::endl;
+        return result.str();
+    }
+
+    /** Try to reserve a connection for a new client.
+     * @return true iff there are less than max_connections clients (the 
+     *         connection has to be released by handle or disconnect)
+     */
+    bool try_connect()
+    {
+        auto count = connections_.load();
+        while (count < max_connections)
+        {
+            if (connections_.compare_exchange_weak(count, count + 1))
+                return true;
+        }
+        return false;
+    }
+
+    /** Release a connection reserved by try_connect. */
+    void disconnect()
+    {
+        --connections_;
+    }
+
+    /** Handle requests of a client until it disconnects.
+     *
+     * Each line of the input is a script. The response is the output of 
+     * the script followed by a line with a single dot. Line ":stats" 
+     * prints statistics of the server and ":quit" closes the connection.
+     * A line longer than max_line_size is answered with an error. If the
+     * client sends more than max_line_size bytes without a new line, the
+     * connection is closed after the error. The connection reserved by 
+     * try_connect is released when the client disconnects.
+     *
+     * @param client connected socket
+     */
+    void handle(socket_type client)
+    {
+        const std::string line_error = "Line is longer than " + 
+            std::to_string(max_line_size) + " bytes.\n.\n";
+        std::string buffer;
+        char data[4096];
+        bool is_open = true;
+        while (is_open)
+        {
+            auto size = recv(client, data, sizeof(data), 0);
+            if (size <= 0)
+                break;
+            buffer.append(data, static_cast<std::size_t>(size));
+
+            std::size_t end;
+            while (is_open && (end = buffer.find('\n')) != std::string::npos)
+            {
+                auto line = buffer.substr(0, end);
+                buffer.erase(0, end + 1);
+                if (!line.empty() && line.back() == '\r')
+                    line.pop_back();
+
+                if (line == ":quit")
+                {
+                    is_open = false;
+                    break;
+                }
+
+                if (line.size() > max_line_size)
+                {
+                    is_open = send_all(client, line_error);
+                    continue;
+                }
+
+                std::string response;
+                try
+                {
+                    response = line == ":stats" ? 
+                        statistics() : 
+                        evaluate(line);
+                }
+                catch (std::exception& error)
+                {
+                    response = std::string{ error.what() } + "\n";
+                }
+                is_open = send_all(client, response + ".\n");
+            }
+
+            // don't buffer a line without a limit
+            if (is_open && buffer.size() > max_line_size)
+            {
+                send_all(client, line_error);
+                is_open = false;
+            }
+        }
+        close_socket(client);
+        disconnect();
+    }
+private:
+    double timeout_;
+    output_format format_;
+    std::vector<std::unique_ptr<dice::calculator>> calculators_;
+
+    // calculators which don't evaluate a request
+    std::mutex free_lock_;
+    std::condition_variable is_free_;
+    std::vector<dice::calculator*> free_;
+
+    std::mutex cache_lock_;
+    std::unordered_map<std::string, std::string> cache_;
+
+    std::mutex stats_lock_;
+    std::size_t requests_ = 0;
+    std::size_t hits_ = 0;
+    std::int64_t total_latency_ = 0;
+    std::int64_t max_latency_ = 0;
+    // memory of the largest value of all evaluated scripts in bytes
+    std::size_t largest_value_ = 0;
+
+    // number of connected clients
+    std::atomic<std::size_t> connections_{ 0 };
+
+    dice::calculator* acquire()
+    {
+        std::unique_lock<std::mutex> guard{ free_lock_ };
+        is_free_.wait(guard, [this]() { return !free_.empty(); });
+        auto result = free_.back();
+        free_.pop_back();
+        return result;
+    }
+
+    void release(dice::calculator* calc)
+    {
+        {
+            std::lock_guard<std::mutex> guard{ free_lock_ };
+            free_.push_back(calc);
+        }
+        is_free_.notify_one();
+    }
+};
+
+const std::size_t server::max_cache_size;
+const std::size_t server::max_line_size;
+const std::size_t server::max_connections;
+
+/** Accept connections on a local port and evaluate their requests.
+ * @param opt options of the program
+ * @return exit code (it only returns if the port can't be used)
+ */
+int serve(const options& opt)
+{
+#ifdef _WIN32
+    WSADATA wsa_data;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0)
+    {
+        std::cerr << "Unable to initialize sockets." << std::endl;
+        return 1;
+    }
+#endif
+
+    auto listener = socket(AF_INET, SOCK_STREAM, 0);
+    if (listener == invalid_socket)
+    {
+        std::cerr << "Unable to create a socket." << std::endl;
+        return 1;
+    }
+
+    int reuse = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, 
+        reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+
+    // only accept local connections
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(opt.port);
+    if (bind(listener, reinterpret_cast<sockaddr*>(&address), 
+            sizeof(address)) != 0 ||
+        listen(listener, SOMAXCONN) != 0)
+    {
+        std::cerr << "Unable to listen on port " << opt.port << std::endl;
+        close_socket(listener);
+        return 1;
+    }
+
+    static server instance{ opt };
+    std::cout << "Listening on 127.0.0.1:" << opt.port << std::endl;
+    for (;;)
+    {
+        auto client = accept(listener, nullptr, nullptr);
+        if (client == invalid_socket)
+            continue;
+
+        // reject a client instead of starting an unbounded number of threads
+        if (!instance.try_connect())
+        {
+            send_all(client, "Too many connections.\n.\n");
+            close_socket(client);
+            continue;
+        }
+        try
+        {
+            std::thread{ [client]() { instance.handle(client); } }.detach();
+        }
+        catch (std::exception&)
+        {
+            // the thread could not be started
+            instance.disconnect();
+            close_socket(client);
+        }
     }
 }
 
@@ -192,7 +1397,43 @@ int main(int argc, char** argv)
     try
     {
         options opt{ argc, argv };
-        dice::calculator calc;
+        if (!opt.cache_file.empty())
+        {
+            auto&& store = dice::distribution_store::instance();
+            if (store.open(opt.cache_file))
+            {
+                using cache_type = dice::roll_cache<
+                    dice::storage::int_type, 
+                    dice::storage::probability_type>;
+                cache_type::instance().set_store(&store);
+            }
+            else 
+            {
+                std::cerr << "Unable to use the cache file: " 
+                    << opt.cache_file << std::endl;
+            }
+        }
+
+        if (!opt.batch.empty())
+        {
+            return evaluate_batch(opt);
+        }
+
+        if (opt.port != 0)
+        {
+            return serve(opt);
+        }
+
+        dice::calculator calc{ opt.threads };
+        configure(calc, opt);
+        calc.profiling = opt.profile;
+
+#ifdef _WIN32
+        if (opt.format == output_format::binary)
+        {
+            _setmode(_fileno(stdout), _O_BINARY);
+        }
+#endif
 
         if (opt.input != nullptr)
         {
@@ -202,7 +1443,10 @@ int main(int argc, char** argv)
                 return 1;
             }
 
-            print_values(calc.evaluate(opt.input));
+            dice::cancellation token;
+            dice::cancellation::scope token_scope{ 
+                start_timeout(token, opt.timeout) };
+            print_values(calc.evaluate(opt.input), calc.samples, opt.format);
         }
         else
         {
@@ -229,14 +1473,37 @@ int main(int argc, char** argv)
                     break;
                 }
 
-                print_values(calc.evaluate(line));
+                try
+                {
+                    dice::cancellation token;
+                    dice::cancellation::scope token_scope{ 
+                        start_timeout(token, opt.timeout) };
+                    print_values(calc.evaluate(line), calc.samples, 
+                        opt.format);
+                }
+                catch (dice::cancelled_error& error)
+                {
+                    std::cerr << error.what() << std::endl;
+                }
             }
         }
+
+        if (opt.profile)
+        {
+            calc.profile().report(std::cerr);
+            std::cerr << "Largest value of the last evaluation: " 
+                << calc.largest_value_memory() << " bytes" << std::endl;
+        }
     }
     catch (std::invalid_argument& error)
     {
         std::cerr << error.what() << std::endl;
         return 1;
     }
+    catch (dice::cancelled_error& error)
+    {
+        std::cerr << error.what() << std::endl;
+        return 1;
+    }
     return 0;
 }
\ No newline at end of file
@@ -201,7 +201,7 @@ namespace dice
                     break;
                 }
             }
-            return std::move(values);
+            return values;
         }
 
         /** Parse a statement and return its result.
@@ -293,6 +293,7 @@ namespace dice
         
                 try 
                 {
+                    int_->set_location(op_location);
                     return int_->rel_in(
                         std::move(left), 
                         std::move(lower_bound), 
@@ -311,9 +312,14 @@ namespace dice
                 eat(symbol_type::rel_op);
                 if (check<nonterminal_type::add>())
                 {
+                    auto right = add();
                     try 
                     {
-                        return int_->rel_op(op.lexeme, std::move(left), add());
+                        int_->set_location(op_location);
+                        return int_->rel_op(
+                            op.lexeme, 
+                            std::move(left), 
+                            std::move(right));
                     }
                     catch (compiler_error& err)
                     {
@@ -325,7 +331,7 @@ namespace dice
                     error("Invalid operand for " + to_string(op));
                 }
             }
-            return std::move(left);
+            return left;
         }
 
         /** Parse an addition and return computed value.
@@ -361,12 +367,18 @@ namespace dice
                 // compute the operator if there won't be any parse error
                 if (check<nonterminal_type::mult>())
                 {
+                    auto right = mult();
                     try
                     {
+                        int_->set_location(op_location);
                         if (op == "+")
-                            result = int_->add(std::move(result), mult());
+                            result = int_->add(
+                                std::move(result), 
+                                std::move(right));
                         else 
-                            result = int_->sub(std::move(result), mult());
+                            result = int_->sub(
+                                std::move(result), 
+                                std::move(right));
                     }
                     catch (compiler_error& err)
                     {
@@ -380,7 +392,7 @@ namespace dice
                         op_location);
                 }
             }
-            return std::move(result);
+            return result;
         }
 
         /** Parse multiplication and return computed value.
@@ -416,12 +428,18 @@ namespace dice
                 // compute the operation if there won't be any parse error
                 if (check<nonterminal_type::dice_roll>())
                 {
+                    auto right = dice_roll();
                     try
                     {
+                        int_->set_location(op_location);
                         if (op == "*")
-                            result = int_->mult(std::move(result), dice_roll());
+                            result = int_->mult(
+                                std::move(result), 
+                                std::move(right));
                         else
-                            result = int_->div(std::move(result), dice_roll());
+                            result = int_->div(
+                                std::move(result), 
+                                std::move(right));
                     }
                     catch (compiler_error& err)
                     {
@@ -435,7 +453,7 @@ namespace dice
                         op_location);
                 }
             }
-            return std::move(result);
+            return result;
         }
 
         /** Parse unary minus and dice roll.
@@ -477,9 +495,13 @@ namespace dice
                     // parse error
                     if (check<nonterminal_type::factor>())
                     {
+                        auto right = factor();
                         try
                         {
-                            result = int_->roll(std::move(result), factor());
+                            int_->set_location(op_location);
+                            result = int_->roll(
+                                std::move(result), 
+                                std::move(right));
                         }
                         catch (compiler_error& err)
                         {
@@ -504,6 +526,7 @@ namespace dice
             {
                 try
                 {
+                    int_->set_location(unary_minus_location);
                     result = int_->unary_minus(std::move(result));
                 }
                 catch (compiler_error& err)
@@ -513,7 +536,7 @@ namespace dice
                 }
             }
 
-            return std::move(result); 
+            return result; 
         }
 
         /** Parse factor and return its value.
@@ -545,7 +568,7 @@ namespace dice
                 }
                 
                 eat(symbol_type::right_paren);
-                return std::move(result);
+                return result;
             }
             else if (lookahead_.type == symbol_type::number)
             {
@@ -565,6 +588,7 @@ namespace dice
 
                 try
                 {
+                    int_->set_location(loc);
                     return int_->call(id.lexeme, std::move(args));
                 }
                 catch (compiler_error& err)
@@ -581,6 +605,7 @@ namespace dice
                 eat(symbol_type::id);
                 try 
                 {
+                    int_->set_location(loc);
                     return int_->variable(id.lexeme);
                 }
                 catch (compiler_error& err)
@@ -617,7 +642,7 @@ namespace dice
             if (lookahead_.type == symbol_type::right_paren)
             {
                 // no arguments
-                return std::move(args); 
+                return args; 
             }
         
             std::size_t number = 0;
@@ -643,7 +668,7 @@ namespace dice
                 eat(symbol_type::param_delim);
                 ++number;
             }
-            return std::move(args);
+            return args;
         }
 
         /** Check whether the lookahead type is in the first set of 
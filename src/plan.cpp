@@ -0,0 +1,772 @@
+#include "plan.hpp"
+#include "profiler.hpp"
+#include "cancellation.hpp"
+
+#include <sstream>
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <cmath>
+#include <cstdint>
+
+namespace
+{
+    using interpreter_type = dice::direct_interpreter<dice::environment>;
+    using value_type = dice::plan::value_type;
+
+    // functions whose result only depends on their arguments
+    const char* const pure_functions[] = {
+        "expectation", "variance", "deviation", "quantile", "min", "max",
+        "keep_highest", "keep_lowest"
+    };
+
+    bool is_pure_function(const std::string& name)
+    {
+        for (auto&& function : pure_functions)
+        {
+            if (name == function)
+                return true;
+        }
+        return false;
+    }
+
+    /** @brief Compute structural keys of all nodes in a tree.
+     *
+     * @param node root of the tree
+     *
+     * @return key of the root (empty if it can't be cached)
+     */
+    const std::string& compute_key(dice::plan_node& node)
+    {
+        using dice::plan_op;
+
+        bool is_pure = node.op != plan_op::variable && 
+            node.op != plan_op::assign &&
+            (node.op != plan_op::call || is_pure_function(node.name));
+        for (auto&& child : node.children)
+        {
+            if (compute_key(*child).empty())
+            {
+                is_pure = false;
+            }
+        }
+
+        if (!is_pure)
+            return node.key;
+
+        std::stringstream key;
+        if (node.op == plan_op::constant)
+        {
+            // keep the type so that 1 and 1.0 are different constants
+            auto int_value = dynamic_cast<dice::type_int*>(node.value.get());
+            auto real_value = dynamic_cast<dice::type_real*>(node.value.get());
+            if (int_value != nullptr)
+            {
+                key << "i" << int_value->data();
+            }
+            else if (real_value != nullptr)
+            {
+                key << "r" << std::hexfloat << real_value->data();
+            }
+            else 
+            {
+                return node.key;
+            }
+        }
+        else
+        {
+            key << static_cast<int>(node.op) << node.name << "(";
+            for (auto&& child : node.children)
+            {
+                key << child->key << ",";
+            }
+            key << ")";
+        }
+        node.key = key.str();
+        return node.key;
+    }
+
+    /** @brief Compute an operation of a node.
+     *
+     * @param node with the operation
+     * @param interpreter which computes it
+     * @param args values of the operands
+     *
+     * @return result of the operation
+     *
+     * @throws compiler_error if the operation fails
+     */
+    value_type apply(
+        const dice::plan_node& node,
+        interpreter_type* interpreter,
+        std::vector<value_type>& args)
+    {
+        using dice::plan_op;
+
+        switch (node.op)
+        {
+        case plan_op::variable:
+            return interpreter->variable(node.name);
+        case plan_op::add:
+            return interpreter->add(std::move(args[0]), std::move(args[1]));
+        case plan_op::sub:
+            return interpreter->sub(std::move(args[0]), std::move(args[1]));
+        case plan_op::mult:
+            return interpreter->mult(std::move(args[0]), std::move(args[1]));
+        case plan_op::div:
+            return interpreter->div(std::move(args[0]), std::move(args[1]));
+        case plan_op::unary_minus:
+            return interpreter->unary_minus(std::move(args[0]));
+        case plan_op::rel_op:
+            return interpreter->rel_op(
+                node.name,
+                std::move(args[0]),
+                std::move(args[1]));
+        case plan_op::rel_in:
+            return interpreter->rel_in(
+                std::move(args[0]),
+                std::move(args[1]),
+                std::move(args[2]));
+        case plan_op::roll:
+            return interpreter->roll(std::move(args[0]), std::move(args[1]));
+        case plan_op::assign:
+            return interpreter->assign(node.name, std::move(args[0]));
+        case plan_op::call:
+            return interpreter->call(node.name, std::move(args));
+        case plan_op::constant:
+            break;
+        }
+        return node.value->clone();
+    }
+
+    // check whether a node is an int or a real constant
+    bool is_number(const dice::plan_node& node)
+    {
+        return node.op == dice::plan_op::constant && (
+            dynamic_cast<const dice::type_int*>(node.value.get()) != nullptr ||
+            dynamic_cast<const dice::type_real*>(node.value.get()) != nullptr);
+    }
+
+    /** @brief Replace subtrees which only compute with numbers by constants.
+     *
+     * Operations which fail (e.g., because of an overflow) are kept in the
+     * tree so that the error is reported when the plan is evaluated.
+     *
+     * @param node root of the tree
+     * @param interpreter which computes the operations
+     */
+    void fold_constants(
+        std::unique_ptr<dice::plan_node>& node, 
+        interpreter_type* interpreter)
+    {
+        using dice::plan_op;
+
+        for (auto&& child : node->children)
+        {
+            fold_constants(child, interpreter);
+        }
+
+        auto op = node->op;
+        if (op == plan_op::constant || op == plan_op::variable ||
+            op == plan_op::assign || op == plan_op::roll ||
+            (op == plan_op::call && !is_pure_function(node->name)))
+            return;
+
+        std::vector<value_type> args;
+        for (auto&& child : node->children)
+        {
+            if (!is_number(*child))
+                return;
+            args.push_back(child->value->clone());
+        }
+
+        value_type value;
+        try
+        {
+            value = apply(*node, interpreter, args);
+        }
+        catch (dice::compiler_error&)
+        {
+            return;
+        }
+
+        auto result = std::make_unique<dice::plan_node>(
+            plan_op::constant,
+            node->location);
+        result->value = std::move(value);
+        if (is_number(*result))
+        {
+            node = std::move(result);
+        }
+    }
+
+    std::size_t count_nodes(const dice::plan_node& node)
+    {
+        std::size_t result = 1;
+        for (auto&& child : node.children)
+        {
+            result += count_nodes(*child);
+        }
+        return result;
+    }
+
+    // check whether a tree only calls functions without side effects
+    bool is_deterministic_node(const dice::plan_node& node)
+    {
+        if (node.op == dice::plan_op::call && !is_pure_function(node.name))
+            return false;
+
+        for (auto&& child : node.children)
+        {
+            if (!is_deterministic_node(*child))
+                return false;
+        }
+        return true;
+    }
+
+    // key of a value of a subexpression in the distribution store
+    // key of a subexpression in the plan_cache (values computed with a
+    // different pruning policy are different)
+    std::string make_cache_key(const dice::plan_node& node)
+    {
+        std::stringstream result;
+        result << std::hexfloat << dice::pruning::epsilon << " " 
+            << dice::pruning::max_size << " " << node.key;
+        return result.str();
+    }
+
+    // make an independent copy of a tree
+    std::unique_ptr<dice::plan_node> copy_tree(const dice::plan_node& node)
+    {
+        auto result = std::make_unique<dice::plan_node>(
+            node.op, 
+            node.location);
+        result->name = node.name;
+        result->key = node.key;
+        if (node.value != nullptr)
+        {
+            result->value = node.value->clone();
+        }
+        for (auto&& child : node.children)
+        {
+            result->children.push_back(copy_tree(*child));
+        }
+        return result;
+    }
+
+    // find names of all variables used in a tree
+    void collect_variables(
+        const dice::plan_node& node, 
+        std::vector<std::string>& out_names)
+    {
+        if (node.op == dice::plan_op::variable && std::find(
+            out_names.begin(), 
+            out_names.end(), 
+            node.name) == out_names.end())
+        {
+            out_names.push_back(node.name);
+        }
+
+        for (auto&& child : node.children)
+        {
+            collect_variables(*child, out_names);
+        }
+    }
+
+    /** @brief Mean, variance and range of a subexpression. */
+    struct moments
+    {
+        double mean;
+        double variance;
+        std::int64_t min;
+        std::int64_t max;
+    };
+
+    // check whether a range of values can be computed without an overflow
+    bool is_int_range(std::int64_t min, std::int64_t max)
+    {
+        return min >= std::numeric_limits<int>::min() &&
+            max <= std::numeric_limits<int>::max();
+    }
+
+    /** @brief Compute moments of a subexpression without its distribution.
+     *
+     * Subexpressions without variables are independent so moments of a
+     * sum or a product follow from moments of the operands. Only constant
+     * ints, dice rolls with a constant number of faces, +, -, * and the 
+     * unary minus are supported. The range is used to detect expressions
+     * which would fail with an overflow if they were evaluated.
+     *
+     * @param node root of the subexpression
+     * @param out_moments computed moments
+     *
+     * @return true iff the moments have been computed (false if the 
+     *         subexpression has to be evaluated)
+     */
+    bool compute_moments(const dice::plan_node& node, moments& out_moments)
+    {
+        using dice::plan_op;
+
+        if (node.op == plan_op::constant)
+        {
+            auto value = dynamic_cast<dice::type_int*>(node.value.get());
+            if (value == nullptr)
+                return false;
+            std::int64_t number = static_cast<int>(value->data());
+            out_moments = moments{ static_cast<double>(number), 0, number, 
+                number };
+            return true;
+        }
+
+        moments left;
+        moments right;
+        if (node.op == plan_op::unary_minus)
+        {
+            if (!compute_moments(*node.children[0], left))
+                return false;
+            out_moments = moments{ -left.mean, left.variance, -left.max, 
+                -left.min };
+        }
+        else if (node.op == plan_op::add || node.op == plan_op::sub ||
+            node.op == plan_op::mult || node.op == plan_op::roll)
+        {
+            if (!compute_moments(*node.children[0], left) ||
+                !compute_moments(*node.children[1], right))
+                return false;
+
+            if (node.op == plan_op::add)
+            {
+                out_moments = moments{ 
+                    left.mean + right.mean, 
+                    left.variance + right.variance,
+                    left.min + right.min, 
+                    left.max + right.max 
+                };
+            }
+            else if (node.op == plan_op::sub)
+            {
+                out_moments = moments{ 
+                    left.mean - right.mean, 
+                    left.variance + right.variance,
+                    left.min - right.max, 
+                    left.max - right.min 
+                };
+            }
+            else if (node.op == plan_op::mult)
+            {
+                // Var(XY) = E[X^2] E[Y^2] - E[X]^2 E[Y]^2
+                auto product = left.mean * right.mean;
+                auto variance = 
+                    (left.variance + left.mean * left.mean) * 
+                    (right.variance + right.mean * right.mean) - 
+                    product * product;
+                std::int64_t bounds[] = { 
+                    left.min * right.min, left.min * right.max,
+                    left.max * right.min, left.max * right.max 
+                };
+                out_moments = moments{ 
+                    product, 
+                    std::max(variance, 0.0),
+                    *std::min_element(std::begin(bounds), std::end(bounds)),
+                    *std::max_element(std::begin(bounds), std::end(bounds))
+                };
+            }
+            else 
+            {
+                // the number of dice can be random but the number of faces 
+                // has to be a positive constant
+                if (left.min <= 0 || right.min != right.max || right.min <= 0)
+                    return false;
+
+                // sum of N dice: E = E[N] mean, Var = E[N] var + Var(N) mean^2
+                auto faces = static_cast<double>(right.min);
+                auto mean = (faces + 1) / 2;
+                auto variance = (faces * faces - 1) / 12;
+                out_moments = moments{ 
+                    left.mean * mean, 
+                    left.mean * variance + left.variance * mean * mean,
+                    left.min, 
+                    left.max * right.max 
+                };
+            }
+        }
+        else 
+        {
+            return false;
+        }
+        return is_int_range(out_moments.min, out_moments.max);
+    }
+
+    /** @brief Compute expectation, variance or deviation from moments.
+     *
+     * Moments are exact. They are not used if pruning is enabled so that
+     * the result is the same as if the distribution was computed.
+     *
+     * @param node call of a function
+     * @param out_value computed value
+     *
+     * @return true iff the value has been computed
+     */
+    bool try_moment_function(const dice::plan_node& node, value_type& out_value)
+    {
+        if (node.op != dice::plan_op::call || node.children.size() != 1 ||
+            dice::pruning::enabled())
+            return false;
+
+        auto&& name = node.name;
+        if (name != "expectation" && name != "variance" && name != "deviation")
+            return false;
+
+        moments result;
+        if (!compute_moments(*node.children[0], result))
+            return false;
+
+        auto value = result.mean;
+        if (name == "variance")
+        {
+            value = result.variance;
+        }
+        else if (name == "deviation")
+        {
+            value = std::sqrt(result.variance);
+        }
+        out_value = dice::make<dice::type_real>(value);
+        return true;
+    }
+
+    struct evaluation_context
+    {
+        interpreter_type* interpreter;
+        dice::logger* log;
+        dice::plan_cache* cache;
+        // number of errors reported so far
+        std::size_t errors;
+    };
+
+    value_type evaluate(
+        const dice::plan_node& node,
+        evaluation_context& context);
+
+    /** @brief Record a definition so that it is updated if an input changes.
+     *
+     * See environment::set_definition.
+     *
+     * @param node assignment
+     * @param context of the evaluation
+     */
+    void record_definition(
+        const dice::plan_node& node,
+        evaluation_context& context)
+    {
+        std::vector<std::string> inputs;
+        collect_variables(*node.children[0], inputs);
+        if (inputs.empty())
+            return;
+
+        // the plan can be destroyed before the definition is used
+        std::shared_ptr<const dice::plan_node> tree = copy_tree(
+            *node.children[0]);
+        auto interpreter = context.interpreter;
+        auto log = context.log;
+        auto cache = context.cache;
+        interpreter->set_definition(node.name, std::move(inputs), [=]()
+        {
+            // the value can be computed while another definition is
+            // being evaluated
+            auto is_nested = interpreter->is_definition();
+            interpreter->enter_assign();
+            auto value = interpreter->finish_definition(
+                dice::evaluate_tree(*tree, interpreter, log, cache));
+            if (is_nested)
+            {
+                interpreter->enter_assign();
+            }
+            return value;
+        });
+    }
+
+    // name of the operation of a node in a profile
+    std::string operation_name(const dice::plan_node& node)
+    {
+        using dice::plan_op;
+
+        switch (node.op)
+        {
+        case plan_op::add:
+            return "+";
+        case plan_op::sub:
+        case plan_op::unary_minus:
+            return "-";
+        case plan_op::mult:
+            return "*";
+        case plan_op::div:
+            return "/";
+        case plan_op::rel_in:
+            return "in";
+        case plan_op::roll:
+            return "d";
+        case plan_op::assign:
+            return "var " + node.name;
+        case plan_op::constant:
+            return "constant";
+        case plan_op::variable:
+        case plan_op::rel_op:
+        case plan_op::call:
+            break;
+        }
+        return node.name;
+    }
+
+    // compute the operation of a node whose operands have been evaluated
+    value_type apply_node(
+        const dice::plan_node& node,
+        evaluation_context& context,
+        std::vector<value_type>& args)
+    {
+        auto interpreter = context.interpreter;
+        auto result = apply(node, interpreter, args);
+        if (node.op == dice::plan_op::assign && 
+            interpreter->get_variable_redefinition())
+        {
+            record_definition(node, context);
+        }
+        return result;
+    }
+
+    // evaluate a node of an expression tree
+    value_type evaluate_node(
+        const dice::plan_node& node,
+        evaluation_context& context)
+    {
+        using dice::plan_op;
+
+        auto interpreter = context.interpreter;
+        if (node.op == plan_op::constant)
+        {
+            return node.value->clone();
+        }
+
+        // don't compute distributions if only their moments are used
+        value_type moment;
+        if (try_moment_function(node, moment))
+        {
+            return moment;
+        }
+
+        if (node.op == plan_op::assign)
+        {
+            interpreter->enter_assign();
+        }
+
+        // evaluate operands
+        std::vector<value_type> args;
+        for (auto&& child : node.children)
+        {
+            args.push_back(evaluate(*child, context));
+        }
+
+        auto token = dice::cancellation::current();
+        if (token != nullptr)
+        {
+            token->check();
+            token->add_work(1);
+        }
+
+        try
+        {
+            auto profile = dice::profiler::current();
+            if (profile == nullptr)
+            {
+                return apply_node(node, context, args);
+            }
+
+            dice::profiler::measurement measure{ profile };
+            auto result = apply_node(node, context, args);
+            profile->record_location(dice::profiler::location{
+                node.location.line,
+                node.location.col,
+                operation_name(node)
+            }, measure.stop(profile));
+            return result;
+        }
+        catch (dice::compiler_error& err)
+        {
+            context.log->error(
+                node.location.line, 
+                node.location.col, 
+                err.what());
+            ++context.errors;
+            if (node.op == plan_op::assign)
+                return nullptr;
+        }
+        return interpreter->make_default();
+    }
+
+    // evaluate a subtree or use its cached value
+    value_type evaluate(
+        const dice::plan_node& node,
+        evaluation_context& context)
+    {
+        if (context.cache == nullptr || 
+            node.key.empty() || 
+            node.op == dice::plan_op::constant)
+        {
+            return evaluate_node(node, context);
+        }
+
+        auto key = make_cache_key(node);
+        auto value = context.cache->find(key);
+        if (value != nullptr)
+        {
+            return value->clone();
+        }
+
+        auto store = context.cache->store;
+        std::string store_key;
+        if (store != nullptr)
+        {
+            store_key = "plan " + key;
+            dice::storage::random_variable_type::var_type var;
+            if (store->load(store_key, var))
+            {
+                value_type result = dice::make<dice::type_rand_var>(
+                    dice::storage::random_variable_type{ std::move(var) });
+                context.cache->insert(key, result->clone());
+                return result;
+            }
+        }
+
+        // don't cache default values of expressions with an error so 
+        // that the error is reported again
+        auto errors = context.errors;
+        auto result = evaluate_node(node, context);
+        if (errors == context.errors && result != nullptr)
+        {
+            auto var = dynamic_cast<dice::type_rand_var*>(result.get());
+            if (store != nullptr && var != nullptr)
+            {
+                store->save(store_key, var->data().to_random_variable());
+            }
+            context.cache->insert(key, result->clone());
+        }
+        return result;
+    }
+}
+
+const std::size_t dice::plan_cache::default_capacity;
+
+void dice::plan_cache::insert(const std::string& key, value_type value)
+{
+    auto size = estimate_size(key, *value);
+    if (size > capacity)
+        return;
+
+    auto it = values_.find(key);
+    if (it != values_.end())
+    {
+        size_ -= it->second.size;
+        values_.erase(it);
+    }
+
+    if (size_ + size > capacity)
+    {
+        clear();
+    }
+    values_.emplace(key, entry{ std::move(value), size });
+    size_ += size;
+}
+
+std::size_t dice::plan_cache::estimate_size(
+    const std::string& key, 
+    const base_value& value)
+{
+    // the key, a hash table node and the value
+    std::size_t result = sizeof(entry) + 2 * sizeof(void*) + key.size();
+    auto var = dynamic_cast<const type_rand_var*>(&value);
+    if (var != nullptr)
+        return result + var->data().memory_usage();
+    return result + sizeof(type_real);
+}
+
+dice::plan::plan(
+    std::vector<node_ptr>&& statements,
+    direct_interpreter<environment>* interpreter) :
+    statements_(std::move(statements))
+{
+    for (auto&& statement : statements_)
+    {
+        if (interpreter != nullptr)
+        {
+            fold_constants(statement, interpreter);
+        }
+        compute_key(*statement);
+    }
+}
+
+std::size_t dice::plan::node_count() const
+{
+    std::size_t result = 0;
+    for (auto&& statement : statements_)
+    {
+        result += count_nodes(*statement);
+    }
+    return result;
+}
+
+bool dice::plan::is_deterministic() const
+{
+    for (auto&& statement : statements_)
+    {
+        if (!is_deterministic_node(*statement))
+            return false;
+    }
+    return true;
+}
+
+dice::plan::value_list dice::plan::execute(
+    direct_interpreter<environment>* interpreter,
+    logger* log,
+    plan_cache* cache) const
+{
+    evaluation_context context{ interpreter, log, cache, 0 };
+    value_list result;
+    auto token = cancellation::current();
+    if (token == nullptr)
+    {
+        for (auto&& statement : statements_)
+        {
+            result.push_back(evaluate(*statement, context));
+        }
+        return result;
+    }
+
+    // work of a statement is estimated by the number of its nodes
+    std::vector<std::size_t> work;
+    std::size_t total_work = 0;
+    for (auto&& statement : statements_)
+    {
+        work.push_back(count_nodes(*statement));
+        total_work += work.back();
+    }
+
+    std::size_t work_done = 0;
+    for (std::size_t i = 0; i < statements_.size(); ++i)
+    {
+        token->check();
+        token->start_statement(i, statements_.size(), work_done, total_work);
+        result.push_back(evaluate(*statements_[i], context));
+        work_done += work[i];
+    }
+    token->finish();
+    return result;
+}
+
+dice::plan::value_type dice::evaluate_tree(
+    const plan_node& node,
+    direct_interpreter<environment>* interpreter,
+    logger* log,
+    plan_cache* cache)
+{
+    evaluation_context context{ interpreter, log, cache, 0 };
+    return evaluate(node, context);
+}
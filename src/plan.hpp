@@ -0,0 +1,415 @@
+/**
+ * @file plan.hpp
+ *
+ * Parsed scripts which can be evaluated repeatedly.
+ */
+#ifndef DICE_PLAN_HPP_
+#define DICE_PLAN_HPP_
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "value.hpp"
+#include "lexer.hpp"
+#include "logger.hpp"
+#include "symbols.hpp"
+#include "environment.hpp"
+#include "direct_interpreter.hpp"
+#include "distribution_store.hpp"
+
+namespace dice
+{
+    /** @brief Operation of a node of an expression tree. */
+    enum class plan_op
+    {
+        constant,
+        variable,
+        add,
+        sub,
+        mult,
+        div,
+        unary_minus,
+        rel_op,
+        rel_in,
+        roll,
+        assign,
+        call
+    };
+
+    /** @brief Node of an expression tree of a plan.
+     *
+     * Operands of the operation are in the children list. Name is the
+     * name of a variable or a function or the type of a relational
+     * operator. Location is used to report errors during evaluation.
+     */
+    struct plan_node
+    {
+        using value_type = std::unique_ptr<base_value>;
+        using node_ptr = std::unique_ptr<plan_node>;
+
+        plan_op op;
+        std::string name;
+        value_type value;
+        std::vector<node_ptr> children;
+        lexer_location location;
+
+        /** Structural key of the subtree or an empty string if its value 
+         * depends on variables or on a function with side effects (see
+         * plan_cache).
+         */
+        std::string key;
+
+        plan_node(plan_op op, const lexer_location& location) :
+            op(op), location(location) {}
+    };
+
+    /** @brief Cache of values of subexpressions shared by plans.
+     *
+     * Subexpressions which only use constants, operators and functions 
+     * without side effects (e.g., max(1d20, 1d20)) evaluate to the same 
+     * value whenever they occur. Values without dependencies are 
+     * independent random variables so a repeated term (such as 1d20 in 
+     * 1d20 + 1d20) can use a copy of the same value.
+     *
+     * Values are keyed by the structure of the subexpression and by the
+     * pruning policy (see plan::execute) so that a change of the policy
+     * does not return stale results. The cache is cleared if estimated
+     * memory of its values would exceed its capacity.
+     *
+     * Distributions which are not in the cache are loaded from the store
+     * (if it is set) and computed distributions are saved there.
+     */
+    class plan_cache
+    {
+    public:
+        using value_type = plan_node::value_type;
+
+        /** Default capacity in bytes. */
+        static const std::size_t default_capacity = 16 * 1024 * 1024;
+
+        /** Maximal estimated memory of cached values in bytes. */
+        std::size_t capacity = default_capacity;
+
+        /** Persistent store of distributions (nullptr not to use it). */
+        distribution_store* store = nullptr;
+
+        /** @brief Find a value of a subexpression.
+         *
+         * @param key structural key of the subexpression
+         *
+         * @return pointer to the cached value or nullptr
+         */
+        const base_value* find(const std::string& key) const
+        {
+            auto it = values_.find(key);
+            return it == values_.end() ? nullptr : it->second.value.get();
+        }
+
+        /** @brief Store a value of a subexpression.
+         *
+         * Values larger than the capacity are not stored.
+         *
+         * @param key structural key of the subexpression
+         * @param value of the subexpression
+         */
+        void insert(const std::string& key, value_type value);
+
+        /** @brief Get number of cached values.
+         *
+         * @return number of values
+         */
+        std::size_t size() const
+        {
+            return values_.size();
+        }
+
+        /** @brief Get estimated memory of cached values.
+         *
+         * @return size in bytes
+         */
+        std::size_t memory_size() const
+        {
+            return size_;
+        }
+
+        /** @brief Remove all values. */
+        void clear()
+        {
+            values_.clear();
+            size_ = 0;
+        }
+    private:
+        struct entry
+        {
+            value_type value;
+            // estimated memory of the entry in bytes
+            std::size_t size;
+        };
+
+        std::unordered_map<std::string, entry> values_;
+        std::size_t size_ = 0;
+
+        static std::size_t estimate_size(
+            const std::string& key, 
+            const base_value& value);
+    };
+
+    /** @brief Parsed script.
+     *
+     * It is a list of expression trees (1 for each statement). The script
+     * is lexed and parsed once. Evaluation only calls functions of the
+     * environment. Parameters of the script are variables of the
+     * environment so the same plan can be evaluated with different values
+     * (see calculator::prepare).
+     */
+    class plan
+    {
+    public:
+        using node_ptr = plan_node::node_ptr;
+        using value_type = plan_node::value_type;
+        using value_list = std::vector<value_type>;
+
+        plan() = default;
+
+        /** @brief Create a plan from parsed statements.
+         *
+         * If an interpreter is provided, subexpressions which only compute
+         * with int and real constants are evaluated now (constant folding).
+         *
+         * @param statements expression trees of statements
+         * @param interpreter used for constant folding (nullptr to keep 
+         *        the trees as they are)
+         */
+        explicit plan(
+            std::vector<node_ptr>&& statements,
+            direct_interpreter<environment>* interpreter = nullptr);
+
+        // allow move
+        plan(plan&&) = default;
+        plan& operator=(plan&&) = default;
+
+        /** @brief Evaluate all statements.
+         *
+         * Errors are reported to the logger. The result of an operation
+         * which fails is the default value (as in the parser).
+         *
+         * @param interpreter which computes the operations
+         * @param log for errors
+         * @param cache of subexpression values (nullptr to evaluate 
+         *        everything)
+         *
+         * @return value of each statement (nullptr for assignments)
+         */
+        value_list execute(
+            direct_interpreter<environment>* interpreter,
+            logger* log,
+            plan_cache* cache = nullptr) const;
+
+        /** @brief Get number of statements.
+         *
+         * @return number of statements in the script
+         */
+        std::size_t size() const
+        {
+            return statements_.size();
+        }
+
+        /** @brief Get number of nodes of all expression trees.
+         *
+         * @return number of nodes
+         */
+        std::size_t node_count() const;
+
+        /** @brief Check whether the result of this plan is always the same.
+         *
+         * @return true iff the plan does not call any function with side 
+         *         effects (e.g., roll) so its result only depends on the 
+         *         values of variables
+         */
+        bool is_deterministic() const;
+
+        /** @brief Get expression trees of all statements.
+         *
+         * @return list of statements
+         */
+        const std::vector<node_ptr>& statements() const
+        {
+            return statements_;
+        }
+    private:
+        std::vector<node_ptr> statements_;
+    };
+
+    /** @brief Evaluate an expression tree of a plan.
+     *
+     * It evaluates the tree in the same way as plan::execute evaluates
+     * a statement. It is used by other evaluation modes (see sampler) for
+     * subtrees which are computed exactly.
+     *
+     * @param node root of the tree
+     * @param interpreter which computes the operations
+     * @param log for errors
+     * @param cache of subexpression values (nullptr to evaluate 
+     *        everything)
+     *
+     * @return value of the tree (nullptr for an assignment)
+     */
+    plan::value_type evaluate_tree(
+        const plan_node& node,
+        direct_interpreter<environment>* interpreter,
+        logger* log,
+        plan_cache* cache = nullptr);
+
+    /** @brief Interpreter which builds expression trees instead of
+     *         evaluating them.
+     *
+     * It implements the same interface as direct_interpreter so that the
+     * parser can be used with it. The result of parsing is a list of
+     * expression trees which can be turned into a plan.
+     */
+    class plan_builder
+    {
+    public:
+        using value_type = plan_node::node_ptr;
+        using value_list = std::vector<value_type>;
+
+        /** @brief Create a builder.
+         *
+         * @param location current location of the lexer (it is stored in
+         *        nodes whose location is not set by the parser)
+         */
+        explicit plan_builder(const lexer_location* location) :
+            lexer_location_(location) {}
+
+        void enter_assign() {}
+
+        /** @brief Set location of the next operation.
+         *
+         * @param location of the operator in the input
+         */
+        void set_location(const lexer_location& location)
+        {
+            location_ = location;
+            has_location_ = true;
+        }
+
+        value_type make_default()
+        {
+            auto result = make_node(plan_op::constant);
+            result->value = make<type_int>(0);
+            return result;
+        }
+
+        value_type number(symbol& token)
+        {
+            assert(token.type == symbol_type::number);
+            auto result = make_node(plan_op::constant);
+            result->value = std::move(token.value);
+            return result;
+        }
+
+        value_type variable(const std::string& name)
+        {
+            auto result = make_node(plan_op::variable);
+            result->name = name;
+            return result;
+        }
+
+        value_type add(value_type left, value_type right)
+        {
+            return make_node(plan_op::add, std::move(left), std::move(right));
+        }
+
+        value_type sub(value_type left, value_type right)
+        {
+            return make_node(plan_op::sub, std::move(left), std::move(right));
+        }
+
+        value_type mult(value_type left, value_type right)
+        {
+            return make_node(plan_op::mult, std::move(left), std::move(right));
+        }
+
+        value_type div(value_type left, value_type right)
+        {
+            return make_node(plan_op::div, std::move(left), std::move(right));
+        }
+
+        value_type unary_minus(value_type value)
+        {
+            auto result = make_node(plan_op::unary_minus);
+            result->children.push_back(std::move(value));
+            return result;
+        }
+
+        value_type rel_op(
+            const std::string& type,
+            value_type left,
+            value_type right)
+        {
+            auto result = make_node(
+                plan_op::rel_op,
+                std::move(left),
+                std::move(right));
+            result->name = type;
+            return result;
+        }
+
+        value_type rel_in(
+            value_type value,
+            value_type lower_bound,
+            value_type upper_bound)
+        {
+            auto result = make_node(
+                plan_op::rel_in,
+                std::move(value),
+                std::move(lower_bound));
+            result->children.push_back(std::move(upper_bound));
+            return result;
+        }
+
+        value_type roll(value_type left, value_type right)
+        {
+            return make_node(plan_op::roll, std::move(left), std::move(right));
+        }
+
+        value_type assign(const std::string& name, value_type value)
+        {
+            auto result = make_node(plan_op::assign);
+            result->name = name;
+            result->children.push_back(std::move(value));
+            return result;
+        }
+
+        value_type call(const std::string& name, value_list&& arguments)
+        {
+            auto result = make_node(plan_op::call);
+            result->name = name;
+            result->children = std::move(arguments);
+            return result;
+        }
+    private:
+        const lexer_location* lexer_location_;
+        lexer_location location_;
+        bool has_location_ = false;
+
+        value_type make_node(plan_op op)
+        {
+            auto location = has_location_ ? location_ : *lexer_location_;
+            has_location_ = false;
+            return std::make_unique<plan_node>(op, location);
+        }
+
+        value_type make_node(plan_op op, value_type left, value_type right)
+        {
+            auto result = make_node(op);
+            result->children.push_back(std::move(left));
+            result->children.push_back(std::move(right));
+            return result;
+        }
+    };
+}
+
+#endif // DICE_PLAN_HPP_
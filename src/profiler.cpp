@@ -0,0 +1,166 @@
+#include "profiler.hpp"
+
+#include <cstdio>
+#include <utility>
+#include <algorithm>
+
+thread_local dice::profiler* dice::profiler::current_ = nullptr;
+
+namespace
+{
+    void add(dice::profiler::counters& sum,
+        const dice::profiler::counters& value)
+    {
+        sum.calls += value.calls;
+        sum.time += value.time;
+        sum.input_size += value.input_size;
+        sum.output_size += value.output_size;
+        sum.max_leaves = std::max(sum.max_leaves, value.max_leaves);
+        sum.allocations += value.allocations;
+    }
+
+    double milliseconds(dice::profiler::clock::duration time)
+    {
+        return std::chrono::duration<double, std::milli>(time).count();
+    }
+
+    // average number of values per call
+    std::size_t average(std::size_t size, std::size_t calls)
+    {
+        return calls == 0 ? 0 : (size + calls - 1) / calls;
+    }
+
+    // get up to count elements of a map with the largest total time
+    template<typename Map>
+    std::vector<typename Map::const_pointer> hottest(
+        const Map& map,
+        std::size_t count)
+    {
+        std::vector<typename Map::const_pointer> result;
+        for (auto&& item : map)
+        {
+            result.push_back(&item);
+        }
+
+        count = std::min(count, result.size());
+        std::partial_sort(
+            result.begin(),
+            result.begin() + count,
+            result.end(),
+            [](auto&& a, auto&& b)
+        {
+            return a->second.time > b->second.time;
+        });
+        result.resize(count);
+        return result;
+    }
+
+    void print_function(
+        std::ostream& output,
+        const std::string& name,
+        const dice::profiler::counters& value)
+    {
+        char buffer[128];
+        std::snprintf(buffer, sizeof(buffer),
+            "  %-24s %8zu %10.3f %8zu %8zu %8zu %8zu\n",
+            name.c_str(),
+            value.calls,
+            milliseconds(value.time),
+            average(value.input_size, value.calls),
+            average(value.output_size, value.calls),
+            value.max_leaves,
+            value.allocations);
+        output << buffer;
+    }
+
+    // sizes of values are only measured by function calls
+    void print_location(
+        std::ostream& output,
+        const dice::profiler::location& where,
+        const dice::profiler::counters& value)
+    {
+        char buffer[128];
+        std::snprintf(buffer, sizeof(buffer),
+            "  %6d %6d %-10s %8zu %10.3f %8zu\n",
+            where.line,
+            where.col,
+            where.operation.substr(0, 10).c_str(),
+            value.calls,
+            milliseconds(value.time),
+            value.allocations);
+        output << buffer;
+    }
+}
+
+bool dice::profiler::location::operator<(const location& other) const
+{
+    if (line != other.line)
+        return line < other.line;
+    if (col != other.col)
+        return col < other.col;
+    return operation < other.operation;
+}
+
+dice::profiler::counters dice::profiler::measurement::stop(
+    const profiler* owner) const
+{
+    counters result;
+    result.calls = 1;
+    result.time = clock::now() - start_;
+    result.allocations = owner->allocations_ - allocations_;
+    return result;
+}
+
+void dice::profiler::record_call(
+    const std::string& name,
+    const counters& value)
+{
+    add(functions_[name], value);
+}
+
+void dice::profiler::record_location(
+    const location& where,
+    const counters& value)
+{
+    add(locations_[where], value);
+}
+
+void dice::profiler::clear()
+{
+    functions_.clear();
+    locations_.clear();
+    allocations_ = 0;
+}
+
+void dice::profiler::report(std::ostream& output, std::size_t count) const
+{
+    char buffer[128];
+    std::snprintf(buffer, sizeof(buffer),
+        "%-26s %8s %10s %8s %8s %8s %8s\n",
+        "Hottest functions", "calls", "time [ms]", "input", "output", 
+        "leaves", "allocs");
+    output << buffer;
+    for (auto&& item : hottest(functions_, count))
+    {
+        print_function(output, item->first, item->second);
+    }
+
+    std::snprintf(buffer, sizeof(buffer),
+        "%-26s %8s %10s %8s\n",
+        "Hottest locations", "calls", "time [ms]", "allocs");
+    output << buffer;
+    for (auto&& item : hottest(locations_, count))
+    {
+        print_location(output, item->first, item->second);
+    }
+}
+
+dice::profiler::scope::scope(profiler* value) : previous_(current_)
+{
+    current_ = value;
+}
+
+dice::profiler::scope::~scope()
+{
+    current_ = previous_;
+}
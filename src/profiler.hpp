@@ -0,0 +1,180 @@
+/**
+ * @file profiler.hpp
+ *
+ * Counters of operations of an evaluation.
+ */
+#ifndef DICE_PROFILER_HPP_
+#define DICE_PROFILER_HPP_
+
+#include <map>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <ostream>
+#include <unordered_map>
+
+namespace dice
+{
+    /** @brief Collect counters of evaluated operations.
+     *
+     * A profiler is only used if it is current for the calling thread (see
+     * scope). Operations check the current profiler before they measure
+     * anything so that the overhead of a disabled profiler is 1 load of a
+     * thread local pointer. If DISABLE_PROFILER is defined, there is never
+     * a current profiler.
+     *
+     * Work done by threads of a thread_pool is included in the time of the
+     * operation which started it but allocations of those threads are not
+     * counted. Counters of an operation include nested operations (e.g.,
+     * recomputation of a variable definition).
+     */
+    class profiler
+    {
+    public:
+        using clock = std::chrono::steady_clock;
+
+        /** @brief Counters of an operation. */
+        struct counters
+        {
+            // number of executions of the operation
+            std::size_t calls = 0;
+            // total time of all executions
+            clock::duration time = clock::duration::zero();
+            // total number of values of arguments (1 for numbers)
+            std::size_t input_size = 0;
+            // total number of values of results
+            std::size_t output_size = 0;
+            // maximal number of leafs of a decomposition of a result
+            std::size_t max_leaves = 0;
+            // number of random variables allocated by the operation
+            std::size_t allocations = 0;
+        };
+
+        /** @brief Location of an operator in the input. */
+        struct location
+        {
+            int line;
+            int col;
+            // name of the operator
+            std::string operation;
+
+            bool operator<(const location& other) const;
+        };
+
+        /** @brief Measure 1 execution of an operation.
+         *
+         * The measurement starts when this object is created.
+         */
+        class measurement
+        {
+        public:
+            explicit measurement(profiler* owner) :
+                start_(clock::now()),
+                allocations_(owner->allocations_) {}
+
+            /** @brief Get counters of the operation since it has started.
+             *
+             * @return counters of 1 call (without sizes)
+             */
+            counters stop(const profiler* owner) const;
+        private:
+            clock::time_point start_;
+            std::size_t allocations_;
+        };
+
+        /** @brief Add counters of a function call.
+         *
+         * @param name of the function
+         * @param value counters of the call
+         */
+        void record_call(const std::string& name, const counters& value);
+
+        /** @brief Add counters of an operator at given location.
+         *
+         * @param where location of the operator
+         * @param value counters of its evaluation
+         */
+        void record_location(const location& where, const counters& value);
+
+        /** @brief Count a random variable allocated by the calling thread.
+         *
+         * Nothing is counted if there is no current profiler.
+         */
+        static void count_allocation()
+        {
+#ifndef DISABLE_PROFILER
+            if (current_ != nullptr)
+            {
+                ++current_->allocations_;
+            }
+#endif // DISABLE_PROFILER
+        }
+
+        /** @brief Get counters of functions.
+         *
+         * @return map of function names to their counters
+         */
+        const std::unordered_map<std::string, counters>& functions() const
+        {
+            return functions_;
+        }
+
+        /** @brief Get counters of operators in the input.
+         *
+         * @return map of locations to their counters
+         */
+        const std::map<location, counters>& locations() const
+        {
+            return locations_;
+        }
+
+        /** @brief Remove all counters. */
+        void clear();
+
+        /** @brief Print the most expensive functions and locations.
+         *
+         * @param output stream
+         * @param count maximal number of functions and locations printed
+         */
+        void report(std::ostream& output, std::size_t count = 10) const;
+
+        /** @brief Get profiler of the calling thread.
+         *
+         * @return current profiler or nullptr if profiling is disabled
+         */
+        static profiler* current()
+        {
+#ifndef DISABLE_PROFILER
+            return current_;
+#else
+            return nullptr;
+#endif // DISABLE_PROFILER
+        }
+
+        /** @brief Make a profiler current for the calling thread.
+         *
+         * The previous profiler is restored when this object is destroyed.
+         */
+        class scope
+        {
+        public:
+            explicit scope(profiler* value);
+            ~scope();
+
+            scope(const scope&) = delete;
+            scope& operator=(const scope&) = delete;
+        private:
+            profiler* previous_;
+        };
+    private:
+        std::unordered_map<std::string, counters> functions_;
+        std::map<location, counters> locations_;
+        // number of allocations counted so far
+        std::size_t allocations_ = 0;
+
+        static thread_local profiler* current_;
+    };
+}
+
+#endif // DICE_PROFILER_HPP_
@@ -0,0 +1,5 @@
+#include "pruning.hpp"
+
+double dice::pruning::epsilon = 0;
+
+std::size_t dice::pruning::max_size = 0;
@@ -0,0 +1,54 @@
+/**
+ * @file pruning.hpp
+ *
+ * Policy for removing negligible probabilities from random variables.
+ */
+#ifndef DICE_PRUNING_HPP_
+#define DICE_PRUNING_HPP_
+
+#include <cstddef>
+
+namespace dice
+{
+    /** @brief Global pruning policy of random variables.
+     *
+     * Pruning is disabled by default. If it is enabled, it is applied to
+     * the result of each operation on random variables (i.e., whenever a 
+     * variable is normalized) and to variables which are added as 
+     * dependencies of a decomposition.
+     *
+     * Removed probability is not redistributed. Each random variable keeps
+     * track of an upper bound of the total probability discarded during 
+     * its computation (see random_variable::discarded_probability).
+     */
+    class pruning
+    {
+    public:
+        /** Maximal total probability removed from the tails of a variable 
+         * by one pruning step.
+         *
+         * Values are removed from the ends of the range (the less probable
+         * end first) as long as the total removed probability stays below
+         * or at this bound. Set it to 0 to disable this kind of pruning.
+         */
+        static double epsilon;
+
+        /** Maximal number of values of a variable.
+         *
+         * If a variable has more values, the least probable ones are 
+         * removed. Set it to 0 to disable this kind of pruning.
+         */
+        static std::size_t max_size;
+
+        /** @brief Check whether any pruning is enabled.
+         *
+         * @return true iff epsilon or max_size is set
+         */
+        static bool enabled()
+        {
+            return epsilon > 0 || max_size > 0;
+        }
+    };
+}
+
+#endif // DICE_PRUNING_HPP_
@@ -4,11 +4,24 @@
 #include <tuple>
 #include <cassert>
 #include <cmath>
+#include <cstdint>
 #include <limits>
 #include <vector>
+#include <iterator>
 #include <algorithm>
 #include <unordered_map>
 #include <map>
+#include <memory>
+#include <random>
+#include <stdexcept>
+
+#include "utils.hpp"
+#include "simd.hpp"
+#include "pruning.hpp"
+#include "convolution.hpp"
+#include "profiler.hpp"
+#include "budget.hpp"
+#include "cancellation.hpp"
 
 #ifdef min
 #undef min
@@ -22,6 +35,7 @@ namespace dice
 {
     class bernoulli_tag{};
     class constant_tag{};
+    class dense_tag{};
 
     template<typename ValueType, typename ProbabilityType>
     class decomposition;
@@ -33,25 +47,174 @@ namespace dice
      *                      - std::hash specialization
      *                      - std::max, std::min specialization
      *                      - convertible to ProbabilityType
+     *                      - convertible to and from std::int64_t
      * @tparam ProbabilityType type of probability (rational number in [0, 1])
      *
-     * The ValueType is used as a key in a hash table. ProbabilityType is a 
-     * value in this hash table. Probabilities of values sum up to 1.
+     * Probabilities are stored in one of 2 ways:
+     * -# dense storage: minimal value of the variable and a vector of
+     *    probabilities of all consecutive values starting with the minimal
+     *    value. This is used when values of the variable cover a compact
+     *    range of integers (which is usual for dice rolls, their sums or
+     *    indicators).
+     * -# sparse storage: a hash table where ValueType is the key and
+     *    ProbabilityType is the value. This is only used as a fallback if
+     *    the values are spread over a large range.
+     *
+     * The storage is chosen automatically. Probabilities of values sum up
+     * to 1 minus the discarded probability (see discarded_probability). It
+     * is 0 unless values with small probability have been removed by 
+     * pruning (see the pruning class) from this variable or from any 
+     * variable it has been computed from. Moments are normalized by the 
+     * retained probability.
      * 
-     * This type is immutable. All public methods and functions which modify
-     * a variable return a new random variable.
+     * Operators and functions which combine variables return a new random
+     * variable. The compound assignment operators (+=, -=, *=) modify the
+     * variable in place and reuse its storage where possible (e.g., adding
+     * a constant to a dense variable only changes its offset).
      */
     template<typename ValueType, typename ProbabilityType>
     class random_variable 
     {
         friend class decomposition<ValueType, ProbabilityType>;
+
+        template<typename T, typename U>
+        friend random_variable<T, U> max(
+            const random_variable<T, U>& a, 
+            const random_variable<T, U>& b);
+
+        template<typename T, typename U>
+        friend random_variable<T, U> min(
+            const random_variable<T, U>& a, 
+            const random_variable<T, U>& b);
     public:
         using value_type = ValueType;
         using probability_type = ProbabilityType;
+        // type of moments and intermediate sums of probabilities
+        using sum_type = accumulator_t<probability_type>;
         using frequency_list = std::vector<std::pair<value_type, std::size_t>>;
         using probability_list = std::vector<
             std::pair<value_type, probability_type>>;
 
+        /** @brief Iterator of the (value, probability) pair collection.
+         *
+         * Values with zero probability are skipped. If the variable uses the
+         * dense storage, values are iterated in ascending order.
+         */
+        class const_iterator
+        {
+            friend class random_variable;
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = std::pair<ValueType, ProbabilityType>;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const value_type*;
+            using reference = const value_type&;
+
+            const_iterator() = default;
+
+            const_iterator& operator++()
+            {
+                if (var_->is_dense_)
+                {
+                    ++index_;
+                    skip_zeros();
+                }
+                else
+                {
+                    ++sparse_it_;
+                }
+                load();
+                return *this;
+            }
+
+            const_iterator operator++(int)
+            {
+                auto copy = *this;
+                ++*this;
+                return copy;
+            }
+
+            reference operator*() const
+            {
+                return current_;
+            }
+
+            pointer operator->() const
+            {
+                return &current_;
+            }
+
+            bool operator==(const const_iterator& other) const
+            {
+                if (var_ == nullptr || var_->is_dense_)
+                {
+                    return index_ == other.index_;
+                }
+                return sparse_it_ == other.sparse_it_;
+            }
+
+            bool operator!=(const const_iterator& other) const
+            {
+                return !operator==(other);
+            }
+        private:
+            using sparse_iterator = typename std::unordered_map<
+                ValueType, ProbabilityType>::const_iterator;
+
+            // iterated variable
+            const random_variable* var_ = nullptr;
+            // position in the dense storage
+            std::size_t index_ = 0;
+            // position in the sparse storage
+            sparse_iterator sparse_it_;
+            // current (value, probability) pair
+            value_type current_;
+
+            const_iterator(const random_variable* var, bool is_end) :
+                var_(var)
+            {
+                if (var_->is_dense_)
+                {
+                    index_ = is_end ? var_->dense_.size() : 0;
+                    skip_zeros();
+                }
+                else
+                {
+                    sparse_it_ = is_end ?
+                        var_->sparse_.cend() :
+                        var_->sparse_.cbegin();
+                }
+                load();
+            }
+
+            void skip_zeros()
+            {
+                while (index_ < var_->dense_.size() &&
+                    var_->dense_[index_] == 0)
+                {
+                    ++index_;
+                }
+            }
+
+            void load()
+            {
+                if (var_->is_dense_)
+                {
+                    if (index_ < var_->dense_.size())
+                    {
+                        current_.first = var_->value_at(index_);
+                        current_.second = var_->dense_[index_];
+                    }
+                }
+                else if (sparse_it_ != var_->sparse_.cend())
+                {
+                    current_ = *sparse_it_;
+                }
+            }
+        };
+
+        using iterator = const_iterator;
+
         /** @brief Create an impossible event. */
         random_variable() {}
 
@@ -59,27 +222,59 @@ namespace dice
          * @param value of the constant
          */
         random_variable(constant_tag, value_type value) : 
-            probability_({ std::make_pair(value, 1.0) }) {}
+            offset_(value), dense_({ 1.0 }), dense_size_(1) {}
 
         /** @brief Create a bernoulli distribution.
          * @param success_prob probability of success
          *        If this is 0 or 1, the variable will be constant. 
          */
         random_variable(bernoulli_tag, probability_type success_prob) : 
-            probability_({ 
-                std::make_pair(0, 1 - success_prob), 
-                std::make_pair(1, success_prob) 
-            }) 
+            offset_(0), dense_({ 1 - success_prob, success_prob }),
+            dense_size_(0)
         {
             // make this a constant if the success probability is 1 or 0
             if (success_prob <= 0)
             {
-                probability_.erase(probability_.find(1));
+                dense_.pop_back();
             }
             else if (success_prob >= 1)
             {
-                probability_.erase(probability_.find(0));
+                dense_.erase(dense_.begin());
+                offset_ = 1;
+            }
+            dense_size_ = dense_.size();
+        }
+
+        /** @brief Create a variable from probabilities of consecutive values.
+         *
+         * Probabilities are copied as they are (they are not normalized
+         * and the pruning policy is not applied). It is used to load 
+         * distributions which have been computed before.
+         *
+         * @param offset value whose probability is *first
+         * @param first iterator to the first probability
+         * @param last iterator past the last probability
+         * @param discarded probability removed by pruning
+         */
+        template<typename InputIt>
+        random_variable(
+            dense_tag, 
+            value_type offset, 
+            InputIt first, 
+            InputIt last,
+            probability_type discarded = 0) : 
+            offset_(offset), 
+            discarded_(discarded)
+        {
+            for (; first != last; ++first)
+            {
+                dense_.push_back(static_cast<probability_type>(*first));
+                if (dense_.back() != 0)
+                {
+                    ++dense_size_;
+                }
             }
+            normalize_storage();
         }
 
         /** @brief Compute probabilities from list of value frequencies.
@@ -88,9 +283,24 @@ namespace dice
         explicit random_variable(const frequency_list& list)
         {
             probability_type sum = 0;
+            std::size_t count = 0;
+            auto lower_bound = std::numeric_limits<value_type>::max();
+            auto upper_bound = std::numeric_limits<value_type>::lowest();
             for (auto&& item : list)
+            {
+                if (item.second == 0)
+                    continue;
+
                 sum += item.second;
+                lower_bound = std::min(lower_bound, item.first);
+                upper_bound = std::max(upper_bound, item.first);
+                ++count;
+            }
+
+            if (count == 0)
+                return;
 
+            init_storage(lower_bound, upper_bound, count);
             for (auto&& item : list)
             {
                 if (item.second == 0)
@@ -98,6 +308,7 @@ namespace dice
                 
                 add_probability(item.first, item.second / sum);
             }
+            normalize();
         }
 
         ~random_variable() = default;
@@ -116,7 +327,61 @@ namespace dice
          */
         bool is_constant() const 
         {
-            return probability_.size() == 1;
+            return size() == 1;
+        }
+
+        /** @brief Check whether this variable uses the dense storage.
+         *
+         * @return true iff probabilities are stored in a vector indexed by
+         *         value (false if they are stored in a hash table)
+         */
+        bool is_dense() const
+        {
+            return is_dense_;
+        }
+
+        /** @brief Get probability removed by pruning.
+         *
+         * It includes probability removed from all variables this variable
+         * has been computed from (see the pruning class). Probabilities of
+         * this variable sum up to at least 1 minus this value (up to the 
+         * rounding error).
+         *
+         * @return upper bound of the removed probability (0 if no value 
+         *         has been removed)
+         */
+        probability_type discarded_probability() const
+        {
+            return discarded_;
+        }
+
+        /** @brief Add probability removed from operands of this variable.
+         *
+         * It is used if the variable has been computed from operands 
+         * without any discarded probability (e.g., a cached result).
+         *
+         * @param probability removed probability
+         */
+        void add_discarded_probability(probability_type probability)
+        {
+            discarded_ += probability;
+        }
+
+        /** @brief Apply the current pruning policy to this variable.
+         *
+         * Results of all operations are pruned automatically. This is 
+         * useful for variables created before the policy has changed.
+         *
+         * @return pruned copy of this variable
+         */
+        random_variable pruned() const
+        {
+            auto result = *this;
+            if (pruning::enabled() && result.prune())
+            {
+                result.normalize_storage();
+            }
+            return result;
         }
 
         /** @brief Find maximal value in the variable's range.
@@ -126,8 +391,15 @@ namespace dice
          */
         auto max_value() const
         {
+            if (is_dense_)
+            {
+                if (dense_.empty())
+                    return std::numeric_limits<value_type>::lowest();
+                return value_at(dense_.size() - 1);
+            }
+
             auto value = std::numeric_limits<value_type>::lowest();
-            for (auto&& pair : probability_)
+            for (auto&& pair : sparse_)
             {
                 value = std::max(value, pair.first);
             }
@@ -141,8 +413,15 @@ namespace dice
          */
         auto min_value() const
         {
+            if (is_dense_)
+            {
+                if (dense_.empty())
+                    return std::numeric_limits<value_type>::max();
+                return offset_;
+            }
+
             auto value = std::numeric_limits<value_type>::max();
-            for (auto&& pair : probability_)
+            for (auto&& pair : sparse_)
             {
                 value = std::min(value, pair.first);
             }
@@ -150,35 +429,75 @@ namespace dice
         }
 
         /** @brief Compute expected value of this random variable.
+         *
+         * It is computed in the accumulator type of probabilities (see
+         * accumulator_t) with compensated summation. Probabilities are 
+         * normalized by their sum, which is less than 1 if some 
+         * probability has been discarded (see discarded_probability).
          *
          * @return expected value of this variable
          */
         auto expected_value() const 
         {
-            probability_type exp = 0;
-            for (auto&& pair : probability_)
+            if (is_dense_)
+            {
+                // E(X) = offset + E(X - offset)
+                auto sums = simd::moments(dense_.data(), dense_.size());
+                if (sums.sum <= 0)
+                    return static_cast<sum_type>(0);
+                return static_cast<sum_type>(offset_) + 
+                    sums.first / sums.sum;
+            }
+
+            compensated_sum<sum_type> exp;
+            compensated_sum<sum_type> total;
+            for (auto&& pair : *this)
             {
-                auto value = static_cast<probability_type>(pair.first);
-                exp += value * pair.second;
+                auto probability = static_cast<sum_type>(pair.second);
+                exp += static_cast<sum_type>(pair.first) * probability;
+                total += probability;
             }
-            return exp;
+            if (total.value() <= 0)
+                return static_cast<sum_type>(0);
+            return exp.value() / total.value();
         }
 
         /** @brief Compute variance of this random variable.
+         *
+         * Probabilities are normalized by their sum (as in expected_value)
+         * so that discarded probability and the rounding error of the 
+         * total probability are not multiplied by the squared mean.
          *
          * @return variance of this variable
          */
         auto variance() const 
         {
-            probability_type sum_sq = 0;
-            probability_type sum = 0;
-            for (auto&& pair : probability_)
+            if (is_dense_)
+            {
+                // Var(X) = Var(X - offset) so the offset cancels out and
+                // the result does not lose precision.
+                auto sums = simd::moments(dense_.data(), dense_.size());
+                if (sums.sum <= 0)
+                    return static_cast<sum_type>(0);
+                auto mean = sums.first / sums.sum;
+                return sums.second / sums.sum - mean * mean;
+            }
+
+            compensated_sum<sum_type> sum_sq;
+            compensated_sum<sum_type> sum;
+            compensated_sum<sum_type> total;
+            for (auto&& pair : *this)
             {
-                auto value = static_cast<probability_type>(pair.first);
-                sum_sq += value * value * pair.second;
-                sum += value * pair.second;
+                auto value = static_cast<sum_type>(pair.first);
+                auto probability = static_cast<sum_type>(pair.second);
+                sum_sq += value * value * probability;
+                sum += value * probability;
+                total += probability;
             }
-            return sum_sq - sum * sum;
+            if (total.value() <= 0)
+                return static_cast<sum_type>(0);
+            auto mean = sum.value() / total.value();
+            return sum_sq.value() / total.value() - mean * mean;
         }
 
         /** @brief Calculate standard deviation of this random variable.
@@ -193,8 +512,10 @@ namespace dice
         /** @brief Compute quantile of this random variable.
          *
          * Def.: Quantile(p) = min{ x : P(X <= x) >= p} 
-         * Note: complexity of this operation is linearithmic with the size of
-         *       the variable as we have to sort the values.
+         * Note: the first call builds a sorted table of the distribution 
+         *       function (linearithmic if the variable uses the sparse 
+         *       storage, linear otherwise). The table is cached so 
+         *       subsequent calls are logarithmic.
          *       
          * @throws std::logic_error if this is an impossible event.
          *       
@@ -204,51 +525,115 @@ namespace dice
          */
         auto quantile(probability_type probability) const
         {
-            if (probability_.empty())
+            if (empty())
                 throw std::logic_error("Quantile is not defined.");
 
-            // sort the values
-            probability_list list{ probability_.begin(), probability_.end() };
-            std::sort(list.begin(), list.end(), [](auto&& a, auto&& b)
-            {
-                return a.first < b.first;
-            });
-
-            // compute the quantile
-            value_type result = list.front().first;
-            probability_type prob_sum = 0;
-            for (auto&& value : list)
-            {
-                if (prob_sum >= probability)
-                {
-                    break;
-                }
-                prob_sum += value.second;
-                result = value.first;
-            }
-            return result;
+            return random_value(probability);
         }
 
         /** @brief Return first value s.t. P(X <= value) >= prob.
          *
-         * Unlike the quantile method, values are not copied nor sorted.
+         * It uses the same cached table as the quantile method.
          * 
          * @param probability (a random number between 0 and 1)
          * 
          * @return value
          */
-        auto random_value(probability_type probability) const
+        value_type random_value(probability_type probability) const
         {
-            probability_type sum = 0;
-            for (auto&& pair : probability_)
+            assert(!empty());
+
+            auto&& cdf = table().cdf;
+            auto&& values = table().values;
+            auto it = std::lower_bound(cdf.begin(), cdf.end(), probability);
+
+            // probabilities don't have to sum up to exactly 1
+            if (it == cdf.end())
+                return values.back();
+            return values[it - cdf.begin()];
+        }
+
+        /** @brief Draw a random value from this distribution.
+         *
+         * It uses the alias method (i.e., it takes constant time). The 
+         * alias table is built on the first call and cached.
+         * 
+         * @param generator uniform random bit generator
+         * 
+         * @return random value
+         */
+        template<typename Generator>
+        value_type sample(Generator& generator) const
+        {
+            assert(!empty());
+
+            auto&& data = table();
+            std::uniform_int_distribution<std::size_t> index_dist(
+                0, data.values.size() - 1);
+            std::uniform_real_distribution<probability_type> prob_dist(0, 1);
+
+            auto index = index_dist(generator);
+            if (prob_dist(generator) < data.alias_prob[index])
+                return data.values[index];
+            return data.values[data.alias[index]];
+        }
+
+        /** @brief Draw many random values from this distribution.
+         *
+         * It uses the same alias table as the sample method. Random
+         * numbers of a batch are generated first and then they are mapped
+         * to values in a loop without branches (which the compiler can
+         * vectorize). Columns are chosen by Lemire's method so the loop
+         * does not divide.
+         *
+         * @param generator uniform random bit generator of 64 bit numbers
+         *        (e.g., sample_engine)
+         * @param first iterator to the first output value
+         * @param last iterator past the last output value
+         */
+        template<typename Generator, typename ForwardIt>
+        void sample_batch(
+            Generator& generator,
+            ForwardIt first,
+            ForwardIt last) const
+        {
+            static_assert(Generator::min() == 0 &&
+                Generator::max() == ~std::uint64_t{ 0 },
+                "Generator has to generate 64 bit numbers.");
+            assert(!empty());
+
+            auto&& data = table();
+            const auto size = static_cast<std::uint64_t>(data.values.size());
+            const auto threshold = static_cast<std::uint32_t>(-size) % size;
+            const auto scale = 1 / static_cast<probability_type>(
+                std::uint64_t{ 1 } << 53);
+
+            const std::size_t batch_size = 256;
+            std::size_t index[batch_size];
+            probability_type coin[batch_size];
+            while (first != last)
             {
-                if (sum + pair.second >= probability)
+                auto output = first;
+                std::size_t count = 0;
+                for (; count < batch_size && first != last; ++count, ++first)
+                {
+                    std::uint64_t product;
+                    do
+                    {
+                        product = (generator() >> 32) * size;
+                    } while (static_cast<std::uint32_t>(product) < threshold);
+                    index[count] = static_cast<std::size_t>(product >> 32);
+                    coin[count] = (generator() >> 11) * scale;
+                }
+
+                for (std::size_t i = 0; i < count; ++i, ++output)
                 {
-                    return pair.first;
+                    auto column = index[i];
+                    auto choice = coin[i] < data.alias_prob[column] ?
+                        column : data.alias[column];
+                    *output = data.values[choice];
                 }
-                sum += pair.second;
             }
-            return probability_.end()->first;
         }
 
         /** @brief Calculate indicator that X (this r.v.) is in given interval
@@ -264,7 +649,7 @@ namespace dice
         random_variable in(const T& lower_bound, const T& upper_bound) const
         {
             probability_type success_prob = 0;
-            for (auto&& pair : probability_)
+            for (auto&& pair : *this)
             {
                 if (lower_bound <= static_cast<T>(pair.first) && 
                     upper_bound >= static_cast<T>(pair.first))
@@ -272,7 +657,9 @@ namespace dice
                     success_prob += pair.second;
                 }
             }
-            return random_variable{ bernoulli_tag{}, success_prob };
+            random_variable result{ bernoulli_tag{}, success_prob };
+            result.discarded_ = discarded_;
+            return result;
         }
 
         /** @brief Compute distribution of X + Y (X is this random variable).
@@ -285,10 +672,35 @@ namespace dice
          */
         auto operator+(const random_variable& other) const 
         {
-            return combine(other, [](auto&& a, auto&& b) 
+            if (other.is_constant())
             {
-                return a + b;
-            });
+                return with_discarded(shift(other.min_value(), false), other);
+            }
+            
+            if (is_constant())
+            {
+                return with_discarded(other.shift(min_value(), false), other);
+            }
+
+            if (is_dense_ && other.is_dense_)
+            {
+                return with_discarded(convolve(other, false), other);
+            }
+
+            if (empty() || other.empty())
+            {
+                return random_variable{};
+            }
+
+            // the bounds are computed using checked arithmetic
+            return with_discarded(combine_unchecked(
+                other,
+                min_value() + other.min_value(),
+                max_value() + other.max_value(),
+                [](std::int64_t a, std::int64_t b) 
+                {
+                    return a + b;
+                }), other);
         }
 
         /** @brief Compute distribution of X - Y (X is this random variable).
@@ -301,10 +713,37 @@ namespace dice
          */
         auto operator-(const random_variable& other) const
         {
-            return combine(other, [](auto&& a, auto&& b) 
+            if (other.is_constant())
             {
-                return a - b;
-            });
+                return with_discarded(shift(other.min_value(), true), other);
+            }
+            
+            if (is_constant())
+            {
+                return with_discarded(
+                    (-other).shift(min_value(), false), 
+                    other);
+            }
+
+            if (is_dense_ && other.is_dense_)
+            {
+                return with_discarded(convolve(other, true), other);
+            }
+
+            if (empty() || other.empty())
+            {
+                return random_variable{};
+            }
+
+            // the bounds are computed using checked arithmetic
+            return with_discarded(combine_unchecked(
+                other,
+                min_value() - other.max_value(),
+                max_value() - other.min_value(),
+                [](std::int64_t a, std::int64_t b) 
+                {
+                    return a - b;
+                }), other);
         }
 
         /** @brief Compute distribution of X * Y (X is this random variable).
@@ -317,10 +756,92 @@ namespace dice
          */
         auto operator*(const random_variable& other) const 
         {
-            return combine(other, [](auto&& a, auto&& b) 
+            if (empty() || other.empty())
             {
-                return a * b;
-            });
+                return random_variable{};
+            }
+
+            if (other.is_constant())
+            {
+                return with_discarded(scale(other.min_value()), other);
+            }
+
+            if (is_constant())
+            {
+                return with_discarded(other.scale(min_value()), other);
+            }
+
+            // product of the interval bounds are the extremes of X * Y
+            auto a = min_value() * other.min_value();
+            auto b = min_value() * other.max_value();
+            auto c = max_value() * other.min_value();
+            auto d = max_value() * other.max_value();
+            return with_discarded(combine_unchecked(
+                other,
+                std::min(std::min(a, b), std::min(c, d)),
+                std::max(std::max(a, b), std::max(c, d)),
+                [](std::int64_t a, std::int64_t b)
+                {
+                    return a * b;
+                }), other);
+        }
+
+        /** @brief Add an independent random variable Y to this variable.
+         *
+         * The result is the same as operator+. If Y is a constant and this
+         * variable uses the dense storage, only the offset changes and the
+         * probability vector is reused.
+         *
+         * @param other random variable Y (independent of X)
+         *
+         * @return this variable
+         */
+        random_variable& operator+=(const random_variable& other)
+        {
+            if (!try_shift(other, false))
+            {
+                *this = *this + other;
+            }
+            return *this;
+        }
+
+        /** @brief Subtract an independent random variable Y from this.
+         *
+         * See operator+=.
+         *
+         * @param other random variable Y (independent of X)
+         *
+         * @return this variable
+         */
+        random_variable& operator-=(const random_variable& other)
+        {
+            if (!try_shift(other, true))
+            {
+                *this = *this - other;
+            }
+            return *this;
+        }
+
+        /** @brief Multiply this variable by an independent variable Y.
+         *
+         * The result is the same as operator*. Multiplication by 1 keeps
+         * the storage.
+         *
+         * @param other random variable Y (independent of X)
+         *
+         * @return this variable
+         */
+        random_variable& operator*=(const random_variable& other)
+        {
+            if (!empty() && other.is_constant() && other.min_value() == 1)
+            {
+                discarded_ += other.discarded_;
+            }
+            else
+            {
+                *this = *this * other;
+            }
+            return *this;
         }
 
         /** @brief Compute distribution of integer division X / Y.
@@ -333,6 +854,32 @@ namespace dice
          */
         auto operator/(const random_variable& other) const 
         {
+            // division by zero is reported by the combination below
+            if (other.is_constant() && other.min_value() != 0)
+            {
+                return with_discarded(divide(other.min_value()), other);
+            }
+
+            // |X / Y| <= |X| if Y is not 0
+            if (!empty() && !other.empty() && other.probability(0) == 0)
+            {
+                auto bound = std::max(
+                    std::abs(static_cast<std::int64_t>(min_value())),
+                    std::abs(static_cast<std::int64_t>(max_value())));
+                if (bound <= static_cast<std::int64_t>(
+                    std::numeric_limits<value_type>::max()))
+                {
+                    return with_discarded(combine_unchecked(
+                        other,
+                        static_cast<value_type>(-bound),
+                        static_cast<value_type>(bound),
+                        [](std::int64_t a, std::int64_t b) 
+                        {
+                            return a / b;
+                        }), other);
+                }
+            }
+
             return combine(other, [](auto&& a, auto&& b)
             {
                 return a / b; 
@@ -350,10 +897,10 @@ namespace dice
          */
         auto less_than(const random_variable& other) const 
         {
-            return combine(other, [](auto&& a, auto&& b) 
-            {
-                return static_cast<value_type>(a < b);
-            });
+            auto result = compare(other);
+            return with_discarded(
+                make_indicator(result.less, result.equal + result.greater), 
+                other);
         }
 
         /** @brief Compute indicator of X <= Y (X is this random variable).
@@ -367,10 +914,10 @@ namespace dice
          */
         auto less_than_or_equal(const random_variable& other) const 
         {
-            return combine(other, [](auto&& a, auto&& b) 
-            {
-                return static_cast<value_type>(a <= b);
-            });
+            auto result = compare(other);
+            return with_discarded(
+                make_indicator(result.less + result.equal, result.greater), 
+                other);
         }
 
         /** @brief Compute indicator of X = Y (X is this random variable).
@@ -384,10 +931,10 @@ namespace dice
          */
         auto equal(const random_variable& other) const 
         {
-            return combine(other, [](auto&& a, auto&& b) 
-            {
-                return static_cast<value_type>(a == b);
-            });
+            auto result = compare(other);
+            return with_discarded(
+                make_indicator(result.equal, result.less + result.greater), 
+                other);
         }
         
         /** @brief Compute indicator of X != Y (X is this random variable).
@@ -401,10 +948,10 @@ namespace dice
          */
         auto not_equal(const random_variable& other) const 
         {
-            return combine(other, [](auto&& a, auto&& b) 
-            {
-                return static_cast<value_type>(a != b);
-            });
+            auto result = compare(other);
+            return with_discarded(
+                make_indicator(result.less + result.greater, result.equal), 
+                other);
         }
         
         /** @brief Compute indicator of X > Y (X is this random variable).
@@ -418,10 +965,10 @@ namespace dice
          */
         auto greater_than(const random_variable& other) const 
         {
-            return combine(other, [](auto&& a, auto&& b) 
-            {
-                return static_cast<value_type>(a > b);
-            });
+            auto result = compare(other);
+            return with_discarded(
+                make_indicator(result.greater, result.less + result.equal), 
+                other);
         }
         
         /** @brief Compute indicator of X >= Y (X is this random variable).
@@ -435,10 +982,10 @@ namespace dice
          */
         auto greater_than_or_equal(const random_variable& other) const 
         {
-            return combine(other, [](auto&& a, auto&& b) 
-            {
-                return static_cast<value_type>(a >= b);
-            });
+            auto result = compare(other);
+            return with_discarded(
+                make_indicator(result.greater + result.equal, result.less), 
+                other);
         }
 
         /** @brief Compute negation of this random variable (-X)
@@ -448,9 +995,22 @@ namespace dice
         auto operator-() const 
         {
             random_variable result;
-            for (auto&& pair : probability_)
+            result.discarded_ = discarded_;
+            if (is_dense_)
             {
-                result.probability_.insert(
+                if (!empty())
+                {
+                    result.offset_ = -max_value();
+                    result.dense_.assign(dense_.rbegin(), dense_.rend());
+                    result.dense_size_ = dense_size_;
+                }
+                return result;
+            }
+
+            result.is_dense_ = false;
+            for (auto&& pair : sparse_)
+            {
+                result.sparse_.insert(
                     std::make_pair(-pair.first, pair.second));
             }
             return result;
@@ -470,7 +1030,7 @@ namespace dice
         auto restrict(Predicate include) const
         {
             probability_type prob_sum = 0;
-            for (auto&& pair : probability_)
+            for (auto&& pair : *this)
             {
                 if (include(pair.first))
                 {
@@ -479,17 +1039,23 @@ namespace dice
             }
             
             random_variable result;
-            for (auto&& pair : probability_)
+            if (!empty())
+            {
+                result.init_storage(min_value(), max_value(), size());
+            }
+
+            for (auto&& pair : *this)
             {
                 if (include(pair.first))
                 {
                     // make sure probabilities sum up to 1
-                    result.probability_.insert(std::make_pair(
+                    result.add_probability(
                         pair.first,
-                        pair.second / prob_sum 
-                    ));
+                        pair.second / prob_sum);
                 }
             }
+            result.discarded_ = discarded_;
+            result.normalize();
             return result;
         }
 
@@ -503,6 +1069,13 @@ namespace dice
          * the probability that we roll k - n with X - 1 throws of a Y sided
          * die and then roll n on the last die for n = 1 to Y.
          * 
+         * If there are a lot of dice, the distribution is computed using 
+         * the FFT instead (see convolution::fft_compound). All numbers of 
+         * dice are computed at once by squaring in the frequency domain. 
+         * Precision of this method is described in the convolution class.
+         * Probability rounded off by the FFT is added to the discarded 
+         * probability of the result.
+         * 
          * @param num_dice number of dice X (independent of Y)
          *        Each value has to be a positive integer.
          * @param num_faces number of faces of each die Y (independent of X)
@@ -518,8 +1091,7 @@ namespace dice
         {
             // If there are no dice or dice sizes, 
             // then this is an impossible event
-            if (num_dice.probability_.empty() || 
-                num_faces.probability_.empty())
+            if (num_dice.empty() || num_faces.empty())
             {
                 return random_variable{};
             }
@@ -528,113 +1100,184 @@ namespace dice
             // number of dice faces is not positive.
             // note: Use the restrict method to restrict variable's 
             //       range to positive integers.
-            for (auto&& pair : num_dice.probability_)
+            if (num_dice.min_value() <= 0)
             {
-                if (pair.first <= 0)
-                {
-                    throw std::invalid_argument(
-                        "Number of dice has to be a positive integer.");
-                }
+                throw std::invalid_argument(
+                    "Number of dice has to be a positive integer.");
             }
 
-            for (auto&& pair : num_faces.probability_)
+            if (num_faces.min_value() <= 0)
             {
-                if (pair.first <= 0)
-                {
-                    throw std::invalid_argument(
-                        "Number of dice faces has to be a positive integer.");
-                }
+                throw std::invalid_argument(
+                    "Number of dice faces has to be a positive integer.");
             }
 
             // find maximal number of dice and faces
             auto max_dice = num_dice.max_value();
+            auto max_faces = num_faces.max_value();
     
             // compute distribution for each possible number of faces
             random_variable dist;
-            for (auto&& pair : num_faces.probability_)
+            dist.init_storage(
+                num_dice.min_value(),
+                max_dice * max_faces,
+                static_cast<std::size_t>(max_dice * max_faces));
+
+            // list numbers of dice in ascending order
+            std::vector<std::pair<std::size_t, probability_type>> dice_list;
+            for (auto&& pair : num_dice)
             {
-                auto faces_count = pair.first;
-                auto faces_prob = pair.second;
-                auto base_prob = 1 / static_cast<probability_type>(faces_count);
-                
-                // save the probability of 1 roll
-                auto one_roll = num_dice.probability_.find(1);
-                if (one_roll != num_dice.probability_.end())
-                {
-                    auto rolls_prob = one_roll->second;
-                    auto prob = base_prob * faces_prob * rolls_prob;
-                    for (value_type i = 1; i <= faces_count; ++i)
-                    {
-                        dist.add_probability(i, prob);
-                    }
-                }
+                dice_list.push_back(std::make_pair(
+                    static_cast<std::size_t>(pair.first),
+                    pair.second));
+            }
+            std::sort(dice_list.begin(), dice_list.end());
+
+            std::vector<std::size_t> powers;
+            std::vector<probability_type> weights;
+            for (auto&& pair : dice_list)
+            {
+                powers.push_back(pair.first);
+                weights.push_back(pair.second);
+            }
+
+            const auto max_count = static_cast<std::size_t>(max_dice);
+            // probability rounded to 0 by the FFT
+            probability_type fft_rounded = 0;
+            for (auto&& pair : num_faces)
+            {
+                cancellation::check_current();
+                const auto faces = static_cast<std::size_t>(pair.first);
+                const auto faces_prob = pair.second;
+                const auto base_prob = 1 / static_cast<probability_type>(faces);
 
-                // Prefix sum of probability:
-                // P(XdY = k | X = dice_count, Y = faces_count)
-                std::vector<probability_type> probability(
-                    faces_count * max_dice + 1, 0);
+                // sum[i] = P(XdY = i | Y = faces)
+                std::vector<probability_type> sum;
                 
-                // base case: roll only 1 die
-                for (value_type i = 1; i <= faces_count; ++i)
+                // For a lot of dice, compute the distribution of a sum of 
+                // `dice_count` rolls by squaring in the frequency domain.
+                if (convolution::use_fft_compound(faces + 1, powers))
                 {
-                    probability[i] = base_prob;
+                    std::vector<probability_type> die(faces + 1, base_prob);
+                    die[0] = 0;
+                    probability_type rounded = 0;
+                    sum = convolution::fft_compound(
+                        die, 
+                        powers, 
+                        weights, 
+                        &rounded);
+                    fft_rounded += rounded * faces_prob;
                 }
-
-                // Roll `dice_count` dice given the result of 
-                // `dice_count - 1` dice
-                for (value_type dice_count = 2; 
-                    dice_count <= max_dice; 
-                    ++dice_count)
+                else 
                 {
-                    // compute the prefix sum of the probability array
-                    for (value_type i = 2; i <= faces_count * dice_count; ++i)
-                    {
-                        probability[i] = probability[i - 1] + probability[i];
-                    }
+                    sum.assign(faces * max_count + 1, 0);
+                    
+                    // Prefix sum of probability:
+                    // P(XdY = k | X = dice_count, Y = faces)
+                    // It is computed in the accumulator type since prefix 
+                    // sums lose precision in float.
+                    std::vector<sum_type> probability(
+                        faces * max_count + 1, 0);
 
-                    // For computation of the probability of the sum of i
-                    // we only need values j < i. By iterating backwards we 
-                    // don't overwrite those values.
-                    for (auto i = faces_count * dice_count; i >= dice_count; --i)
+                    // base case: roll only 1 die
+                    for (std::size_t i = 1; i <= faces; ++i)
                     {
-                        // compute the probability of the sum of i
-                        value_type j = std::max(i - faces_count, 1);
-                        auto prob_i = probability[i - 1] - probability[j - 1];
-                        prob_i *= base_prob;
-
-                        // We will break the invariant that the probability 
-                        // array is a prefix sum of the probabilities but it
-                        // will be restored in the next iteration.
-                        probability[i] = prob_i;
+                        probability[i] = 1 / static_cast<sum_type>(faces);
                     }
 
-                    // zero out probabilities of lower values
-                    for (value_type i = 1; i < dice_count; ++i)
+                    auto weight = dice_list.begin();
+                    for (std::size_t dice_count = 1; 
+                        dice_count <= max_count; 
+                        ++dice_count)
                     {
-                        probability[i] = 0;
-                    }
+                        // Roll `dice_count` dice given the result of 
+                        // `dice_count - 1` dice
+                        if (dice_count > 1)
+                        {
+                            cancellation::check_current();
+                            add_die(probability, dice_count, faces);
+                        }
 
-                    // check whether dice_count is a valid number of dice
-                    auto rolls_it = num_dice.probability_.find(dice_count);
-                    if (rolls_it == num_dice.probability_.end())
-                    {
-                        continue;
+                        // check whether dice_count is a valid number of dice
+                        if (weight->first != dice_count)
+                        {
+                            continue;
+                        }
+
+                        // save the probability 
+                        for (auto i = dice_count; i <= faces * dice_count; ++i)
+                        {
+                            sum[i] += static_cast<probability_type>(
+                                probability[i] * weight->second);
+                        }
+                        ++weight;
                     }
+                }
 
-                    // save the probability 
-                    auto rolls_prob = rolls_it->second;
-                    for (auto i = dice_count; i <= faces_count * dice_count; ++i)
+                for (std::size_t i = 0; i < sum.size(); ++i)
+                {
+                    if (sum[i] != 0)
                     {
                         dist.add_probability(
-                            i, 
-                            probability[i] * rolls_prob * faces_prob
-                        );
+                            static_cast<value_type>(i), 
+                            sum[i] * faces_prob);
                     }
                 }
             }
+            dist.discarded_ = num_dice.discarded_ + num_faces.discarded_ + 
+                fft_rounded;
+            dist.normalize();
             return dist;
         }
 
+        /** @brief Compute distribution of the sum of the highest dice.
+         *
+         * X times roll a Y sided die and sum the K highest results (e.g.,
+         * 4d6 keep highest 3). X and Y are assumed to be independent. If
+         * K is greater than the number of dice, all dice are kept.
+         *
+         * The distribution is computed by a dynamic programming algorithm
+         * over order statistics (see keep_sums) in polynomial time instead
+         * of enumerating all outcomes.
+         *
+         * @param num_dice number of dice X (positive integers)
+         * @param num_faces number of faces of each die Y (positive integers)
+         * @param kept number of kept dice K (non-negative)
+         *
+         * @return distribution of the sum of K highest dice of XdY
+         *
+         * @throws std::invalid_argument if X or Y contain a non-positive 
+         *         value or K is negative
+         */
+        friend auto keep_highest(
+            const random_variable& num_dice, 
+            const random_variable& num_faces,
+            const value_type& kept)
+        {
+            return keep_dice(num_dice, num_faces, kept, true);
+        }
+
+        /** @brief Compute distribution of the sum of the lowest dice.
+         *
+         * See keep_highest.
+         *
+         * @param num_dice number of dice X (positive integers)
+         * @param num_faces number of faces of each die Y (positive integers)
+         * @param kept number of kept dice K (non-negative)
+         *
+         * @return distribution of the sum of K lowest dice of XdY
+         *
+         * @throws std::invalid_argument if X or Y contain a non-positive 
+         *         value or K is negative
+         */
+        friend auto keep_lowest(
+            const random_variable& num_dice, 
+            const random_variable& num_faces,
+            const value_type& kept)
+        {
+            return keep_dice(num_dice, num_faces, kept, false);
+        }
+
         /** @brief Create a random variable that is a function
          *         of this variable X and the other variable Y.
          *
@@ -653,15 +1296,18 @@ namespace dice
             CombinationFunction combination) const
         {
             random_variable dist;
-            for (auto&& pair_a : probability_)
+            dist.is_dense_ = false;
+            for (auto&& pair_a : *this)
             {
-                for (auto&& pair_b : other.probability_)
+                for (auto&& pair_b : other)
                 {
                     auto value = combination(pair_a.first, pair_b.first);
                     auto probability = pair_b.second * pair_a.second;
                     dist.add_probability(value, probability);
                 }
             }
+            dist.discarded_ = discarded_ + other.discarded_;
+            dist.normalize();
             return dist;
         }
 
@@ -674,8 +1320,16 @@ namespace dice
          */
         auto probability(const value_type& value) const
         {
-            auto it = probability_.find(value);
-            if (it == probability_.end())
+            if (is_dense_)
+            {
+                std::size_t index;
+                if (!try_index_of(value, index))
+                    return probability_type{ 0 };
+                return dense_[index];
+            }
+
+            auto it = sparse_.find(value);
+            if (it == sparse_.end())
                 return probability_type{ 0 };
             return it->second;
         }
@@ -687,27 +1341,57 @@ namespace dice
          * 
          * @return number of such values
          */
-        auto size() const
+        std::size_t size() const
+        {
+            return is_dense_ ? dense_size_ : sparse_.size();
+        }
+
+        /** @brief Compute memory used by this variable.
+         *
+         * It includes the object itself, its storage and the distribution
+         * table (even if it is shared with copies of this variable). Size 
+         * of nodes of the sparse storage is approximated.
+         *
+         * @return number of bytes
+         */
+        std::size_t memory_usage() const
         {
-            return probability_.size();
+            std::size_t result = sizeof(*this);
+            result += dense_.capacity() * sizeof(probability_type);
+            result += sparse_.bucket_count() * sizeof(void*);
+            result += sparse_.size() * sparse_node_size;
+
+            auto table = std::atomic_load(&table_);
+            if (table != nullptr)
+            {
+                result += sizeof(distribution_table);
+                result += table->values.capacity() * sizeof(value_type);
+                result += table->probabilities.capacity() * 
+                    sizeof(probability_type);
+                result += table->cdf.capacity() * sizeof(probability_type);
+                result += table->alias_prob.capacity() * 
+                    sizeof(probability_type);
+                result += table->alias.capacity() * sizeof(std::size_t);
+            }
+            return result;
         }
 
         /** @brief First iterator of the (value, probaiblity) pair collection.
          *
          * @return iterator pointing to the first value
          */
-        auto begin() const
+        const_iterator begin() const
         {
-            return probability_.begin();
+            return const_iterator{ this, false };
         }
 
         /** @brief Last iterator of the (value, probability) pair collection.
          *
          * @return iterator pointing past the last value
          */
-        auto end() const
+        const_iterator end() const
         {
-            return probability_.cend();
+            return const_iterator{ this, true };
         }
 
         /** @brief Check whether there are any values with non-zero probability.
@@ -716,7 +1400,7 @@ namespace dice
          */
         bool empty() const
         {
-            return probability_.empty();
+            return size() == 0;
         }
 
         /** @brief Chek whether this variable is equal to some other variable.
@@ -730,77 +1414,1368 @@ namespace dice
          */
         bool operator==(const random_variable& other) const
         {
-            return probability_ == other.probability_;
+            if (size() != other.size())
+                return false;
+
+            for (auto&& pair : *this)
+            {
+                if (other.probability(pair.first) != pair.second)
+                    return false;
+            }
+            return true;
         }
 
         bool operator!=(const random_variable& other) const
         {
-            return probability_ != other.probability_;
+            return !operator==(other);
         }
     private:
-        std::unordered_map<value_type, probability_type> probability_;
+        /** Dense storage is used if the range of values is at most this big
+         * (regardless of the number of values with non-zero probability).
+         */
+        static constexpr std::int64_t dense_min_range = 64;
 
-        /** @brief Add probability to current porbability of given value.
+        /** Dense storage is used if values with non-zero probability fill
+         * at least 1 / dense_max_sparsity of the range. A probability in the
+         * vector takes a fraction of memory of a hash table node.
+         */
+        static constexpr std::int64_t dense_max_sparsity = 4;
+
+        /** True iff the dense storage is used.
          *
-         * Note: caller guarantees that probabilities sum up to 1.
-         * 
-         * @param value
-         * @param probability that will be added to current probability of value
+         * Only one storage (dense_ or sparse_) is used at a time. The other
+         * one is empty.
          */
-        void add_probability(value_type value, probability_type probability)
+        bool is_dense_ = true;
+
+        /** Minimal value of the dense storage.
+         *
+         * Probability of value offset_ + i is in dense_[i].
+         */
+        value_type offset_ = 0;
+
+        /** Dense storage.
+         *
+         * Probabilities of consecutive values starting with offset_. After
+         * the normalize() call, first and last probability are non-zero.
+         */
+        std::vector<probability_type> dense_;
+
+        /** Number of non-zero probabilities in the dense_ vector. */
+        std::size_t dense_size_ = 0;
+
+        /** Sparse storage (fallback for values spread over a large range). */
+        std::unordered_map<value_type, probability_type> sparse_;
+
+        /** Approximate size of a node of the sparse storage (a pair and a 
+         * pointer to the next node).
+         */
+        static constexpr std::size_t sparse_node_size = 
+            sizeof(std::pair<const value_type, probability_type>) + 
+            sizeof(void*);
+
+        /** Upper bound of probability removed by pruning (see pruning). */
+        probability_type discarded_ = 0;
+
+        /** @brief Sorted view of the distribution.
+         *
+         * It is used to compute quantiles and random values.
+         */
+        struct distribution_table
         {
-            auto result = probability_.insert(
-                std::make_pair(value, probability));
-            auto iter = result.first;
-            auto is_inserted = result.second;
-            if (!is_inserted)
+            /** Values with non-zero probability in ascending order. */
+            std::vector<value_type> values;
+
+            /** probabilities[i] = P(X = values[i]) */
+            std::vector<probability_type> probabilities;
+
+            /** cdf[i] = P(X <= values[i]) */
+            std::vector<probability_type> cdf;
+
+            /** Alias table: probability that values[i] is chosen instead 
+             * of values[alias[i]] if the i-th column is drawn. 
+             */
+            std::vector<probability_type> alias_prob;
+
+            /** Alias table: alternative value index of each column. */
+            std::vector<std::size_t> alias;
+        };
+
+        /** Lazily built distribution table (null if it was not built yet).
+         *
+         * It is shared by copies as the table is never modified. Any 
+         * modification of the variable resets the pointer.
+         */
+        mutable std::shared_ptr<const distribution_table> table_;
+
+        /** @brief Get distribution table of this variable.
+         *
+         * It can be called concurrently (e.g. by parallel leaf evaluation
+         * in a decomposition). The pointer is set only once so that the 
+         * returned reference stays valid. If 2 threads build the table at
+         * the same time, one of the tables is thrown away.
+         *
+         * @return table built on the first call
+         */
+        const distribution_table& table() const
+        {
+            auto current = std::atomic_load(&table_);
+            if (current == nullptr)
             {
-                iter->second += probability;
+                auto value = std::make_shared<const distribution_table>(
+                    build_table());
+                if (std::atomic_compare_exchange_strong(
+                    &table_, &current, value))
+                {
+                    return *value;
+                }
             }
+            return *current;
         }
-    };
 
-    /** @brief Calculate max(X, Y) for independent r.v. X and Y
-     * 
-     * @tparam T ValueType of random variable
-     * @tparam U ProbabilityType of random variable
-     * 
-     * @param a first random variable X (independent of Y)
-     * @param b second random variable Y (independent of X)
-     * 
-     * @return distribution of max(X, Y)
-     */
-    template<typename T, typename U>
-    random_variable<T, U> max(
-        const random_variable<T, U>& a, 
-        const random_variable<T, U>& b)
-    {
-        return a.combine(b, [](auto&& value_a, auto&& value_b) 
+        /** @brief Compute distribution table of this variable.
+         *
+         * The alias table is built using Vose's algorithm.
+         *
+         * @return new table
+         */
+        distribution_table build_table() const
         {
-            return std::max(value_a, value_b);
-        });
-    }
+            probability_list list{ begin(), end() };
+            // values are already sorted in the dense storage
+            if (!is_dense_)
+            {
+                std::sort(list.begin(), list.end(), [](auto&& a, auto&& b)
+                {
+                    return a.first < b.first;
+                });
+            }
 
-    /** @brief Calculate min(X, Y) for independent r.v. X and Y
-    *
-    * @tparam T ValueType of random variable
-    * @tparam U ProbabilityType of random variable
-    *
-    * @param a first random variable X (independent of Y)
-    * @param b second random variable Y (independent of X)
-    *
-    * @return distribution of min(X, Y)
-    */
-    template<typename T, typename U>
-    random_variable<T, U> min(
-        const random_variable<T, U>& a, 
-        const random_variable<T, U>& b)
-    {
-        return a.combine(b, [](auto&& value_a, auto&& value_b) 
+            distribution_table result;
+            result.values.reserve(list.size());
+            result.probabilities.reserve(list.size());
+            result.cdf.reserve(list.size());
+            probability_type sum = 0;
+            for (auto&& pair : list)
+            {
+                sum += pair.second;
+                result.values.push_back(pair.first);
+                result.probabilities.push_back(pair.second);
+                result.cdf.push_back(sum);
+            }
+
+            // scale probabilities so that their mean is 1
+            const auto size = list.size();
+            result.alias.assign(size, 0);
+            result.alias_prob.resize(size);
+            std::vector<std::size_t> small;
+            std::vector<std::size_t> large;
+            for (std::size_t i = 0; i < size; ++i)
+            {
+                result.alias_prob[i] = list[i].second * 
+                    static_cast<probability_type>(size) / sum;
+                if (result.alias_prob[i] < 1)
+                    small.push_back(i);
+                else
+                    large.push_back(i);
+            }
+
+            // fill each column of a small value with a large value
+            while (!small.empty() && !large.empty())
+            {
+                auto less = small.back();
+                auto more = large.back();
+                small.pop_back();
+                result.alias[less] = more;
+                result.alias_prob[more] -= 1 - result.alias_prob[less];
+                if (result.alias_prob[more] < 1)
+                {
+                    large.pop_back();
+                    small.push_back(more);
+                }
+            }
+
+            // remaining columns are full (up to a rounding error)
+            for (auto&& index : small)
+            {
+                result.alias_prob[index] = 1;
+            }
+            for (auto&& index : large)
+            {
+                result.alias_prob[index] = 1;
+            }
+            return result;
+        }
+
+        /** @brief Check whether we should use the dense storage.
+         *
+         * @param range number of integers between min and max value
+         *              (including the bounds)
+         * @param count number of values with non-zero probability
+         *
+         * @return true iff dense storage should be used
+         */
+        static bool is_compact(std::int64_t range, std::int64_t count)
+        {
+            return range <= dense_min_range ||
+                range <= count * dense_max_sparsity;
+        }
+
+        /** @brief Compute distribution of the sum of kept dice.
+         *
+         * @param num_dice number of dice X
+         * @param num_faces number of faces of each die Y
+         * @param kept number of kept dice K
+         * @param highest if true, the highest dice are kept, otherwise the
+         *        lowest dice are kept
+         *
+         * @return distribution of the sum of K kept dice of XdY
+         */
+        static random_variable keep_dice(
+            const random_variable& num_dice, 
+            const random_variable& num_faces,
+            const value_type& kept,
+            bool highest)
+        {
+            if (num_dice.empty() || num_faces.empty())
+            {
+                return random_variable{};
+            }
+
+            if (num_dice.min_value() <= 0)
+            {
+                throw std::invalid_argument(
+                    "Number of dice has to be a positive integer.");
+            }
+
+            if (num_faces.min_value() <= 0)
+            {
+                throw std::invalid_argument(
+                    "Number of dice faces has to be a positive integer.");
+            }
+
+            if (kept < 0)
+            {
+                throw std::invalid_argument(
+                    "Number of kept dice has to be a non-negative integer.");
+            }
+
+            // this also checks that the sum does not overflow
+            value_type max_kept = std::min(kept, num_dice.max_value());
+            value_type upper_bound = max_kept * num_faces.max_value();
+
+            random_variable dist;
+            dist.init_storage(
+                0, 
+                upper_bound, 
+                static_cast<std::size_t>(upper_bound) + 1);
+            for (auto&& dice : num_dice)
+            {
+                auto count = static_cast<std::size_t>(dice.first);
+                auto keep_count = std::min(
+                    count, 
+                    static_cast<std::size_t>(kept));
+                for (auto&& faces : num_faces)
+                {
+                    auto sums = keep_sums(
+                        count,
+                        static_cast<std::size_t>(faces.first),
+                        keep_count,
+                        highest);
+                    auto weight = dice.second * faces.second;
+                    for (std::size_t i = 0; i < sums.size(); ++i)
+                    {
+                        if (sums[i] != 0)
+                        {
+                            dist.add_probability(
+                                static_cast<value_type>(i), 
+                                sums[i] * weight);
+                        }
+                    }
+                }
+            }
+            dist.discarded_ = num_dice.discarded_ + num_faces.discarded_;
+            dist.normalize();
+            return dist;
+        }
+
+        /** @brief Distribution of the sum of kept dice of a constant roll.
+         *
+         * Faces are processed from the best one (the highest face if the 
+         * highest dice are kept). State of the algorithm is the number m
+         * of dice which show one of the processed faces and the sum of 
+         * these dice. The remaining n - m dice show one of the u faces 
+         * which have not been processed yet uniformly at random so c of
+         * them show the current face with the binomial probability 
+         * C(n - m, c) (1/u)^c (1 - 1/u)^(n - m - c) and min(c, kept - m) of
+         * them are added to the sum. As soon as kept dice are known, the 
+         * state is moved to the result. There are O(kept * kept * faces) 
+         * states so the complexity is O(faces^2 * kept^2 * count).
+         *
+         * Binomial probabilities are computed in log space so that they
+         * don't overflow or underflow for a large number of dice.
+         *
+         * @param count number of dice
+         * @param faces number of faces of each die
+         * @param kept number of kept dice (at most count)
+         * @param highest true iff the highest dice are kept
+         *
+         * @return probability of each sum (indexed by the sum)
+         *
+         * @throws budget_error if the tables exceed the memory limit
+         */
+        static std::vector<probability_type> keep_sums(
+            std::size_t count,
+            std::size_t faces,
+            std::size_t kept,
+            bool highest)
         {
-            return std::min(value_a, value_b);
-        });
+            assert(kept <= count);
+
+            auto max_sum = kept * faces;
+            std::vector<probability_type> result(max_sum + 1, 0);
+            if (kept == 0)
+            {
+                result[0] = 1;
+                return result;
+            }
+
+            // binomial[m * (count + 1) + c] is the probability that c of 
+            // the count - m remaining dice show the current face
+            const auto width = max_sum + 1;
+            budget::check_allocation_current(cost::add(
+                cost::multiply(cost::multiply(kept, count + 1), 
+                    sizeof(probability_type)),
+                cost::multiply(cost::multiply(2 * kept, width), 
+                    sizeof(probability_type))));
+
+            // log_factorial[i] = log(i!)
+            std::vector<sum_type> log_factorial(count + 1, 0);
+            for (std::size_t i = 2; i <= count; ++i)
+            {
+                log_factorial[i] = log_factorial[i - 1] + 
+                    std::log(static_cast<sum_type>(i));
+            }
+            std::vector<probability_type> binomial(kept * (count + 1), 0);
+
+            // state[m * (max_sum + 1) + sum] for m < kept
+            std::vector<probability_type> state(kept * width, 0);
+            std::vector<probability_type> next(kept * width, 0);
+            state[0] = 1;
+            for (std::size_t step = 0; step < faces; ++step)
+            {
+                cancellation::check_current();
+                auto face = highest ? faces - step : step + 1;
+
+                // the current face and the faces which are worse
+                auto unprocessed = static_cast<sum_type>(faces - step);
+                auto log_face = -std::log(unprocessed);
+                auto log_other = std::log1p(-1 / unprocessed);
+                for (std::size_t m = 0; m < kept; ++m)
+                {
+                    auto remaining = count - m;
+                    auto row = binomial.begin() + m * (count + 1);
+                    for (std::size_t c = 0; c <= remaining; ++c)
+                    {
+                        if (step + 1 == faces)
+                        {
+                            // all remaining dice show the last face
+                            row[c] = c == remaining ? 1 : 0;
+                            continue;
+                        }
+
+                        auto log_prob = log_factorial[remaining] - 
+                            log_factorial[c] - 
+                            log_factorial[remaining - c] +
+                            static_cast<sum_type>(c) * log_face + 
+                            static_cast<sum_type>(remaining - c) * log_other;
+                        row[c] = static_cast<probability_type>(
+                            std::exp(log_prob));
+                    }
+                }
+
+                std::fill(next.begin(), next.end(), 0);
+                for (std::size_t m = 0; m < kept; ++m)
+                {
+                    auto remaining = count - m;
+                    auto row = binomial.begin() + m * (count + 1);
+                    for (std::size_t sum = 0; sum <= m * faces; ++sum)
+                    {
+                        auto prob = state[m * width + sum];
+                        if (prob == 0)
+                            continue;
+
+                        for (std::size_t c = 0; c <= remaining; ++c)
+                        {
+                            auto weight = prob * row[c];
+                            if (weight == 0)
+                                continue;
+
+                            auto known = m + c;
+                            auto value = sum + 
+                                std::min(c, kept - m) * face;
+                            if (known >= kept)
+                            {
+                                result[value] += weight;
+                            }
+                            else
+                            {
+                                next[known * width + value] += weight;
+                            }
+                        }
+                    }
+                }
+                std::swap(state, next);
+            }
+            return result;
+        }
+
+        /** @brief Add 1 die to the distribution of a sum of dice.
+         *
+         * The probability that we roll k with n dice is the probability
+         * that we roll k - i with n - 1 dice and then roll i on the last
+         * die for i = 1 to the number of faces.
+         *
+         * @param probability distribution of the sum of dice_count - 1 dice
+         *        It is replaced with the distribution of dice_count dice.
+         * @param dice_count new number of dice (at least 2)
+         * @param faces number of faces of each die
+         */
+        static void add_die(
+            std::vector<sum_type>& probability,
+            std::size_t dice_count,
+            std::size_t faces)
+        {
+            const auto base_prob = 1 / static_cast<sum_type>(faces);
+            const auto max_sum = faces * dice_count;
+            assert(probability.size() > max_sum);
+
+            // compute the prefix sum of the probability array
+            for (std::size_t i = 2; i <= max_sum; ++i)
+            {
+                probability[i] = probability[i - 1] + probability[i];
+            }
+
+            // For computation of the probability of the sum of i
+            // we only need values j < i. By iterating backwards we 
+            // don't overwrite those values. The probability of the sum 
+            // of i is (probability[i - 1] - probability[i - faces - 1]) *
+            // base_prob (probability[0] = 0 is used if i <= faces).
+            // 
+            // We will break the invariant that the probability array is 
+            // a prefix sum of the probabilities but it will be restored 
+            // in the next iteration.
+            simd::window_difference(
+                probability.data(), 
+                dice_count, 
+                max_sum, 
+                faces, 
+                base_prob);
+
+            // zero out probabilities of lower values
+            for (std::size_t i = 1; i < dice_count; ++i)
+            {
+                probability[i] = 0;
+            }
+        }
+
+        /** @brief Compute number of integers in [lower_bound, upper_bound].
+         *
+         * @param lower_bound
+         * @param upper_bound
+         *
+         * @return size of the interval
+         */
+        static std::int64_t range_size(
+            const value_type& lower_bound,
+            const value_type& upper_bound)
+        {
+            return static_cast<std::int64_t>(upper_bound) -
+                static_cast<std::int64_t>(lower_bound) + 1;
+        }
+
+        /** @brief Get value at given index of the dense storage.
+         *
+         * @param index in the dense_ vector
+         *
+         * @return value
+         */
+        value_type value_at(std::size_t index) const
+        {
+            return static_cast<value_type>(
+                static_cast<std::int64_t>(offset_) +
+                static_cast<std::int64_t>(index));
+        }
+
+        /** @brief Find index of a value in the dense storage.
+         *
+         * @param value
+         * @param index output index (valid only if this returns true)
+         *
+         * @return true iff the value is in the range of the dense storage
+         */
+        bool try_index_of(const value_type& value, std::size_t& index) const
+        {
+            auto diff = static_cast<std::int64_t>(value) -
+                static_cast<std::int64_t>(offset_);
+            if (diff < 0 || diff >= static_cast<std::int64_t>(dense_.size()))
+                return false;
+            index = static_cast<std::size_t>(diff);
+            return true;
+        }
+
+        /** @brief Prepare empty storage for values in given range.
+         *
+         * @param lower_bound of the value range
+         * @param upper_bound of the value range
+         * @param count estimated number of values with non-zero probability
+         */
+        void init_storage(
+            const value_type& lower_bound,
+            const value_type& upper_bound,
+            std::size_t count)
+        {
+            assert(lower_bound <= upper_bound);
+
+            profiler::count_allocation();
+            table_.reset();
+            sparse_.clear();
+            dense_.clear();
+            dense_size_ = 0;
+
+            auto range = range_size(lower_bound, upper_bound);
+            is_dense_ = is_compact(range, static_cast<std::int64_t>(count));
+            if (is_dense_)
+            {
+                budget::check_allocation_current(cost::multiply(
+                    static_cast<std::size_t>(range), 
+                    sizeof(probability_type)));
+                offset_ = lower_bound;
+                dense_.assign(static_cast<std::size_t>(range), 0);
+            }
+            else
+            {
+                budget::check_allocation_current(
+                    cost::multiply(count, sparse_node_size));
+            }
+        }
+
+        /** @brief Switch from dense to sparse storage. */
+        void to_sparse()
+        {
+            assert(is_dense_);
+
+            sparse_.reserve(dense_size_);
+            for (std::size_t i = 0; i < dense_.size(); ++i)
+            {
+                if (dense_[i] != 0)
+                {
+                    sparse_.insert(std::make_pair(value_at(i), dense_[i]));
+                }
+            }
+            dense_.clear();
+            dense_size_ = 0;
+            is_dense_ = false;
+        }
+
+        /** @brief Switch from sparse to dense storage.
+         *
+         * @param lower_bound minimal value in the sparse storage
+         * @param upper_bound maximal value in the sparse storage
+         */
+        void to_dense(
+            const value_type& lower_bound,
+            const value_type& upper_bound)
+        {
+            assert(!is_dense_);
+
+            auto range = range_size(lower_bound, upper_bound);
+            budget::check_allocation_current(cost::multiply(
+                static_cast<std::size_t>(range), 
+                sizeof(probability_type)));
+
+            offset_ = lower_bound;
+            dense_.assign(static_cast<std::size_t>(range), 0);
+            dense_size_ = 0;
+            is_dense_ = true;
+            for (auto&& pair : sparse_)
+            {
+                add_probability(pair.first, pair.second);
+            }
+            sparse_.clear();
+        }
+
+        /** @brief Choose the best storage and restore its invariants.
+         *
+         * This has to be called after the variable is constructed using
+         * the add_probability method. It also applies the pruning policy.
+         */
+        void normalize()
+        {
+            normalize_storage();
+            if (pruning::enabled() && prune())
+            {
+                normalize_storage();
+            }
+        }
+
+        /** @brief Remove negligible probabilities (see the pruning class).
+         *
+         * Removed probability is added to the discarded probability. At 
+         * least 1 value is always kept. Storage has to be normalized 
+         * afterwards.
+         *
+         * @return true iff some values were removed
+         */
+        bool prune()
+        {
+            if (empty())
+                return false;
+
+            probability_list list{ begin(), end() };
+            if (!is_dense_)
+            {
+                std::sort(list.begin(), list.end(), [](auto&& a, auto&& b)
+                {
+                    return a.first < b.first;
+                });
+            }
+
+            // remove values at the ends of the range [first, last)
+            probability_type removed = 0;
+            std::size_t first = 0;
+            std::size_t last = list.size();
+            const auto epsilon = static_cast<probability_type>(
+                pruning::epsilon);
+            while (last - first > 1)
+            {
+                auto&& lower = list[first].second;
+                auto&& upper = list[last - 1].second;
+                auto prob = std::min(lower, upper);
+                if (removed + prob > epsilon)
+                    break;
+                removed += prob;
+                if (lower <= upper)
+                    ++first;
+                else 
+                    --last;
+            }
+
+            // remove the least probable values
+            auto end = list.begin() + last;
+            if (pruning::max_size > 0 && last - first > pruning::max_size)
+            {
+                auto middle = list.begin() + first + pruning::max_size;
+                std::nth_element(list.begin() + first, middle, end, 
+                    [](auto&& a, auto&& b)
+                {
+                    return a.second > b.second;
+                });
+                for (auto it = middle; it != end; ++it)
+                {
+                    removed += it->second;
+                }
+                end = middle;
+            }
+
+            auto kept = static_cast<std::size_t>(
+                std::distance(list.begin() + first, end));
+            if (kept == list.size())
+                return false;
+
+            // rebuild the storage with the kept values
+            table_.reset();
+            auto it = list.begin() + first;
+            if (is_dense_)
+            {
+                std::fill(dense_.begin(), dense_.end(), 0);
+                for (; it != end; ++it)
+                {
+                    std::size_t index = 0;
+                    try_index_of(it->first, index);
+                    dense_[index] = it->second;
+                }
+                dense_size_ = kept;
+            }
+            else 
+            {
+                sparse_.clear();
+                for (; it != end; ++it)
+                {
+                    sparse_.insert(*it);
+                }
+            }
+            discarded_ += removed;
+            return true;
+        }
+
+        /** @brief Choose the best storage and restore its invariants. */
+        void normalize_storage()
+        {
+            table_.reset();
+            if (is_dense_)
+            {
+                // remove zero probabilities at both ends of the range
+                std::size_t first = 0;
+                while (first < dense_.size() && dense_[first] == 0)
+                {
+                    ++first;
+                }
+
+                if (first >= dense_.size())
+                {
+                    dense_.clear();
+                    dense_size_ = 0;
+                    offset_ = 0;
+                    return;
+                }
+
+                std::size_t last = dense_.size();
+                while (dense_[last - 1] == 0)
+                {
+                    --last;
+                }
+
+                if (first > 0 || last < dense_.size())
+                {
+                    offset_ = value_at(first);
+                    dense_.erase(dense_.begin() + last, dense_.end());
+                    dense_.erase(dense_.begin(), dense_.begin() + first);
+                }
+
+                if (!is_compact(
+                    static_cast<std::int64_t>(dense_.size()),
+                    static_cast<std::int64_t>(dense_size_)))
+                {
+                    to_sparse();
+                }
+            }
+            else if (sparse_.empty())
+            {
+                is_dense_ = true;
+                offset_ = 0;
+            }
+            else
+            {
+                auto lower_bound = min_value();
+                auto upper_bound = max_value();
+                if (is_compact(
+                    range_size(lower_bound, upper_bound),
+                    static_cast<std::int64_t>(sparse_.size())))
+                {
+                    to_dense(lower_bound, upper_bound);
+                }
+            }
+        }
+
+        /** @brief Add probability to current porbability of given value.
+         *
+         * Note: caller guarantees that probabilities sum up to 1 and calls
+         *       the normalize method when the variable is constructed.
+         * 
+         * @param value
+         * @param probability that will be added to current probability of value
+         */
+        void add_probability(value_type value, probability_type probability)
+        {
+            table_.reset();
+            if (is_dense_)
+            {
+                std::size_t index;
+                if (try_index_of(value, index))
+                {
+                    auto& current = dense_[index];
+                    if (current == 0 && probability != 0)
+                    {
+                        ++dense_size_;
+                    }
+                    current += probability;
+                    return;
+                }
+
+                // the value is out of the range of the dense storage
+                to_sparse();
+            }
+
+            auto result = sparse_.insert(
+                std::make_pair(value, probability));
+            auto iter = result.first;
+            auto is_inserted = result.second;
+            if (!is_inserted)
+            {
+                iter->second += probability;
+            }
+        }
+
+        /** @brief Compute distribution of X + Y or X - Y.
+         *
+         * Both variables have to use the dense storage. The result is
+         * computed directly in a vector without any hashing. Large vectors
+         * are convolved using the FFT (see the convolution class). Its
+         * discarded probability is the probability rounded off by the FFT
+         * (the caller adds discarded probability of the operands).
+         *
+         * @param other random variable Y (independent of X)
+         * @param subtract if true, X - Y is computed. X + Y otherwise.
+         *
+         * @return distribution of the result
+         */
+        random_variable convolve(
+            const random_variable& other,
+            bool subtract) const
+        {
+            assert(is_dense_ && other.is_dense_);
+
+            random_variable result;
+            if (empty() || other.empty())
+            {
+                return result;
+            }
+
+            // The bounds are values in the range of the result. This will
+            // also check for an overflow.
+            value_type lower_bound = subtract ?
+                min_value() - other.max_value() :
+                min_value() + other.min_value();
+            value_type upper_bound = subtract ?
+                max_value() - other.min_value() :
+                max_value() + other.max_value();
+
+            budget::check_allocation_current(cost::multiply(
+                static_cast<std::size_t>(range_size(lower_bound, upper_bound)),
+                sizeof(probability_type)));
+            profiler::count_allocation();
+
+            result.offset_ = lower_bound;
+            if (subtract)
+            {
+                // X - Y = X + (-Y)
+                std::vector<probability_type> negated{
+                    other.dense_.rbegin(),
+                    other.dense_.rend()
+                };
+                result.dense_ = convolution::convolve(
+                    dense_, 
+                    negated, 
+                    &result.discarded_);
+            }
+            else
+            {
+                result.dense_ = convolution::convolve(
+                    dense_, 
+                    other.dense_, 
+                    &result.discarded_);
+            }
+            assert(static_cast<std::int64_t>(result.dense_.size()) == 
+                range_size(lower_bound, upper_bound));
+
+            for (auto&& prob : result.dense_)
+            {
+                if (prob != 0)
+                {
+                    ++result.dense_size_;
+                }
+            }
+            result.normalize();
+            return result;
+        }
+
+        /** @brief Probabilities of relations of 2 independent variables. */
+        struct comparison
+        {
+            /** P(X < Y) */
+            probability_type less = 0;
+
+            /** P(X = Y) */
+            probability_type equal = 0;
+
+            /** P(X > Y) */
+            probability_type greater = 0;
+        };
+
+        /** @brief Compare this random variable X with other variable Y.
+         *
+         * Values of both variables are merged in ascending order (using
+         * the cached distribution tables). P(X < Y) is computed from the
+         * suffix sums and P(X > Y) from the prefix sums of probabilities
+         * of Y so that small probabilities are not lost in a subtraction.
+         * The complexity is linear after the tables are built.
+         *
+         * @param other random variable Y (independent of X)
+         *
+         * @return probabilities of X < Y, X = Y and X > Y
+         *         (all 0 if X or Y is an impossible event)
+         */
+        comparison compare(const random_variable& other) const
+        {
+            comparison result;
+            if (empty() || other.empty())
+            {
+                return result;
+            }
+
+            auto&& a = table();
+            auto&& b = other.table();
+
+            // suffix[j] = P(Y >= b.values[j])
+            std::vector<probability_type> suffix(b.values.size() + 1, 0);
+            for (auto j = b.values.size(); j > 0; --j)
+            {
+                suffix[j - 1] = suffix[j] + b.probabilities[j - 1];
+            }
+
+            std::size_t j = 0;
+            for (std::size_t i = 0; i < a.values.size(); ++i)
+            {
+                // find the first value of Y which is not less than X
+                while (j < b.values.size() && b.values[j] < a.values[i])
+                {
+                    ++j;
+                }
+
+                auto prob = a.probabilities[i];
+                auto below = j > 0 ? b.cdf[j - 1] : 0;
+                auto above = suffix[j];
+                if (j < b.values.size() && b.values[j] == a.values[i])
+                {
+                    result.equal += prob * b.probabilities[j];
+                    above = suffix[j + 1];
+                }
+                result.greater += prob * below;
+                result.less += prob * above;
+            }
+            return result;
+        }
+
+        /** @brief Compute X + c or X - c for a constant c.
+         *
+         * If X uses the dense storage, only the offset changes.
+         *
+         * @param value constant c
+         * @param subtract if true, compute X - c, otherwise X + c
+         *
+         * @return distribution of X + c or X - c
+         */
+        random_variable shift(const value_type& value, bool subtract) const
+        {
+            random_variable result;
+            if (empty())
+            {
+                return result;
+            }
+
+            if (is_dense_)
+            {
+                // check whether the values overflow
+                if (subtract)
+                {
+                    result.offset_ = offset_ - value;
+                    static_cast<void>(max_value() - value);
+                }
+                else
+                {
+                    result.offset_ = offset_ + value;
+                    static_cast<void>(max_value() + value);
+                }
+                result.dense_ = dense_;
+                result.dense_size_ = dense_size_;
+                return result;
+            }
+
+            result.init_storage(
+                subtract ? min_value() - value : min_value() + value,
+                subtract ? max_value() - value : max_value() + value,
+                size());
+            for (auto&& pair : sparse_)
+            {
+                result.add_probability(
+                    subtract ? pair.first - value : pair.first + value,
+                    pair.second);
+            }
+            result.normalize();
+            return result;
+        }
+
+        /** @brief Compute X + c or X - c in place for a constant c.
+         *
+         * @param other constant c
+         * @param subtract if true, compute X - c, otherwise X + c
+         *
+         * @return false if it can't be computed in place (i.e., other is
+         *         not a constant or this variable is not dense)
+         */
+        bool try_shift(const random_variable& other, bool subtract)
+        {
+            if (!is_dense_ || empty() || !other.is_constant())
+                return false;
+
+            // check whether the values overflow before anything changes
+            auto value = other.min_value();
+            auto offset = subtract ? offset_ - value : offset_ + value;
+            static_cast<void>(subtract ? 
+                max_value() - value : 
+                max_value() + value);
+
+            offset_ = offset;
+            discarded_ += other.discarded_;
+            table_.reset();
+            return true;
+        }
+
+        /** @brief Compute X * c for a constant c.
+         *
+         * @param value constant c
+         *
+         * @return distribution of X * c
+         */
+        random_variable scale(const value_type& value) const
+        {
+            if (empty())
+            {
+                return random_variable{};
+            }
+
+            if (value == 1)
+            {
+                // discarded probability is added by the caller
+                auto result = *this;
+                result.discarded_ = 0;
+                return result;
+            }
+
+            if (value == 0)
+            {
+                return random_variable{ constant_tag{}, 0 };
+            }
+
+            auto a = min_value() * value;
+            auto b = max_value() * value;
+            return map(std::min(a, b), std::max(a, b), [&value](auto&& x)
+            {
+                return x * value;
+            });
+        }
+
+        /** @brief Compute integer division X / c for a non-zero constant c.
+         *
+         * @param value constant c (not 0)
+         *
+         * @return distribution of X / c
+         */
+        random_variable divide(const value_type& value) const
+        {
+            assert(value != 0);
+            if (empty())
+            {
+                return random_variable{};
+            }
+
+            // division by a constant is monotonic
+            auto a = min_value() / value;
+            auto b = max_value() / value;
+            return map(std::min(a, b), std::max(a, b), [&value](auto&& x)
+            {
+                return x / value;
+            });
+        }
+
+        /** @brief Compute distribution of f(X).
+         *
+         * @param lower_bound of the result (all values are at least this big)
+         * @param upper_bound of the result (all values are at most this big)
+         * @param function f
+         *
+         * @return distribution of f(X)
+         */
+        template<typename Function>
+        random_variable map(
+            const value_type& lower_bound,
+            const value_type& upper_bound,
+            Function function) const
+        {
+            random_variable result;
+            result.init_storage(lower_bound, upper_bound, size());
+            for (auto&& pair : *this)
+            {
+                result.add_probability(function(pair.first), pair.second);
+            }
+            result.normalize();
+            return result;
+        }
+
+        /** @brief Compute distribution of max(X, Y) or min(X, Y).
+         *
+         * The CDF of max(X, Y) is the product of CDFs of X and Y. To avoid
+         * subtraction of 2 products, probability of value v is computed as
+         * P(X = v) * P(Y <= v) + P(X < v) * P(Y = v). Values are merged in 
+         * ascending order (descending for the minimum) so the complexity 
+         * is linear after the distribution tables are built.
+         *
+         * @param x random variable X (independent of Y)
+         * @param y random variable Y (independent of X)
+         * @param maximum if true, compute max(X, Y), otherwise min(X, Y)
+         *
+         * @return distribution of max(X, Y) or min(X, Y)
+         */
+        static random_variable extremum(
+            const random_variable& x,
+            const random_variable& y,
+            bool maximum)
+        {
+            random_variable result;
+            if (x.empty() || y.empty())
+            {
+                return result;
+            }
+
+            auto&& a = x.table();
+            auto&& b = y.table();
+            const auto size_a = a.values.size();
+            const auto size_b = b.values.size();
+
+            // index of the k-th value in the order of iteration
+            auto index = [maximum](std::size_t size, std::size_t k)
+            {
+                return maximum ? k : size - 1 - k;
+            };
+
+            // v is before u in the order of iteration
+            auto precedes = [maximum](const value_type& v, const value_type& u)
+            {
+                return maximum ? v < u : u < v;
+            };
+
+            if (maximum)
+            {
+                result.init_storage(
+                    std::max(x.min_value(), y.min_value()),
+                    std::max(x.max_value(), y.max_value()),
+                    size_a + size_b);
+            }
+            else
+            {
+                result.init_storage(
+                    std::min(x.min_value(), y.min_value()),
+                    std::min(x.max_value(), y.max_value()),
+                    size_a + size_b);
+            }
+
+            // probability of values before the current value
+            probability_type before_a = 0;
+            probability_type before_b = 0;
+            std::size_t i = 0;
+            std::size_t j = 0;
+            while (i < size_a || j < size_b)
+            {
+                auto take_a = i < size_a;
+                auto take_b = j < size_b;
+                if (take_a && take_b)
+                {
+                    auto&& value_a = a.values[index(size_a, i)];
+                    auto&& value_b = b.values[index(size_b, j)];
+                    take_a = !precedes(value_b, value_a);
+                    take_b = !precedes(value_a, value_b);
+                }
+
+                probability_type prob_a = 0;
+                probability_type prob_b = 0;
+                value_type value;
+                if (take_a)
+                {
+                    prob_a = a.probabilities[index(size_a, i)];
+                    value = a.values[index(size_a, i++)];
+                }
+                if (take_b)
+                {
+                    prob_b = b.probabilities[index(size_b, j)];
+                    value = b.values[index(size_b, j++)];
+                }
+
+                // values out of the result range have zero probability
+                auto prob = prob_a * (before_b + prob_b) + before_a * prob_b;
+                if (prob != 0)
+                {
+                    result.add_probability(value, prob);
+                }
+                before_a += prob_a;
+                before_b += prob_b;
+            }
+            result.discarded_ = x.discarded_ + y.discarded_;
+            result.normalize();
+            return result;
+        }
+
+        /** @brief Create a random variable with a Bernoulli distribution.
+         *
+         * @param success probability of 1
+         * @param failure probability of 0
+         *
+         * @return indicator (empty if both probabilities are 0)
+         */
+        static random_variable make_indicator(
+            probability_type success,
+            probability_type failure)
+        {
+            random_variable result;
+            result.init_storage(0, 1, 2);
+            result.add_probability(0, failure);
+            result.add_probability(1, success);
+            result.normalize();
+            return result;
+        }
+
+        /** @brief Same as combine but with known bounds of the result.
+         *
+         * The combination function is evaluated on std::int64_t values 
+         * without any overflow checks. The caller has to guarantee that 
+         * the function result is in the [lower_bound, upper_bound] range 
+         * for all pairs of values (the bounds are usually computed using 
+         * checked arithmetic of value_type so any overflow is reported 
+         * there). If the result range is compact, the result will be 
+         * computed directly in the dense storage.
+         *
+         * @param other random variable Y (independent of X)
+         * @param lower_bound of the result (all values are at least this big)
+         * @param upper_bound of the result (all values are at most this big)
+         * @param combination function of X and Y
+         *
+         * @return a new random variable that is a function of X and Y
+         */
+        template<typename CombinationFunction>
+        random_variable combine_unchecked(
+            const random_variable& other,
+            const value_type& lower_bound,
+            const value_type& upper_bound,
+            CombinationFunction combination) const
+        {
+            random_variable dist;
+            if (empty() || other.empty())
+            {
+                return dist;
+            }
+
+            auto count = std::min(
+                static_cast<std::int64_t>(size()) *
+                    static_cast<std::int64_t>(other.size()),
+                range_size(lower_bound, upper_bound));
+            dist.init_storage(
+                lower_bound,
+                upper_bound,
+                static_cast<std::size_t>(count));
+
+            // convert values only once
+            auto list_a = raw_values();
+            auto list_b = other.raw_values();
+            if (dist.is_dense_)
+            {
+                const auto offset = static_cast<std::int64_t>(lower_bound);
+                for (auto&& pair_a : list_a)
+                {
+                    for (auto&& pair_b : list_b)
+                    {
+                        auto index = 
+                            combination(pair_a.first, pair_b.first) - offset;
+                        assert(index >= 0 && 
+                            index < static_cast<std::int64_t>(
+                                dist.dense_.size()));
+                        dist.dense_[static_cast<std::size_t>(index)] += 
+                            pair_b.second * pair_a.second;
+                    }
+                }
+
+                dist.dense_size_ = static_cast<std::size_t>(std::count_if(
+                    dist.dense_.begin(), 
+                    dist.dense_.end(), 
+                    [](auto&& prob) { return prob != 0; }));
+            }
+            else 
+            {
+                for (auto&& pair_a : list_a)
+                {
+                    for (auto&& pair_b : list_b)
+                    {
+                        auto value = combination(pair_a.first, pair_b.first);
+                        assert(value >= static_cast<std::int64_t>(lower_bound));
+                        assert(value <= static_cast<std::int64_t>(upper_bound));
+                        dist.add_probability(
+                            static_cast<value_type>(value), 
+                            pair_b.second * pair_a.second);
+                    }
+                }
+            }
+            dist.normalize();
+            return dist;
+        }
+
+        /** @brief Add discarded probability of operands to a result.
+         *
+         * @param result of an operation with this variable and other
+         * @param other operand
+         *
+         * @return result
+         */
+        random_variable with_discarded(
+            random_variable&& result,
+            const random_variable& other) const
+        {
+            result.discarded_ += discarded_ + other.discarded_;
+            return std::move(result);
+        }
+
+        /** @brief Get values of this variable converted to std::int64_t.
+         *
+         * @return list of (value, probability) pairs
+         */
+        std::vector<std::pair<std::int64_t, probability_type>> 
+            raw_values() const
+        {
+            std::vector<std::pair<std::int64_t, probability_type>> result;
+            result.reserve(size());
+            for (auto&& pair : *this)
+            {
+                result.push_back(std::make_pair(
+                    static_cast<std::int64_t>(pair.first), 
+                    pair.second));
+            }
+            return result;
+        }
+    };
+
+    /** @brief Calculate max(X, Y) for independent r.v. X and Y
+     * 
+     * @tparam T ValueType of random variable
+     * @tparam U ProbabilityType of random variable
+     * 
+     * @param a first random variable X (independent of Y)
+     * @param b second random variable Y (independent of X)
+     * 
+     * @return distribution of max(X, Y)
+     */
+    template<typename T, typename U>
+    random_variable<T, U> max(
+        const random_variable<T, U>& a, 
+        const random_variable<T, U>& b)
+    {
+        return random_variable<T, U>::extremum(a, b, true);
+    }
+
+    /** @brief Calculate min(X, Y) for independent r.v. X and Y
+    *
+    * @tparam T ValueType of random variable
+    * @tparam U ProbabilityType of random variable
+    *
+    * @param a first random variable X (independent of Y)
+    * @param b second random variable Y (independent of X)
+    *
+    * @return distribution of min(X, Y)
+    */
+    template<typename T, typename U>
+    random_variable<T, U> min(
+        const random_variable<T, U>& a, 
+        const random_variable<T, U>& b)
+    {
+        return random_variable<T, U>::extremum(a, b, false);
     }
 }
 
-#endif // DICE_RANDOM_VARIABLE_HPP_
\ No newline at end of file
+#endif // DICE_RANDOM_VARIABLE_HPP_
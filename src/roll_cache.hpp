@@ -0,0 +1,359 @@
+/**
+ * @file roll_cache.hpp
+ *
+ * Process-wide cache of distributions of dice rolls.
+ */
+#ifndef DICE_ROLL_CACHE_HPP_
+#define DICE_ROLL_CACHE_HPP_
+
+#include <list>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <sstream>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+
+#include "pruning.hpp"
+#include "random_variable.hpp"
+#include "distribution_store.hpp"
+
+namespace dice
+{
+    /** @brief Bounded LRU cache of XdY distributions for constant X and Y.
+     *
+     * Expressions such as 1d20 or 4d6 are very common. The distribution of
+     * a roll with a constant number of dice and faces is computed once and
+     * shared afterwards. Cached distributions are immutable. Users get a
+     * shared pointer to a const variable and they have to copy it before
+     * they modify it (that is, copy on write).
+     *
+     * The key also contains the pruning policy so that a change of the
+     * policy does not return stale results. All methods are thread safe.
+     * Distributions are computed outside of the lock so that a slow roll
+     * does not block other threads (2 threads can compute the same
+     * distribution in that case).
+     *
+     * If the cache has a distribution_store, distributions which are not
+     * in the cache are loaded from the store before they are computed and
+     * computed distributions are saved to the store.
+     *
+     * @tparam ValueType type of values of random variables
+     * @tparam ProbabilityType type of probabilities of random variables
+     */
+    template<typename ValueType, typename ProbabilityType>
+    class roll_cache
+    {
+    public:
+        using value_type = ValueType;
+        using probability_type = ProbabilityType;
+        using var_type = random_variable<value_type, probability_type>;
+        using var_handle = std::shared_ptr<const var_type>;
+
+        /** Default capacity in bytes. */
+        static const std::size_t default_capacity = 16 * 1024 * 1024;
+
+        explicit roll_cache(std::size_t capacity = default_capacity) :
+            capacity_(capacity) {}
+
+        /** @brief Get the process-wide cache.
+         *
+         * @return cache shared by all calculators
+         */
+        static roll_cache& instance()
+        {
+            static roll_cache cache;
+            return cache;
+        }
+
+        /** @brief Compute distribution of XdY.
+         *
+         * If both X and Y are constants, the result is looked up in the
+         * cache (and stored there on a miss). Otherwise, it is computed
+         * directly and the cache is not used. The cache only contains 
+         * rolls of constants without any discarded probability. Probability
+         * discarded from X and Y is added to the result after the lookup.
+         *
+         * @param num_dice number of dice X (see roll())
+         * @param num_faces number of faces Y (see roll())
+         *
+         * @return shared immutable distribution of XdY
+         */
+        var_handle get(const var_type& num_dice, const var_type& num_faces)
+        {
+            if (!num_dice.is_constant() || !num_faces.is_constant())
+            {
+                return std::make_shared<const var_type>(
+                    roll(num_dice, num_faces));
+            }
+
+            key_type key{
+                num_dice.min_value(),
+                num_faces.min_value(),
+                pruning::epsilon,
+                pruning::max_size
+            };
+
+            auto value = lookup(key);
+            auto discarded = num_dice.discarded_probability() + 
+                num_faces.discarded_probability();
+            if (discarded == 0)
+                return value;
+
+            auto result = *value;
+            result.add_discarded_probability(discarded);
+            return std::make_shared<const var_type>(std::move(result));
+        }
+
+        /** @brief Set persistent store of distributions.
+         *
+         * @param store of distributions (nullptr to only use memory)
+         */
+        void set_store(distribution_store* store)
+        {
+            store_ = store;
+        }
+
+        /** @brief Set maximal memory used by cached distributions.
+         *
+         * Least recently used entries are removed if the cache is larger.
+         *
+         * @param bytes capacity in bytes (0 disables the cache)
+         */
+        void set_capacity(std::size_t bytes)
+        {
+            std::lock_guard<std::mutex> lock{ mutex_ };
+            capacity_ = bytes;
+            evict();
+        }
+
+        /** @brief Get maximal memory used by cached distributions.
+         *
+         * @return capacity in bytes
+         */
+        std::size_t capacity() const
+        {
+            std::lock_guard<std::mutex> lock{ mutex_ };
+            return capacity_;
+        }
+
+        /** @brief Get estimated memory used by cached distributions.
+         *
+         * @return size in bytes
+         */
+        std::size_t memory_size() const
+        {
+            std::lock_guard<std::mutex> lock{ mutex_ };
+            return size_;
+        }
+
+        /** @brief Get number of cached distributions.
+         *
+         * @return number of entries
+         */
+        std::size_t size() const
+        {
+            std::lock_guard<std::mutex> lock{ mutex_ };
+            return entries_.size();
+        }
+
+        /** @brief Get number of rolls found in the cache.
+         *
+         * @return number of hits
+         */
+        std::size_t hits() const
+        {
+            return hits_;
+        }
+
+        /** @brief Get number of rolls loaded from the store.
+         *
+         * @return number of loaded distributions
+         */
+        std::size_t loads() const
+        {
+            return loads_;
+        }
+
+        /** @brief Get number of constant rolls which had to be computed.
+         *
+         * @return number of misses
+         */
+        std::size_t misses() const
+        {
+            return misses_;
+        }
+
+        /** @brief Remove all entries and reset the counters. */
+        void clear()
+        {
+            std::lock_guard<std::mutex> lock{ mutex_ };
+            entries_.clear();
+            index_.clear();
+            size_ = 0;
+            hits_ = 0;
+            misses_ = 0;
+            loads_ = 0;
+        }
+    private:
+        struct key_type
+        {
+            value_type num_dice;
+            value_type num_faces;
+            double epsilon;
+            std::size_t max_size;
+
+            bool operator==(const key_type& other) const
+            {
+                return num_dice == other.num_dice &&
+                    num_faces == other.num_faces &&
+                    epsilon == other.epsilon &&
+                    max_size == other.max_size;
+            }
+        };
+
+        struct key_hash
+        {
+            std::size_t operator()(const key_type& key) const
+            {
+                auto result = std::hash<value_type>{}(key.num_dice);
+                result = result * 31 + std::hash<value_type>{}(key.num_faces);
+                result = result * 31 + std::hash<double>{}(key.epsilon);
+                return result * 31 + key.max_size;
+            }
+        };
+
+        struct entry
+        {
+            key_type key;
+            var_handle value;
+            std::size_t size;
+        };
+
+        using entry_list = std::list<entry>;
+
+        mutable std::mutex mutex_;
+        std::size_t capacity_;
+        std::size_t size_ = 0;
+        std::atomic<std::size_t> hits_{ 0 };
+        std::atomic<std::size_t> misses_{ 0 };
+        std::atomic<std::size_t> loads_{ 0 };
+        std::atomic<distribution_store*> store_{ nullptr };
+
+        // most recently used entries are at the front
+        entry_list entries_;
+        std::unordered_map<
+            key_type,
+            typename entry_list::iterator,
+            key_hash> index_;
+
+        // find a roll of clean constants or compute it on a miss
+        var_handle lookup(const key_type& key)
+        {
+            {
+                std::lock_guard<std::mutex> lock{ mutex_ };
+                auto it = index_.find(key);
+                if (it != index_.end())
+                {
+                    // move the entry to the front
+                    entries_.splice(entries_.begin(), entries_, it->second);
+                    ++hits_;
+                    return it->second->value;
+                }
+            }
+
+            auto store = store_.load();
+            std::string store_key;
+            if (store != nullptr)
+            {
+                store_key = make_store_key(key);
+                var_type stored;
+                if (store->load(store_key, stored))
+                {
+                    ++loads_;
+                    auto value = std::make_shared<const var_type>(
+                        std::move(stored));
+                    insert(key, value);
+                    return value;
+                }
+            }
+            ++misses_;
+
+            auto value = std::make_shared<const var_type>(roll(
+                var_type{ constant_tag{}, key.num_dice },
+                var_type{ constant_tag{}, key.num_faces }));
+            if (store != nullptr)
+            {
+                store->save(store_key, *value);
+            }
+            insert(key, value);
+            return value;
+        }
+
+        // key of a roll in the distribution store
+        static std::string make_store_key(const key_type& key)
+        {
+            std::stringstream result;
+            result << "roll " << static_cast<std::int64_t>(key.num_dice) << " "
+                << static_cast<std::int64_t>(key.num_faces) << " "
+                << std::hexfloat << key.epsilon << " " << key.max_size;
+            return result.str();
+        }
+
+        /** @brief Estimate memory used by a cached variable.
+         *
+         * @param var cached variable
+         *
+         * @return size in bytes
+         */
+        static std::size_t estimate_size(const var_type& var)
+        {
+            std::size_t result = sizeof(entry) + sizeof(var_type);
+            if (var.empty())
+                return result;
+            if (var.is_dense())
+            {
+                auto range = static_cast<std::size_t>(
+                    var.max_value() - var.min_value()) + 1;
+                return result + range * sizeof(probability_type);
+            }
+
+            // hash table node with a pointer to the next node and a bucket
+            const auto node_size = sizeof(value_type) +
+                sizeof(probability_type) + 2 * sizeof(void*);
+            return result + var.size() * node_size;
+        }
+
+        void insert(const key_type& key, const var_handle& value)
+        {
+            auto size = estimate_size(*value);
+
+            std::lock_guard<std::mutex> lock{ mutex_ };
+            if (size > capacity_ || index_.find(key) != index_.end())
+                return;
+
+            entries_.push_front(entry{ key, value, size });
+            index_.emplace(key, entries_.begin());
+            size_ += size;
+            evict();
+        }
+
+        // remove least recently used entries until the cache fits
+        // (mutex_ has to be locked)
+        void evict()
+        {
+            while (size_ > capacity_ && !entries_.empty())
+            {
+                auto&& last = entries_.back();
+                size_ -= last.size;
+                index_.erase(last.key);
+                entries_.pop_back();
+            }
+        }
+    };
+}
+
+#endif // DICE_ROLL_CACHE_HPP_
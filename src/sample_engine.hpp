@@ -0,0 +1,111 @@
+/**
+ * @file sample_engine.hpp
+ *
+ * Fast pseudo-random number generator.
+ */
+#ifndef DICE_SAMPLE_ENGINE_HPP_
+#define DICE_SAMPLE_ENGINE_HPP_
+
+#include <cstdint>
+
+namespace dice
+{
+    /** @brief Pseudo-random number generator of rolls and samples.
+     *
+     * It is the xoshiro256** generator. It is a lot faster than the
+     * engines of the standard library and its state is small so that
+     * each block of samples (see sampler) can use its own generator. It
+     * satisfies the UniformRandomBitGenerator requirements.
+     */
+    class sample_engine
+    {
+    public:
+        using result_type = std::uint64_t;
+
+        /** @brief Create a generator.
+         *
+         * @param seed of the generator (any value)
+         */
+        explicit sample_engine(std::uint64_t seed)
+        {
+            // initialize the state using splitmix64 (it is never all 0)
+            for (auto&& word : state_)
+            {
+                seed += 0x9E3779B97F4A7C15;
+                word = mix(seed);
+            }
+        }
+
+        static constexpr result_type min()
+        {
+            return 0;
+        }
+
+        static constexpr result_type max()
+        {
+            return ~result_type{ 0 };
+        }
+
+        result_type operator()()
+        {
+            auto result = rotate(state_[1] * 5, 7) * 9;
+            auto shifted = state_[1] << 17;
+            state_[2] ^= state_[0];
+            state_[3] ^= state_[1];
+            state_[1] ^= state_[2];
+            state_[0] ^= state_[3];
+            state_[2] ^= shifted;
+            state_[3] = rotate(state_[3], 45);
+            return result;
+        }
+
+        /** @brief Generate a uniform random number from [0, range).
+         *
+         * It uses Lemire's multiply and shift method (i.e., it does not
+         * divide unless the result would be biased).
+         *
+         * @param range size of the interval (positive)
+         *
+         * @return random number from [0, range)
+         */
+        std::uint32_t uniform(std::uint32_t range)
+        {
+            auto product = (operator()() >> 32) * range;
+            auto low = static_cast<std::uint32_t>(product);
+            if (low < range)
+            {
+                auto threshold = static_cast<std::uint32_t>(-range) % range;
+                while (low < threshold)
+                {
+                    product = (operator()() >> 32) * range;
+                    low = static_cast<std::uint32_t>(product);
+                }
+            }
+            return static_cast<std::uint32_t>(product >> 32);
+        }
+
+        /** @brief Finalizer of the splitmix64 generator.
+         *
+         * It is used to derive independent seeds.
+         *
+         * @param value any value
+         *
+         * @return scrambled value
+         */
+        static std::uint64_t mix(std::uint64_t value)
+        {
+            value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9;
+            value = (value ^ (value >> 27)) * 0x94D049BB133111EB;
+            return value ^ (value >> 31);
+        }
+    private:
+        std::uint64_t state_[4];
+
+        static std::uint64_t rotate(std::uint64_t value, int count)
+        {
+            return (value << count) | (value >> (64 - count));
+        }
+    };
+}
+
+#endif // DICE_SAMPLE_ENGINE_HPP_
@@ -0,0 +1,613 @@
+#include "sampler.hpp"
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <stdexcept>
+
+#include "thread_pool.hpp"
+#include "cancellation.hpp"
+
+const std::size_t dice::sampler::block_size;
+
+namespace
+{
+    using int_type = dice::storage::int_type;
+    using var_type = dice::storage::random_variable_type::var_type;
+
+    /** @brief Error of a sampled subexpression.
+     *
+     * It is reported at the location of the node.
+     */
+    class sample_error : public std::runtime_error
+    {
+    public:
+        sample_error(const dice::plan_node* node, const std::string& message) :
+            std::runtime_error(message), node(node) {}
+
+        const dice::plan_node* node;
+    };
+
+    // functions which are computed separately for each sample
+    enum class sampled_function
+    {
+        none,
+        min,
+        max,
+        keep_highest,
+        keep_lowest,
+        roll
+    };
+
+    sampled_function find_sampled_function(
+        const std::string& name,
+        std::size_t argc)
+    {
+        if (name == "min" && argc >= 2)
+            return sampled_function::min;
+        if (name == "max" && argc >= 2)
+            return sampled_function::max;
+        if (name == "keep_highest" && argc == 3)
+            return sampled_function::keep_highest;
+        if (name == "keep_lowest" && argc == 3)
+            return sampled_function::keep_lowest;
+        // a roll of a sampled value is the value itself
+        if (name == "roll" && argc == 1)
+            return sampled_function::roll;
+        return sampled_function::none;
+    }
+
+    // seed of a block of samples
+    std::uint64_t block_seed(
+        std::uint64_t seed,
+        std::uint64_t stream,
+        std::size_t block)
+    {
+        using dice::sample_engine;
+        return sample_engine::mix(sample_engine::mix(seed ^
+            sample_engine::mix(stream)) + block);
+    }
+
+    // state of the sampler in 1 block
+    struct draw_context
+    {
+        dice::sample_engine engine;
+        // buffer of dice values of keep_highest and keep_lowest
+        std::vector<int> dice;
+    };
+
+    void check_dice(const dice::plan_node* node, int count, int faces)
+    {
+        if (count <= 0)
+        {
+            throw sample_error{ node,
+                "Number of dice has to be a positive integer, got " +
+                std::to_string(count) };
+        }
+
+        if (faces <= 0)
+        {
+            throw sample_error{ node,
+                "Number of dice faces has to be a positive integer, got " +
+                std::to_string(faces) };
+        }
+    }
+
+    // sum of 64-bit values which has to fit into int_type
+    int_type checked_sum(const dice::plan_node* node, std::int64_t sum)
+    {
+        if (sum > std::numeric_limits<int>::max() ||
+            sum < std::numeric_limits<int>::min())
+        {
+            throw sample_error{ node, "Overflow" };
+        }
+        return static_cast<int>(sum);
+    }
+}
+
+/** @brief Compiled expression tree of a sampled statement. */
+struct dice::sampler::sample_tree
+{
+    enum class node_type
+    {
+        // exact value (int, real or a random variable)
+        value,
+        // int constant
+        constant,
+        // value drawn from a distribution
+        distribution,
+        // samples of a variable
+        samples,
+        // operation of the source node
+        operation
+    };
+
+    node_type type = node_type::operation;
+    const plan_node* source = nullptr;
+    // exact value of the value and distribution nodes
+    value_type value;
+    int_type constant;
+    const var_type* distribution = nullptr;
+    const sample_list* samples = nullptr;
+    sampled_function function = sampled_function::none;
+    std::vector<sample_tree> children;
+
+    /** @brief Compute value of this tree in a sample.
+     *
+     * @param index of the sample
+     * @param context of the block
+     *
+     * @return value in the sample
+     *
+     * @throws sample_error if the operation fails
+     */
+    int_type draw(std::size_t index, draw_context& context) const
+    {
+        switch (type)
+        {
+        case node_type::constant:
+            return constant;
+        case node_type::distribution:
+            return distribution->sample(context.engine);
+        case node_type::samples:
+            return (*samples)[index];
+        case node_type::value:
+        case node_type::operation:
+            break;
+        }
+
+        assert(type == node_type::operation);
+        try
+        {
+            return compute(index, context);
+        }
+        catch (safe_int_error& error)
+        {
+            throw sample_error{ source,
+                is_overflow_error(error) ? "Overflow" : "Division by Zero" };
+        }
+    }
+private:
+    int_type compute(std::size_t index, draw_context& context) const
+    {
+        if (source->op == plan_op::call)
+            return call(index, context);
+        if (source->op == plan_op::unary_minus)
+            return -children[0].draw(index, context);
+
+        // operands are drawn from left to right
+        auto a = children[0].draw(index, context);
+        auto b = children[1].draw(index, context);
+        switch (source->op)
+        {
+        case plan_op::add:
+            return a + b;
+        case plan_op::sub:
+            return a - b;
+        case plan_op::mult:
+            return a * b;
+        case plan_op::div:
+            return a / b;
+        case plan_op::rel_op:
+            return compare(a, b) ? 1 : 0;
+        case plan_op::rel_in:
+        {
+            auto upper_bound = children[2].draw(index, context);
+            return b <= a && a <= upper_bound ? 1 : 0;
+        }
+        case plan_op::roll:
+            return roll(a, b, context);
+        case plan_op::constant:
+        case plan_op::variable:
+        case plan_op::unary_minus:
+        case plan_op::assign:
+        case plan_op::call:
+            break;
+        }
+        assert(false);
+        return 0;
+    }
+
+    bool compare(const int_type& a, const int_type& b) const
+    {
+        auto&& name = source->name;
+        if (name == "<")
+            return a < b;
+        if (name == "<=")
+            return a <= b;
+        if (name == "==")
+            return a == b;
+        if (name == "!=")
+            return a != b;
+        if (name == ">=")
+            return a >= b;
+        assert(name == ">");
+        return a > b;
+    }
+
+    int_type roll(int count, int faces, draw_context& context) const
+    {
+        check_dice(source, count, faces);
+
+        std::int64_t sum = count;
+        for (int i = 0; i < count; ++i)
+        {
+            sum += context.engine.uniform(static_cast<std::uint32_t>(faces));
+        }
+        return checked_sum(source, sum);
+    }
+
+    int_type call(std::size_t index, draw_context& context) const
+    {
+        if (function == sampled_function::roll)
+            return children[0].draw(index, context);
+
+        if (function == sampled_function::min ||
+            function == sampled_function::max)
+        {
+            auto result = children[0].draw(index, context);
+            for (std::size_t i = 1; i < children.size(); ++i)
+            {
+                auto value = children[i].draw(index, context);
+                if (function == sampled_function::min ?
+                    value < result : value > result)
+                {
+                    result = value;
+                }
+            }
+            return result;
+        }
+
+        assert(function == sampled_function::keep_highest ||
+            function == sampled_function::keep_lowest);
+        int count = children[0].draw(index, context);
+        int faces = children[1].draw(index, context);
+        int kept = children[2].draw(index, context);
+        check_dice(source, count, faces);
+        if (kept < 0)
+        {
+            throw sample_error{ source,
+                "Number of kept dice has to be a non-negative integer, got " +
+                std::to_string(kept) };
+        }
+
+        auto&& dice = context.dice;
+        dice.resize(static_cast<std::size_t>(count));
+        for (auto&& value : dice)
+        {
+            auto range = static_cast<std::uint32_t>(faces);
+            value = static_cast<int>(context.engine.uniform(range)) + 1;
+        }
+
+        auto end = dice.begin() + std::min(kept, count);
+        if (function == sampled_function::keep_highest)
+        {
+            std::nth_element(dice.begin(), end, dice.end(),
+                [](int a, int b) { return a > b; });
+        }
+        else
+        {
+            std::nth_element(dice.begin(), end, dice.end());
+        }
+
+        std::int64_t sum = 0;
+        for (auto it = dice.begin(); it != end; ++it)
+        {
+            sum += *it;
+        }
+        return checked_sum(source, sum);
+    }
+};
+
+dice::confidence_interval dice::estimate_interval(
+    storage::real_type probability,
+    std::size_t samples,
+    storage::real_type z)
+{
+    assert(samples > 0);
+
+    auto n = static_cast<storage::real_type>(samples);
+    auto z2 = z * z;
+    auto center = (probability + z2 / (2 * n)) / (1 + z2 / n);
+    auto radius = z / (1 + z2 / n) * std::sqrt(
+        probability * (1 - probability) / n + z2 / (4 * n * n));
+    return confidence_interval{
+        std::max<storage::real_type>(center - radius, 0),
+        std::min<storage::real_type>(center + radius, 1)
+    };
+}
+
+dice::sampler::value_list dice::sampler::execute(
+    const plan& script,
+    std::size_t count,
+    std::uint64_t seed)
+{
+    if (count == 0)
+    {
+        throw std::invalid_argument{
+            "Number of samples has to be a positive integer." };
+    }
+
+    count_ = count;
+    seed_ = seed;
+    stream_ = 0;
+    samples_.clear();
+
+    // work of each statement is estimated to be the same
+    value_list result;
+    auto token = cancellation::current();
+    auto&& statements = script.statements();
+    for (std::size_t i = 0; i < statements.size(); ++i)
+    {
+        if (token != nullptr)
+        {
+            token->check();
+            token->start_statement(i, statements.size(), i, statements.size());
+        }
+        result.push_back(execute_statement(*statements[i]));
+    }
+
+    if (token != nullptr)
+    {
+        token->finish();
+    }
+    return result;
+}
+
+dice::sampler::value_type dice::sampler::execute_statement(
+    const plan_node& node)
+{
+    auto&& expr = node.op == plan_op::assign ? *node.children[0] : node;
+    if (!is_random(expr))
+    {
+        // a redefined variable is not sampled anymore
+        if (node.op == plan_op::assign)
+        {
+            samples_.erase(node.name);
+        }
+        return evaluate_tree(node, interpreter_, log_, cache_);
+    }
+
+    sample_list values;
+    value_type value;
+    try
+    {
+        auto tree = compile(expr);
+        if (tree.type == sample_tree::node_type::value)
+        {
+            value = std::move(tree.value);
+        }
+        else
+        {
+            values = draw_all(tree);
+            value = make_empirical(values);
+        }
+    }
+    catch (sample_error& error)
+    {
+        log_->error(
+            error.node->location.line,
+            error.node->location.col,
+            error.what());
+        values.clear();
+        value = interpreter_->make_default();
+    }
+
+    if (node.op != plan_op::assign)
+        return value;
+
+    try
+    {
+        interpreter_->enter_assign();
+        interpreter_->assign(node.name, std::move(value));
+    }
+    catch (compiler_error& error)
+    {
+        log_->error(node.location.line, node.location.col, error.what());
+        return nullptr;
+    }
+
+    if (values.empty())
+    {
+        samples_.erase(node.name);
+    }
+    else
+    {
+        samples_[node.name] = std::move(values);
+    }
+    return nullptr;
+}
+
+bool dice::sampler::is_random(const plan_node& node) const
+{
+    if (node.op == plan_op::roll)
+        return true;
+
+    if (node.op == plan_op::variable)
+    {
+        if (samples_.find(node.name) != samples_.end())
+            return true;
+        auto value = env_->get_var(node.name);
+        return value != nullptr && value->type() == type_rand_var::id();
+    }
+
+    for (auto&& child : node.children)
+    {
+        if (is_random(*child))
+            return true;
+    }
+    return false;
+}
+
+dice::sampler::sample_tree dice::sampler::compile(const plan_node& node)
+{
+    sample_tree result;
+    result.source = &node;
+    if (!is_random(node))
+    {
+        result.type = sample_tree::node_type::value;
+        result.value = evaluate_tree(node, interpreter_, log_, cache_);
+        return result;
+    }
+
+    if (node.op == plan_op::variable)
+    {
+        result.type = sample_tree::node_type::samples;
+        result.samples = &variable_samples(node);
+        return result;
+    }
+
+    if (node.op == plan_op::call)
+    {
+        result.function = find_sampled_function(
+            node.name,
+            node.children.size());
+        if (result.function == sampled_function::none)
+        {
+            result.type = sample_tree::node_type::value;
+            result.value = aggregate(node);
+            return result;
+        }
+    }
+
+    for (auto&& child : node.children)
+    {
+        result.children.push_back(compile_operand(*child));
+    }
+    return result;
+}
+
+dice::sampler::sample_tree dice::sampler::compile_operand(
+    const plan_node& node)
+{
+    auto result = compile(node);
+    if (result.type != sample_tree::node_type::value)
+        return result;
+
+    if (auto value = dynamic_cast<const type_int*>(result.value.get()))
+    {
+        result.type = sample_tree::node_type::constant;
+        result.constant = value->data();
+        return result;
+    }
+
+    if (auto value = dynamic_cast<const type_rand_var*>(result.value.get()))
+    {
+        result.distribution = &value->data().marginal();
+        if (result.distribution->empty())
+        {
+            throw sample_error{ &node, "Random variable has no value" };
+        }
+        result.type = sample_tree::node_type::distribution;
+        return result;
+    }
+
+    throw sample_error{ &node,
+        "Only int values can be used in a sampled expression, got " +
+        to_string(result.value->type()) };
+}
+
+dice::sampler::value_type dice::sampler::aggregate(const plan_node& node)
+{
+    // call the function with empirical distributions of the arguments
+    value_list args;
+    for (auto&& child : node.children)
+    {
+        auto tree = compile(*child);
+        if (tree.type == sample_tree::node_type::value)
+        {
+            args.push_back(std::move(tree.value));
+        }
+        else
+        {
+            args.push_back(make_empirical(draw_all(tree)));
+        }
+    }
+
+    try
+    {
+        return interpreter_->call(node.name, std::move(args));
+    }
+    catch (compiler_error& error)
+    {
+        throw sample_error{ &node, error.what() };
+    }
+}
+
+const dice::sampler::sample_list& dice::sampler::variable_samples(
+    const plan_node& node)
+{
+    auto&& name = node.name;
+    auto it = samples_.find(name);
+    if (it != samples_.end())
+        return it->second;
+
+    auto value = dynamic_cast<const type_rand_var*>(env_->get_var(name));
+    assert(value != nullptr);
+    if (value->data().marginal().empty())
+    {
+        throw sample_error{ &node, "Variable '" + name + "' has no value" };
+    }
+
+    sample_tree tree;
+    tree.type = sample_tree::node_type::distribution;
+    tree.distribution = &value->data().marginal();
+    return samples_[name] = draw_all(tree);
+}
+
+dice::sampler::sample_list dice::sampler::draw_all(const sample_tree& tree)
+{
+    sample_list result(count_);
+    auto stream = stream_++;
+    auto blocks = (count_ + block_size - 1) / block_size;
+    auto token = cancellation::current();
+    auto sample_blocks = [&](std::size_t first, std::size_t last)
+    {
+        for (auto block = first; block < last; ++block)
+        {
+            if (token != nullptr)
+            {
+                token->check();
+            }
+
+            draw_context context{
+                sample_engine{ block_seed(seed_, stream, block) },
+                {}
+            };
+            auto end = std::min(count_, (block + 1) * block_size);
+            for (auto i = block * block_size; i < end; ++i)
+            {
+                result[i] = tree.draw(i, context);
+            }
+        }
+    };
+
+    auto pool = thread_pool::current();
+    if (pool == nullptr || pool->size() <= 1 || blocks <= 1)
+    {
+        sample_blocks(0, blocks);
+    }
+    else
+    {
+        pool->parallel_for(blocks, sample_blocks);
+    }
+    return result;
+}
+
+dice::sampler::value_type dice::sampler::make_empirical(
+    const sample_list& values)
+{
+    std::vector<int> sorted(values.begin(), values.end());
+    std::sort(sorted.begin(), sorted.end());
+
+    var_type::frequency_list list;
+    for (auto it = sorted.begin(); it != sorted.end();)
+    {
+        auto next = std::upper_bound(it, sorted.end(), *it);
+        list.emplace_back(*it, static_cast<std::size_t>(next - it));
+        it = next;
+    }
+    return make<type_rand_var>(storage::random_variable_type{
+        var_type{ list }
+    });
+}
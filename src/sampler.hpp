@@ -0,0 +1,141 @@
+/**
+ * @file sampler.hpp
+ *
+ * Monte Carlo evaluation of parsed scripts.
+ */
+#ifndef DICE_SAMPLER_HPP_
+#define DICE_SAMPLER_HPP_
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <unordered_map>
+
+#include "value.hpp"
+#include "logger.hpp"
+#include "environment.hpp"
+#include "direct_interpreter.hpp"
+#include "plan.hpp"
+#include "sample_engine.hpp"
+
+namespace dice
+{
+    /** @brief Confidence interval of a probability estimated by sampling. */
+    struct confidence_interval
+    {
+        storage::real_type lower;
+        storage::real_type upper;
+    };
+
+    /** @brief Compute the Wilson score interval of an estimated probability.
+     *
+     * Unlike the normal approximation, it does not collapse to a single
+     * point for values which have not been sampled (or which are sampled
+     * every time).
+     *
+     * @param probability relative frequency of a value in the samples
+     * @param samples number of samples
+     * @param z quantile of the standard normal distribution (1.96 for the
+     *        95 % interval)
+     *
+     * @return interval which contains the probability with given confidence
+     */
+    confidence_interval estimate_interval(
+        storage::real_type probability,
+        std::size_t samples,
+        storage::real_type z = 1.96);
+
+    /** @brief Evaluate a plan by sampling instead of computing it exactly.
+     *
+     * Each statement with a random subexpression is evaluated count times
+     * with random values of the dice. Its value is the empirical
+     * distribution of the results. Samples are split into blocks of
+     * block_size samples. Each block has its own generator whose seed is
+     * derived from the seed of the evaluation, thus blocks are sampled in
+     * parallel (using the current thread_pool) and the result only
+     * depends on the seed (not on the number of threads).
+     *
+     * Variables defined by the script keep their samples. Sample i of an
+     * expression uses sample i of each variable so that all uses of a
+     * variable share 1 value in each sample (as if the script was
+     * executed count times). Random variables of the environment which
+     * have not been defined by the script are sampled from their
+     * distribution once per sample (they are treated as independent).
+     *
+     * Subexpressions without randomness (e.g., constants or constant
+     * rolls in keep_highest(4, 6, 3)) are computed exactly. Functions
+     * which compute a number from a distribution (e.g., expectation) are
+     * called with the empirical distribution of their arguments.
+     */
+    class sampler
+    {
+    public:
+        using value_type = plan::value_type;
+        using value_list = plan::value_list;
+
+        /** Number of samples computed with 1 generator. */
+        static const std::size_t block_size = 1024;
+
+        /** @brief Create a sampler.
+         *
+         * @param env environment with variables and functions
+         * @param interpreter which computes exact subexpressions
+         * @param log for errors
+         * @param cache of subexpression values (nullptr not to cache)
+         */
+        sampler(
+            environment* env,
+            direct_interpreter<environment>* interpreter,
+            logger* log,
+            plan_cache* cache = nullptr) :
+            env_(env),
+            interpreter_(interpreter),
+            log_(log),
+            cache_(cache) {}
+
+        /** @brief Evaluate all statements by sampling.
+         *
+         * Errors are reported to the logger. The result of a statement
+         * which fails is the default value.
+         *
+         * @param script parsed script
+         * @param count number of samples (positive)
+         * @param seed of the generators
+         *
+         * @return value of each statement (nullptr for assignments)
+         *
+         * @throws std::invalid_argument if count is 0
+         */
+        value_list execute(
+            const plan& script,
+            std::size_t count,
+            std::uint64_t seed);
+    private:
+        struct sample_tree;
+        using sample_list = std::vector<storage::int_type>;
+
+        environment* env_;
+        direct_interpreter<environment>* interpreter_;
+        logger* log_;
+        plan_cache* cache_;
+
+        std::size_t count_ = 0;
+        std::uint64_t seed_ = 0;
+        // index of the next set of generators
+        std::uint64_t stream_ = 0;
+        // samples of variables used by the script
+        std::unordered_map<std::string, sample_list> samples_;
+
+        value_type execute_statement(const plan_node& node);
+        bool is_random(const plan_node& node) const;
+        sample_tree compile(const plan_node& node);
+        sample_tree compile_operand(const plan_node& node);
+        value_type aggregate(const plan_node& node);
+        const sample_list& variable_samples(const plan_node& node);
+        sample_list draw_all(const sample_tree& tree);
+        static value_type make_empirical(const sample_list& values);
+    };
+}
+
+#endif // DICE_SAMPLER_HPP_
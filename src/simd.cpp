@@ -0,0 +1,151 @@
+#include "simd.hpp"
+
+#ifdef DICE_SIMD_NEON
+#include <arm_neon.h>
+#endif // DICE_SIMD_NEON
+
+namespace
+{
+    using dice::simd::instruction_set;
+    using dice::simd::power_sums;
+
+#ifdef DICE_SIMD_NEON
+
+    void neon_axpy(double* out, const double* in, double scale, std::size_t size)
+    {
+        std::size_t i = 0;
+        auto factor = vdupq_n_f64(scale);
+        for (; i + 2 <= size; i += 2)
+        {
+            auto product = vmulq_f64(factor, vld1q_f64(in + i));
+            vst1q_f64(out + i, vaddq_f64(vld1q_f64(out + i), product));
+        }
+        dice::simd::axpy<double>(out + i, in + i, scale, size - i);
+    }
+
+    void neon_window_difference(
+        double* data,
+        std::size_t first,
+        std::size_t last,
+        std::size_t window,
+        double scale)
+    {
+        // process blocks [i - 1, i] while both reads are unclamped
+        auto factor = vdupq_n_f64(scale);
+        auto i = last;
+        for (; i >= first + 1 && i >= window + 2; i -= 2)
+        {
+            auto prev = vld1q_f64(data + i - 2);
+            auto lower = vld1q_f64(data + i - window - 2);
+            vst1q_f64(data + i - 1, vmulq_f64(vsubq_f64(prev, lower), factor));
+        }
+
+        if (i >= first)
+        {
+            dice::simd::window_difference<double>(
+                data, first, i, window, scale);
+        }
+    }
+
+#endif // DICE_SIMD_NEON
+
+    instruction_set detect()
+    {
+    #ifdef DICE_SIMD_X86
+        if (dice::simd::detail::avx2_supported())
+            return instruction_set::avx2;
+    #endif // DICE_SIMD_X86
+    #ifdef DICE_SIMD_NEON
+        return instruction_set::neon;
+    #else
+        return instruction_set::scalar;
+    #endif // DICE_SIMD_NEON
+    }
+
+    instruction_set& current()
+    {
+        static instruction_set value = detect();
+        return value;
+    }
+}
+
+dice::simd::instruction_set dice::simd::best()
+{
+    static const instruction_set value = detect();
+    return value;
+}
+
+dice::simd::instruction_set dice::simd::active()
+{
+    return current();
+}
+
+bool dice::simd::select(instruction_set set)
+{
+    if (set != instruction_set::scalar && set != best())
+        return false;
+    current() = set;
+    return true;
+}
+
+void dice::simd::axpy(
+    double* out,
+    const double* in,
+    double scale,
+    std::size_t size)
+{
+    switch (current())
+    {
+#ifdef DICE_SIMD_X86
+    case instruction_set::avx2:
+        detail::avx2_axpy(out, in, scale, size);
+        return;
+#endif // DICE_SIMD_X86
+#ifdef DICE_SIMD_NEON
+    case instruction_set::neon:
+        neon_axpy(out, in, scale, size);
+        return;
+#endif // DICE_SIMD_NEON
+    default:
+        axpy<double>(out, in, scale, size);
+    }
+}
+
+void dice::simd::window_difference(
+    double* data,
+    std::size_t first,
+    std::size_t last,
+    std::size_t window,
+    double scale)
+{
+    switch (current())
+    {
+#ifdef DICE_SIMD_X86
+    case instruction_set::avx2:
+        detail::avx2_window_difference(data, first, last, window, scale);
+        return;
+#endif // DICE_SIMD_X86
+#ifdef DICE_SIMD_NEON
+    case instruction_set::neon:
+        neon_window_difference(data, first, last, window, scale);
+        return;
+#endif // DICE_SIMD_NEON
+    default:
+        window_difference<double>(data, first, last, window, scale);
+    }
+}
+
+dice::simd::power_sums<double> dice::simd::moments(
+    const double* data,
+    std::size_t size)
+{
+    switch (current())
+    {
+#ifdef DICE_SIMD_X86
+    case instruction_set::avx2:
+        return detail::avx2_moments(data, size);
+#endif // DICE_SIMD_X86
+    default:
+        return moments<double>(data, size);
+    }
+}
@@ -0,0 +1,210 @@
+/**
+ * @file simd.hpp
+ *
+ * Vectorized kernels of loops over contiguous probability arrays.
+ */
+#ifndef DICE_SIMD_HPP_
+#define DICE_SIMD_HPP_
+
+#include <cstddef>
+
+#include "utils.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64) || \
+    defined(__i386__) || defined(_M_IX86)
+#define DICE_SIMD_X86
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define DICE_SIMD_NEON
+#endif
+
+namespace dice
+{
+    /** @brief Kernels with a scalar, an AVX2 and a NEON implementation.
+     *
+     * Function templates are the scalar implementation for any probability
+     * type. Overloads for double dispatch to the best implementation
+     * supported by the CPU. It is detected at runtime when a kernel is
+     * called for the first time (AVX2 on x86, NEON on ARM if the compiler
+     * targets it). If no vector instructions are available, the scalar
+     * implementation is used.
+     *
+     * Implementations don't use fused multiply-add instructions so that
+     * results of element-wise kernels are exactly the same as results of
+     * the scalar implementation. Only the order of additions of the sum
+     * kernel changes.
+     */
+    namespace simd
+    {
+        enum class instruction_set
+        {
+            scalar,
+            avx2,
+            neon
+        };
+
+        /** @brief Find the best instruction set supported by this CPU.
+         *
+         * @return instruction set
+         */
+        instruction_set best();
+
+        /** @brief Get instruction set currently used by the kernels.
+         *
+         * @return instruction set
+         */
+        instruction_set active();
+
+        /** @brief Choose instruction set used by the kernels.
+         *
+         * This is mainly useful for testing and benchmarks.
+         *
+         * @param set instruction set
+         *
+         * @return false if the CPU does not support it
+         *         (the active instruction set does not change in that case)
+         */
+        bool select(instruction_set set);
+
+        /** @brief Sums of powers of indices weighted by an array.
+         *
+         * It is an aggregate without constructors so that no inline code
+         * is shared with the AVX2 translation unit.
+         */
+        template<typename T>
+        struct power_sums
+        {
+            /** sum of data[i] */
+            T sum;
+
+            /** sum of i * data[i] */
+            T first;
+
+            /** sum of i * i * data[i] */
+            T second;
+        };
+
+        /** @brief Compute out[i] += scale * in[i] for all i < size.
+         *
+         * @param out array of size elements
+         * @param in array of size elements
+         * @param scale
+         * @param size of both arrays
+         */
+        template<typename T>
+        void axpy(T* out, const T* in, T scale, std::size_t size)
+        {
+            for (std::size_t i = 0; i < size; ++i)
+            {
+                out[i] += scale * in[i];
+            }
+        }
+
+        void axpy(
+            double* out, 
+            const double* in, 
+            double scale, 
+            std::size_t size);
+
+        /** @brief Compute windowed differences of a prefix sum in place.
+         *
+         * For i = last down to first (in this order):
+         * data[i] = (data[i - 1] - data[i > window ? i - window - 1 : 0]) *
+         *           scale
+         *
+         * That is, if data is a prefix sum, data[i] will be the sum of the
+         * original values in the (i - window - 1, i - 1] interval. The
+         * iteration order guarantees that only the original values are
+         * read.
+         *
+         * @param data array of at least last + 1 elements
+         * @param first index (at least 1)
+         * @param last index
+         * @param window size of the window (at least 1)
+         * @param scale of the result
+         */
+        template<typename T>
+        void window_difference(
+            T* data,
+            std::size_t first,
+            std::size_t last,
+            std::size_t window,
+            T scale)
+        {
+            for (auto i = last; i >= first; --i)
+            {
+                auto j = i > window ? i - window - 1 : 0;
+                data[i] = (data[i - 1] - data[j]) * scale;
+            }
+        }
+
+        void window_difference(
+            double* data,
+            std::size_t first,
+            std::size_t last,
+            std::size_t window,
+            double scale);
+
+        /** @brief Compute weighted sums of powers of indices.
+         *
+         * The scalar implementation uses compensated summation in the
+         * accumulator type of T (see accumulator_t).
+         *
+         * @param data array of size elements
+         * @param size of the array
+         *
+         * @return sums of data[i], i * data[i] and i * i * data[i]
+         */
+        template<typename T>
+        power_sums<accumulator_t<T>> moments(const T* data, std::size_t size)
+        {
+            using sum_type = accumulator_t<T>;
+            compensated_sum<sum_type> sum;
+            compensated_sum<sum_type> first;
+            compensated_sum<sum_type> second;
+            for (std::size_t i = 0; i < size; ++i)
+            {
+                auto index = static_cast<sum_type>(i);
+                auto value = static_cast<sum_type>(data[i]);
+                sum += value;
+                first += index * value;
+                second += index * index * value;
+            }
+            return power_sums<sum_type>{ 
+                sum.value(), 
+                first.value(), 
+                second.value() 
+            };
+        }
+
+        power_sums<double> moments(const double* data, std::size_t size);
+
+        namespace detail
+        {
+            // AVX2 implementations (see simd_avx2.cpp)
+        #ifdef DICE_SIMD_X86
+            bool avx2_supported();
+
+            void avx2_axpy(
+                double* out,
+                const double* in,
+                double scale,
+                std::size_t size);
+
+            void avx2_window_difference(
+                double* data,
+                std::size_t first,
+                std::size_t last,
+                std::size_t window,
+                double scale);
+
+            power_sums<double> avx2_moments(
+                const double* data,
+                std::size_t size);
+        #endif // DICE_SIMD_X86
+        }
+    }
+}
+
+#endif // DICE_SIMD_HPP_
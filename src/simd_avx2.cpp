@@ -0,0 +1,131 @@
+/**
+ * @file simd_avx2.cpp
+ *
+ * AVX2 kernels. This file is compiled with AVX2 enabled so it must not
+ * include headers with inline functions which could be shared with other
+ * translation units (only the kernels declared in simd.hpp are defined
+ * here).
+ */
+#include "simd.hpp"
+
+#ifdef DICE_SIMD_X86
+
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif // _MSC_VER
+
+bool dice::simd::detail::avx2_supported()
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+
+    // the OS has to save the AVX registers (OSXSAVE and XCR0 bits)
+    __cpuid(info, 1);
+    if ((info[2] & (1 << 27)) == 0 || (_xgetbv(0) & 6) != 6)
+        return false;
+
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") != 0;
+#endif // _MSC_VER
+}
+
+void dice::simd::detail::avx2_axpy(
+    double* out,
+    const double* in,
+    double scale,
+    std::size_t size)
+{
+    std::size_t i = 0;
+    auto factor = _mm256_set1_pd(scale);
+    for (; i + 4 <= size; i += 4)
+    {
+        auto product = _mm256_mul_pd(factor, _mm256_loadu_pd(in + i));
+        auto sum = _mm256_add_pd(_mm256_loadu_pd(out + i), product);
+        _mm256_storeu_pd(out + i, sum);
+    }
+
+    for (; i < size; ++i)
+    {
+        out[i] += scale * in[i];
+    }
+}
+
+void dice::simd::detail::avx2_window_difference(
+    double* data,
+    std::size_t first,
+    std::size_t last,
+    std::size_t window,
+    double scale)
+{
+    // Process blocks [i - 3, i] while both reads are unclamped. All loads
+    // of a block precede its store and they only read lower indices so
+    // the result is the same as the result of the scalar loop.
+    auto factor = _mm256_set1_pd(scale);
+    auto i = last;
+    for (; i >= first + 3 && i >= window + 4; i -= 4)
+    {
+        auto prev = _mm256_loadu_pd(data + i - 4);
+        auto lower = _mm256_loadu_pd(data + i - window - 4);
+        auto diff = _mm256_mul_pd(_mm256_sub_pd(prev, lower), factor);
+        _mm256_storeu_pd(data + i - 3, diff);
+    }
+
+    for (; i >= first; --i)
+    {
+        auto j = i > window ? i - window - 1 : 0;
+        data[i] = (data[i - 1] - data[j]) * scale;
+    }
+}
+
+dice::simd::power_sums<double> dice::simd::detail::avx2_moments(
+    const double* data,
+    std::size_t size)
+{
+    std::size_t i = 0;
+    auto sum = _mm256_setzero_pd();
+    auto first = _mm256_setzero_pd();
+    auto second = _mm256_setzero_pd();
+    auto index = _mm256_set_pd(3, 2, 1, 0);
+    const auto step = _mm256_set1_pd(4);
+    for (; i + 4 <= size; i += 4)
+    {
+        auto value = _mm256_loadu_pd(data + i);
+        auto weighted = _mm256_mul_pd(index, value);
+        sum = _mm256_add_pd(sum, value);
+        first = _mm256_add_pd(first, weighted);
+        second = _mm256_add_pd(second, _mm256_mul_pd(index, weighted));
+        index = _mm256_add_pd(index, step);
+    }
+
+    alignas(32) double lanes[3][4];
+    _mm256_store_pd(lanes[0], sum);
+    _mm256_store_pd(lanes[1], first);
+    _mm256_store_pd(lanes[2], second);
+
+    power_sums<double> result{ 0, 0, 0 };
+    for (int lane = 0; lane < 4; ++lane)
+    {
+        result.sum += lanes[0][lane];
+        result.first += lanes[1][lane];
+        result.second += lanes[2][lane];
+    }
+
+    for (; i < size; ++i)
+    {
+        auto value = static_cast<double>(i);
+        result.sum += data[i];
+        result.first += value * data[i];
+        result.second += value * value * data[i];
+    }
+    return result;
+}
+
+#endif // DICE_SIMD_X86
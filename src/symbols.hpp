@@ -9,6 +9,7 @@
 #include <string>
 #include <memory>
 #include <type_traits>
+#include <stdexcept>
 
 #include "value.hpp"
 
@@ -0,0 +1,208 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+
+std::size_t dice::thread_pool::min_parallel_size = 256;
+
+thread_local dice::thread_pool* dice::thread_pool::current_ = nullptr;
+
+dice::thread_pool::thread_pool(std::size_t threads) : size_(threads)
+{
+    if (size_ == 0)
+    {
+        size_ = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+}
+
+dice::thread_pool::~thread_pool()
+{
+    {
+        std::lock_guard<std::mutex> guard{ lock_ };
+        stop_ = true;
+    }
+    wake_.notify_all();
+
+    for (auto&& worker : workers_)
+    {
+        worker.join();
+    }
+}
+
+dice::thread_pool* dice::thread_pool::current()
+{
+    return current_;
+}
+
+dice::thread_pool::scope::scope(thread_pool* pool) : previous_(current_)
+{
+    current_ = pool;
+}
+
+dice::thread_pool::scope::~scope()
+{
+    current_ = previous_;
+}
+
+void dice::thread_pool::parallel_for(
+    std::size_t count,
+    const range_function& function)
+{
+    if (count == 0)
+        return;
+
+    if (size_ <= 1)
+    {
+        function(0, count);
+        return;
+    }
+
+    std::lock_guard<std::mutex> call_guard{ call_lock_ };
+    start();
+
+    // split the index space evenly
+    job task;
+    task.function = &function;
+    task.ranges.reset(new range[size_]);
+    task.chunk_size = std::max<std::size_t>(count / (size_ * 16), 1);
+    for (std::size_t i = 0; i < size_; ++i)
+    {
+        task.ranges[i].first = count * i / size_;
+        task.ranges[i].last = count * (i + 1) / size_;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard{ lock_ };
+        job_ = &task;
+        pending_ = workers_.size();
+        ++generation_;
+    }
+    wake_.notify_all();
+
+    {
+        // nested loops of the calling thread run serially
+        scope serial{ nullptr };
+        run(task, 0);
+    }
+
+    {
+        std::unique_lock<std::mutex> guard{ lock_ };
+        done_.wait(guard, [this]() { return pending_ == 0; });
+        job_ = nullptr;
+    }
+
+    if (task.error != nullptr)
+    {
+        std::rethrow_exception(task.error);
+    }
+}
+
+void dice::thread_pool::start()
+{
+    if (!workers_.empty())
+        return;
+
+    workers_.reserve(size_ - 1);
+    for (std::size_t i = 1; i < size_; ++i)
+    {
+        workers_.emplace_back([this, i]() { work(i); });
+    }
+}
+
+void dice::thread_pool::work(std::size_t index)
+{
+    std::size_t generation = 0;
+    for (;;)
+    {
+        job* task = nullptr;
+        {
+            std::unique_lock<std::mutex> guard{ lock_ };
+            wake_.wait(guard, [this, generation]()
+            {
+                return stop_ || generation_ != generation;
+            });
+            if (stop_)
+                return;
+            generation = generation_;
+            task = job_;
+        }
+
+        run(*task, index);
+
+        {
+            std::lock_guard<std::mutex> guard{ lock_ };
+            if (--pending_ == 0)
+            {
+                done_.notify_one();
+            }
+        }
+    }
+}
+
+void dice::thread_pool::run(job& task, std::size_t index)
+{
+    std::size_t first = 0;
+    std::size_t last = 0;
+    while (!task.failed &&
+        (take(task, index, first, last) ||
+        (steal(task, index) && take(task, index, first, last))))
+    {
+        try
+        {
+            (*task.function)(first, last);
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> guard{ task.error_lock };
+            if (task.error == nullptr)
+            {
+                task.error = std::current_exception();
+            }
+            task.failed = true;
+        }
+    }
+}
+
+bool dice::thread_pool::take(
+    job& task,
+    std::size_t index,
+    std::size_t& first,
+    std::size_t& last)
+{
+    auto&& own = task.ranges[index];
+    std::lock_guard<std::mutex> guard{ own.lock };
+    if (own.first >= own.last)
+        return false;
+
+    first = own.first;
+    last = std::min(own.first + task.chunk_size, own.last);
+    own.first = last;
+    return true;
+}
+
+bool dice::thread_pool::steal(job& task, std::size_t index)
+{
+    for (std::size_t i = 1; i < size_; ++i)
+    {
+        auto&& victim = task.ranges[(index + i) % size_];
+        std::size_t first = 0;
+        std::size_t last = 0;
+        {
+            std::lock_guard<std::mutex> guard{ victim.lock };
+            if (victim.first >= victim.last)
+                continue;
+
+            // take the upper half of the remaining range
+            auto half = (victim.last - victim.first + 1) / 2;
+            first = victim.last - half;
+            last = victim.last;
+            victim.last = first;
+        }
+
+        auto&& own = task.ranges[index];
+        std::lock_guard<std::mutex> guard{ own.lock };
+        own.first = first;
+        own.last = last;
+        return true;
+    }
+    return false;
+}
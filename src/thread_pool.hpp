@@ -0,0 +1,188 @@
+/**
+ * @file thread_pool.hpp
+ *
+ * Thread pool for data parallel loops.
+ */
+#ifndef DICE_THREAD_POOL_HPP_
+#define DICE_THREAD_POOL_HPP_
+
+#include <mutex>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <condition_variable>
+
+#include "budget.hpp"
+#include "cancellation.hpp"
+
+namespace dice
+{
+    /** @brief Pool of worker threads which execute parallel loops.
+     *
+     * The index space of a loop is split into 1 contiguous range per
+     * thread. Each thread processes small chunks of its own range. When
+     * its range is empty, it steals the upper half of the remaining range
+     * of other thread. The calling thread takes part in the computation.
+     *
+     * Worker threads are started by the first parallel loop so that a pool
+     * which is never used does not cost anything.
+     *
+     * Code which does not have the pool (e.g. random variable operations)
+     * finds it using current(). The pool is made current for a thread by
+     * creating a scope object (see calculator::evaluate). Loops nested in
+     * a parallel loop run serially.
+     */
+    class thread_pool
+    {
+    public:
+        /** Type of the loop body. It processes indices in [first, last). */
+        using range_function = std::function<void(std::size_t, std::size_t)>;
+
+        /** Minimal number of iterations for which for_each runs in parallel.
+         *
+         * Smaller loops run serially in the calling thread.
+         */
+        static std::size_t min_parallel_size;
+
+        /** @brief Create a pool.
+         *
+         * @param threads number of threads including the calling thread
+         *        (0 to use 1 thread per hardware thread, 1 to run all loops
+         *        serially)
+         */
+        explicit thread_pool(std::size_t threads = 0);
+        ~thread_pool();
+
+        // disallow copy
+        thread_pool(const thread_pool&) = delete;
+        thread_pool& operator=(const thread_pool&) = delete;
+
+        /** @brief Get number of threads which execute a loop.
+         *
+         * @return number of threads including the calling thread
+         */
+        std::size_t size() const
+        {
+            return size_;
+        }
+
+        /** @brief Execute function for all indices from 0 to count - 1.
+         *
+         * The function is called concurrently with disjoint ranges. If it
+         * throws an exception, remaining ranges are skipped and the first
+         * exception is rethrown in the calling thread.
+         *
+         * @param count number of iterations
+         * @param function loop body
+         */
+        void parallel_for(std::size_t count, const range_function& function);
+
+        /** @brief Get pool of the calling thread.
+         *
+         * @return pool or nullptr if there is none
+         */
+        static thread_pool* current();
+
+        /** @brief Execute a loop using the pool of the calling thread.
+         *
+         * The loop runs serially if there is no pool or if it is smaller
+         * than min_parallel_size. The cancellation token and the budget of
+         * the calling thread are current in all threads which execute the
+         * loop so that kernels check allocations of the loop body against
+         * the budget of the caller.
+         *
+         * @param count number of iterations
+         * @param function loop body (it is called with [first, last)
+         *        ranges of indices)
+         */
+        template<typename Function>
+        static void for_each(std::size_t count, Function&& function)
+        {
+            auto pool = current();
+            if (pool == nullptr || pool->size() <= 1 ||
+                count < min_parallel_size)
+            {
+                if (count > 0)
+                {
+                    function(std::size_t{ 0 }, count);
+                }
+                return;
+            }
+
+            // threads of the pool check the token and the budget of the 
+            // calling thread
+            auto token = cancellation::current();
+            auto limits = budget::current();
+            pool->parallel_for(count, [&](std::size_t first, std::size_t last)
+            {
+                cancellation::scope token_scope{ token };
+                budget::scope budget_scope{ limits };
+                function(first, last);
+            });
+        }
+
+        /** @brief Make a pool current for the calling thread.
+         *
+         * The previous pool is restored when this object is destroyed.
+         */
+        class scope
+        {
+        public:
+            explicit scope(thread_pool* pool);
+            ~scope();
+
+            scope(const scope&) = delete;
+            scope& operator=(const scope&) = delete;
+        private:
+            thread_pool* previous_;
+        };
+    private:
+        // part of the index space of a loop owned by 1 thread
+        struct range
+        {
+            std::mutex lock;
+            std::size_t first = 0;
+            std::size_t last = 0;
+        };
+
+        struct job
+        {
+            const range_function* function;
+            std::unique_ptr<range[]> ranges;
+            std::size_t chunk_size;
+            std::atomic<bool> failed{ false };
+            std::mutex error_lock;
+            std::exception_ptr error;
+        };
+
+        std::size_t size_;
+        std::vector<std::thread> workers_;
+
+        // only 1 loop runs at a time
+        std::mutex call_lock_;
+
+        // protects the state below
+        std::mutex lock_;
+        std::condition_variable wake_;
+        std::condition_variable done_;
+        job* job_ = nullptr;
+        std::size_t generation_ = 0;
+        std::size_t pending_ = 0;
+        bool stop_ = false;
+
+        static thread_local thread_pool* current_;
+
+        void start();
+        void work(std::size_t index);
+        void run(job& task, std::size_t index);
+        bool take(job& task, std::size_t index,
+            std::size_t& first, std::size_t& last);
+        bool steal(job& task, std::size_t index);
+    };
+}
+
+#endif // DICE_THREAD_POOL_HPP_
@@ -6,8 +6,10 @@
 #ifndef DICE_UTILS_HPP_
 #define DICE_UTILS_HPP_
 
+#include <cmath>
 #include <vector>
 #include <functional>
+#include <type_traits>
 
 namespace dice 
 {
@@ -81,6 +83,56 @@ namespace dice
             return upper;
         return value;
     }
+
+    /** @brief Type in which sums of values of type T are accumulated.
+     *
+     * It is at least as precise as double so that moments of variables 
+     * with float probabilities don't lose most of their digits.
+     */
+    template<typename T>
+    using accumulator_t = typename std::conditional<
+        (sizeof(T) < sizeof(double)), double, T>::type;
+
+    /** @brief Compensated (Kahan-Babuska) summation.
+     *
+     * The rounding error of each addition is accumulated separately and
+     * added to the result at the end. Error of the sum does not grow with
+     * the number of terms (unlike error of a naive sum).
+     */
+    template<typename T>
+    class compensated_sum
+    {
+    public:
+        compensated_sum() = default;
+        explicit compensated_sum(T value) : sum_(value) {}
+
+        compensated_sum& operator+=(T value)
+        {
+            auto result = sum_ + value;
+            if (std::abs(sum_) >= std::abs(value))
+            {
+                error_ += (sum_ - result) + value;
+            }
+            else
+            {
+                error_ += (value - result) + sum_;
+            }
+            sum_ = result;
+            return *this;
+        }
+
+        /** @brief Get value of the sum.
+         *
+         * @return sum of all added values
+         */
+        T value() const
+        {
+            return sum_ + error_;
+        }
+    private:
+        T sum_ = 0;
+        T error_ = 0;
+    };
 }
 
 #endif // DICE_UTILS_HPP_
\ No newline at end of file
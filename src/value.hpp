@@ -9,8 +9,11 @@
 #include <memory>
 #include <string>
 #include <typeinfo>
+#include <type_traits>
+#include <stdexcept>
 
 #include "safe.hpp"
+#include "block_pool.hpp"
 #include "random_variable.hpp"
 #include "decomposition.hpp"
 
@@ -21,7 +24,19 @@ namespace dice
     {
         using int_type = safe<int>;
         using real_type = double;
-        using random_variable_type = decomposition<int_type, real_type>;
+
+        // Probabilities of random variables (it is chosen when the library
+        // is built, see DICE_PROBABILITY in CMakeLists.txt)
+    #if defined(DICE_PROBABILITY_FLOAT)
+        using probability_type = float;
+    #elif defined(DICE_PROBABILITY_LONG_DOUBLE)
+        using probability_type = long double;
+    #else
+        using probability_type = double;
+    #endif
+
+        using random_variable_type = 
+            decomposition<int_type, probability_type>;
     }
 
     /** @brief Type identifier of a value in a dice expression */
@@ -150,13 +165,123 @@ namespace dice
         virtual void accept(value_visitor* visitor) = 0;
     };
 
-    /** @brief Value with data */
+    /** @brief Data of a value stored inline. */
+    template<typename T>
+    class value_storage
+    {
+    public:
+        value_storage() = default;
+        explicit value_storage(T value) : value_(std::move(value)) {}
+
+        T& get() { return value_; }
+        const T& get() const { return value_; }
+
+        /** @brief Check whether the data is shared with other values.
+         *
+         * @return always false (data is stored inline)
+         */
+        bool is_shared() const
+        {
+            return false;
+        }
+
+        /** @brief Create a copy of the data.
+         *
+         * @return copy
+         */
+        value_storage share() const
+        {
+            return value_storage{ value_ };
+        }
+    private:
+        T value_;
+    };
+
+    /** @brief Data of a random variable shared by copies of a value.
+     *
+     * Copying the whole decomposition for each use of a variable is
+     * expensive. Copies of the value (see typed_value::clone) share the
+     * data instead. It is copied when a shared value is modified (copy on
+     * write). Thus, functions which only read their arguments should use
+     * the const data accessor.
+     */
+    template<>
+    class value_storage<storage::random_variable_type>
+    {
+    public:
+        using value_type = storage::random_variable_type;
+
+        value_storage() : value_(std::make_shared<value_type>()) {}
+        explicit value_storage(value_type value) : 
+            value_(std::make_shared<value_type>(std::move(value))) {}
+
+        value_type& get()
+        {
+            if (value_.use_count() > 1)
+            {
+                value_ = std::make_shared<value_type>(*value_);
+            }
+            return *value_;
+        }
+
+        const value_type& get() const 
+        { 
+            return *value_; 
+        }
+
+        bool is_shared() const
+        {
+            return value_.use_count() > 1;
+        }
+
+        value_storage share() const
+        {
+            return *this;
+        }
+    private:
+        std::shared_ptr<value_type> value_;
+    };
+
+    /** @brief Value with data
+     *
+     * Small values (ints and reals) are allocated from a thread local 
+     * block_pool instead of the heap since they are created and destroyed
+     * for each operation.
+     */
     template<typename T>
     class typed_value : public base_value
     {
     public:
         using value_type = T;
 
+        // maximal size of a value allocated from a block_pool
+        static const std::size_t max_pooled_size = 32;
+
+        // only ints and reals are pooled (random variables use the global
+        // allocator like their shared data)
+        static constexpr bool is_pooled = 
+            std::is_same<T, storage::int_type>::value || 
+            std::is_same<T, storage::real_type>::value;
+
+        static void* operator new(std::size_t size)
+        {
+            if (is_pooled && size == sizeof(typed_value) && 
+                size <= max_pooled_size)
+                return block_pool<sizeof(typed_value)>::allocate();
+            return ::operator new(size);
+        }
+
+        static void operator delete(void* ptr, std::size_t size) noexcept
+        {
+            if (is_pooled && size == sizeof(typed_value) && 
+                size <= max_pooled_size)
+            {
+                block_pool<sizeof(typed_value)>::deallocate(ptr);
+                return;
+            }
+            ::operator delete(ptr);
+        }
+
         static type_id id() 
         {
             return get_type_id<T>();
@@ -221,16 +346,29 @@ namespace dice
          */
         std::unique_ptr<base_value> clone() const override
         {
-            return std::make_unique<typed_value>(data());
+            return std::unique_ptr<typed_value>(
+                new typed_value(value_.share()));
         }
 
-        // value getter setter
-        value_type& data() { return value_; }
-        const value_type& data() const { return value_; }
+        // value getter setter (the getter copies shared data)
+        value_type& data() { return value_.get(); }
+        const value_type& data() const { return value_.get(); }
+
+        /** @brief Check whether data of this value is shared by a copy.
+         *
+         * @return true iff modification of the data would copy it
+         */
+        bool is_shared() const { return value_.is_shared(); }
     private:
-        value_type value_;
+        value_storage<value_type> value_;
+
+        explicit typed_value(value_storage<value_type>&& value) : 
+            value_(std::move(value)) {}
     };
 
+    template<typename T>
+    constexpr bool typed_value<T>::is_pooled;
+
     // used data types
     using type_int = typed_value<storage::int_type>;
     using type_real = typed_value<storage::real_type>;
@@ -254,7 +392,7 @@ namespace dice
         static_assert(std::is_base_of<base_value, T>::value, 
             "Dice value has to be derived from dice::base_value.");
         using value_type = typename T::value_type;
-        return std::make_unique<T>(value_type{ std::forward<Value>(data)... });
+        return std::make_unique<T>(value_type(std::forward<Value>(data)...));
     }
 }
 
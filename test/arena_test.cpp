@@ -0,0 +1,65 @@
+#include "catch.hpp"
+#include "arena.hpp"
+#include "convolution.hpp"
+
+#include <vector>
+
+TEST_CASE("Blocks released in reverse order are reused", "[arena]")
+{
+    dice::arena memory{ 1024 };
+    auto a = memory.allocate(100, 8);
+    auto b = memory.allocate(10, 8);
+    REQUIRE(a != nullptr);
+    REQUIRE(b != nullptr);
+    REQUIRE(memory.contains(a));
+    REQUIRE(memory.contains(b));
+    REQUIRE(memory.used() == 114);
+
+    // a is not the last block
+    memory.deallocate(a, 100);
+    REQUIRE(memory.used() == 114);
+
+    memory.deallocate(b, 10);
+    REQUIRE(memory.used() == 104);
+    REQUIRE(memory.allocate(8, 8) == b);
+
+    memory.reset();
+    REQUIRE(memory.used() == 0);
+    REQUIRE(memory.allocate(1024, 8) == a);
+    REQUIRE(memory.allocate(1, 1) == nullptr);
+}
+
+TEST_CASE("Scratch vectors use the current arena", "[arena]")
+{
+    dice::arena memory{ 1024 };
+    {
+        dice::scratch_vector<int> heap(4, 1);
+        REQUIRE_FALSE(memory.contains(heap.data()));
+    }
+
+    dice::arena::scope scope{ &memory };
+    REQUIRE(dice::arena::current() == &memory);
+    {
+        dice::scratch_vector<int> small(4, 1);
+        REQUIRE(memory.contains(small.data()));
+
+        // allocations which don't fit use the global allocator
+        dice::scratch_vector<int> large(1024, 2);
+        REQUIRE_FALSE(memory.contains(large.data()));
+        REQUIRE(large.back() == 2);
+    }
+    REQUIRE(memory.used() == 0);
+}
+
+TEST_CASE("FFT buffers in an arena give the same result", "[arena]")
+{
+    std::vector<double> a(300, 1 / 300.0);
+    std::vector<double> b(200, 1 / 200.0);
+    auto expected = dice::convolution::fft_convolve(a, b);
+
+    dice::arena memory;
+    dice::arena::scope scope{ &memory };
+    auto result = dice::convolution::fft_convolve(a, b);
+    REQUIRE(memory.used() == 0);
+    REQUIRE(result == expected);
+}
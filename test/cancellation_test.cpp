@@ -0,0 +1,91 @@
+#include "catch.hpp"
+#include "cancellation.hpp"
+#include "calculator.hpp"
+
+#include <chrono>
+#include <sstream>
+
+TEST_CASE("Cancellation token stops the evaluation at the next check", "[cancellation]")
+{
+    dice::cancellation token;
+    REQUIRE(!token.is_cancelled());
+    REQUIRE_NOTHROW(token.check());
+
+    // there is nothing to check without a current token
+    REQUIRE(dice::cancellation::current() == nullptr);
+    REQUIRE_NOTHROW(dice::cancellation::check_current());
+
+    token.cancel();
+    REQUIRE(token.is_cancelled());
+    {
+        dice::cancellation::scope scope{ &token };
+        REQUIRE(dice::cancellation::current() == &token);
+        REQUIRE_THROWS_AS(
+            dice::cancellation::check_current(),
+            dice::cancelled_error);
+    }
+    REQUIRE(dice::cancellation::current() == nullptr);
+
+    dice::cancellation expired;
+    expired.set_deadline(dice::cancellation::clock::now());
+    REQUIRE(expired.is_cancelled());
+    REQUIRE_THROWS_AS(expired.check(), dice::cancelled_error);
+}
+
+TEST_CASE("Report progress of the evaluated statements", "[cancellation]")
+{
+    dice::cancellation token;
+    REQUIRE(token.get_progress().fraction == 0);
+
+    token.start_statement(1, 2, 3, 6);
+    token.add_work(1);
+    auto progress = token.get_progress();
+    REQUIRE(progress.statement == 1);
+    REQUIRE(progress.statement_count == 2);
+    REQUIRE(progress.fraction == Approx(4 / 6.0));
+
+    token.finish();
+    REQUIRE(token.get_progress().statement == 2);
+    REQUIRE(token.get_progress().fraction == 1);
+}
+
+TEST_CASE("Evaluate a script asynchronously", "[cancellation]")
+{
+    std::stringstream errors;
+    dice::calculator calc{ 2 };
+    calc.log = dice::logger{ &errors, true };
+
+    dice::cancellation token;
+    auto result = calc.evaluate_async("var x = 1d6; x + 1; 2d4", &token);
+    auto values = result.get();
+    REQUIRE(values.size() == 3);
+    REQUIRE(errors.str().empty());
+    REQUIRE(token.get_progress().statement == 3);
+    REQUIRE(token.get_progress().fraction == 1);
+
+    // evaluation without a token can't be cancelled
+    REQUIRE(calc.evaluate_async("1d6").get().size() == 1);
+}
+
+TEST_CASE("Cancel an asynchronous evaluation", "[cancellation]")
+{
+    std::stringstream errors;
+    dice::calculator calc{ 2 };
+    calc.log = dice::logger{ &errors, true };
+
+    dice::cancellation cancelled;
+    cancelled.cancel();
+    auto result = calc.evaluate_async("1d6", &cancelled);
+    REQUIRE_THROWS_AS(result.get(), dice::cancelled_error);
+
+    // a long roll is stopped at its deadline
+    dice::cancellation token;
+    token.set_timeout(std::chrono::milliseconds{ 10 });
+    result = calc.evaluate_async("(1d1000)d1000", &token);
+    REQUIRE_THROWS_AS(result.get(), dice::cancelled_error);
+    REQUIRE(errors.str().empty());
+
+    // the calculator can be used after a cancelled evaluation
+    REQUIRE(calc.evaluate("1d6 + 1").size() == 1);
+    REQUIRE(errors.str().empty());
+}
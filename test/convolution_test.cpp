@@ -0,0 +1,215 @@
+#include "catch.hpp"
+#include "convolution.hpp"
+#include "random_variable.hpp"
+
+#include <limits>
+
+namespace 
+{
+    // restore the FFT threshold at the end of a test
+    struct threshold_guard
+    {
+        std::size_t value = dice::convolution::fft_threshold;
+
+        explicit threshold_guard(std::size_t threshold)
+        {
+            dice::convolution::fft_threshold = threshold;
+        }
+
+        ~threshold_guard()
+        {
+            dice::convolution::fft_threshold = value;
+        }
+    };
+
+    std::vector<double> uniform(std::size_t size)
+    {
+        return std::vector<double>(size, 1.0 / size);
+    }
+}
+
+TEST_CASE("Convolve small vectors directly", "[convolution]")
+{
+    std::vector<double> a{ 0.5, 0.5 };
+    std::vector<double> b{ 0.25, 0.5, 0.25 };
+
+    auto result = dice::convolution::convolve(a, b);
+    REQUIRE(result.size() == 4);
+    REQUIRE(result[0] == Approx(0.125));
+    REQUIRE(result[1] == Approx(0.375));
+    REQUIRE(result[2] == Approx(0.375));
+    REQUIRE(result[3] == Approx(0.125));
+}
+
+TEST_CASE("Convolution of an empty vector is empty", "[convolution]")
+{
+    std::vector<double> a;
+    std::vector<double> b{ 1 };
+
+    REQUIRE(dice::convolution::convolve(a, b).empty());
+    REQUIRE(dice::convolution::fft_convolve(b, a).empty());
+}
+
+TEST_CASE("FFT convolution is within the error bound of the direct method", "[convolution]")
+{
+    auto a = uniform(300);
+    auto b = uniform(1000);
+    b[17] = 0;
+
+    auto direct = dice::convolution::direct_convolve(a, b);
+    auto fft = dice::convolution::fft_convolve(a, b);
+    REQUIRE(direct.size() == fft.size());
+
+    auto bound = dice::convolution::error_bound<double>(direct.size());
+    for (std::size_t i = 0; i < direct.size(); ++i)
+    {
+        REQUIRE(std::abs(direct[i] - fft[i]) <= bound);
+    }
+}
+
+TEST_CASE("FFT convolution reports the probability rounded to 0", "[convolution]")
+{
+    auto a = uniform(300);
+    auto b = uniform(1000);
+    // probability of 0 is below the error bound but not below the error
+    b[0] = 1.5e-12;
+
+    double rounded = 0;
+    auto direct = dice::convolution::direct_convolve(a, b);
+    auto fft = dice::convolution::fft_convolve(a, b, &rounded);
+    REQUIRE(direct[0] > 0);
+    REQUIRE(fft[0] == 0);
+    REQUIRE(rounded > 0);
+
+    double direct_sum = 0;
+    double fft_sum = 0;
+    for (std::size_t i = 0; i < direct.size(); ++i)
+    {
+        direct_sum += direct[i];
+        fft_sum += fft[i];
+    }
+    REQUIRE(fft_sum + rounded == Approx(direct_sum));
+
+    // nothing is rounded by the direct method
+    rounded = 0;
+    dice::convolution::convolve(uniform(3), uniform(4), &rounded);
+    REQUIRE(rounded == 0);
+}
+
+TEST_CASE("FFT compound is within the error bound of repeated convolution", "[convolution]")
+{
+    auto die = uniform(7);
+    die[0] = 0;
+
+    auto actual = dice::convolution::fft_compound(
+        die, 
+        { 1, 2, 30 }, 
+        { 0.25, 0.25, 0.5 });
+    REQUIRE(actual.size() == 6 * 30 + 1);
+
+    std::vector<double> expected(actual.size(), 0);
+    auto power = die;
+    for (std::size_t k = 1; k <= 30; ++k)
+    {
+        if (k == 1 || k == 2 || k == 30)
+        {
+            auto weight = k == 30 ? 0.5 : 0.25;
+            for (std::size_t i = 0; i < power.size(); ++i)
+            {
+                expected[i] += power[i] * weight;
+            }
+        }
+        power = dice::convolution::direct_convolve(power, die);
+    }
+
+    auto bound = dice::convolution::error_bound<double>(actual.size());
+    for (std::size_t i = 0; i < expected.size(); ++i)
+    {
+        REQUIRE(std::abs(actual[i] - expected[i]) <= bound);
+    }
+}
+
+TEST_CASE("Count multiplications of the FFT compound", "[convolution]")
+{
+    REQUIRE(dice::convolution::compound_steps({}) == 0);
+    
+    // 3 squares, 1 multiplication and 1 weight for 8
+    REQUIRE(dice::convolution::compound_steps({ 8 }) == 5);
+
+    // consecutive powers need only 1 multiplication each
+    REQUIRE(dice::convolution::compound_steps({ 1, 2, 3, 4 }) == 2 + 4 + 4);
+}
+
+TEST_CASE("Sum of large random variables is the same with and without FFT", "[convolution]")
+{
+    using var_type = dice::random_variable<int, double>;
+    var_type num_dice{ dice::constant_tag{}, 20 };
+    var_type num_faces{ dice::constant_tag{}, 50 };
+    var_type other_dice{ dice::constant_tag{}, 10 };
+    var_type other_faces{ dice::constant_tag{}, 20 };
+
+    var_type direct;
+    {
+        threshold_guard guard{ std::numeric_limits<std::size_t>::max() };
+        auto a = roll(num_dice, num_faces);
+        auto b = roll(other_dice, other_faces);
+        direct = a - b;
+    }
+
+    var_type fft;
+    {
+        threshold_guard guard{ 0 };
+        auto a = roll(num_dice, num_faces);
+        auto b = roll(other_dice, other_faces);
+        fft = a - b;
+    }
+
+    REQUIRE(direct.min_value() == 20 - 200);
+    REQUIRE(fft.min_value() >= direct.min_value());
+    for (auto&& pair : direct)
+    {
+        REQUIRE(std::abs(fft.probability(pair.first) - pair.second) <= 1e-12);
+    }
+    REQUIRE(fft.expected_value() == Approx(direct.expected_value()));
+
+    // probability removed by the FFT is discarded
+    REQUIRE(direct.discarded_probability() == 0);
+    double total = fft.discarded_probability();
+    for (auto&& pair : fft)
+    {
+        total += pair.second;
+    }
+    REQUIRE(total == Approx(1));
+}
+
+TEST_CASE("Roll with variable number of dice is the same with and without FFT", "[convolution]")
+{
+    using var_type = dice::random_variable<int, double>;
+    var_type num_dice{ var_type::frequency_list{ 
+        std::make_pair(3, 1), 
+        std::make_pair(40, 2),
+        std::make_pair(41, 1),
+    } };
+    var_type num_faces{ dice::constant_tag{}, 20 };
+
+    var_type direct;
+    {
+        threshold_guard guard{ std::numeric_limits<std::size_t>::max() };
+        direct = roll(num_dice, num_faces);
+    }
+
+    var_type fft;
+    {
+        threshold_guard guard{ 0 };
+        fft = roll(num_dice, num_faces);
+    }
+
+    REQUIRE(direct.min_value() == 3);
+    REQUIRE(direct.probability(3) == Approx(0.25 / (20 * 20 * 20)));
+    for (auto&& pair : direct)
+    {
+        REQUIRE(std::abs(fft.probability(pair.first) - pair.second) <= 1e-12);
+    }
+    REQUIRE(fft.expected_value() == Approx(direct.expected_value()));
+    REQUIRE(direct.expected_value() == Approx((0.75 + 20 + 10.25) * 10.5));
+}
@@ -378,4 +378,371 @@ TEST_CASE("Convert decomposition with no dependencies to random varaible", "[dec
     auto var = value.to_random_variable();
     REQUIRE(var.probability(0) == Approx(0.2));
     REQUIRE(var.probability(1) == Approx(0.8));
-}
\ No newline at end of file
+}
+TEST_CASE("Distribution of a decomposition is cached", "[decomposition]")
+{
+    dice::random_variable<int, double> test{ dice::bernoulli_tag{}, 0.8 };
+    dice::decomposition<int, double> value{ test };
+
+    auto&& var = value.marginal();
+    REQUIRE(&var == &value.marginal());
+    REQUIRE(var.probability(1) == Approx(0.8));
+    REQUIRE(value.quantile(0.5) == 1);
+
+    auto copy = value;
+    REQUIRE(&copy.marginal() == &var);
+}
+
+TEST_CASE("Combine a dependent variable with a constant", "[decomposition]")
+{
+    dice::random_variable<int, double> var_a{ freq_list{
+        std::make_pair(1, 1),
+        std::make_pair(2, 1),
+    } };
+    dice::decomposition<int, double> a{ var_a };
+    a = a.compute_decomposition();
+    dice::decomposition<int, double> two{ dice::constant_tag{}, 2 };
+
+    auto result = (a * two) - a;
+    REQUIRE(result.dependencies_internal().size() == 1);
+    auto var = result.to_random_variable();
+    REQUIRE(var.probability(1) == Approx(0.5));
+    REQUIRE(var.probability(2) == Approx(0.5));
+
+    result = two + a;
+    REQUIRE(result.dependencies_internal().size() == 1);
+    var = result.to_random_variable();
+    REQUIRE(var.probability(3) == Approx(0.5));
+    REQUIRE(var.probability(4) == Approx(0.5));
+}
+
+TEST_CASE("Prune leafs when the decomposition is computed", "[decomposition]")
+{
+    dice::random_variable<int, double> var{ freq_list{
+        std::make_pair(1, 1),
+        std::make_pair(2, 98),
+        std::make_pair(3, 1),
+    } };
+    dice::decomposition<int, double> a{ var };
+
+    auto epsilon = dice::pruning::epsilon;
+    dice::pruning::epsilon = 0.015;
+    auto result = a.compute_decomposition();
+    dice::pruning::epsilon = epsilon;
+
+    auto marginal = result.to_random_variable();
+    REQUIRE(marginal.size() == 2);
+    REQUIRE(marginal.probability(2) == Approx(0.98));
+    REQUIRE(marginal.probability(3) == Approx(0.01));
+    REQUIRE(marginal.discarded_probability() == Approx(0.01));
+}
+
+TEST_CASE("Combine variables with partially shared dependencies", "[decomposition][multiple_vars]")
+{
+    dice::random_variable<int, double> var_x{ freq_list{
+        std::make_pair(0, 1),
+        std::make_pair(1, 1),
+    } };
+    dice::random_variable<int, double> var_y{ freq_list{
+        std::make_pair(0, 1),
+        std::make_pair(10, 1),
+        std::make_pair(20, 1),
+    } };
+    dice::random_variable<int, double> var_z{ freq_list{
+        std::make_pair(1, 1),
+        std::make_pair(2, 1),
+        std::make_pair(3, 1),
+        std::make_pair(4, 1),
+    } };
+
+    dice::decomposition<int, double> x{ var_x };
+    dice::decomposition<int, double> y{ var_y };
+    dice::decomposition<int, double> z{ var_z };
+    x = x.compute_decomposition();
+    y = y.compute_decomposition();
+    z = z.compute_decomposition();
+
+    // (X + Z) + (Y * Z) where Z is shared by both operands
+    auto result = (x + z) + (y * z);
+    auto var = result.to_random_variable();
+
+    // compute the distribution directly
+    dice::random_variable<int, double> expected;
+    freq_list list;
+    for (int value_x : { 0, 1 })
+    {
+        for (int value_y : { 0, 10, 20 })
+        {
+            for (int value_z : { 1, 2, 3, 4 })
+            {
+                list.push_back(std::make_pair(
+                    value_x + value_z + value_y * value_z, 1));
+            }
+        }
+    }
+    expected = dice::random_variable<int, double>{ list };
+
+    REQUIRE(var.size() == expected.size());
+    for (auto&& pair : expected)
+    {
+        REQUIRE(var.probability(pair.first) == Approx(pair.second));
+    }
+}
+
+TEST_CASE("Sum a dependency out of a decomposition", "[decomposition]")
+{
+    dice::random_variable<int, double> var_a{ freq_list{
+        std::make_pair(1, 1),
+        std::make_pair(2, 3),
+    } };
+    dice::random_variable<int, double> var_b{ freq_list{
+        std::make_pair(1, 1),
+        std::make_pair(2, 1),
+        std::make_pair(3, 2),
+    } };
+    dice::decomposition<int, double> a{ var_a };
+    dice::decomposition<int, double> b{ var_b };
+    a = a.compute_decomposition();
+    b = b.compute_decomposition();
+
+    auto result = a * b + a;
+    auto expected = result.to_random_variable();
+    REQUIRE(result.dependency_count() == 2);
+    REQUIRE(result.unshared_dependencies() == 0);
+
+    for (std::size_t index : { 0, 1 })
+    {
+        auto marginalized = result.marginalize(index);
+        REQUIRE(marginalized.dependency_count() == 1);
+        REQUIRE(marginalized.size() == result.size() / (index == 0 ? 2 : 3));
+
+        auto var = marginalized.to_random_variable();
+        REQUIRE(var.size() == expected.size());
+        for (auto&& pair : expected)
+        {
+            REQUIRE(var.probability(pair.first) == Approx(pair.second));
+        }
+    }
+
+    // the dependency on B is not shared after b is reset
+    b = dice::decomposition<int, double>{};
+    REQUIRE(result.unshared_dependencies() == 1);
+    auto simplified = result.marginalize_unshared();
+    REQUIRE(simplified.dependency_count() == 1);
+    REQUIRE(simplified.to_random_variable() == expected);
+}
+
+TEST_CASE("Store constant leafs in the compact buffer", "[decomposition]")
+{
+    dice::random_variable<int, double> var_a{ freq_list{
+        std::make_pair(1, 1),
+        std::make_pair(2, 1),
+        std::make_pair(3, 2),
+    } };
+    dice::random_variable<int, double> var_b{ freq_list{
+        std::make_pair(-1, 1),
+        std::make_pair(4, 3),
+    } };
+    dice::decomposition<int, double> a{ var_a };
+    dice::decomposition<int, double> b{ var_b };
+    REQUIRE(!a.is_compact());
+
+    a = a.compute_decomposition();
+    b = b.compute_decomposition();
+    REQUIRE(a.is_compact());
+    REQUIRE(a.size() == 3);
+    REQUIRE(a.to_random_variable() == var_a);
+
+    // combination of compact leafs is compact
+    auto result = -(a * b) + a;
+    REQUIRE(result.is_compact());
+    REQUIRE(result.size() == 6);
+
+    freq_list list;
+    for (auto&& pair_a : var_a)
+    {
+        for (auto&& pair_b : var_b)
+        {
+            auto value = -(pair_a.first * pair_b.first) + pair_a.first;
+            auto freq = static_cast<std::size_t>(
+                pair_a.second * 4 * pair_b.second * 4 + 0.5);
+            list.push_back(std::make_pair(value, freq));
+        }
+    }
+    dice::random_variable<int, double> expected{ list };
+
+    auto var = result.to_random_variable();
+    REQUIRE(var.size() == expected.size());
+    for (auto&& pair : expected)
+    {
+        REQUIRE(var.probability(pair.first) == Approx(pair.second));
+    }
+
+    // large leafs are not compact
+    auto large = a + dice::decomposition<int, double>{ freq_list{
+        std::make_pair(1, 1),
+        std::make_pair(2, 1),
+        std::make_pair(3, 1),
+        std::make_pair(4, 1),
+        std::make_pair(5, 1),
+    } };
+    REQUIRE(!large.is_compact());
+    REQUIRE(large.size() == 3);
+
+    // leafs are converted back when they are modified
+    auto copy = result;
+    copy.variables_internal();
+    REQUIRE(!copy.is_compact());
+    REQUIRE(copy == result);
+    REQUIRE(copy.to_random_variable() == var);
+}
+
+TEST_CASE("Fold visits the same values as the iterator", "[decomposition]")
+{
+    dice::random_variable<int, double> var_a{ freq_list{
+        std::make_pair(1, 1),
+        std::make_pair(2, 3),
+    } };
+    dice::random_variable<int, double> var_b{ freq_list{
+        std::make_pair(1, 1),
+        std::make_pair(2, 1),
+        std::make_pair(3, 2),
+    } };
+    dice::decomposition<int, double> a{ var_a };
+    dice::decomposition<int, double> b{ var_b };
+    a = a.compute_decomposition();
+    b = b.compute_decomposition();
+    auto result = roll(a, b) + a * b;
+
+    std::vector<std::pair<int, double>> expected;
+    for (auto it = result.begin(); it != result.end(); ++it)
+    {
+        expected.push_back(*it);
+    }
+
+    std::vector<std::pair<int, double>> actual;
+    result.fold([&](auto&& value, auto&& probability)
+    {
+        actual.push_back(std::make_pair(value, probability));
+    });
+
+    REQUIRE(actual.size() == expected.size());
+    for (std::size_t i = 0; i < expected.size(); ++i)
+    {
+        REQUIRE(actual[i].first == expected[i].first);
+        REQUIRE(actual[i].second == Approx(expected[i].second));
+    }
+
+    // a range of leafs starts with the right weights
+    auto offset = result.variables_internal()[0].size();
+    std::vector<std::pair<int, double>> range;
+    result.fold(1, 3, [&](auto&& value, auto&& probability)
+    {
+        range.push_back(std::make_pair(value, probability));
+    });
+
+    REQUIRE(range.size() == result.variables_internal()[1].size() + 
+        result.variables_internal()[2].size());
+    for (std::size_t i = 0; i < range.size(); ++i)
+    {
+        REQUIRE(range[i].first == expected[offset + i].first);
+        REQUIRE(range[i].second == Approx(expected[offset + i].second));
+    }
+}
+
+TEST_CASE("Estimate size of a decomposition and check it against a budget", "[decomposition]")
+{
+    dice::random_variable<int, double> var_a{ freq_list{
+        std::make_pair(1, 1),
+        std::make_pair(2, 1),
+        std::make_pair(3, 1),
+    } };
+    dice::random_variable<int, double> var_b{ freq_list{
+        std::make_pair(1, 1),
+        std::make_pair(2, 1),
+    } };
+    dice::decomposition<int, double> a{ var_a };
+    dice::decomposition<int, double> b{ var_b };
+    REQUIRE(a.decomposition_cost().leaf_count == 3);
+
+    a = a.compute_decomposition();
+    b = b.compute_decomposition();
+    auto cost = a.combine_cost(b);
+    REQUIRE(cost.leaf_count == 6);
+    REQUIRE(cost.bytes > 0);
+    REQUIRE((a + b).size() == cost.leaf_count);
+    REQUIRE(a.combine_cost(a).leaf_count == 3);
+    REQUIRE(a.combine_cost(dice::decomposition<int, double>{ 
+        dice::constant_tag{}, 1 }).leaf_count == 3);
+
+    dice::budget limits;
+    limits.max_leaves = 5;
+    {
+        dice::budget::scope scope{ &limits };
+        REQUIRE_THROWS_AS(a + b, dice::budget_error);
+        REQUIRE((a + a).size() == 3);
+
+        limits.max_leaves = 0;
+        limits.max_bytes = cost.bytes - 1;
+        REQUIRE_THROWS_AS(a * b, dice::budget_error);
+    }
+
+    // there is no limit without a current budget
+    REQUIRE(dice::budget::current() == nullptr);
+    REQUIRE((a + b).size() == 6);
+}
+
+TEST_CASE("Compound assignment of decompositions", "[decomposition]")
+{
+    using var_type = dice::random_variable<int, double>;
+    using decomposition_type = dice::decomposition<int, double>;
+    var_type var_a{ freq_list{
+        std::make_pair(1, 1),
+        std::make_pair(2, 1),
+        std::make_pair(3, 2),
+    } };
+    decomposition_type a{ var_a };
+    a = a.compute_decomposition();
+    decomposition_type c{ var_type{ dice::constant_tag{}, 4 } };
+
+    // the constant is added to the leafs in place
+    auto sum = a + a;
+    auto expected = sum + c;
+    sum += c;
+    REQUIRE(sum.to_random_variable() == expected.to_random_variable());
+
+    // dependent operands are combined as by operator-
+    auto difference = sum;
+    difference -= a;
+    REQUIRE(difference.to_random_variable() == 
+        (sum - a).to_random_variable());
+    REQUIRE(difference.to_random_variable().probability(5) == 
+        Approx(0.25));
+
+    auto product = a;
+    product *= c;
+    REQUIRE(product.to_random_variable() == (a * c).to_random_variable());
+}
+
+TEST_CASE("Compute memory used by a decomposition", "[decomposition]")
+{
+    dice::random_variable<int, double> var{ freq_list{
+        std::make_pair(1, 1),
+        std::make_pair(2, 1),
+        std::make_pair(3, 1),
+    } };
+    dice::decomposition<int, double> a{ var };
+    auto before = a.memory_usage();
+    REQUIRE(before >= var.memory_usage());
+
+    // the marginal distribution is included once it is computed
+    a.marginal();
+    REQUIRE(a.memory_usage() > before);
+
+    // dependencies are included in each decomposition which uses them
+    auto b = a.compute_decomposition();
+    REQUIRE(b.has_dependencies());
+    REQUIRE(b.memory_usage() >= var.memory_usage());
+    auto sum = b + b;
+    REQUIRE(sum.memory_usage() >= var.memory_usage());
+}
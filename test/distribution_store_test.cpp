@@ -0,0 +1,214 @@
+#include "catch.hpp"
+#include "distribution_store.hpp"
+#include "roll_cache.hpp"
+#include "calculator.hpp"
+
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <fstream>
+
+using var_type = dice::random_variable<int, double>;
+using freq_list = var_type::frequency_list;
+
+namespace
+{
+    // remove the file of a store at the start and at the end of a test
+    struct temporary_file
+    {
+        std::string path;
+
+        explicit temporary_file(const std::string& path) : path(path)
+        {
+            std::remove(path.c_str());
+        }
+
+        ~temporary_file()
+        {
+            std::remove(path.c_str());
+        }
+    };
+}
+
+TEST_CASE("Load distributions saved by another store", "[distribution_store]")
+{
+    temporary_file file{ "distribution_store_test.bin" };
+    var_type var{ freq_list{
+        std::make_pair(-2, 1),
+        std::make_pair(1, 2),
+        std::make_pair(3, 1),
+    } };
+
+    {
+        dice::distribution_store store;
+        REQUIRE(store.open(file.path));
+        REQUIRE(store.size() == 0);
+        store.save("var", var);
+        store.save("constant", var_type{ dice::constant_tag{}, 7 });
+        REQUIRE(store.size() == 2);
+
+        // saved entries can be loaded before the file is opened again
+        var_type loaded;
+        REQUIRE(store.load("var", loaded));
+        REQUIRE(loaded == var);
+    }
+
+    dice::distribution_store store;
+    REQUIRE(store.open(file.path));
+    REQUIRE(store.size() == 2);
+
+    dice::distribution_store::view view;
+    REQUIRE(!store.find("var", view));
+    REQUIRE(store.find(dice::distribution_store::typed_key<double>("var"), 
+        view));
+    REQUIRE(view.offset == -2);
+    REQUIRE(view.count == 6);
+    REQUIRE(view.probabilities[0] == 0.25);
+    REQUIRE(view.probabilities[1] == 0);
+    REQUIRE(view.probabilities[3] == 0.5);
+
+    var_type loaded;
+    REQUIRE(store.load("var", loaded));
+    REQUIRE(loaded == var);
+    REQUIRE(store.load("constant", loaded));
+    REQUIRE(loaded == var_type(dice::constant_tag{}, 7));
+    REQUIRE(!store.load("unknown", loaded));
+
+    store.close();
+    REQUIRE(!store.is_open());
+    REQUIRE(!store.load("var", loaded));
+}
+
+TEST_CASE("Don't load entries saved with a different precision", "[distribution_store]")
+{
+    using float_var = dice::random_variable<int, float>;
+    temporary_file file{ "distribution_store_precision_test.bin" };
+    dice::distribution_store store;
+    REQUIRE(store.open(file.path));
+    store.save("var", float_var{ dice::constant_tag{}, 1 });
+    REQUIRE(store.size() == 1);
+
+    var_type loaded;
+    REQUIRE(!store.load("var", loaded));
+
+    float_var loaded_float;
+    REQUIRE(store.load("var", loaded_float));
+    REQUIRE(loaded_float == float_var(dice::constant_tag{}, 1));
+
+    // both precisions can share the file
+    store.save("var", var_type{ dice::constant_tag{}, 2 });
+    REQUIRE(store.size() == 2);
+    REQUIRE(store.load("var", loaded));
+    REQUIRE(loaded == var_type(dice::constant_tag{}, 2));
+}
+
+TEST_CASE("Don't use a file with a different format", "[distribution_store]")
+{
+    temporary_file file{ "distribution_store_format_test.bin" };
+    {
+        std::ofstream output{ file.path, std::ios::binary };
+        output << "not a distribution store";
+    }
+
+    dice::distribution_store store;
+    REQUIRE(!store.open(file.path));
+    REQUIRE(!store.is_open());
+}
+
+TEST_CASE("Ignore an incomplete entry at the end of the file", "[distribution_store]")
+{
+    temporary_file file{ "distribution_store_damaged_test.bin" };
+    {
+        dice::distribution_store store;
+        REQUIRE(store.open(file.path));
+        store.save("var", var_type{ dice::constant_tag{}, 1 });
+    }
+
+    {
+        std::ofstream output{ file.path, std::ios::binary | std::ios::app };
+        output << "incomplete";
+    }
+
+    dice::distribution_store store;
+    REQUIRE(store.open(file.path));
+    REQUIRE(store.size() == 1);
+
+    // new entries could not be read after the incomplete entry
+    store.save("other", var_type{ dice::constant_tag{}, 2 });
+    REQUIRE(store.size() == 1);
+
+    // the key fits in the file but its padding does not
+    std::remove(file.path.c_str());
+    REQUIRE(store.open(file.path));
+    store.save("var", var_type{ dice::constant_tag{}, 1 });
+    store.close();
+    {
+        std::uint64_t key_size = 13;
+        std::ofstream output{ file.path, std::ios::binary | std::ios::app };
+        output.write(reinterpret_cast<const char*>(&key_size), 
+            sizeof(key_size));
+        output << std::string(14, 'k');
+    }
+
+    REQUIRE(store.open(file.path));
+    REQUIRE(store.size() == 1);
+}
+
+TEST_CASE("Roll cache loads distributions from a store", "[distribution_store]")
+{
+    temporary_file file{ "distribution_store_roll_test.bin" };
+    var_type num_dice{ dice::constant_tag{}, 3 };
+    var_type num_faces{ dice::constant_tag{}, 6 };
+
+    {
+        dice::distribution_store store;
+        REQUIRE(store.open(file.path));
+        dice::roll_cache<int, double> cache;
+        cache.set_store(&store);
+        cache.get(num_dice, num_faces);
+        REQUIRE(cache.misses() == 1);
+        REQUIRE(store.size() == 1);
+    }
+
+    dice::distribution_store store;
+    REQUIRE(store.open(file.path));
+    dice::roll_cache<int, double> cache;
+    cache.set_store(&store);
+    auto result = cache.get(num_dice, num_faces);
+    REQUIRE(cache.misses() == 0);
+    REQUIRE(cache.loads() == 1);
+    REQUIRE(*result == roll(num_dice, num_faces));
+}
+
+TEST_CASE("Plan cache loads distributions from a store", "[distribution_store]")
+{
+    temporary_file file{ "distribution_store_plan_test.bin" };
+    const std::string script = "keep_highest(4, 6, 3) + 1";
+
+    dice::distribution_store store;
+    REQUIRE(store.open(file.path));
+    dice::calculator calc{ 1 };
+    calc.cache.store = &store;
+    auto expected = calc.evaluate(script);
+    REQUIRE(store.size() > 0);
+
+    REQUIRE(store.open(file.path));
+    dice::calculator other{ 1 };
+    other.cache.store = &store;
+    auto actual = other.evaluate(script);
+
+    REQUIRE(actual.size() == 1);
+    auto&& expected_var = dynamic_cast<dice::type_rand_var&>(*expected[0])
+        .data().to_random_variable();
+    auto&& actual_var = dynamic_cast<dice::type_rand_var&>(*actual[0])
+        .data().to_random_variable();
+
+    // probabilities are saved in double
+    REQUIRE(actual_var.size() == expected_var.size());
+    for (auto&& pair : expected_var)
+    {
+        auto probability = static_cast<double>(pair.second);
+        REQUIRE(static_cast<double>(actual_var.probability(pair.first)) ==
+            Approx(probability));
+    }
+}
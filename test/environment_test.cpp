@@ -3,7 +3,7 @@
 
 using freq_list = dice::random_variable<
     dice::storage::int_type, 
-    dice::storage::real_type>::frequency_list;
+    dice::storage::probability_type>::frequency_list;
 
 TEST_CASE("Call operator + on integers", "[environment]")
 {
@@ -119,8 +119,8 @@ TEST_CASE("Call unary - function on random variable", "[environment]")
 
     auto drv = dynamic_cast<dice::type_rand_var*>(result.get());
     auto var = drv->data().to_random_variable();
-    REQUIRE(var.probability(-1) == 0.4);
-    REQUIRE(var.probability(0) == 0.6);
+    REQUIRE(var.probability(-1) == Approx(0.4));
+    REQUIRE(var.probability(0) == Approx(0.6));
 }
 
 TEST_CASE("Call the variance function on a random variable", "[environment]")
@@ -190,8 +190,112 @@ TEST_CASE("Generate a random number from given distribution", "[environment]")
     }
 }
 
+TEST_CASE("Rolls are reproducible with the same seed", "[environment]")
+{
+    auto roll = [](dice::environment& env)
+    {
+        auto result = env.call("roll", dice::make<dice::type_rand_var>(
+            freq_list{
+                std::make_pair(1, 1),
+                std::make_pair(2, 1),
+                std::make_pair(3, 1),
+            }), dice::make<dice::type_int>(3000));
+        REQUIRE(result->type() == dice::type_rand_var::id());
+        auto&& data = dynamic_cast<const dice::type_rand_var&>(*result).data();
+        return data.to_random_variable();
+    };
+
+    dice::environment env;
+    dice::environment other;
+    env.seed(7);
+    other.seed(7);
+
+    auto var = roll(env);
+    REQUIRE(var == roll(other));
+    REQUIRE(var.size() == 3);
+    REQUIRE(var.probability(1) == Approx(1 / 3.0).margin(0.05));
+    REQUIRE(var.probability(2) == Approx(1 / 3.0).margin(0.05));
+    REQUIRE(var.probability(3) == Approx(1 / 3.0).margin(0.05));
+
+    REQUIRE_THROWS_AS(env.call("roll", 
+        dice::make<dice::type_rand_var>(dice::constant_tag{}, 1), 
+        dice::make<dice::type_int>(0)), dice::compiler_error);
+}
+
 #endif // DISABLE_RNG
 
+TEST_CASE("Remove all variables", "[environment]")
+{
+    dice::environment env;
+    env.set_var("x", dice::make<dice::type_int>(1));
+    env.set_var("y", dice::make<dice::type_rand_var>(dice::constant_tag{}, 2));
+    env.clear_variables();
+
+    REQUIRE(env.get_var("x") == nullptr);
+    REQUIRE(env.get_var("y") == nullptr);
+
+    // functions are kept
+    auto result = env.call("+", 
+        dice::make<dice::type_int>(1), 
+        dice::make<dice::type_int>(2));
+    REQUIRE((dynamic_cast<dice::type_int&>(*result).data() == 3));
+}
+
+TEST_CASE("Recompute definitions whose inputs have changed", "[environment]")
+{
+    dice::environment env;
+    std::size_t calls = 0;
+    auto read_int = [&](const std::string& name)
+    {
+        return dynamic_cast<dice::type_int&>(*env.get_var(name)).data();
+    };
+
+    // y = x + 1, z = y * 2, w = 5
+    env.set_var("x", dice::make<dice::type_int>(1));
+    env.set_var("y", dice::make<dice::type_int>(2));
+    env.set_definition("y", { "x" }, [&]()
+    {
+        ++calls;
+        return dice::make<dice::type_int>(read_int("x") + 1);
+    });
+    env.set_var("z", dice::make<dice::type_int>(4));
+    env.set_definition("z", { "y" }, [&]()
+    {
+        ++calls;
+        return dice::make<dice::type_int>(read_int("y") * 2);
+    });
+    env.set_var("w", dice::make<dice::type_int>(5));
+
+    env.set_var("x", dice::make<dice::type_int>(10));
+    REQUIRE(env.is_stale("y"));
+    REQUIRE(env.is_stale("z"));
+    REQUIRE(!env.is_stale("w"));
+    REQUIRE(calls == 0);
+
+    // values are computed when they are used
+    REQUIRE((read_int("z") == 22));
+    REQUIRE(calls == 2);
+    REQUIRE((read_int("y") == 11));
+    REQUIRE((read_int("w") == 5));
+    REQUIRE(calls == 2);
+
+    // setting a variable removes its definition
+    env.set_var("y", dice::make<dice::type_int>(0));
+    env.set_var("x", dice::make<dice::type_int>(3));
+    REQUIRE(!env.is_stale("y"));
+    REQUIRE((read_int("y") == 0));
+    REQUIRE((read_int("z") == 0));
+
+    // a definition can't depend on itself (z depends on y)
+    env.set_definition("y", { "z" }, [&]()
+    {
+        return dice::make<dice::type_int>(read_int("z") + 1);
+    });
+    env.set_var("z", dice::make<dice::type_int>(7));
+    REQUIRE(!env.is_stale("y"));
+    REQUIRE((read_int("y") == 0));
+}
+
 TEST_CASE("Set value of unknown variable", "[environment]")
 {
     dice::environment env;
@@ -228,7 +332,7 @@ TEST_CASE("Roll function throws an error for impossible events", "[environment]"
     dice::environment env;
     dice::decomposition<
         dice::storage::int_type, 
-        dice::storage::real_type> num_dice, num_faces;
+        dice::storage::probability_type> num_dice, num_faces;
 
     auto a = dice::make<dice::type_rand_var>(num_dice);
     auto b = dice::make<dice::type_rand_var>(num_faces);
@@ -240,7 +344,8 @@ TEST_CASE("Roll function throws an error if dice count is an impossible event",
     dice::environment env;
     dice::decomposition<
         dice::storage::int_type, 
-        dice::storage::real_type> num_dice, num_faces{ dice::constant_tag{}, 1 };
+        dice::storage::probability_type> num_dice, 
+        num_faces{ dice::constant_tag{}, 1 };
 
     auto a = dice::make<dice::type_rand_var>(num_dice);
     auto b = dice::make<dice::type_rand_var>(num_faces);
@@ -252,7 +357,8 @@ TEST_CASE("Roll function throws an error if face count is an impossible event",
     dice::environment env;
     dice::decomposition<
         dice::storage::int_type, 
-        dice::storage::real_type> num_dice{ dice::constant_tag{}, 1 }, num_faces;
+        dice::storage::probability_type> 
+        num_dice{ dice::constant_tag{}, 1 }, num_faces;
 
     auto a = dice::make<dice::type_rand_var>(num_dice);
     auto b = dice::make<dice::type_rand_var>(num_faces);
@@ -264,7 +370,7 @@ TEST_CASE("Roll function throws an error if dice count is not positive integer",
     dice::environment env;
     dice::decomposition<
         dice::storage::int_type, 
-        dice::storage::real_type> num_dice{ dice::constant_tag{}, 0 }, 
+        dice::storage::probability_type> num_dice{ dice::constant_tag{}, 0 }, 
                                     num_faces{ dice::constant_tag{}, 1 };
 
     auto a = dice::make<dice::type_rand_var>(num_dice);
@@ -277,7 +383,7 @@ TEST_CASE("Roll function throws an error if face count is not positive integer",
     dice::environment env;
     dice::decomposition<
         dice::storage::int_type, 
-        dice::storage::real_type> num_dice{ dice::constant_tag{}, 1 }, 
+        dice::storage::probability_type> num_dice{ dice::constant_tag{}, 1 }, 
                                     num_faces{ dice::constant_tag{}, 0 };
 
     auto a = dice::make<dice::type_rand_var>(num_dice);
@@ -309,4 +415,160 @@ TEST_CASE("Preserve a valid state even if user function throws an exception", "[
         auto int_value = dynamic_cast<type_int&>(*result).data();
         REQUIRE((int_value == 7));
     }
-}
\ No newline at end of file
+}
+TEST_CASE("Call max function with more than 2 arguments", "[environment]")
+{
+    dice::environment env;
+    auto a = dice::make<dice::type_rand_var>(freq_list{
+        std::make_pair(1, 1),
+        std::make_pair(2, 1)
+    });
+    auto b = dice::make<dice::type_rand_var>(freq_list{
+        std::make_pair(1, 1),
+        std::make_pair(2, 1)
+    });
+    auto c = dice::make<dice::type_int>(0);
+
+    auto result = env.call("max", std::move(a), std::move(b), std::move(c));
+    REQUIRE(result->type() == dice::type_rand_var::id());
+
+    auto rand_var_result = dynamic_cast<dice::type_rand_var*>(result.get());
+    auto var = rand_var_result->data().to_random_variable();
+    REQUIRE(var.probability(1) == Approx(1 / 4.0));
+    REQUIRE(var.probability(2) == Approx(3 / 4.0));
+}
+
+TEST_CASE("Call min function with more than 2 int arguments", "[environment]")
+{
+    dice::environment env;
+    auto result = env.call("min", 
+        dice::make<dice::type_int>(4), 
+        dice::make<dice::type_int>(2),
+        dice::make<dice::type_int>(3));
+    REQUIRE(result->type() == dice::type_int::id());
+
+    auto int_result = dynamic_cast<dice::type_int*>(result.get());
+    REQUIRE((int_result->data() == 2));
+}
+
+TEST_CASE("Variadic function requires minimal number of arguments", "[environment]")
+{
+    dice::environment env;
+    REQUIRE_THROWS_AS(
+        env.call("max", dice::make<dice::type_int>(1)), 
+        dice::compiler_error);
+}
+
+TEST_CASE("Simplify variables whose dependencies are not shared", "[environment]")
+{
+    using decomposition_type = dice::storage::random_variable_type;
+    dice::environment env;
+    decomposition_type x{ freq_list{
+        std::make_pair(1, 1),
+        std::make_pair(2, 1),
+    } };
+    decomposition_type z{ freq_list{
+        std::make_pair(1, 1),
+        std::make_pair(2, 1),
+        std::make_pair(3, 1),
+    } };
+    x = x.compute_decomposition();
+    z = z.compute_decomposition();
+    auto sum = x + z;
+    auto expected = sum.to_random_variable();
+
+    env.set_var("x", dice::make<dice::type_rand_var>(x));
+    env.set_var("z", dice::make<dice::type_rand_var>(z));
+    env.set_var("y", dice::make<dice::type_rand_var>(std::move(sum)));
+    x = decomposition_type{};
+    z = decomposition_type{};
+
+    auto y = dynamic_cast<dice::type_rand_var*>(env.get_var("y"));
+    REQUIRE(y->data().dependency_count() == 2);
+
+    // z still shares a dependency with y
+    env.set_var("x", dice::make<dice::type_int>(1));
+    REQUIRE(y->data().dependency_count() == 2);
+
+    env.set_var("z", dice::make<dice::type_int>(1));
+    REQUIRE(y->data().dependency_count() == 1);
+    REQUIRE(y->data().size() == expected.size());
+    REQUIRE(y->data().to_random_variable() == expected);
+}
+
+TEST_CASE("Call a function by its id", "[environment]")
+{
+    dice::environment env;
+    REQUIRE(env.find_function("undefined") == dice::environment::no_function);
+
+    auto id = env.find_function("+");
+    REQUIRE(id != dice::environment::no_function);
+    REQUIRE(env.find_function("+") == id);
+
+    auto result = env.call(id, 
+        dice::make<dice::type_int>(1), 
+        dice::make<dice::type_int>(2));
+    auto int_result = dynamic_cast<dice::type_int*>(result.get());
+    REQUIRE(int_result != nullptr);
+    REQUIRE((int_result->data() == 3));
+
+    // the same id with different argument types
+    result = env.call(id, 
+        dice::make<dice::type_int>(1), 
+        dice::make<dice::type_real>(2.5));
+    auto real_result = dynamic_cast<dice::type_real*>(result.get());
+    REQUIRE(real_result != nullptr);
+    REQUIRE(real_result->data() == Approx(3.5));
+}
+
+TEST_CASE("Adding an overload changes the chosen function", "[environment]")
+{
+    using fn = dice::execution_context;
+    dice::environment env;
+    env.add_function("f", {
+        [](fn::context_type&) { return dice::make<dice::type_int>(1); },
+        { dice::type_real::id() }
+    });
+
+    auto call_f = [&]()
+    {
+        auto result = env.call("f", dice::make<dice::type_int>(0));
+        return dynamic_cast<dice::type_int*>(result.get())->data();
+    };
+    REQUIRE((call_f() == 1));
+    REQUIRE((call_f() == 1));
+
+    env.add_function("f", {
+        [](fn::context_type&) { return dice::make<dice::type_int>(2); },
+        { dice::type_int::id() }
+    });
+    REQUIRE((call_f() == 2));
+
+    // failed resolutions are reported every time
+    for (int i = 0; i < 2; ++i)
+    {
+        REQUIRE_THROWS_AS(env.call("f", dice::make<dice::type_rand_var>(
+            dice::constant_tag{}, 1)), dice::compiler_error);
+    }
+}
+
+TEST_CASE("Operators don't copy shared random variables", "[environment]")
+{
+    dice::environment env;
+    env.set_var("x", dice::make<dice::type_rand_var>(freq_list{
+        std::make_pair(1, 1),
+        std::make_pair(2, 1)
+    }));
+    const dice::base_value& x = *env.get_var("x");
+    auto&& x_data = dynamic_cast<const dice::type_rand_var&>(x).data();
+
+    auto result = env.call("+", x.clone(), x.clone());
+    auto&& sum = dynamic_cast<const dice::type_rand_var&>(*result).data();
+    REQUIRE(sum.to_random_variable().probability(3) == Approx(0.5));
+
+    // the variable has not been modified or detached
+    auto&& current = dynamic_cast<const dice::type_rand_var&>(
+        *env.get_var("x")).data();
+    REQUIRE(&current == &x_data);
+    REQUIRE(current.to_random_variable().probability(1) == Approx(0.5));
+}
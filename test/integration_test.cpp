@@ -5,10 +5,15 @@
 #include "direct_interpreter.hpp"
 #include "environment.hpp"
 #include "value.hpp"
+#include "calculator.hpp"
+#include "pruning.hpp"
 
+#include <limits>
 #include <memory>
+#include <algorithm>
 #include <sstream>
 #include <string>
+#include <thread>
 
 namespace 
 {
@@ -762,6 +767,33 @@ TEST_CASE("Interpret quantile function call", "[dice]")
     REQUIRE((data == 2));
 }
 
+TEST_CASE("Interpret keep highest and keep lowest function calls", "[dice]")
+{
+    auto result = interpret("keep_highest(4, 6, 3); keep_lowest(2, 20, 1)");
+
+    REQUIRE(result.values.size() == 2);
+    result.assert_no_error();
+
+    auto&& highest = dynamic_cast<dice::type_rand_var&>(*result.values[0]);
+    auto var = highest.data().to_random_variable();
+    REQUIRE(var.probability(3) == Approx(1 / 1296.0));
+    REQUIRE(var.probability(18) == Approx(21 / 1296.0));
+
+    auto&& lowest = dynamic_cast<dice::type_rand_var&>(*result.values[1]);
+    var = lowest.data().to_random_variable();
+    REQUIRE(var.probability(1) == Approx(39 / 400.0));
+    REQUIRE(var.probability(20) == Approx(1 / 400.0));
+}
+
+TEST_CASE("Keep function with a negative number of kept dice", "[dice]")
+{
+    auto result = interpret("keep_highest(4, 6, -1)");
+
+    REQUIRE(result.values.size() == 1);
+    result.assert_error("Number of kept dice has to be a "
+        "non-negative integer, got -1");
+}
+
 TEST_CASE("Interpret variable names in dice roll operator", "[dice]")
 {
     auto result = interpret("var X = 1d2; var Y = X d X; Y + Y");
@@ -797,3 +829,283 @@ TEST_CASE("Interpret division by zero", "[dice]")
     auto data = dynamic_cast<dice::type_int&>(*value).data();
     REQUIRE((data == 0));
 }
+
+TEST_CASE("Evaluate scripts in different calculators concurrently", "[dice]")
+{
+    const std::string script = 
+        "var x = 1d6 + 1d4;"
+        "var y = x * 2 + (x in [3, 5]);"
+        "expectation(x * y)";
+    auto evaluate = [&]()
+    {
+        dice::calculator calc{ 1 };
+        auto values = calc.evaluate(script);
+        auto&& value = dynamic_cast<dice::type_real&>(*values.back());
+        return value.data();
+    };
+
+    auto expected = evaluate();
+
+    std::vector<double> results(4, 0);
+    std::vector<std::thread> threads;
+    for (std::size_t i = 0; i < results.size(); ++i)
+    {
+        threads.emplace_back([&, i]()
+        {
+            for (int j = 0; j < 8; ++j)
+            {
+                results[i] = evaluate();
+            }
+        });
+    }
+
+    for (auto&& thread : threads)
+    {
+        thread.join();
+    }
+
+    for (auto&& result : results)
+    {
+        REQUIRE(result == Approx(expected));
+    }
+}
+
+TEST_CASE("Evaluate a prepared script with different parameters", "[dice]")
+{
+    std::stringstream errors;
+    dice::calculator calc{ 1 };
+    calc.log = dice::logger{ &errors, true };
+
+    auto script = calc.prepare("var y = x * 2 + 1; expectation(y + 1d4); y");
+    REQUIRE(script.size() == 3);
+    REQUIRE(errors.str().empty());
+
+    // unknown variable is reported when the plan is evaluated
+    auto values = calc.execute(script);
+    REQUIRE(errors.str() == "Unknown variable 'x'\n");
+    errors.str("");
+
+    calc.enable_interactive_mode();
+    for (int x : { 1, 5, 9 })
+    {
+        calc.env.set_var("x", dice::make<dice::type_int>(x));
+        values = calc.execute(script);
+        REQUIRE(values.size() == 3);
+        REQUIRE(values[0] == nullptr);
+
+        auto&& mean = dynamic_cast<dice::type_real&>(*values[1]).data();
+        REQUIRE(mean == Approx(x * 2 + 1 + 2.5));
+
+        auto&& y = dynamic_cast<dice::type_int&>(*values[2]).data();
+        REQUIRE((y == x * 2 + 1));
+    }
+    REQUIRE(errors.str().empty());
+}
+
+TEST_CASE("Reuse values of repeated subexpressions", "[dice]")
+{
+    std::stringstream errors;
+    dice::calculator calc{ 1 };
+    calc.log = dice::logger{ &errors, true };
+
+    auto values = calc.evaluate(
+        "max(1d20, 1d20) + max(1d20, 1d20); var x = 1d4; x + 1d20");
+    REQUIRE(errors.str().empty());
+
+    // 1d20, max(1d20, 1d20), the sum and 1d4 are cached
+    REQUIRE(calc.cache.size() == 4);
+
+    // repeated terms are still independent
+    auto expected = interpret("max(1d20, 1d20) + max(1d20, 1d20)");
+    auto&& actual_var = dynamic_cast<dice::type_rand_var&>(*values[0])
+        .data().to_random_variable();
+    auto&& expected_var = dynamic_cast<dice::type_rand_var&>(
+        *expected.values[0]).data().to_random_variable();
+    REQUIRE(actual_var == expected_var);
+
+    // errors are reported whenever the expression is evaluated
+    calc.evaluate("1 / 0");
+    calc.evaluate("1 / 0");
+    REQUIRE(errors.str() == "Division by Zero\nDivision by Zero\n");
+
+    calc.cache.clear();
+    REQUIRE(calc.cache.size() == 0);
+}
+
+TEST_CASE("Cached values depend on the pruning policy and fit the capacity", "[dice]")
+{
+    std::stringstream errors;
+    dice::calculator calc{ 1 };
+    calc.log = dice::logger{ &errors, true };
+
+    auto values = calc.evaluate("max(3d6, 3d6)");
+    REQUIRE(calc.cache.size() == 2);
+    auto size = dynamic_cast<dice::type_rand_var&>(*values[0]).data()
+        .to_random_variable().size();
+
+    // values computed with a different policy are not reused
+    auto max_size = dice::pruning::max_size;
+    dice::pruning::max_size = 5;
+    values = calc.evaluate("max(3d6, 3d6)");
+    dice::pruning::max_size = max_size;
+    REQUIRE(errors.str().empty());
+    REQUIRE(calc.cache.size() == 4);
+    REQUIRE(dynamic_cast<dice::type_rand_var&>(*values[0]).data()
+        .to_random_variable().size() < size);
+
+    // values which don't fit are not cached
+    REQUIRE(calc.cache.memory_size() > 0);
+    calc.cache.clear();
+    calc.cache.capacity = 64;
+    calc.evaluate("max(3d6, 3d6)");
+    REQUIRE(calc.cache.size() == 0);
+    REQUIRE(calc.cache.memory_size() == 0);
+}
+
+TEST_CASE("Fold constant subexpressions when a script is prepared", "[dice]")
+{
+    std::stringstream errors;
+    dice::calculator calc{ 1 };
+    calc.log = dice::logger{ &errors, true };
+
+    auto script = calc.prepare(
+        "(1 + 2) * 3; 10 / 4.0; 1d6 in [2 * 1, 3 * 2]; 2147483647 + 1");
+    REQUIRE(errors.str().empty());
+
+    // only the roll, the in operator and the overflowing sum are left
+    REQUIRE(script.node_count() == 1 + 1 + 6 + 3);
+
+    auto values = calc.execute(script);
+    REQUIRE(values.size() == 4);
+    REQUIRE((dynamic_cast<dice::type_int&>(*values[0]).data() == 9));
+    REQUIRE(dynamic_cast<dice::type_real&>(*values[1]).data() == 2.5);
+
+    auto&& var = dynamic_cast<dice::type_rand_var&>(*values[2])
+        .data().to_random_variable();
+    REQUIRE(var.probability(1) == Approx(5 / 6.0));
+
+    // overflow is reported when the script is evaluated
+    REQUIRE(errors.str() == "Overflow\n");
+    REQUIRE((dynamic_cast<dice::type_int&>(*values[3]).data() == 0));
+}
+
+TEST_CASE("Detect scripts which call functions with side effects", "[dice]")
+{
+    dice::calculator calc{ 1 };
+
+    REQUIRE(calc.prepare("var X = 2d6; max(X, 3) + 1d4").is_deterministic());
+    REQUIRE(calc.prepare("expectation(1d6 + 1)").is_deterministic());
+    REQUIRE(!calc.prepare("1 + roll(1d6)").is_deterministic());
+    REQUIRE(!calc.prepare("1d6; max(1, roll(1d6, 2))").is_deterministic());
+}
+
+TEST_CASE("Redefined variables update definitions which use them", "[dice]")
+{
+    std::stringstream errors;
+    dice::calculator calc{ 1 };
+    calc.log = dice::logger{ &errors, true };
+    calc.enable_interactive_mode();
+
+    calc.evaluate("var X = 1d6; var Y = X + 1; var Z = 2 * Y; var W = X");
+    calc.evaluate("var W = 1");
+    calc.evaluate("var X = 1d4");
+    REQUIRE(calc.env.is_stale("Y"));
+    REQUIRE(calc.env.is_stale("Z"));
+    REQUIRE(!calc.env.is_stale("W"));
+
+    auto values = calc.evaluate("expectation(Z); Z - 2 * Y; W");
+    REQUIRE(errors.str().empty());
+    REQUIRE(values.size() == 3);
+    REQUIRE(dynamic_cast<dice::type_real&>(*values[0]).data() == 
+        Approx(2 * 3.5));
+
+    // Z still depends on Y
+    auto&& difference = dynamic_cast<dice::type_rand_var&>(*values[1])
+        .data().to_random_variable();
+    REQUIRE((difference.probability(0) == Approx(1)));
+    REQUIRE((dynamic_cast<dice::type_int&>(*values[2]).data() == 1));
+
+    // a definition which uses its old value is computed once
+    calc.evaluate("var A = 1; var A = A + 1; var X = 2");
+    values = calc.evaluate("A; Y");
+    REQUIRE((dynamic_cast<dice::type_int&>(*values[0]).data() == 2));
+    REQUIRE((dynamic_cast<dice::type_int&>(*values[1]).data() == 3));
+}
+
+TEST_CASE("Compute moments of expressions without their distribution", "[dice]")
+{
+    std::stringstream errors;
+    dice::calculator calc{ 1 };
+    calc.log = dice::logger{ &errors, true };
+
+    // moments are computed in double but the distribution is computed in
+    // the probability type
+    auto tolerance = std::max(1e-5, static_cast<double>(
+        std::numeric_limits<dice::storage::probability_type>::epsilon() *
+        1000));
+
+    for (std::string expr : {
+        "100d100 * 3 + 50d20", "(1d4)d6 * 1d3 - 2", "-(2d6 - 3d4)" })
+    {
+        // the distribution of a variable has to be computed
+        auto values = calc.evaluate(
+            "var X = " + expr + "; expectation(" + expr + "); " + 
+            "expectation(X); variance(" + expr + "); variance(X); " +
+            "deviation(" + expr + "); deviation(X)");
+        REQUIRE(values.size() == 7);
+        for (std::size_t i = 1; i < values.size(); i += 2)
+        {
+            auto&& moment = dynamic_cast<dice::type_real&>(*values[i]).data();
+            auto&& exact = dynamic_cast<dice::type_real&>(*values[i + 1])
+                .data();
+            REQUIRE(moment == Approx(exact).epsilon(tolerance));
+        }
+        calc.env.clear_variables();
+    }
+
+    // the distribution is computed if it would be pruned
+    auto max_size = dice::pruning::max_size;
+    dice::pruning::max_size = 5;
+    auto pruned = calc.evaluate(
+        "var X = 10 d 6; expectation(10 d 6); expectation(X + 0); " 
+        "variance(X)");
+    dice::pruning::max_size = max_size;
+    calc.env.clear_variables();
+    REQUIRE(pruned.size() == 4);
+    auto&& shortcut = dynamic_cast<dice::type_real&>(*pruned[1]).data();
+    auto&& computed = dynamic_cast<dice::type_real&>(*pruned[2]).data();
+    auto&& variance = dynamic_cast<dice::type_real&>(*pruned[3]).data();
+    REQUIRE(shortcut == Approx(computed));
+
+    // moments are normalized by the probability which has not been pruned
+    REQUIRE(computed == Approx(35));
+    REQUIRE(variance > 0);
+    REQUIRE(variance <= 4);
+    REQUIRE(errors.str().empty());
+
+    // an expression which would overflow is still reported
+    calc.evaluate("expectation(1d6 * 2147483647 * 2)");
+    REQUIRE(errors.str() == "Overflow\n");
+}
+
+TEST_CASE("Limit memory of values computed by a calculator", "[dice]")
+{
+    std::stringstream errors;
+    dice::calculator calc{ 1 };
+    calc.log = dice::logger{ &errors, true };
+
+    calc.evaluate("10d10 + 1");
+    auto largest = calc.largest_value_memory();
+    REQUIRE(largest >= 91 * sizeof(dice::storage::probability_type));
+    REQUIRE(errors.str().empty());
+
+    calc.limits.max_bytes = largest - 1;
+    calc.evaluate("10d10 + 2");
+    REQUIRE(errors.str().find("exceeds the limit") != std::string::npos);
+    REQUIRE(calc.largest_value_memory() < largest);
+
+    // the largest value is measured again by each evaluation
+    calc.limits.max_bytes = 0;
+    calc.evaluate("1d6");
+    REQUIRE(calc.largest_value_memory() < largest);
+}
@@ -4,6 +4,8 @@
 #include "value.hpp"
 
 #include <sstream>
+#include <string>
+#include <vector>
 
 namespace 
 {
@@ -395,4 +397,44 @@ TEST_CASE("Lexer won't crash for any input character", "[lexer]")
         auto token = lex.read_token();
         REQUIRE(token.type == dice::symbol_type::end);
     }
-}
\ No newline at end of file
+}
+TEST_CASE("Buffer lexer finds the same tokens as the stream lexer", "[lexer]")
+{
+    std::vector<std::string> inputs{
+        "",
+        " \t\n<=<!===>>=in\n",
+        " \t \t\nd di D Da D6\t",
+        "var x_1 = 1.5 * max(2d6, 3) // comment\n; x_1 in [1, 2]",
+        "1.2.3 3. 20000000000000000000000 $ id  \n (",
+    };
+    for (int i = 1; i < 256; ++i)
+    {
+        inputs.push_back("a" + std::string(1, static_cast<char>(i)) + "b");
+    }
+
+    for (auto&& input : inputs)
+    {
+        auto lex = make_lexer(input);
+        logger_mock logger;
+        dice::buffer_lexer<logger_mock> buffer{ input, &logger };
+
+        for (;;)
+        {
+            auto expected = lex.read_token();
+            auto token = buffer.read_token();
+            REQUIRE(token.type == expected.type);
+            REQUIRE(token.lexeme == expected.lexeme);
+            REQUIRE(buffer.location().line == lex.lexer.location().line);
+            REQUIRE(buffer.location().col == lex.lexer.location().col);
+            if (token.type == dice::symbol_type::end)
+                break;
+        }
+
+        REQUIRE(logger.errors().size() == lex.errors().size());
+        for (std::size_t i = 0; i < logger.errors().size(); ++i)
+        {
+            REQUIRE(logger.errors()[i].col == lex.errors()[i].col);
+            REQUIRE(logger.errors()[i].message == lex.errors()[i].message);
+        }
+    }
+}
@@ -36,6 +36,8 @@ public:
 
     void enter_assign() {}
 
+    void set_location(const dice::lexer_location&) {}
+
     value_type make_default()
     {
         return "<DEFAULT>";
@@ -0,0 +1,86 @@
+#include "catch.hpp"
+#include "profiler.hpp"
+#include "calculator.hpp"
+
+#include <sstream>
+
+#ifndef DISABLE_PROFILER
+
+TEST_CASE("Profiler is only used in its scope", "[profiler]")
+{
+    dice::profiler profile;
+    REQUIRE(dice::profiler::current() == nullptr);
+    {
+        dice::profiler::scope scope{ &profile };
+        REQUIRE(dice::profiler::current() == &profile);
+
+        dice::profiler::count_allocation();
+        {
+            dice::profiler::scope disabled{ nullptr };
+            REQUIRE(dice::profiler::current() == nullptr);
+            dice::profiler::count_allocation();
+        }
+        REQUIRE(dice::profiler::current() == &profile);
+
+        dice::profiler::measurement measure{ &profile };
+        dice::profiler::count_allocation();
+        auto value = measure.stop(&profile);
+        REQUIRE(value.calls == 1);
+        REQUIRE(value.allocations == 1);
+    }
+    REQUIRE(dice::profiler::current() == nullptr);
+}
+
+TEST_CASE("Accumulate counters of an operation", "[profiler]")
+{
+    dice::profiler profile;
+    dice::profiler::counters value;
+    value.calls = 1;
+    value.input_size = 12;
+    value.output_size = 11;
+    value.max_leaves = 2;
+    profile.record_call("+", value);
+    value.max_leaves = 1;
+    profile.record_call("+", value);
+
+    auto&& counters = profile.functions().at("+");
+    REQUIRE(counters.calls == 2);
+    REQUIRE(counters.input_size == 24);
+    REQUIRE(counters.output_size == 22);
+    REQUIRE(counters.max_leaves == 2);
+
+    profile.clear();
+    REQUIRE(profile.functions().empty());
+}
+
+TEST_CASE("Calculator profiles functions and locations of a script", "[profiler]")
+{
+    std::stringstream errors;
+    dice::calculator calc{ 1 };
+    calc.log = dice::logger{ &errors };
+
+    calc.evaluate("1d6 + 2");
+    REQUIRE(calc.profile().functions().empty());
+
+    calc.profiling = true;
+    calc.evaluate("var x = 1d8;\nx + x");
+    REQUIRE(errors.str().empty());
+
+    auto&& functions = calc.profile().functions();
+    REQUIRE(functions.at("roll_op").calls == 1);
+    REQUIRE(functions.at("roll_op").allocations > 0);
+    // both arguments have 8 values (x + x is 2 * x)
+    REQUIRE(functions.at("+").input_size == 16);
+    REQUIRE(functions.at("+").output_size == 8);
+
+    auto&& locations = calc.profile().locations();
+    REQUIRE(locations.count(dice::profiler::location{ 0, 9, "d" }) == 1);
+    REQUIRE(locations.count(dice::profiler::location{ 1, 2, "+" }) == 1);
+
+    std::stringstream output;
+    calc.profile().report(output);
+    REQUIRE(output.str().find("Hottest functions") != std::string::npos);
+    REQUIRE(output.str().find("Hottest locations") != std::string::npos);
+}
+
+#endif // DISABLE_PROFILER
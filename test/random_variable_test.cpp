@@ -1,8 +1,67 @@
 #include "catch.hpp"
 #include "random_variable.hpp"
+#include "safe.hpp"
+#include "sample_engine.hpp"
+
+#include <map>
+#include <limits>
+#include <vector>
+#include <algorithm>
 
 using freq_list = dice::random_variable<int, double>::frequency_list;
 
+namespace
+{
+    // compute a distribution with probabilities of type T
+    template<typename T>
+    dice::random_variable<int, T> compute_sum_of_rolls()
+    {
+        using var_type = dice::random_variable<int, T>;
+        auto a = roll(
+            var_type{ dice::constant_tag{}, 100 },
+            var_type{ dice::constant_tag{}, 100 });
+        auto b = roll(
+            var_type{ dice::constant_tag{}, 50 },
+            var_type{ dice::constant_tag{}, 20 });
+        return a * var_type{ dice::constant_tag{}, 3 } + b;
+    }
+
+    // compare a distribution with probabilities of type T with the same
+    // distribution computed in double
+    template<typename T>
+    void check_accuracy()
+    {
+        auto exact = compute_sum_of_rolls<double>();
+        auto value = compute_sum_of_rolls<T>();
+        // the result in double has an error as well (mostly from the FFT)
+        auto tolerance = std::max(
+            static_cast<double>(std::numeric_limits<T>::epsilon()) * 100,
+            std::numeric_limits<double>::epsilon() * 1000);
+
+        // values with a negligible probability may be rounded to 0
+        for (auto&& pair : exact)
+        {
+            auto probability = static_cast<double>(
+                value.probability(pair.first));
+            REQUIRE(probability == Approx(pair.second).margin(tolerance));
+        }
+
+        for (auto&& pair : value)
+        {
+            auto probability = static_cast<double>(pair.second);
+            REQUIRE(probability == 
+                Approx(exact.probability(pair.first)).margin(tolerance));
+        }
+
+        // 100d100 * 3 + 50d20
+        auto relative = std::max(tolerance, 1e-8);
+        REQUIRE(static_cast<double>(value.expected_value()) == 
+            Approx(15675).epsilon(relative));
+        REQUIRE(static_cast<double>(value.variance()) == 
+            Approx(9 * 83325 + 50 * 33.25).epsilon(relative));
+    }
+}
+
 TEST_CASE("Compute distribution of a single dice roll", "[random_variable]")
 {
     dice::random_variable<int, double> num_dice{ dice::constant_tag{}, 1 };
@@ -419,4 +478,682 @@ TEST_CASE("roll() throws std::invalid_argument if an argument contains 0 value",
     REQUIRE_THROWS_AS(roll(one, zero), std::invalid_argument);
     REQUIRE_THROWS_AS(roll(zero, zero), std::invalid_argument);
     REQUIRE_NOTHROW(roll(one, one));
-}
\ No newline at end of file
+}
+TEST_CASE("Random variable with a compact range uses the dense storage", "[random_variable]")
+{
+    dice::random_variable<int, double> num_dice{ dice::constant_tag{}, 3 };
+    dice::random_variable<int, double> num_sides{ dice::constant_tag{}, 6 };
+
+    auto dist = roll(num_dice, num_sides);
+    REQUIRE(dist.is_dense());
+    REQUIRE(dist.size() == 16);
+    REQUIRE(dist.min_value() == 3);
+    REQUIRE(dist.max_value() == 18);
+
+    // values are iterated in ascending order
+    int expected = 3;
+    for (auto&& pair : dist)
+    {
+        REQUIRE(pair.first == expected++);
+        REQUIRE(pair.second > 0);
+    }
+    REQUIRE(expected == 19);
+}
+
+TEST_CASE("Random variable with values spread over a large range uses the sparse storage", "[random_variable]")
+{
+    dice::random_variable<int, double> var{ freq_list{
+        std::make_pair(-1000000, 1),
+        std::make_pair(1, 2),
+        std::make_pair(1000000, 1),
+    } };
+
+    REQUIRE(!var.is_dense());
+    REQUIRE(var.size() == 3);
+    REQUIRE(var.min_value() == -1000000);
+    REQUIRE(var.max_value() == 1000000);
+    REQUIRE(var.probability(1) == Approx(0.5));
+    REQUIRE(var.probability(2) == 0);
+
+    auto sum = var + var;
+    REQUIRE(!sum.is_dense());
+    REQUIRE(sum.size() == 6);
+    REQUIRE(sum.probability(0) == Approx(2 / 16.0));
+    REQUIRE(sum.probability(2) == Approx(4 / 16.0));
+    REQUIRE(sum.probability(1000001) == Approx(4 / 16.0));
+}
+
+TEST_CASE("Combine a dense and a sparse random variable", "[random_variable]")
+{
+    dice::random_variable<int, double> sparse{ freq_list{
+        std::make_pair(0, 1),
+        std::make_pair(1000, 1),
+    } };
+    dice::random_variable<int, double> dense{ freq_list{
+        std::make_pair(1, 1),
+        std::make_pair(2, 1),
+    } };
+
+    auto result = sparse + dense;
+    REQUIRE(result.size() == 4);
+    REQUIRE(result.probability(1) == Approx(0.25));
+    REQUIRE(result.probability(2) == Approx(0.25));
+    REQUIRE(result.probability(1001) == Approx(0.25));
+    REQUIRE(result.probability(1002) == Approx(0.25));
+
+    auto indicator = sparse.less_than(dense);
+    REQUIRE(indicator.is_dense());
+    REQUIRE(indicator.probability(0) == Approx(0.5));
+    REQUIRE(indicator.probability(1) == Approx(0.5));
+}
+
+TEST_CASE("Dense storage doesn't contain values with zero probability", "[random_variable]")
+{
+    dice::random_variable<int, double> a{ freq_list{
+        std::make_pair(1, 1),
+        std::make_pair(3, 1),
+    } };
+    dice::random_variable<int, double> b{ freq_list{
+        std::make_pair(1, 1),
+        std::make_pair(3, 1),
+    } };
+
+    auto result = a - b;
+    REQUIRE(result.size() == 3);
+    REQUIRE(result.probability(-2) == Approx(0.25));
+    REQUIRE(result.probability(-1) == 0);
+    REQUIRE(result.probability(0) == Approx(0.5));
+    REQUIRE(result.probability(1) == 0);
+    REQUIRE(result.probability(2) == Approx(0.25));
+    REQUIRE(std::distance(result.begin(), result.end()) == 3);
+
+    auto negated = -a;
+    REQUIRE(negated.min_value() == -3);
+    REQUIRE(negated.max_value() == -1);
+    REQUIRE(negated.probability(-2) == 0);
+    REQUIRE(negated == dice::random_variable<int, double>{ freq_list{
+        std::make_pair(-3, 1),
+        std::make_pair(-1, 1),
+    } });
+}
+
+TEST_CASE("Compute quantile of a sparse random variable", "[random_variable]")
+{
+    dice::random_variable<int, double> var{ freq_list{
+        std::make_pair(1000000, 1),
+        std::make_pair(-5, 2),
+        std::make_pair(0, 1),
+    } };
+    REQUIRE(!var.is_dense());
+
+    REQUIRE(var.quantile(0) == -5);
+    REQUIRE(var.quantile(0.5) == -5);
+    REQUIRE(var.quantile(0.6) == 0);
+    REQUIRE(var.quantile(0.75) == 0);
+    REQUIRE(var.quantile(0.8) == 1000000);
+    REQUIRE(var.quantile(1) == 1000000);
+    REQUIRE(var.random_value(0.7) == 0);
+
+    // copies share the cached table
+    auto copy = var;
+    REQUIRE(copy.quantile(0.6) == 0);
+}
+
+TEST_CASE("Sample values using the alias method", "[random_variable]")
+{
+    dice::random_variable<int, double> var{ freq_list{
+        std::make_pair(1, 1),
+        std::make_pair(2, 2),
+        std::make_pair(4, 5),
+    } };
+
+    std::default_random_engine engine{ 42 };
+    std::map<int, int> count;
+    const int sample_count = 20000;
+    for (int i = 0; i < sample_count; ++i)
+    {
+        ++count[var.sample(engine)];
+    }
+
+    REQUIRE(count.size() == 3);
+    REQUIRE(count[1] + count[2] + count[4] == sample_count);
+    REQUIRE(count[1] / static_cast<double>(sample_count) == 
+        Approx(1 / 8.0).epsilon(0.1));
+    REQUIRE(count[2] / static_cast<double>(sample_count) == 
+        Approx(2 / 8.0).epsilon(0.1));
+    REQUIRE(count[4] / static_cast<double>(sample_count) == 
+        Approx(5 / 8.0).epsilon(0.1));
+}
+
+TEST_CASE("Sample a batch of values using the alias method", "[random_variable]")
+{
+    dice::random_variable<int, double> var{ freq_list{
+        std::make_pair(1, 1),
+        std::make_pair(2, 2),
+        std::make_pair(4, 5),
+    } };
+
+    dice::sample_engine engine{ 42 };
+    std::vector<int> values(20000);
+    var.sample_batch(engine, values.begin(), values.end());
+
+    std::map<int, int> count;
+    for (auto&& value : values)
+    {
+        ++count[value];
+    }
+    REQUIRE(count.size() == 3);
+    REQUIRE(count[1] / static_cast<double>(values.size()) == 
+        Approx(1 / 8.0).epsilon(0.1));
+    REQUIRE(count[2] / static_cast<double>(values.size()) == 
+        Approx(2 / 8.0).epsilon(0.1));
+    REQUIRE(count[4] / static_cast<double>(values.size()) == 
+        Approx(5 / 8.0).epsilon(0.1));
+
+    // the same seed generates the same values
+    dice::sample_engine same{ 42 };
+    std::vector<int> other(values.size());
+    var.sample_batch(same, other.begin(), other.end());
+    REQUIRE(other == values);
+}
+
+TEST_CASE("Comparison indicators agree with the combination of all pairs", "[random_variable]")
+{
+    using var_type = dice::random_variable<int, double>;
+    var_type sparse{ freq_list{
+        std::make_pair(-1000, 1),
+        std::make_pair(2, 3),
+        std::make_pair(5, 1),
+        std::make_pair(1000, 2),
+    } };
+    auto dense = roll(var_type{ dice::constant_tag{}, 2 }, 
+        var_type{ dice::constant_tag{}, 4 });
+
+    auto check = [](auto&& actual, auto&& expected)
+    {
+        REQUIRE(actual.size() == expected.size());
+        for (auto&& pair : expected)
+        {
+            REQUIRE(actual.probability(pair.first) == Approx(pair.second));
+        }
+    };
+
+    for (auto&& pair : { std::make_pair(sparse, dense), 
+        std::make_pair(dense, sparse), 
+        std::make_pair(dense, dense),
+        std::make_pair(sparse, sparse) })
+    {
+        auto&& x = pair.first;
+        auto&& y = pair.second;
+        check(x.less_than(y), x.combine(y, [](auto a, auto b) 
+        { 
+            return static_cast<int>(a < b); 
+        }));
+        check(x.less_than_or_equal(y), x.combine(y, [](auto a, auto b) 
+        { 
+            return static_cast<int>(a <= b); 
+        }));
+        check(x.equal(y), x.combine(y, [](auto a, auto b) 
+        { 
+            return static_cast<int>(a == b); 
+        }));
+        check(x.not_equal(y), x.combine(y, [](auto a, auto b) 
+        { 
+            return static_cast<int>(a != b); 
+        }));
+        check(x.greater_than(y), x.combine(y, [](auto a, auto b) 
+        { 
+            return static_cast<int>(a > b); 
+        }));
+        check(x.greater_than_or_equal(y), x.combine(y, [](auto a, auto b) 
+        { 
+            return static_cast<int>(a >= b); 
+        }));
+    }
+}
+
+TEST_CASE("Comparison keeps small probabilities", "[random_variable]")
+{
+    using var_type = dice::random_variable<int, double>;
+    auto x = roll(var_type{ dice::constant_tag{}, 20 }, 
+        var_type{ dice::constant_tag{}, 6 });
+    var_type y{ dice::constant_tag{}, 21 };
+
+    // P(20d6 < 21) = P(20d6 = 20) = 6^-20
+    auto indicator = x.less_than(y);
+    REQUIRE(indicator.probability(1) == Approx(std::pow(6.0, -20)));
+    REQUIRE(indicator.probability(0) == Approx(1));
+}
+
+TEST_CASE("Maximum and minimum agree with the combination of all pairs", "[random_variable]")
+{
+    using var_type = dice::random_variable<int, double>;
+    var_type sparse{ freq_list{
+        std::make_pair(-1000, 1),
+        std::make_pair(2, 3),
+        std::make_pair(5, 1),
+        std::make_pair(1000, 2),
+    } };
+    auto dense = roll(var_type{ dice::constant_tag{}, 2 }, 
+        var_type{ dice::constant_tag{}, 4 });
+
+    auto check = [](auto&& actual, auto&& expected)
+    {
+        REQUIRE(actual.size() == expected.size());
+        for (auto&& pair : expected)
+        {
+            REQUIRE(actual.probability(pair.first) == Approx(pair.second));
+        }
+    };
+
+    for (auto&& pair : { std::make_pair(sparse, dense), 
+        std::make_pair(dense, sparse), 
+        std::make_pair(dense, dense),
+        std::make_pair(sparse, sparse) })
+    {
+        auto&& x = pair.first;
+        auto&& y = pair.second;
+        check(max(x, y), x.combine(y, [](auto a, auto b) 
+        { 
+            return std::max(a, b); 
+        }));
+        check(min(x, y), x.combine(y, [](auto a, auto b) 
+        { 
+            return std::min(a, b); 
+        }));
+    }
+}
+
+TEST_CASE("Maximum of an impossible event is an impossible event", "[random_variable]")
+{
+    using var_type = dice::random_variable<int, double>;
+    var_type impossible;
+    var_type constant{ dice::constant_tag{}, 1 };
+    REQUIRE(max(impossible, constant).empty());
+    REQUIRE(min(constant, impossible).empty());
+}
+
+TEST_CASE("Add and subtract a constant", "[random_variable]")
+{
+    using var_type = dice::random_variable<int, double>;
+    var_type dense{ freq_list{
+        std::make_pair(1, 1),
+        std::make_pair(2, 3),
+    } };
+    var_type sparse{ freq_list{
+        std::make_pair(0, 1),
+        std::make_pair(1000, 1),
+    } };
+    var_type five{ dice::constant_tag{}, 5 };
+
+    auto result = dense + five;
+    REQUIRE(result.is_dense());
+    REQUIRE(result.size() == 2);
+    REQUIRE(result.probability(6) == Approx(0.25));
+    REQUIRE(result.probability(7) == Approx(0.75));
+    REQUIRE(result == five + dense);
+
+    result = sparse - five;
+    REQUIRE(!result.is_dense());
+    REQUIRE(result.probability(-5) == Approx(0.5));
+    REQUIRE(result.probability(995) == Approx(0.5));
+
+    result = five - dense;
+    REQUIRE(result.size() == 2);
+    REQUIRE(result.probability(4) == Approx(0.25));
+    REQUIRE(result.probability(3) == Approx(0.75));
+}
+
+TEST_CASE("Multiply and divide by a constant", "[random_variable]")
+{
+    using var_type = dice::random_variable<int, double>;
+    auto dice = roll(var_type{ dice::constant_tag{}, 1 }, 
+        var_type{ dice::constant_tag{}, 6 });
+    var_type zero{ dice::constant_tag{}, 0 };
+    var_type minus_three{ dice::constant_tag{}, -3 };
+    var_type two{ dice::constant_tag{}, 2 };
+
+    auto result = dice * minus_three;
+    REQUIRE(result.size() == 6);
+    REQUIRE(result.min_value() == -18);
+    REQUIRE(result.max_value() == -3);
+    REQUIRE(result.probability(-12) == Approx(1 / 6.0));
+    REQUIRE(result.probability(-11) == 0);
+    REQUIRE(result == minus_three * dice);
+
+    result = dice * zero;
+    REQUIRE(result.is_constant());
+    REQUIRE(result.probability(0) == 1);
+
+    result = dice / two;
+    REQUIRE(result.size() == 4);
+    REQUIRE(result.probability(0) == Approx(1 / 6.0));
+    REQUIRE(result.probability(1) == Approx(2 / 6.0));
+    REQUIRE(result.probability(2) == Approx(2 / 6.0));
+    REQUIRE(result.probability(3) == Approx(1 / 6.0));
+
+    result = dice / minus_three;
+    REQUIRE(result.size() == 3);
+    REQUIRE(result.probability(0) == Approx(2 / 6.0));
+    REQUIRE(result.probability(-1) == Approx(3 / 6.0));
+    REQUIRE(result.probability(-2) == Approx(1 / 6.0));
+}
+
+TEST_CASE("Unchecked kernels report overflow using the bounds", "[random_variable]")
+{
+    using var_type = dice::random_variable<dice::safe<int>, double>;
+    using safe_freq_list = var_type::frequency_list;
+    const auto max = std::numeric_limits<int>::max();
+    var_type big{ safe_freq_list{ 
+        std::make_pair(dice::safe<int>{ 0 }, 1),
+        std::make_pair(dice::safe<int>{ max }, 1),
+    } };
+    var_type small{ safe_freq_list{ 
+        std::make_pair(dice::safe<int>{ 1 }, 1),
+        std::make_pair(dice::safe<int>{ 1000 }, 1),
+    } };
+    var_type minus{ safe_freq_list{ 
+        std::make_pair(dice::safe<int>{ -1 }, 1),
+        std::make_pair(dice::safe<int>{ -1000 }, 1),
+    } };
+
+    REQUIRE_THROWS_AS(big + small, dice::safe_int_error);
+    REQUIRE_THROWS_AS(big * small, dice::safe_int_error);
+    REQUIRE_THROWS_AS(big - minus, dice::safe_int_error);
+
+    auto quotient = big / minus;
+    REQUIRE(quotient.probability(0) == Approx(0.5));
+    REQUIRE(quotient.probability(-max) == Approx(0.25));
+    REQUIRE(quotient.probability(-max / 1000) == Approx(0.25));
+
+    auto difference = big - small;
+    REQUIRE(difference.probability(max - 1000) == Approx(0.25));
+    REQUIRE(difference.probability(-1000) == Approx(0.25));
+}
+
+namespace
+{
+    // restore the pruning policy at the end of a test
+    struct pruning_guard
+    {
+        double epsilon = dice::pruning::epsilon;
+        std::size_t max_size = dice::pruning::max_size;
+
+        ~pruning_guard()
+        {
+            dice::pruning::epsilon = epsilon;
+            dice::pruning::max_size = max_size;
+        }
+    };
+}
+
+TEST_CASE("Pruning is disabled by default", "[random_variable]")
+{
+    dice::random_variable<int, double> num_dice{ dice::constant_tag{}, 10 };
+    dice::random_variable<int, double> num_sides{ dice::constant_tag{}, 6 };
+
+    auto dist = roll(num_dice, num_sides);
+    REQUIRE(dist.size() == 51);
+    REQUIRE(dist.discarded_probability() == 0);
+}
+
+TEST_CASE("Prune tails of a distribution with epsilon", "[random_variable]")
+{
+    pruning_guard guard;
+    dice::pruning::epsilon = 1e-6;
+
+    dice::random_variable<int, double> num_dice{ dice::constant_tag{}, 10 };
+    dice::random_variable<int, double> num_sides{ dice::constant_tag{}, 6 };
+
+    auto dist = roll(num_dice, num_sides);
+    REQUIRE(dist.min_value() > 10);
+    REQUIRE(dist.max_value() < 60);
+    REQUIRE(dist.max_value() - 35 == 35 - dist.min_value());
+    REQUIRE(dist.discarded_probability() > 0);
+    REQUIRE(dist.discarded_probability() <= 1e-6);
+
+    double sum = 0;
+    for (auto&& pair : dist)
+    {
+        sum += pair.second;
+    }
+    REQUIRE(sum + dist.discarded_probability() == Approx(1));
+
+    // discarded probability is propagated to results of operations
+    auto shifted = dist + num_dice;
+    REQUIRE(shifted.discarded_probability() == 
+        Approx(dist.discarded_probability()));
+    auto sum_dist = dist + dist;
+    REQUIRE(sum_dist.discarded_probability() >= 
+        2 * dist.discarded_probability());
+}
+
+TEST_CASE("Prune the least probable values with max size", "[random_variable]")
+{
+    pruning_guard guard;
+    dice::pruning::max_size = 3;
+
+    dice::random_variable<int, double> num_dice{ dice::constant_tag{}, 2 };
+    dice::random_variable<int, double> num_sides{ dice::constant_tag{}, 6 };
+
+    auto dist = roll(num_dice, num_sides);
+    REQUIRE(dist.size() == 3);
+    REQUIRE(dist.probability(6) == Approx(5 / 36.0));
+    REQUIRE(dist.probability(7) == Approx(6 / 36.0));
+    REQUIRE(dist.probability(8) == Approx(5 / 36.0));
+    REQUIRE(dist.discarded_probability() == Approx(20 / 36.0));
+}
+
+TEST_CASE("Prune a variable with the sparse storage", "[random_variable]")
+{
+    pruning_guard guard;
+    dice::pruning::epsilon = 0.05;
+
+    dice::random_variable<int, double> var{ freq_list{
+        std::make_pair(0, 1),
+        std::make_pair(1000, 10),
+        std::make_pair(2000, 10),
+        std::make_pair(5000, 1),
+    } };
+    REQUIRE(!var.is_dense());
+    REQUIRE(var.size() == 3);
+    REQUIRE(var.probability(0) == 0);
+    REQUIRE(var.probability(5000) == Approx(1 / 22.0));
+    REQUIRE(var.discarded_probability() == Approx(1 / 22.0));
+}
+
+TEST_CASE("Apply pruning to an existing variable", "[random_variable]")
+{
+    pruning_guard guard;
+
+    dice::random_variable<int, double> var{ freq_list{
+        std::make_pair(1, 1),
+        std::make_pair(2, 98),
+        std::make_pair(3, 1),
+    } };
+    REQUIRE(var.pruned() == var);
+
+    dice::pruning::max_size = 1;
+    auto pruned = var.pruned();
+    REQUIRE(pruned.size() == 1);
+    REQUIRE(pruned.probability(2) == Approx(0.98));
+    REQUIRE(pruned.discarded_probability() == Approx(0.02));
+}
+
+TEST_CASE("Compound assignment computes the same as the operators", "[random_variable]")
+{
+    using var_type = dice::random_variable<int, double>;
+    var_type two_dice = roll(
+        var_type{ dice::constant_tag{}, 2 }, 
+        var_type{ dice::constant_tag{}, 6 });
+    var_type sparse{ freq_list{
+        std::make_pair(-100, 1),
+        std::make_pair(100, 3),
+    } };
+    var_type three{ dice::constant_tag{}, 3 };
+    var_type one{ dice::constant_tag{}, 1 };
+
+    for (auto&& a : { two_dice, sparse, three })
+    {
+        for (auto&& b : { two_dice, sparse, three, one })
+        {
+            auto sum = a;
+            sum += b;
+            REQUIRE(sum == a + b);
+
+            auto difference = a;
+            difference -= b;
+            REQUIRE(difference == a - b);
+
+            auto product = a;
+            product *= b;
+            REQUIRE(product == a * b);
+        }
+    }
+
+    // a constant shift keeps the dense storage
+    auto shifted = two_dice;
+    shifted += three;
+    REQUIRE(shifted.is_dense());
+    REQUIRE(shifted.probability(5) == Approx(1 / 36.0));
+}
+
+TEST_CASE("Keep highest and lowest dice of a roll", "[random_variable]")
+{
+    using var_type = dice::random_variable<int, double>;
+    var_type count{ dice::constant_tag{}, 3 };
+    var_type faces{ dice::constant_tag{}, 4 };
+
+    // enumerate all outcomes of 3d4
+    std::map<int, double> highest;
+    std::map<int, double> lowest;
+    for (int a = 1; a <= 4; ++a)
+    {
+        for (int b = 1; b <= 4; ++b)
+        {
+            for (int c = 1; c <= 4; ++c)
+            {
+                std::vector<int> dice{ a, b, c };
+                std::sort(dice.begin(), dice.end());
+                highest[dice[1] + dice[2]] += 1 / 64.0;
+                lowest[dice[0]] += 1 / 64.0;
+            }
+        }
+    }
+
+    auto keep_high = keep_highest(count, faces, 2);
+    REQUIRE(keep_high.size() == highest.size());
+    for (auto&& item : highest)
+    {
+        REQUIRE(keep_high.probability(item.first) == Approx(item.second));
+    }
+
+    auto keep_low = keep_lowest(count, faces, 1);
+    REQUIRE(keep_low.size() == lowest.size());
+    for (auto&& item : lowest)
+    {
+        REQUIRE(keep_low.probability(item.first) == Approx(item.second));
+    }
+
+    // 4d6 keep highest 3
+    auto stats = keep_highest(
+        var_type{ dice::constant_tag{}, 4 }, 
+        var_type{ dice::constant_tag{}, 6 }, 
+        3);
+    REQUIRE(stats.probability(3) == Approx(1 / 1296.0));
+    REQUIRE(stats.probability(18) == Approx(21 / 1296.0));
+
+    // all dice are kept
+    auto sum = roll(count, faces);
+    auto all_high = keep_highest(count, faces, 5);
+    auto all_low = keep_lowest(count, faces, 3);
+    REQUIRE(all_high.size() == sum.size());
+    REQUIRE(all_low.size() == sum.size());
+    for (auto&& item : sum)
+    {
+        REQUIRE(all_high.probability(item.first) == Approx(item.second));
+        REQUIRE(all_low.probability(item.first) == Approx(item.second));
+    }
+
+    // no dice are kept
+    auto none = keep_highest(count, faces, 0);
+    REQUIRE(none.size() == 1);
+    REQUIRE(none.probability(0) == Approx(1));
+
+    // variable number of dice
+    var_type one_or_two{ freq_list{
+        std::make_pair(1, 1),
+        std::make_pair(2, 1),
+    } };
+    auto mixed = keep_highest(one_or_two, faces, 1);
+    REQUIRE(mixed.probability(1) == Approx(0.5 / 4 + 0.5 / 16));
+    REQUIRE(mixed.probability(4) == Approx(0.5 / 4 + 0.5 * 7 / 16));
+
+    // binomial coefficients of a large pool don't overflow
+    var_type pool{ dice::constant_tag{}, 2000 };
+    var_type d6{ dice::constant_tag{}, 6 };
+    auto large = keep_highest(pool, d6, 3);
+    REQUIRE(large.expected_value() == Approx(18));
+    REQUIRE(large.probability(18) == Approx(1).epsilon(1e-6));
+    REQUIRE(keep_lowest(pool, d6, 2).expected_value() == Approx(2));
+
+    // tables of the algorithm are checked by the memory limit
+    dice::budget limits;
+    limits.max_bytes = 1000;
+    {
+        dice::budget::scope scope{ &limits };
+        REQUIRE_THROWS_AS(keep_highest(pool, d6, 3), dice::budget_error);
+    }
+
+    REQUIRE_THROWS_AS(keep_highest(count, faces, -1), std::invalid_argument);
+    REQUIRE_THROWS_AS(
+        keep_lowest(var_type{ dice::constant_tag{}, 0 }, faces, 1), 
+        std::invalid_argument);
+}
+
+TEST_CASE("Compute memory used by a random variable", "[random_variable]")
+{
+    using var_type = dice::random_variable<int, double>;
+    var_type constant{ dice::constant_tag{}, 1 };
+    var_type count{ dice::constant_tag{}, 1 };
+    var_type faces{ dice::constant_tag{}, 100 };
+    auto dense = roll(count, faces);
+    REQUIRE(dense.is_dense());
+    REQUIRE(dense.memory_usage() >= sizeof(var_type) + 100 * sizeof(double));
+    REQUIRE(dense.memory_usage() > constant.memory_usage());
+
+    var_type sparse{ var_type::frequency_list{
+        std::make_pair(1, 1),
+        std::make_pair(1000000, 1),
+    } };
+    REQUIRE(!sparse.is_dense());
+    REQUIRE(sparse.memory_usage() > sizeof(var_type));
+    REQUIRE(sparse.memory_usage() < dense.memory_usage());
+
+    // the distribution table is included
+    auto before = dense.memory_usage();
+    dense.quantile(0.5);
+    REQUIRE(dense.memory_usage() > before);
+
+    // storage over the memory limit is not allocated
+    dice::budget limits;
+    limits.max_bytes = 150 * sizeof(double);
+    {
+        dice::budget::scope scope{ &limits };
+        REQUIRE_THROWS_AS(dense + dense, dice::budget_error);
+        REQUIRE((dense + constant).size() == 100);
+    }
+    REQUIRE((dense + dense).size() == 199);
+}
+
+TEST_CASE("Compute distributions accurately with all probability types", "[random_variable]")
+{
+    check_accuracy<float>();
+    check_accuracy<double>();
+    check_accuracy<long double>();
+
+    // moments of float probabilities are computed in double
+    auto value = compute_sum_of_rolls<float>();
+    REQUIRE((std::is_same<decltype(value.expected_value()), double>::value));
+    REQUIRE((std::is_same<decltype(value.variance()), double>::value));
+}
@@ -0,0 +1,119 @@
+#include "catch.hpp"
+#include "roll_cache.hpp"
+
+#include <vector>
+
+using cache_type = dice::roll_cache<int, double>;
+using var_type = cache_type::var_type;
+using freq_list = var_type::frequency_list;
+
+TEST_CASE("Cache distribution of a constant roll", "[roll_cache]")
+{
+    cache_type cache;
+    var_type num_dice{ dice::constant_tag{}, 2 };
+    var_type num_faces{ dice::constant_tag{}, 6 };
+
+    auto first = cache.get(num_dice, num_faces);
+    REQUIRE(cache.hits() == 0);
+    REQUIRE(cache.misses() == 1);
+    REQUIRE(*first == roll(num_dice, num_faces));
+
+    auto second = cache.get(num_dice, num_faces);
+    REQUIRE(cache.hits() == 1);
+    REQUIRE(cache.misses() == 1);
+    REQUIRE(second == first);
+    REQUIRE(cache.size() == 1);
+    REQUIRE(cache.memory_size() > 0);
+
+    // a copy can be modified without changing the cached value
+    auto copy = *second;
+    copy = copy + num_dice;
+    REQUIRE(*cache.get(num_dice, num_faces) == roll(num_dice, num_faces));
+}
+
+TEST_CASE("Discarded probability of operands is not cached", "[roll_cache]")
+{
+    cache_type cache;
+    var_type num_dice{ dice::constant_tag{}, 1 };
+    var_type num_faces{ dice::constant_tag{}, 6 };
+
+    // constant 1 whose probability has been reduced by pruning
+    std::vector<double> probability{ 0.9 };
+    var_type pruned_dice{ 
+        dice::dense_tag{}, 
+        1, 
+        probability.begin(), 
+        probability.end(), 
+        0.1 
+    };
+    REQUIRE(pruned_dice.is_constant());
+
+    auto pruned = cache.get(pruned_dice, num_faces);
+    REQUIRE(pruned->discarded_probability() == Approx(0.1));
+    REQUIRE(pruned->probability(1) == Approx(1 / 6.0));
+
+    auto clean = cache.get(num_dice, num_faces);
+    REQUIRE(cache.hits() == 1);
+    REQUIRE(cache.misses() == 1);
+    REQUIRE(clean->discarded_probability() == 0);
+    REQUIRE(*clean == roll(num_dice, num_faces));
+
+    // in the reverse order
+    cache.clear();
+    cache.get(num_dice, num_faces);
+    pruned = cache.get(pruned_dice, num_faces);
+    REQUIRE(cache.hits() == 1);
+    REQUIRE(pruned->discarded_probability() == Approx(0.1));
+    REQUIRE(cache.get(num_dice, num_faces)->discarded_probability() == 0);
+}
+
+TEST_CASE("Don't cache rolls with variable operands", "[roll_cache]")
+{
+    cache_type cache;
+    var_type num_dice{ freq_list{
+        std::make_pair(1, 1),
+        std::make_pair(2, 1),
+    } };
+    var_type num_faces{ dice::constant_tag{}, 6 };
+
+    auto result = cache.get(num_dice, num_faces);
+    REQUIRE(*result == roll(num_dice, num_faces));
+    REQUIRE(cache.size() == 0);
+    REQUIRE(cache.hits() == 0);
+    REQUIRE(cache.misses() == 0);
+}
+
+TEST_CASE("Evict least recently used rolls", "[roll_cache]")
+{
+    cache_type cache;
+    var_type one{ dice::constant_tag{}, 1 };
+    var_type d6{ dice::constant_tag{}, 6 };
+    var_type d8{ dice::constant_tag{}, 8 };
+    var_type d10{ dice::constant_tag{}, 10 };
+
+    cache.get(one, d6);
+    auto size = cache.memory_size();
+    cache.get(one, d8);
+
+    // there is enough space for d8 and d6 but not for d10
+    cache.set_capacity(cache.memory_size() + size);
+    REQUIRE(cache.size() == 2);
+    cache.get(one, d6);
+    cache.get(one, d10);
+    REQUIRE(cache.size() == 2);
+    REQUIRE(cache.memory_size() <= cache.capacity());
+
+    cache.get(one, d6);
+    REQUIRE(cache.hits() == 2);
+    cache.get(one, d8);
+    REQUIRE(cache.hits() == 2);
+    REQUIRE(cache.misses() == 4);
+
+    cache.set_capacity(0);
+    REQUIRE(cache.size() == 0);
+    REQUIRE(cache.memory_size() == 0);
+
+    cache.clear();
+    REQUIRE(cache.hits() == 0);
+    REQUIRE(cache.misses() == 0);
+}
@@ -0,0 +1,154 @@
+#include "catch.hpp"
+#include "sampler.hpp"
+#include "calculator.hpp"
+
+#include <sstream>
+#include <string>
+
+namespace
+{
+    dice::storage::random_variable_type::var_type sample(
+        dice::calculator& calc,
+        const std::string& script)
+    {
+        auto values = calc.evaluate(script);
+        REQUIRE(values.back() != nullptr);
+        REQUIRE(values.back()->type() == dice::type_rand_var::id());
+        auto&& value = dynamic_cast<dice::type_rand_var&>(*values.back());
+        return value.data().to_random_variable();
+    }
+}
+
+TEST_CASE("Sample engine generates uniform numbers in given range", "[sampler]")
+{
+    dice::sample_engine engine{ 42 };
+    dice::sample_engine same{ 42 };
+    std::vector<std::size_t> counts(6, 0);
+    for (int i = 0; i < 60000; ++i)
+    {
+        auto value = engine.uniform(6);
+        REQUIRE(value < 6);
+        REQUIRE(value == same.uniform(6));
+        ++counts[value];
+    }
+
+    for (auto&& count : counts)
+    {
+        REQUIRE(count > 9500);
+        REQUIRE(count < 10500);
+    }
+}
+
+TEST_CASE("Confidence interval of an estimated probability", "[sampler]")
+{
+    auto interval = dice::estimate_interval(0.25, 10000);
+    REQUIRE(interval.lower < 0.25);
+    REQUIRE(interval.upper > 0.25);
+    REQUIRE(interval.lower == Approx(0.2416).epsilon(0.001));
+    REQUIRE(interval.upper == Approx(0.2586).epsilon(0.001));
+
+    // values which have not been sampled can still have some probability
+    auto zero = dice::estimate_interval(0, 100);
+    REQUIRE(zero.lower == 0);
+    REQUIRE(zero.upper > 0);
+    REQUIRE(zero.upper < 0.05);
+}
+
+TEST_CASE("Sample a dice roll", "[sampler]")
+{
+    dice::calculator calc{ 1 };
+    calc.samples = 60000;
+
+    auto var = sample(calc, "1d6 + 1");
+    REQUIRE(var.size() == 6);
+    for (int i = 2; i <= 7; ++i)
+    {
+        REQUIRE(var.probability(i) == Approx(1 / 6.0).margin(0.01));
+    }
+}
+
+TEST_CASE("Uses of a sampled variable share its value", "[sampler]")
+{
+    dice::calculator calc{ 1 };
+    calc.samples = 10000;
+
+    auto difference = sample(calc, "var X = 1d6; X - X");
+    REQUIRE(difference.size() == 1);
+    REQUIRE(difference.probability(0) == 1);
+
+    calc.enable_interactive_mode();
+    auto sum = sample(calc, "var X = 1d6; var Y = X + 1; Y - X");
+    REQUIRE(sum.size() == 1);
+    REQUIRE(sum.probability(1) == 1);
+}
+
+TEST_CASE("Sampled result only depends on the seed", "[sampler]")
+{
+    const std::string script =
+        "var X = 2d6; max(X, 1d12) + keep_highest(1d4, 6, 2) * X";
+    dice::calculator serial{ 1 };
+    serial.samples = 50000;
+    serial.seed = 7;
+    dice::calculator parallel{ 4 };
+    parallel.samples = 50000;
+    parallel.seed = 7;
+
+    auto expected = sample(serial, script);
+    auto actual = sample(parallel, script);
+    REQUIRE(actual.size() == expected.size());
+    for (auto&& pair : expected)
+    {
+        REQUIRE((actual.probability(pair.first) == pair.second));
+    }
+}
+
+TEST_CASE("Sampled keep highest matches the exact distribution", "[sampler]")
+{
+    dice::calculator calc{ 1 };
+    calc.samples = 100000;
+
+    auto var = sample(calc, "keep_highest(3 + 1d1, 6, 3)");
+    dice::calculator exact_calc{ 1 };
+    auto exact = sample(exact_calc, "keep_highest(4, 6, 3)");
+    for (auto&& pair : exact)
+    {
+        REQUIRE(var.probability(pair.first) ==
+            Approx(pair.second).margin(0.005));
+    }
+}
+
+TEST_CASE("Functions of distributions use the empirical distribution", "[sampler]")
+{
+    dice::calculator calc{ 1 };
+    calc.samples = 100000;
+
+    auto values = calc.evaluate("expectation(1d6 + 1d6)");
+    REQUIRE(values.size() == 1);
+    REQUIRE(values[0]->type() == dice::type_real::id());
+    auto&& value = dynamic_cast<dice::type_real&>(*values[0]);
+    REQUIRE(value.data() == Approx(7).margin(0.05));
+}
+
+TEST_CASE("Report errors of sampled expressions", "[sampler]")
+{
+    std::stringstream errors;
+    dice::calculator calc{ 1 };
+    calc.log = dice::logger{ &errors, true };
+    calc.samples = 1000;
+
+    auto values = calc.evaluate("20 / (1d6 - 1); 1d6 + expectation(1d6)");
+    REQUIRE(errors.str() == "Division by Zero\n"
+        "Only int values can be used in a sampled expression, got real\n");
+
+    REQUIRE(values.size() == 2);
+    for (auto&& value : values)
+    {
+        REQUIRE(value->type() == dice::type_int::id());
+        REQUIRE((dynamic_cast<dice::type_int&>(*value).data() == 0));
+    }
+
+    dice::sampler monte_carlo{ &calc.env, &calc.interpret, &calc.log };
+    REQUIRE_THROWS_AS(
+        monte_carlo.execute(calc.prepare("1d6"), 0, 0),
+        std::invalid_argument);
+}
@@ -0,0 +1,94 @@
+#include "catch.hpp"
+#include "simd.hpp"
+
+#include <vector>
+
+namespace
+{
+    // restore the instruction set at the end of a test
+    struct instruction_set_guard
+    {
+        dice::simd::instruction_set value = dice::simd::active();
+
+        ~instruction_set_guard()
+        {
+            dice::simd::select(value);
+        }
+    };
+
+    std::vector<double> make_data(std::size_t size)
+    {
+        std::vector<double> result(size);
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            result[i] = static_cast<double>((i * 7919) % 101) / 101.0;
+        }
+        return result;
+    }
+}
+
+TEST_CASE("Select scalar and the best instruction set", "[simd]")
+{
+    instruction_set_guard guard;
+
+    REQUIRE(dice::simd::select(dice::simd::instruction_set::scalar));
+    REQUIRE(dice::simd::active() == dice::simd::instruction_set::scalar);
+    REQUIRE(dice::simd::select(dice::simd::best()));
+    REQUIRE(dice::simd::active() == dice::simd::best());
+}
+
+TEST_CASE("Vectorized axpy is the same as the scalar version", "[simd]")
+{
+    instruction_set_guard guard;
+
+    // use a size which is not a multiple of the vector width
+    auto in = make_data(103);
+    auto expected = make_data(103);
+    auto actual = expected;
+
+    dice::simd::axpy<double>(expected.data(), in.data(), 0.3, in.size());
+
+    dice::simd::select(dice::simd::best());
+    dice::simd::axpy(actual.data(), in.data(), 0.3, in.size());
+    REQUIRE(actual == expected);
+}
+
+TEST_CASE("Vectorized window difference is the same as the scalar version", "[simd]")
+{
+    instruction_set_guard guard;
+    dice::simd::select(dice::simd::best());
+
+    for (std::size_t window : { 1, 2, 3, 6, 20 })
+    {
+        for (std::size_t first : { 1, 2, 5 })
+        {
+            auto expected = make_data(64);
+            expected[0] = 0;
+            auto actual = expected;
+
+            dice::simd::window_difference<double>(
+                expected.data(), first, 63, window, 0.5);
+            dice::simd::window_difference(
+                actual.data(), first, 63, window, 0.5);
+            REQUIRE(actual == expected);
+        }
+    }
+}
+
+TEST_CASE("Vectorized moments are within rounding error of the scalar version", "[simd]")
+{
+    instruction_set_guard guard;
+    dice::simd::select(dice::simd::best());
+
+    auto data = make_data(1001);
+    auto expected = dice::simd::moments<double>(data.data(), data.size());
+    auto actual = dice::simd::moments(data.data(), data.size());
+    REQUIRE(actual.sum == Approx(expected.sum));
+    REQUIRE(actual.first == Approx(expected.first));
+    REQUIRE(actual.second == Approx(expected.second));
+
+    auto empty = dice::simd::moments(data.data(), 0);
+    REQUIRE(empty.sum == 0);
+    REQUIRE(empty.first == 0);
+    REQUIRE(empty.second == 0);
+}
@@ -0,0 +1,188 @@
+#include "catch.hpp"
+#include "thread_pool.hpp"
+#include "decomposition.hpp"
+
+#include <atomic>
+#include <vector>
+#include <stdexcept>
+
+namespace
+{
+    // restore the parallel loop threshold at the end of a test
+    struct threshold_guard
+    {
+        std::size_t value = dice::thread_pool::min_parallel_size;
+
+        ~threshold_guard()
+        {
+            dice::thread_pool::min_parallel_size = value;
+        }
+    };
+}
+
+TEST_CASE("Parallel loop visits each index exactly once", "[thread_pool]")
+{
+    dice::thread_pool pool{ 4 };
+    REQUIRE(pool.size() == 4);
+
+    for (std::size_t count : { 1, 3, 100, 10007 })
+    {
+        std::vector<std::atomic<int>> visits(count);
+        for (auto&& value : visits)
+        {
+            value = 0;
+        }
+
+        pool.parallel_for(count, [&](std::size_t first, std::size_t last)
+        {
+            for (auto i = first; i < last; ++i)
+            {
+                ++visits[i];
+            }
+        });
+
+        for (auto&& value : visits)
+        {
+            REQUIRE(value == 1);
+        }
+    }
+}
+
+TEST_CASE("Exception in a parallel loop is rethrown", "[thread_pool]")
+{
+    dice::thread_pool pool{ 4 };
+    auto loop = [&]()
+    {
+        pool.parallel_for(1000, [](std::size_t first, std::size_t last)
+        {
+            if (first <= 500 && 500 < last)
+                throw std::runtime_error{ "error" };
+        });
+    };
+    REQUIRE_THROWS_AS(loop(), std::runtime_error);
+
+    // the pool can be used after an exception
+    std::atomic<std::size_t> sum{ 0 };
+    pool.parallel_for(1000, [&](std::size_t first, std::size_t last)
+    {
+        sum += last - first;
+    });
+    REQUIRE(sum == 1000);
+}
+
+TEST_CASE("Loops run serially without a current pool", "[thread_pool]")
+{
+    threshold_guard guard;
+    dice::thread_pool::min_parallel_size = 1;
+    REQUIRE(dice::thread_pool::current() == nullptr);
+
+    std::size_t calls = 0;
+    dice::thread_pool::for_each(100, [&](std::size_t first, std::size_t last)
+    {
+        ++calls;
+        REQUIRE(first == 0);
+        REQUIRE(last == 100);
+    });
+    REQUIRE(calls == 1);
+
+    dice::thread_pool pool{ 2 };
+    {
+        dice::thread_pool::scope scope{ &pool };
+        REQUIRE(dice::thread_pool::current() == &pool);
+
+        // nested loops run serially
+        std::atomic<std::size_t> sum{ 0 };
+        std::atomic<bool> is_serial{ true };
+        dice::thread_pool::for_each(8, [&](std::size_t first, std::size_t last)
+        {
+            for (auto i = first; i < last; ++i)
+            {
+                dice::thread_pool::for_each(10, [&](auto a, auto b)
+                {
+                    if (a != 0 || b != 10)
+                        is_serial = false;
+                    sum += b - a;
+                });
+            }
+        });
+        REQUIRE(sum == 80);
+        REQUIRE(is_serial);
+    }
+    REQUIRE(dice::thread_pool::current() == nullptr);
+}
+
+TEST_CASE("Parallel loop uses the budget of the calling thread", "[thread_pool]")
+{
+    threshold_guard guard;
+    dice::thread_pool::min_parallel_size = 1;
+
+    dice::budget limits;
+    limits.max_bytes = 100;
+    dice::budget::scope budget_scope{ &limits };
+
+    dice::thread_pool pool{ 4 };
+    dice::thread_pool::scope scope{ &pool };
+
+    std::atomic<bool> has_budget{ true };
+    dice::thread_pool::for_each(1000, [&](std::size_t, std::size_t)
+    {
+        if (dice::budget::current() != &limits)
+            has_budget = false;
+    });
+    REQUIRE(has_budget);
+
+    REQUIRE_THROWS_AS(dice::thread_pool::for_each(1000, 
+        [&](std::size_t, std::size_t)
+        {
+            dice::budget::check_allocation_current(1000);
+        }), dice::budget_error);
+}
+
+TEST_CASE("Parallel combination of leafs is the same as serial", "[thread_pool]")
+{
+    using var_type = dice::random_variable<int, double>;
+    using decomposition_type = dice::decomposition<int, double>;
+    threshold_guard guard;
+    dice::thread_pool::min_parallel_size = 16;
+
+    var_type var_a{ var_type::frequency_list{
+        std::make_pair(1, 1),
+        std::make_pair(2, 2),
+        std::make_pair(3, 3),
+        std::make_pair(4, 4),
+        std::make_pair(5, 5),
+        std::make_pair(6, 6),
+    } };
+    var_type d6{ dice::constant_tag{}, 6 };
+
+    auto compute = [&]()
+    {
+        decomposition_type a{ var_a };
+        decomposition_type b{ var_a };
+        decomposition_type c{ var_a };
+        a = a.compute_decomposition();
+        b = b.compute_decomposition();
+        c = c.compute_decomposition();
+        auto sum = (a + b) * c - a + roll(b, decomposition_type{ d6 });
+        return std::make_pair(
+            sum.to_random_variable(), 
+            sum.less_than(a + c));
+    };
+
+    auto expected = compute();
+
+    dice::thread_pool pool{ 4 };
+    dice::thread_pool::scope scope{ &pool };
+    auto actual = compute();
+
+    REQUIRE(actual.first.size() == expected.first.size());
+    for (auto&& pair : expected.first)
+    {
+        REQUIRE(actual.first.probability(pair.first) == Approx(pair.second));
+    }
+
+    auto&& indicator = actual.second.to_random_variable();
+    auto&& expected_indicator = expected.second.to_random_variable();
+    REQUIRE(indicator.probability(1) ==
+        Approx(expected_indicator.probability(1)));
+}
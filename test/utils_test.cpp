@@ -42,4 +42,28 @@ TEST_CASE("Clamp floating point nubmer to the [0, 1] range", "[utils]")
     REQUIRE(dice::clamp(1.0, 0.0, 1.0) == 1.0);
     REQUIRE(dice::clamp(1.1, 0.0, 1.0) == 1.0);
     REQUIRE(dice::clamp(1e20, 0.0, 1.0) == 1.0);
-}
\ No newline at end of file
+}
+TEST_CASE("Compensated sum does not lose small values", "[utils]")
+{
+    dice::compensated_sum<float> sum{ 1 };
+    float naive = 1;
+    for (int i = 0; i < 1000; ++i)
+    {
+        sum += 1e-8f;
+        naive += 1e-8f;
+    }
+    REQUIRE(naive == 1);
+    REQUIRE(sum.value() == Approx(1.00001f));
+
+    dice::compensated_sum<double> alternating;
+    alternating += 1e100;
+    alternating += 1;
+    alternating += -1e100;
+    REQUIRE(alternating.value() == 1);
+
+    REQUIRE((std::is_same<dice::accumulator_t<float>, double>::value));
+    REQUIRE((std::is_same<dice::accumulator_t<double>, double>::value));
+    REQUIRE((std::is_same<
+        dice::accumulator_t<long double>, 
+        long double>::value));
+}
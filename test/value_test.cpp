@@ -1,6 +1,8 @@
 #include <catch.hpp>
 #include "value.hpp"
 
+#include <thread>
+
 TEST_CASE("Compare 2 different values of the same type", "[value]")
 {
     dice::type_int value_a{ 4 };
@@ -72,4 +74,71 @@ TEST_CASE("Convert type_id to string", "[type]")
     REQUIRE(dice::to_string(dice::type_id::integer) == "int");
     REQUIRE(dice::to_string(dice::type_id::real) == "real");
     REQUIRE(dice::to_string(dice::type_id::random_variable) == "random_variable");
-}
\ No newline at end of file
+}
+TEST_CASE("Memory of released int values is reused", "[value]")
+{
+    using pool = dice::block_pool<sizeof(dice::type_int)>;
+
+    auto value = dice::make<dice::type_int>(1);
+    auto address = value.get();
+    value = nullptr;
+    REQUIRE(pool::free_size() > 0);
+
+    auto free_size = pool::free_size();
+    std::unique_ptr<dice::base_value> other = dice::make<dice::type_int>(2);
+    REQUIRE(other.get() == address);
+    REQUIRE(pool::free_size() == free_size - 1);
+
+    // release through a pointer to the base class
+    other = nullptr;
+    REQUIRE(pool::free_size() == free_size);
+
+    // a thread which only releases values frees its list when it exits
+    auto released = dice::make<dice::type_int>(3);
+    std::size_t thread_free_size = 0;
+    std::thread{ [&]() 
+    {
+        released = nullptr;
+        thread_free_size = pool::free_size();
+    } }.join();
+    REQUIRE(thread_free_size == 1);
+}
+
+TEST_CASE("Random variable values are not pooled", "[value]")
+{
+    using var_pool = dice::block_pool<sizeof(dice::type_rand_var)>;
+    REQUIRE(dice::type_int::is_pooled);
+    REQUIRE(dice::type_real::is_pooled);
+    REQUIRE(!dice::type_rand_var::is_pooled);
+
+    auto free_size = var_pool::free_size();
+    auto value = dice::make<dice::type_rand_var>(
+        dice::storage::random_variable_type{ dice::constant_tag{}, 1 });
+    value = nullptr;
+    REQUIRE(var_pool::free_size() == free_size);
+}
+
+TEST_CASE("Copies of a random variable share data until modified", "[value]")
+{
+    using var_type = dice::storage::random_variable_type;
+    using freq_list = var_type::frequency_list;
+    dice::type_rand_var value{ var_type{ freq_list{
+        std::make_pair(1, 1),
+        std::make_pair(2, 1)
+    } } };
+    const dice::type_rand_var& original = value;
+
+    auto copy = value.clone();
+    auto&& copy_value = dynamic_cast<dice::type_rand_var&>(*copy);
+    const dice::type_rand_var& shared = copy_value;
+    REQUIRE(&shared.data() == &original.data());
+    REQUIRE(copy_value == value);
+
+    // modification copies the data
+    copy_value.data() = -copy_value.data();
+    REQUIRE(&shared.data() != &original.data());
+    REQUIRE(original.data().to_random_variable().probability(1) == 
+        Approx(0.5));
+    REQUIRE(shared.data().to_random_variable().probability(-1) == 
+        Approx(0.5));
+}